@@ -42,8 +42,30 @@ SOURCES += main.cpp\
     logconfigdialog.cpp \
     logroutinginfotablemodel.cpp \
     restorebackup.cpp \
-    dbfileentrytreeitem.cpp \
-    dbfileentriestreemodel.cpp
+    dbfileentriestreemodel.cpp \
+    hashcache.cpp \
+    contentindex.cpp \
+    snapshotretention.cpp \
+    matchplan.cpp \
+    directoryscanner.cpp \
+    backupprogress.cpp \
+    perftrace.cpp \
+    catalogparser.cpp \
+    catalogwriter.cpp \
+    backupjournal.cpp \
+    linkbase.cpp \
+    snapshotscrub.cpp \
+    restoreengine.cpp \
+    catalogsearchindex.cpp \
+    snapshotdiff.cpp \
+    changejournal.cpp \
+    changewatcher.cpp \
+    directorycatalog.cpp \
+    directorymaterializer.cpp \
+    blockdelta.cpp \
+    filehash.cpp \
+    chunkstore.cpp \
+    restorethread.cpp
 
 HEADERS  += linkbackupadp.h \
     backupsetdialog.h \
@@ -72,8 +94,30 @@ HEADERS  += linkbackupadp.h \
     logconfigdialog.h \
     logroutinginfotablemodel.h \
     restorebackup.h \
-    dbfileentrytreeitem.h \
-    dbfileentriestreemodel.h
+    dbfileentriestreemodel.h \
+    hashcache.h \
+    contentindex.h \
+    snapshotretention.h \
+    matchplan.h \
+    directoryscanner.h \
+    backupprogress.h \
+    perftrace.h \
+    catalogparser.h \
+    catalogwriter.h \
+    backupjournal.h \
+    linkbase.h \
+    snapshotscrub.h \
+    restoreengine.h \
+    catalogsearchindex.h \
+    snapshotdiff.h \
+    changejournal.h \
+    changewatcher.h \
+    directorycatalog.h \
+    directorymaterializer.h \
+    blockdelta.h \
+    filehash.h \
+    chunkstore.h \
+    restorethread.h
 
 FORMS    += linkbackupadp.ui \
     backupsetdialog.ui \
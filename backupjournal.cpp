@@ -0,0 +1,136 @@
+#include "backupjournal.h"
+#include "linkbackupglobals.h"
+
+#include <QFileInfo>
+
+#include <unistd.h>
+
+static const char* s_journalName = ".linkbackup-journal";
+static const char* s_header = "LinkBackupJournal=1";
+
+BackupJournal::BackupJournal()
+{
+}
+
+BackupJournal::~BackupJournal()
+{
+  close();
+}
+
+QString BackupJournal::journalPath(const QString& snapshotPath)
+{
+  return snapshotPath + "/" + s_journalName;
+}
+
+bool BackupJournal::exists(const QString& snapshotPath)
+{
+  return QFileInfo::exists(journalPath(snapshotPath));
+}
+
+bool BackupJournal::create(const QString& snapshotPath, const QString& catalogName, const QString& fromPath)
+{
+  close();
+  m_catalogName = catalogName;
+  m_fromPath = fromPath;
+  m_completed.clear();
+  m_file.setFileName(journalPath(snapshotPath));
+  if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+  {
+    ERROR_MSG(QString(QObject::tr("Failed to create the backup journal %1")).arg(m_file.fileName()), 1);
+    return false;
+  }
+  QByteArray text(s_header);
+  text.append('\n');
+  text.append("Catalog=").append(catalogName.toUtf8()).append('\n');
+  text.append("From=").append(fromPath.toUtf8()).append('\n');
+  if (m_file.write(text) != text.size() || !m_file.flush() || ::fdatasync(m_file.handle()) != 0)
+  {
+    ERROR_MSG(QString(QObject::tr("Failed to write the backup journal %1")).arg(m_file.fileName()), 1);
+    m_file.close();
+    return false;
+  }
+  return true;
+}
+
+bool BackupJournal::read(const QString& snapshotPath)
+{
+  close();
+  m_catalogName.clear();
+  m_fromPath.clear();
+  m_completed.clear();
+  QFile file(journalPath(snapshotPath));
+  if (!file.open(QIODevice::ReadOnly))
+  {
+    return false;
+  }
+  bool validHeader = false;
+  while (!file.atEnd())
+  {
+    // A line without a new line was being written when the backup stopped.
+    QByteArray line = file.readLine();
+    if (!line.endsWith('\n'))
+    {
+      break;
+    }
+    line.chop(1);
+    if (!validHeader)
+    {
+      validHeader = (line == s_header);
+      if (!validHeader)
+      {
+        WARN_MSG(QString(QObject::tr("Unknown backup journal format in %1")).arg(file.fileName()), 1);
+        return false;
+      }
+    }
+    else if (line.startsWith("Catalog="))
+    {
+      m_catalogName = QString::fromUtf8(line.mid(8));
+    }
+    else if (line.startsWith("From="))
+    {
+      m_fromPath = QString::fromUtf8(line.mid(5));
+    }
+    else if (line.startsWith("Done="))
+    {
+      m_completed.insert(QString::fromUtf8(line.mid(5)));
+    }
+  }
+  return validHeader;
+}
+
+bool BackupJournal::writeCompleted(const QStringList& dirs)
+{
+  if (!m_file.isOpen())
+  {
+    return false;
+  }
+  QByteArray text;
+  for (const QString& dir : dirs)
+  {
+    text.append("Done=").append(dir.toUtf8()).append('\n');
+  }
+  return m_file.write(text) == text.size() && m_file.flush() && ::fdatasync(m_file.handle()) == 0;
+}
+
+void BackupJournal::close()
+{
+  if (m_file.isOpen())
+  {
+    m_file.close();
+  }
+}
+
+bool BackupJournal::remove()
+{
+  close();
+  if (m_file.fileName().isEmpty() || !m_file.exists())
+  {
+    return true;
+  }
+  if (!m_file.remove())
+  {
+    ERROR_MSG(QString(QObject::tr("Failed to remove the backup journal %1")).arg(m_file.fileName()), 1);
+    return false;
+  }
+  return true;
+}
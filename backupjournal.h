@@ -0,0 +1,117 @@
+#ifndef BACKUPJOURNAL_H
+#define BACKUPJOURNAL_H
+
+#include <QFile>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+
+//**************************************************************************
+/*! \class BackupJournal
+ *  \brief Journal kept in a snapshot while it is being written, so an interrupted backup can be resumed.
+ *
+ * The journal is the file ".linkbackup-journal" in the snapshot directory. Its existence marks
+ * the snapshot as incomplete; it is removed only after the catalog has been renamed to its final
+ * name. The file holds one "key=value" per line:
+ * \code
+ * LinkBackupJournal=1
+ * Catalog=sha1
+ * From=/home/andy/Documents
+ * Done=Documents/letters
+ * \endcode
+ *
+ * A "Done" line names a directory, relative to the snapshot, whose files and sub-directories are
+ * all backed up. The lines are written by the CatalogWriter after the catalog entries for the
+ * directory are synced, so every entry in a completed directory is in the partial catalog.
+ *
+ * \author Andrew Pitonyak
+ * \copyright Andrew Pitonyak, but you may use without restriction.
+ * \date 2026
+ **************************************************************************/
+class BackupJournal
+{
+public:
+  /*! \brief Constructor, the journal is not open. */
+  BackupJournal();
+
+  /*! \brief Destructor, closes the journal but leaves the file in place. */
+  ~BackupJournal();
+
+  //**************************************************************************
+  /*! \brief Create an empty journal, replacing any journal in the snapshot.
+   *
+   *  \param [in] snapshotPath Full path to the snapshot directory.
+   *  \param [in] catalogName Catalog name for the backup set, such as "sha1".
+   *  \param [in] fromPath Directory being backed up.
+   *  \return True if the journal was written and synced.
+   ***************************************************************************/
+  bool create(const QString& snapshotPath, const QString& catalogName, const QString& fromPath);
+
+  //**************************************************************************
+  /*! \brief Read the journal left in a snapshot by an interrupted backup; the journal is not opened for writing.
+   *
+   *  \param [in] snapshotPath Full path to the snapshot directory.
+   *  \return True if the journal exists and has a valid header.
+   ***************************************************************************/
+  bool read(const QString& snapshotPath);
+
+  //**************************************************************************
+  /*! \brief Append completed directories and sync the journal.
+   *
+   *  \param [in] dirs Directories, relative to the snapshot, that are complete.
+   *  \return True if the lines were written and synced.
+   ***************************************************************************/
+  bool writeCompleted(const QStringList& dirs);
+
+  /*! \brief Close and delete the journal, which marks the snapshot as complete. */
+  bool remove();
+
+  /*! \brief Close the journal, leaving the file in place. */
+  void close();
+
+  /*! \brief True if the journal is open for writing. */
+  bool isOpen() const;
+
+  /*! \brief Catalog name from the journal. */
+  const QString& getCatalogName() const;
+
+  /*! \brief Directory being backed up from the journal. */
+  const QString& getFromPath() const;
+
+  /*! \brief Completed directories read from the journal, relative to the snapshot. */
+  const QSet<QString>& getCompleted() const;
+
+  /*! \brief Full path to the journal in a snapshot. */
+  static QString journalPath(const QString& snapshotPath);
+
+  /*! \brief True if the snapshot has a journal, so the backup that wrote it did not finish. */
+  static bool exists(const QString& snapshotPath);
+
+private:
+  QFile m_file;
+  QString m_catalogName;
+  QString m_fromPath;
+  QSet<QString> m_completed;
+};
+
+inline bool BackupJournal::isOpen() const
+{
+  return m_file.isOpen();
+}
+
+inline const QString& BackupJournal::getCatalogName() const
+{
+  return m_catalogName;
+}
+
+inline const QString& BackupJournal::getFromPath() const
+{
+  return m_fromPath;
+}
+
+inline const QSet<QString>& BackupJournal::getCompleted() const
+{
+  return m_completed;
+}
+
+#endif // BACKUPJOURNAL_H
@@ -0,0 +1,123 @@
+#include "backupprogress.h"
+#include "copylinkutil.h"
+
+#include <QStringList>
+
+#include <chrono>
+
+//**************************************************************************
+/*! \brief Monotonic clock in milliseconds; safe to read from any thread. */
+//**************************************************************************
+static qint64 monotonicMillis()
+{
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+BackupProgress::BackupProgress() : m_expectedFiles(0), m_expectedBytes(0), m_startMillis(0), m_finishedMillis(0), m_running(false)
+{
+  for (int i=0; i<NumCounters; ++i)
+  {
+    m_counters[i] = 0;
+  }
+}
+
+void BackupProgress::start(const qint64 expectedFiles, const qint64 expectedBytes)
+{
+  for (int i=0; i<NumCounters; ++i)
+  {
+    m_counters[i] = 0;
+  }
+  setExpected(expectedFiles, expectedBytes);
+  m_finishedMillis = 0;
+  m_startMillis = monotonicMillis();
+  m_running = true;
+}
+
+void BackupProgress::setExpected(const qint64 expectedFiles, const qint64 expectedBytes)
+{
+  m_expectedFiles = expectedFiles;
+  m_expectedBytes = expectedBytes;
+}
+
+void BackupProgress::finish()
+{
+  m_finishedMillis = monotonicMillis() - m_startMillis;
+  m_running = false;
+}
+
+BackupProgress::Sample BackupProgress::sample() const
+{
+  Sample sample;
+  for (int i=0; i<NumCounters; ++i)
+  {
+    sample.values[i] = m_counters[i].load(std::memory_order_relaxed);
+  }
+  sample.expectedFiles = m_expectedFiles;
+  sample.expectedBytes = m_expectedBytes;
+  sample.running = m_running;
+  sample.elapsedMillis = sample.running ? monotonicMillis() - m_startMillis : m_finishedMillis.load();
+  return sample;
+}
+
+double BackupProgress::Sample::percent() const
+{
+  if (!running && elapsedMillis > 0)
+  {
+    return 100.0;
+  }
+  // Bytes measure the work best because a copy dominates; files are used for a backup of empty files.
+  double fraction = -1.0;
+  if (expectedBytes > 0)
+  {
+    fraction = static_cast<double>(values[BytesLinked] + values[BytesCopied]) / expectedBytes;
+  }
+  else if (expectedFiles > 0)
+  {
+    fraction = static_cast<double>(values[FilesLinked] + values[FilesCopied]) / expectedFiles;
+  }
+  if (fraction < 0.0)
+  {
+    return -1.0;
+  }
+  // The source may have grown since the previous backup, so never claim to be done early.
+  return qMin(fraction, 0.999) * 100.0;
+}
+
+qint64 BackupProgress::Sample::etaMillis() const
+{
+  const double p = percent();
+  if (p <= 0.0 || !running)
+  {
+    return -1;
+  }
+  return static_cast<qint64>(elapsedMillis * (100.0 - p) / p);
+}
+
+QString BackupProgress::Sample::toString() const
+{
+  QStringList parts;
+  const double p = percent();
+  if (p >= 0.0)
+  {
+    parts << QString("%1%").arg(p, 0, 'f', 1);
+  }
+  parts << QString("%1 files scanned").arg(values[FilesScanned]);
+  parts << QString("%1 linked (%2)").arg(values[FilesLinked]).arg(CopyLinkUtil::getBPS(values[BytesLinked], 0));
+  parts << QString("%1 copied (%2)").arg(values[FilesCopied]).arg(CopyLinkUtil::getBPS(values[BytesCopied], 0));
+  parts << QString("%1 hashed").arg(CopyLinkUtil::getBPS(values[BytesHashed], 0));
+  if (values[FilesSkipped] > 0)
+  {
+    parts << QString("%1 skipped").arg(values[FilesSkipped]);
+  }
+  if (values[Errors] > 0)
+  {
+    parts << QString("%1 errors").arg(values[Errors]);
+  }
+  const qint64 eta = etaMillis();
+  if (eta >= 0)
+  {
+    const qint64 seconds = eta / 1000;
+    parts << QString("ETA %1:%2:%3").arg(seconds / 3600).arg((seconds / 60) % 60, 2, 10, QChar('0')).arg(seconds % 60, 2, 10, QChar('0'));
+  }
+  return parts.join(", ");
+}
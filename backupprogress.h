@@ -0,0 +1,95 @@
+#ifndef BACKUPPROGRESS_H
+#define BACKUPPROGRESS_H
+
+#include <QString>
+
+#include <atomic>
+
+//**************************************************************************
+/*! \class BackupProgress
+ *  \brief Counters published by the backup as it runs and sampled by the user interface at a fixed rate.
+ *
+ * Workers only add to relaxed atomic counters, so publishing progress costs nothing more than
+ * an atomic add; there are no signals and no per-file strings. The GUI (or a command line driver)
+ * calls sample() on a timer and displays the result.
+ *
+ * The totals from the previous backup's catalog are the expected work, so a percentage
+ * and an estimated time remaining are available when a previous backup exists.
+ *
+ * \author Andrew Pitonyak
+ * \copyright Andrew Pitonyak, but you may use without restriction.
+ * \date 2026
+ **************************************************************************/
+class BackupProgress
+{
+public:
+  /*! \brief Counters. Bytes are counted as the data moves, so a large copy advances the progress. */
+  enum Counter {FilesScanned=0, BytesScanned, FilesSkipped, FilesLinked, BytesLinked, FilesCopied, BytesCopied, BytesHashed, Errors, NumCounters};
+
+  /*! \brief Consistent enough copy of the counters taken at one time. */
+  struct Sample
+  {
+    qint64 values[NumCounters];
+    qint64 expectedFiles;
+    qint64 expectedBytes;
+    qint64 elapsedMillis;
+    bool running;
+
+    /*! \brief Percent complete from zero to 100, or a negative number if the expected work is not known. */
+    double percent() const;
+
+    /*! \brief Estimated milliseconds remaining, or a negative number if it is not known. */
+    qint64 etaMillis() const;
+
+    /*! \brief Single line suitable for a status bar. */
+    QString toString() const;
+  };
+
+  /*! \brief Constructor, all counters are zero and nothing is running. */
+  BackupProgress();
+
+  //**************************************************************************
+  /*! \brief Clear the counters and start the clock for a new backup.
+   *
+   *  \param [in] expectedFiles Number of files in the previous backup, zero if not known.
+   *  \param [in] expectedBytes Number of bytes in the previous backup, zero if not known.
+   ***************************************************************************/
+  void start(const qint64 expectedFiles, const qint64 expectedBytes);
+
+  /*! \brief Set the expected work after the backup started, such as when the previous catalog was read. */
+  void setExpected(const qint64 expectedFiles, const qint64 expectedBytes);
+
+  /*! \brief Mark the backup as finished; the clock stops. */
+  void finish();
+
+  /*! \brief Add to a counter; safe to call from any thread. */
+  void add(const Counter counter, const qint64 amount = 1);
+
+  /*! \brief Get the current value of one counter. */
+  qint64 value(const Counter counter) const;
+
+  /*! \brief Take a copy of every counter. */
+  Sample sample() const;
+
+private:
+  std::atomic<qint64> m_counters[NumCounters];
+  std::atomic<qint64> m_expectedFiles;
+  std::atomic<qint64> m_expectedBytes;
+  /*! \brief Monotonic clock in milliseconds when the backup started. */
+  std::atomic<qint64> m_startMillis;
+  /*! \brief Elapsed milliseconds when the backup finished. */
+  std::atomic<qint64> m_finishedMillis;
+  std::atomic<bool> m_running;
+};
+
+inline void BackupProgress::add(const Counter counter, const qint64 amount)
+{
+  m_counters[counter].fetch_add(amount, std::memory_order_relaxed);
+}
+
+inline qint64 BackupProgress::value(const Counter counter) const
+{
+  return m_counters[counter].load(std::memory_order_relaxed);
+}
+
+#endif // BACKUPPROGRESS_H
@@ -1,15 +1,17 @@
 #include "backupset.h"
 #include "linkbackupglobals.h"
+#include "directoryscanner.h"
+#include <QCryptographicHash>
 #include <QFile>
 #include <QFileInfo>
 #include <QMetaObject>
 #include <QMetaEnum>
 
-BackupSet::BackupSet()
+BackupSet::BackupSet() : m_hashChunkSize(0), m_hashCacheSize(0), m_useContentIndex(false), m_keepDaily(0), m_keepWeekly(0), m_keepMonthly(0), m_writePerfTrace(false), m_linkBaseDepth(0), m_strictScan(false), m_deltaThreshold(0), m_chunkThreshold(0)
 {
 }
 
-BackupSet::BackupSet(const BackupSet& backupSet)
+BackupSet::BackupSet(const BackupSet& backupSet) : m_hashChunkSize(0), m_hashCacheSize(0), m_useContentIndex(false), m_keepDaily(0), m_keepWeekly(0), m_keepMonthly(0), m_writePerfTrace(false), m_linkBaseDepth(0), m_strictScan(false), m_deltaThreshold(0), m_chunkThreshold(0)
 {
   operator=(backupSet);
 }
@@ -21,6 +23,17 @@ BackupSet& BackupSet::operator=(const BackupSet& backupSet)
     setFromPath(backupSet.getFromPath());
     setToPath(backupSet.getToPath());
     setHashMethod(backupSet.getHashMethod());
+    setHashChunkSize(backupSet.getHashChunkSize());
+    setHashCacheSize(backupSet.getHashCacheSize());
+    setUseContentIndex(backupSet.isUseContentIndex());
+    setKeepDaily(backupSet.getKeepDaily());
+    setKeepWeekly(backupSet.getKeepWeekly());
+    setKeepMonthly(backupSet.getKeepMonthly());
+    setWritePerfTrace(backupSet.isWritePerfTrace());
+    setLinkBaseDepth(backupSet.getLinkBaseDepth());
+    setStrictScan(backupSet.isStrictScan());
+    setDeltaThreshold(backupSet.getDeltaThreshold());
+    setChunkThreshold(backupSet.getChunkThreshold());
     setPriority(backupSet.getPriority());
     setFilters(backupSet.getFilters());
     setCriteria(backupSet.getCriteria());
@@ -28,6 +41,17 @@ BackupSet& BackupSet::operator=(const BackupSet& backupSet)
   return *this;
 }
 
+QString BackupSet::getFiltersFingerprint() const
+{
+  QByteArray xml;
+  QXmlStreamWriter writer(&xml);
+  for (const LinkBackFilter& filter : m_filters)
+  {
+    writer << filter;
+  }
+  return QString::fromLatin1(QCryptographicHash::hash(xml, QCryptographicHash::Sha1).toHex());
+}
+
 const QList<LinkBackFilter>& BackupSet::getFilters() const
 {
   return m_filters;
@@ -59,9 +83,30 @@ void BackupSet::clear()
 {
   m_fromPath.clear();
   m_toPath.clear();
+  m_hashChunkSize = 0;
+  m_hashCacheSize = 0;
+  m_useContentIndex = false;
+  m_keepDaily = 0;
+  m_keepWeekly = 0;
+  m_keepMonthly = 0;
+  m_writePerfTrace = false;
+  m_linkBaseDepth = 0;
+  m_strictScan = false;
+  m_deltaThreshold = 0;
+  m_chunkThreshold = 0;
   m_filters.clear();
 }
 
+QString BackupSet::getHashCatalogName() const
+{
+  return CopyLinkUtil::hashModeName(getHashMethod(), getHashChunkSize());
+}
+
+QString BackupSet::getHashCachePath() const
+{
+  return getToPath() + "/HashCache-" + getHashCatalogName() + ".dat";
+}
+
 bool BackupSet::readFile(const QString& fullPath)
 {
   QFile file(fullPath);
@@ -95,6 +140,50 @@ QXmlStreamWriter& BackupSet::operator<<(QXmlStreamWriter& writer) const
   writer.writeTextElement("From", getFromPath());
   writer.writeTextElement("To", getToPath());
   writer.writeTextElement("Hash", getHashMethod());
+  if (getHashChunkSize() > 0)
+  {
+    writer.writeTextElement("HashChunkSize", QString::number(getHashChunkSize()));
+  }
+  if (getHashCacheSize() > 0)
+  {
+    writer.writeTextElement("HashCacheSize", QString::number(getHashCacheSize()));
+  }
+  if (isUseContentIndex())
+  {
+    writer.writeTextElement("ContentIndex", "True");
+  }
+  if (getKeepDaily() > 0)
+  {
+    writer.writeTextElement("KeepDaily", QString::number(getKeepDaily()));
+  }
+  if (getKeepWeekly() > 0)
+  {
+    writer.writeTextElement("KeepWeekly", QString::number(getKeepWeekly()));
+  }
+  if (getKeepMonthly() > 0)
+  {
+    writer.writeTextElement("KeepMonthly", QString::number(getKeepMonthly()));
+  }
+  if (isWritePerfTrace())
+  {
+    writer.writeTextElement("PerfTrace", "True");
+  }
+  if (getLinkBaseDepth() > 0)
+  {
+    writer.writeTextElement("LinkBaseDepth", QString::number(getLinkBaseDepth()));
+  }
+  if (isStrictScan())
+  {
+    writer.writeTextElement("StrictScan", "True");
+  }
+  if (getDeltaThreshold() > 0)
+  {
+    writer.writeTextElement("DeltaThreshold", QString::number(getDeltaThreshold()));
+  }
+  if (getChunkThreshold() > 0)
+  {
+    writer.writeTextElement("ChunkThreshold", QString::number(getChunkThreshold()));
+  }
   writer.writeTextElement("Priority", getPriority());
 
   writer.writeStartElement("Filters");
@@ -159,6 +248,28 @@ void BackupSet::readInternals(QXmlStreamReader& reader)
         //name = "To";
       } else if (QString::compare(name, "Hash", Qt::CaseInsensitive) == 0) {
         //name = "Hash";
+      } else if (QString::compare(name, "HashChunkSize", Qt::CaseInsensitive) == 0) {
+        //name = "HashChunkSize";
+      } else if (QString::compare(name, "HashCacheSize", Qt::CaseInsensitive) == 0) {
+        //name = "HashCacheSize";
+      } else if (QString::compare(name, "ContentIndex", Qt::CaseInsensitive) == 0) {
+        //name = "ContentIndex";
+      } else if (QString::compare(name, "KeepDaily", Qt::CaseInsensitive) == 0) {
+        //name = "KeepDaily";
+      } else if (QString::compare(name, "KeepWeekly", Qt::CaseInsensitive) == 0) {
+        //name = "KeepWeekly";
+      } else if (QString::compare(name, "KeepMonthly", Qt::CaseInsensitive) == 0) {
+        //name = "KeepMonthly";
+      } else if (QString::compare(name, "PerfTrace", Qt::CaseInsensitive) == 0) {
+        //name = "PerfTrace";
+      } else if (QString::compare(name, "LinkBaseDepth", Qt::CaseInsensitive) == 0) {
+        //name = "LinkBaseDepth";
+      } else if (QString::compare(name, "StrictScan", Qt::CaseInsensitive) == 0) {
+        //name = "StrictScan";
+      } else if (QString::compare(name, "DeltaThreshold", Qt::CaseInsensitive) == 0) {
+        //name = "DeltaThreshold";
+      } else if (QString::compare(name, "ChunkThreshold", Qt::CaseInsensitive) == 0) {
+        //name = "ChunkThreshold";
       } else if (QString::compare(name, "Priority", Qt::CaseInsensitive) == 0) {
         //name = "Priority";
       } else if (QString::compare(name, "Filters", Qt::CaseInsensitive) == 0) {
@@ -178,6 +289,28 @@ void BackupSet::readInternals(QXmlStreamReader& reader)
         setToPath(reader.text().toString());
       } else if (QString::compare(name, "Hash", Qt::CaseInsensitive) == 0) {
         setHashMethod(reader.text().toString());
+      } else if (QString::compare(name, "HashChunkSize", Qt::CaseInsensitive) == 0) {
+        setHashChunkSize(reader.text().toString().toLongLong());
+      } else if (QString::compare(name, "HashCacheSize", Qt::CaseInsensitive) == 0) {
+        setHashCacheSize(reader.text().toString().toUInt());
+      } else if (QString::compare(name, "ContentIndex", Qt::CaseInsensitive) == 0) {
+        setUseContentIndex(QString::compare(reader.text().toString(), "True", Qt::CaseInsensitive) == 0);
+      } else if (QString::compare(name, "KeepDaily", Qt::CaseInsensitive) == 0) {
+        setKeepDaily(reader.text().toString().toInt());
+      } else if (QString::compare(name, "KeepWeekly", Qt::CaseInsensitive) == 0) {
+        setKeepWeekly(reader.text().toString().toInt());
+      } else if (QString::compare(name, "KeepMonthly", Qt::CaseInsensitive) == 0) {
+        setKeepMonthly(reader.text().toString().toInt());
+      } else if (QString::compare(name, "PerfTrace", Qt::CaseInsensitive) == 0) {
+        setWritePerfTrace(QString::compare(reader.text().toString(), "True", Qt::CaseInsensitive) == 0);
+      } else if (QString::compare(name, "LinkBaseDepth", Qt::CaseInsensitive) == 0) {
+        setLinkBaseDepth(reader.text().toString().toInt());
+      } else if (QString::compare(name, "StrictScan", Qt::CaseInsensitive) == 0) {
+        setStrictScan(QString::compare(reader.text().toString(), "True", Qt::CaseInsensitive) == 0);
+      } else if (QString::compare(name, "DeltaThreshold", Qt::CaseInsensitive) == 0) {
+        setDeltaThreshold(reader.text().toString().toLongLong());
+      } else if (QString::compare(name, "ChunkThreshold", Qt::CaseInsensitive) == 0) {
+        setChunkThreshold(reader.text().toString().toLongLong());
       } else if (QString::compare(name, "Priority", Qt::CaseInsensitive) == 0) {
         setPriority(reader.text().toString());
       }
@@ -244,18 +377,23 @@ void BackupSet::readCriteria(QXmlStreamReader& reader)
 
 
 bool BackupSet::passes(const QFileInfo& info) const
+{
+  return passes(ScannedEntry::fromFileInfo(info));
+}
+
+bool BackupSet::passes(const ScannedEntry& info) const
 {
   // I do it this way so that a new copy is not created every time.
   // I used to use a foreach loop.
   for (int i=0; i<m_filters.count(); ++i) {
     const LinkBackFilter& filter(m_filters[i]);
     if (filter.passes(info)) {
-      TRACE_MSG(QString("Path %1 passed with filter (%2)").arg(info.absoluteFilePath(), filter.getMainValueAsString()), 10);
+      TRACE_MSG(QString("Path %1 passed with filter (%2)").arg(info.path, filter.getMainValueAsString()), 10);
       return filter.isFilterMeansAccept();
     }
     else
     {
-      TRACE_MSG(QString("Path %1 did not pass with filter (%2)").arg(info.absoluteFilePath(), filter.getMainValueAsString()), 10);
+      TRACE_MSG(QString("Path %1 did not pass with filter (%2)").arg(info.path, filter.getMainValueAsString()), 10);
     }
   }
   return false;
@@ -85,6 +85,114 @@ public:
      */
     void setHashMethod(const QString& hashMethod);
 
+    /*! \brief Get the chunk size used to generate a chunked tree hash.
+     *
+     *  A value of zero means that each file is hashed sequentially as a single stream.
+     *  \return Chunk size in bytes used to generate a tree hash.
+     */
+    qint64 getHashChunkSize() const;
+
+    /*! \brief Set the chunk size used to generate a chunked tree hash.
+     *
+     *  Each file is split into chunks of this size, the chunks are hashed in parallel,
+     *  and the chunk digests are combined. A tree hash is not comparable to a sequential hash,
+     *  so changing this value means that the previous backup is not used for matching by hash.
+     *  \param [in] hashChunkSize Chunk size in bytes, or zero to hash sequentially.
+     */
+    void setHashChunkSize(const qint64 hashChunkSize);
+
+    /*! \brief Get the name used for the file entries (catalog) written with each backup.
+     *
+     *  This is the hash method, decorated with the tree hash chunk size when a tree hash is used.
+     *  Digests are only compared between catalogs with the same name.
+     *  \return Name of the file entries file without the ".txt" extension.
+     */
+    QString getHashCatalogName() const;
+
+    /*! \brief Get the maximum number of entries in the persistent hash cache.
+     *
+     *  \return Maximum number of entries in the hash cache; zero means no hash cache is used.
+     */
+    quint32 getHashCacheSize() const;
+
+    /*! \brief Set the maximum number of entries in the persistent hash cache.
+     *
+     *  The cache is stored in the "to" path and maps file system identity to a hash value.
+     *  \param [in] hashCacheSize Maximum number of entries; zero means no hash cache is used.
+     */
+    void setHashCacheSize(const quint32 hashCacheSize);
+
+    /*! \brief Get the full path to the persistent hash cache file for this backup set. */
+    QString getHashCachePath() const;
+
+    /*! \brief Determine if the global content index is used to link against any earlier backup.
+     *
+     *  \return True if the content index in the "to" path is used.
+     */
+    bool isUseContentIndex() const;
+
+    /*! \brief Set if the global content index is used to link against any earlier backup.
+     *
+     *  The content index maps a hash and size to a canonical file in any earlier backup
+     *  or backup set using the same "to" path, so it requires a match criteria that uses the hash.
+     *  \param [in] useContentIndex True to use the content index.
+     */
+    void setUseContentIndex(const bool useContentIndex);
+
+    /*! \brief Get the number of days for which the newest backup is kept when old backups are pruned; zero for no daily rule. */
+    int getKeepDaily() const;
+
+    /*! \brief Set the number of days for which the newest backup is kept when old backups are pruned; zero for no daily rule. */
+    void setKeepDaily(const int keepDaily);
+
+    /*! \brief Get the number of weeks for which the newest backup is kept when old backups are pruned; zero for no weekly rule. */
+    int getKeepWeekly() const;
+
+    /*! \brief Set the number of weeks for which the newest backup is kept when old backups are pruned; zero for no weekly rule. */
+    void setKeepWeekly(const int keepWeekly);
+
+    /*! \brief Get the number of months for which the newest backup is kept when old backups are pruned; zero for no monthly rule. */
+    int getKeepMonthly() const;
+
+    /*! \brief Set the number of months for which the newest backup is kept when old backups are pruned; zero for no monthly rule. */
+    void setKeepMonthly(const int keepMonthly);
+
+    /*! \brief Returns True if any retention rule is set, so old backups can be pruned. */
+    bool hasRetention() const;
+
+    /*! \brief Get the number of earlier backups searched for files to link against; zero uses the default. */
+    int getLinkBaseDepth() const;
+
+    /*! \brief Set the number of earlier backups searched for files to link against, newest first; zero uses the default. */
+    void setLinkBaseDepth(const int linkBaseDepth);
+
+    /*! \brief Returns True if a Chrome trace-event file is written with the backup. */
+    bool isWritePerfTrace() const;
+
+    /*! \brief Set if a Chrome trace-event file is written with the backup; every timed scope is saved in memory while the backup runs. */
+    void setWritePerfTrace(const bool writePerfTrace);
+
+    /*! \brief Returns True if every directory is read; otherwise a directory that did not change since the previous backup reuses its previous listing. */
+    bool isStrictScan() const;
+
+    /*! \brief Set if every directory is read, even when its time stamps and link count match the previous backup. */
+    void setStrictScan(const bool strictScan);
+
+    /*! \brief Get the size in bytes from which a changed file is copied as a block delta against the previous backup; zero if never. */
+    qint64 getDeltaThreshold() const;
+
+    /*! \brief Set the size in bytes from which a changed file is copied as a block delta against the previous backup; zero if never. */
+    void setDeltaThreshold(const qint64 deltaThreshold);
+
+    /*! \brief Get the size in bytes from which a new or changed file is stored as chunks in the chunk store of the To path; zero if never. */
+    qint64 getChunkThreshold() const;
+
+    /*! \brief Set the size in bytes from which a new or changed file is stored as chunks in the chunk store of the To path; zero if never. */
+    void setChunkThreshold(const qint64 chunkThreshold);
+
+    /*! \brief Get a hash of the filters, so a listing made with different filters is not reused. */
+    QString getFiltersFingerprint() const;
+
     /*! \brief Get the thread priority at which the backup runs.
      *
      *  \return Thread priority at which the backup runs.
@@ -167,6 +275,13 @@ public:
      */
     bool passes(const QFileInfo& info) const;
 
+    /*! \brief Determine if a scanned file or directory passes the filters.
+     *
+     *  \param [in] info Entry read by the DirectoryScanner.
+     *  \return True if the file or directory passes the filters, false otherwise.
+     */
+    bool passes(const ScannedEntry& info) const;
+
     /*! \brief Convert a QThread::Priority to a string for use in saving the priority to a configuration file or for pretty printing.
      *
      *  \param [in] priority Priority to convert to a string.
@@ -227,6 +342,33 @@ private:
     /*! \brief Hash method to use. */
     QString m_hashMethod;
 
+    /*! \brief Chunk size for a parallel tree hash; zero for a sequential hash. */
+    qint64 m_hashChunkSize;
+
+    /*! \brief Maximum number of entries in the persistent hash cache; zero for no cache. */
+    quint32 m_hashCacheSize;
+
+    /*! \brief If true, the global content index is used. */
+    bool m_useContentIndex;
+
+    /*! \brief Retention rules used to prune old backups; zero means the rule is not used. */
+    int m_keepDaily;
+    int m_keepWeekly;
+    int m_keepMonthly;
+
+    /*! \brief If true, a Chrome trace-event file is written with the backup. */
+    bool m_writePerfTrace;
+
+    /*! \brief Number of earlier backups searched for files to link against; zero uses the default. */
+    int m_linkBaseDepth;
+
+    /*! \brief If true, every directory is read rather than reusing the listing of an unchanged directory. */
+    bool m_strictScan;
+
+    /*! \brief Files at least this large are copied as a block delta; zero if never. */
+    qint64 m_deltaThreshold;
+    qint64 m_chunkThreshold;
+
     /*! \brief Priority at which the backup thread runs. */
     QString m_backupPriority;
 
@@ -278,6 +420,121 @@ inline void BackupSet::setHashMethod(const QString& hashMethod)
     m_hashMethod = hashMethod;
 }
 
+inline qint64 BackupSet::getHashChunkSize() const
+{
+    return m_hashChunkSize;
+}
+
+inline void BackupSet::setHashChunkSize(const qint64 hashChunkSize)
+{
+    m_hashChunkSize = hashChunkSize;
+}
+
+inline quint32 BackupSet::getHashCacheSize() const
+{
+    return m_hashCacheSize;
+}
+
+inline void BackupSet::setHashCacheSize(const quint32 hashCacheSize)
+{
+    m_hashCacheSize = hashCacheSize;
+}
+
+inline bool BackupSet::isUseContentIndex() const
+{
+    return m_useContentIndex;
+}
+
+inline void BackupSet::setUseContentIndex(const bool useContentIndex)
+{
+    m_useContentIndex = useContentIndex;
+}
+
+inline int BackupSet::getKeepDaily() const
+{
+    return m_keepDaily;
+}
+
+inline void BackupSet::setKeepDaily(const int keepDaily)
+{
+    m_keepDaily = keepDaily;
+}
+
+inline int BackupSet::getKeepWeekly() const
+{
+    return m_keepWeekly;
+}
+
+inline void BackupSet::setKeepWeekly(const int keepWeekly)
+{
+    m_keepWeekly = keepWeekly;
+}
+
+inline int BackupSet::getKeepMonthly() const
+{
+    return m_keepMonthly;
+}
+
+inline void BackupSet::setKeepMonthly(const int keepMonthly)
+{
+    m_keepMonthly = keepMonthly;
+}
+
+inline bool BackupSet::hasRetention() const
+{
+    return m_keepDaily > 0 || m_keepWeekly > 0 || m_keepMonthly > 0;
+}
+
+inline int BackupSet::getLinkBaseDepth() const
+{
+    return m_linkBaseDepth;
+}
+
+inline void BackupSet::setLinkBaseDepth(const int linkBaseDepth)
+{
+    m_linkBaseDepth = linkBaseDepth;
+}
+
+inline bool BackupSet::isStrictScan() const
+{
+    return m_strictScan;
+}
+
+inline void BackupSet::setStrictScan(const bool strictScan)
+{
+    m_strictScan = strictScan;
+}
+
+inline qint64 BackupSet::getDeltaThreshold() const
+{
+    return m_deltaThreshold;
+}
+
+inline void BackupSet::setDeltaThreshold(const qint64 deltaThreshold)
+{
+    m_deltaThreshold = (deltaThreshold > 0) ? deltaThreshold : 0;
+}
+
+inline qint64 BackupSet::getChunkThreshold() const
+{
+    return m_chunkThreshold;
+}
+
+inline void BackupSet::setChunkThreshold(const qint64 chunkThreshold)
+{
+    m_chunkThreshold = (chunkThreshold > 0) ? chunkThreshold : 0;
+}
+
+inline bool BackupSet::isWritePerfTrace() const
+{
+    return m_writePerfTrace;
+}
+
+inline void BackupSet::setWritePerfTrace(const bool writePerfTrace)
+{
+    m_writePerfTrace = writePerfTrace;
+}
+
 inline const QString& BackupSet::getPriority() const
 {
     return m_backupPriority;
@@ -33,7 +33,8 @@ void BackupSetDialog::setConfigFilePath(const QString &path)
 
 BackupSet BackupSetDialog::getBackupSet() const
 {
-  BackupSet backupSet;
+  // Start from the last set so that values not shown in the dialog are not lost.
+  BackupSet backupSet(m_backupSet);
   backupSet.setCriteria(m_criteriaForFileMatchTableModel.getCriteria());
   backupSet.setFilters(m_filterTableModel.getFilters());
   backupSet.setToPath(ui->toRootLineEdit->text());
@@ -45,6 +46,7 @@ BackupSet BackupSetDialog::getBackupSet() const
 
 void BackupSetDialog::setBackupSet(const BackupSet& backupSet)
 {
+  m_backupSet = backupSet;
   TRACE_MSG("Setting filters", 10);
   m_filterTableModel.setFilters(backupSet.getFilters());
   TRACE_MSG("Setting Criteria", 10);
@@ -151,6 +151,9 @@ private:
     /*! \brief Criteria for how two decide if a file should be copied or linked. */
     CriteriaForFileMatchTableModel m_criteriaForFileMatchTableModel;
 
+    /*! \brief Backup set last placed in the dialog; holds settings that the dialog does not display. */
+    BackupSet m_backupSet;
+
 };
 
 #endif // BACKUPSETDIALOG_H
@@ -0,0 +1,93 @@
+#-------------------------------------------------
+#
+# Benchmarks for LinkBackADP.
+#
+# qmake && make && ./linkbackupbench
+# Results are written as JSON to $BENCH_OUTPUT or ./linkbackup-bench.json.
+#
+#-------------------------------------------------
+
+QT       += xml testlib
+QT       += core gui
+
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+
+TARGET = linkbackupbench
+TEMPLATE = app
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+# The benchmarks use the application sources directly; main.cpp is replaced by benchglobals.cpp.
+INCLUDEPATH += ..
+DEFINES += BENCH_SOURCE_DIR=\\\"$$PWD/..\\\"
+
+SOURCES += linkbackupbenchmark.cpp \
+    benchglobals.cpp \
+    benchresults.cpp \
+    treegenerator.cpp \
+    ../linkbackfilter.cpp \
+    ../stringhelper.cpp \
+    ../backupset.cpp \
+    ../criteriaforfilematch.cpp \
+    ../dbfileentry.cpp \
+    ../dbfileentries.cpp \
+    ../linkbackupthread.cpp \
+    ../copylinkutil.cpp \
+    ../simpleloggeradp.cpp \
+    ../simpleloggerroutinginfo.cpp \
+    ../xmlutility.cpp \
+    ../enhancedqcryptographichash.cpp \
+    ../logmessagecontainer.cpp \
+    ../logmessagequeue.cpp \
+    ../qtenummapper.cpp \
+    ../hashcache.cpp \
+    ../contentindex.cpp \
+    ../matchplan.cpp \
+    ../directoryscanner.cpp \
+    ../backupprogress.cpp \
+    ../perftrace.cpp \
+    ../catalogparser.cpp \
+    ../catalogwriter.cpp \
+    ../backupjournal.cpp \
+    ../linkbase.cpp \
+    ../changejournal.cpp \
+    ../directorycatalog.cpp \
+    ../directorymaterializer.cpp \
+    ../blockdelta.cpp \
+    ../filehash.cpp \
+    ../chunkstore.cpp
+
+HEADERS  += benchresults.h \
+    treegenerator.h \
+    ../linkbackfilter.h \
+    ../stringhelper.h \
+    ../backupset.h \
+    ../criteriaforfilematch.h \
+    ../dbfileentry.h \
+    ../dbfileentries.h \
+    ../linkbackupthread.h \
+    ../copylinkutil.h \
+    ../linkbackupglobals.h \
+    ../simpleloggeradp.h \
+    ../simpleloggerroutinginfo.h \
+    ../xmlutility.h \
+    ../enhancedqcryptographichash.h \
+    ../logmessagecontainer.h \
+    ../logmessagequeue.h \
+    ../qtenummapper.h \
+    ../hashcache.h \
+    ../contentindex.h \
+    ../matchplan.h \
+    ../directoryscanner.h \
+    ../backupprogress.h \
+    ../perftrace.h \
+    ../catalogparser.h \
+    ../catalogwriter.h \
+    ../backupjournal.h \
+    ../linkbase.h \
+    ../changejournal.h \
+    ../directorycatalog.h \
+    ../directorymaterializer.h \
+    ../blockdelta.h \
+    ../filehash.h \
+    ../chunkstore.h
@@ -0,0 +1,61 @@
+//**************************************************************************
+// Globals normally defined in main.cpp, which is not linked into the benchmarks.
+//**************************************************************************
+#include "linkbackupglobals.h"
+
+static CopyLinkUtil globalCopyLinkUtil;
+static PerfTrace globalPerfTrace;
+
+// No routing is added, so messages are counted but not written.
+SimpleLoggerADP logger;
+QtEnumMapper enumMapper;
+
+CopyLinkUtil& getCopyLinkUtil()
+{
+  return globalCopyLinkUtil;
+}
+
+QtEnumMapper& getEnumMapper()
+{
+  return enumMapper;
+}
+
+PerfTrace& getPerfTrace()
+{
+  return globalPerfTrace;
+}
+
+SimpleLoggerADP& getLogger()
+{
+  return logger;
+}
+
+void errorMessage(const QString& message, const QString& location, const QDateTime& dateTime, int level)
+{
+  logger.receiveMessage(message, location, dateTime, SimpleLoggerRoutingInfo::ErrorMessage, level);
+}
+
+void warnMessage(const QString& message, const QString& location, const QDateTime& dateTime, int level)
+{
+  logger.receiveMessage(message, location, dateTime, SimpleLoggerRoutingInfo::WarningMessage, level);
+}
+
+void infoMessage(const QString& message, const QString& location, const QDateTime& dateTime, int level)
+{
+  logger.receiveMessage(message, location, dateTime, SimpleLoggerRoutingInfo::InformationMessage, level);
+}
+
+void traceMessage(const QString& message, const QString& location, const QDateTime& dateTime, int level)
+{
+  logger.receiveMessage(message, location, dateTime, SimpleLoggerRoutingInfo::TraceMessage, level);
+}
+
+void debugMessage(const QString& message, const QString& location, const QDateTime& dateTime, int level)
+{
+  logger.receiveMessage(message, location, dateTime, SimpleLoggerRoutingInfo::DebugMessage, level);
+}
+
+void userMessage(const QString& message, const QString& location, const QDateTime& dateTime, int level)
+{
+  logger.receiveMessage(message, location, dateTime, SimpleLoggerRoutingInfo::UserMessage, level);
+}
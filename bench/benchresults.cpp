@@ -0,0 +1,107 @@
+#include "benchresults.h"
+
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonDocument>
+#include <QSysInfo>
+#include <QThread>
+#include <QVector>
+
+#include <algorithm>
+
+BenchResults::BenchResults()
+{
+  m_environment["date"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+  m_environment["commit"] = qEnvironmentVariable("BENCH_COMMIT");
+  m_environment["qtVersion"] = QString(qVersion());
+  m_environment["kernel"] = QSysInfo::kernelVersion();
+  m_environment["cpu"] = QSysInfo::currentCpuArchitecture();
+  m_environment["idealThreadCount"] = QThread::idealThreadCount();
+}
+
+void BenchResults::setParameter(const QString& name, const QJsonValue& value)
+{
+  m_parameters[name] = value;
+}
+
+bool BenchResults::measure(const QString& name, const int repetitions, const qint64 items, const qint64 bytes,
+                           const std::function<void()>& setup, const std::function<bool()>& body)
+{
+  QVector<double> millis;
+  QElapsedTimer timer;
+  for (int i=0; i<repetitions; ++i)
+  {
+    if (setup)
+    {
+      setup();
+    }
+    timer.start();
+    if (!body())
+    {
+      return false;
+    }
+    millis.append(timer.nsecsElapsed() / 1000000.0);
+  }
+  std::sort(millis.begin(), millis.end());
+
+  QJsonObject result;
+  result["name"] = name;
+  result["repetitions"] = repetitions;
+  result["items"] = items;
+  result["bytes"] = bytes;
+  result["minMs"] = millis.first();
+  result["medianMs"] = millis.at(millis.size() / 2);
+  result["maxMs"] = millis.last();
+  // Throughput uses the median, which is less sensitive to a single slow run than the mean.
+  const double seconds = millis.at(millis.size() / 2) / 1000.0;
+  if (seconds > 0.0)
+  {
+    result["itemsPerSecond"] = items / seconds;
+    if (bytes > 0)
+    {
+      result["megabytesPerSecond"] = bytes / seconds / (1024.0 * 1024.0);
+    }
+  }
+  m_results.append(result);
+  qInfo("%s: median %.3f ms, min %.3f ms", qPrintable(name), millis.at(millis.size() / 2), millis.first());
+  return true;
+}
+
+void BenchResults::record(const QString& name, const double millis, const qint64 items, const qint64 bytes)
+{
+  QJsonObject result;
+  result["name"] = name;
+  result["repetitions"] = 1;
+  result["items"] = items;
+  result["bytes"] = bytes;
+  result["minMs"] = millis;
+  result["medianMs"] = millis;
+  result["maxMs"] = millis;
+  if (millis > 0.0)
+  {
+    result["itemsPerSecond"] = items / (millis / 1000.0);
+    if (bytes > 0)
+    {
+      result["megabytesPerSecond"] = bytes / (millis / 1000.0) / (1024.0 * 1024.0);
+    }
+  }
+  m_results.append(result);
+  qInfo("%s: %.3f ms", qPrintable(name), millis);
+}
+
+bool BenchResults::write(const QString& path) const
+{
+  QJsonObject root;
+  root["environment"] = m_environment;
+  root["parameters"] = m_parameters;
+  root["results"] = m_results;
+  QFile file(path);
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+  {
+    return false;
+  }
+  file.write(QJsonDocument(root).toJson(QJsonDocument::Indented));
+  file.close();
+  return file.error() == QFile::NoError;
+}
@@ -0,0 +1,69 @@
+#ifndef BENCHRESULTS_H
+#define BENCHRESULTS_H
+
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QString>
+
+#include <functional>
+
+//**************************************************************************
+/*! \class BenchResults
+ *  \brief Time benchmarks and write the results as JSON so that two commits can be compared.
+ *
+ * Each benchmark is run a fixed number of times and the minimum and median wall clock
+ * times are recorded with the amount of work, so throughput can be compared even if the
+ * size of the generated tree changes.
+ *
+ * \author Andrew Pitonyak
+ * \copyright Andrew Pitonyak, but you may use without restriction.
+ * \date 2026
+ **************************************************************************/
+class BenchResults
+{
+public:
+  /*! \brief Constructor, records the time, Qt version, and the commit from BENCH_COMMIT if set. */
+  BenchResults();
+
+  /*! \brief Record a description of the input, such as the tree generator options. */
+  void setParameter(const QString& name, const QJsonValue& value);
+
+  //**************************************************************************
+  /*! \brief Run a benchmark and record the result.
+   *
+   *  \param [in] name Unique name of the benchmark.
+   *  \param [in] repetitions Number of times the body is run.
+   *  \param [in] items Items processed by one run, such as files or lookups.
+   *  \param [in] bytes Bytes processed by one run, zero if bytes are not meaningful.
+   *  \param [in] setup Called before each run and not timed; may be empty.
+   *  \param [in] body Work that is timed; returns False on failure.
+   *  \return True if every run succeeded.
+   ***************************************************************************/
+  bool measure(const QString& name, const int repetitions, const qint64 items, const qint64 bytes,
+               const std::function<void()>& setup, const std::function<bool()>& body);
+
+  //**************************************************************************
+  /*! \brief Record a result timed by the caller.
+   *
+   *  \param [in] name Unique name of the benchmark.
+   *  \param [in] millis Elapsed time in milliseconds for one run.
+   *  \param [in] items Items processed.
+   *  \param [in] bytes Bytes processed, zero if bytes are not meaningful.
+   ***************************************************************************/
+  void record(const QString& name, const double millis, const qint64 items, const qint64 bytes);
+
+  //**************************************************************************
+  /*! \brief Write every result.
+   *
+   *  \param [in] path Full path to the JSON file, which is replaced.
+   *  \return True if the file was written.
+   ***************************************************************************/
+  bool write(const QString& path) const;
+
+private:
+  QJsonObject m_parameters;
+  QJsonArray m_results;
+  QJsonObject m_environment;
+};
+
+#endif // BENCHRESULTS_H
@@ -0,0 +1,465 @@
+#include "benchresults.h"
+#include "treegenerator.h"
+
+#include "backupset.h"
+#include "copylinkutil.h"
+#include "dbfileentries.h"
+#include "directoryscanner.h"
+#include "linkbackupglobals.h"
+#include "linkbackupthread.h"
+#include "matchplan.h"
+#include "simpleloggeradp.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QThread>
+#include <QtTest>
+
+//**************************************************************************
+/*! \class LinkBackupBenchmark
+ *  \brief Benchmarks for a full and an incremental backup and for the hot spots inside a backup.
+ *
+ * Run the bench target from any directory; the results are written to the file named by
+ * BENCH_OUTPUT, or linkbackup-bench.json in the current directory. The tree generator reads
+ * its options from the environment, see TreeGenerator::Options::readEnvironment(). BENCH_REPETITIONS
+ * sets how often each microbenchmark runs, BENCH_CATALOG_ENTRIES the size of the synthetic catalog,
+ * and BENCH_COPY_BYTES the size of the file copied and hashed. BENCH_TREE_HASH_BYTES is the size of
+ * the file hashed as a tree with each thread count from one to QThread::idealThreadCount(), and
+ * BENCH_TREE_CHUNK_BYTES its chunk size.
+ *
+ * \author Andrew Pitonyak
+ * \copyright Andrew Pitonyak, but you may use without restriction.
+ * \date 2026
+ **************************************************************************/
+class LinkBackupBenchmark : public QObject
+{
+  Q_OBJECT
+
+public:
+  LinkBackupBenchmark();
+
+private slots:
+  void initTestCase();
+  void fullBackup();
+  void unchangedBackup();
+  void incrementalBackup();
+  void catalogWrite();
+  void catalogRead();
+  void catalogReadTextStream();
+  void catalogReadMatchesTextStream();
+  void catalogFindEntry();
+  void backupSetPasses();
+  void copyFile();
+  void hashFile();
+  void copyFileGenerateHash();
+  void hashFileTreeThreads();
+  void loggerThroughput();
+  void cleanupTestCase();
+
+private:
+  /*! \brief Run one backup of the generated tree with LinkBackupThread and record the time. */
+  void runBackup(const QString& name, const qint64 bytes);
+
+  /*! \brief Wait until the clock reaches a new second; backup directories are named to the second. */
+  static void waitForNextSecond();
+
+  /*! \brief Build a catalog with the requested number of entries. */
+  DBFileEntries* buildCatalog(const int numEntries, const MatchPlan::Indexes indexes) const;
+
+  /*! \brief Read a catalog with DBFileEntries::read() and with the QTextStream reader and compare every field of every entry. */
+  void compareCatalogReaders(const QString& path, const int numEntries);
+
+  QTemporaryDir m_tempDir;
+  QString m_sourceRoot;
+  QString m_backupRoot;
+  BackupSet m_backupSet;
+  TreeGenerator::Options m_options;
+  TreeGenerator* m_generator;
+  BenchResults m_results;
+  int m_repetitions;
+  int m_catalogEntries;
+  qint64 m_copyBytes;
+  qint64 m_treeHashBytes;
+  qint64 m_treeChunkBytes;
+};
+
+LinkBackupBenchmark::LinkBackupBenchmark() : m_generator(nullptr), m_repetitions(5), m_catalogEntries(200000), m_copyBytes(0), m_treeHashBytes(0), m_treeChunkBytes(0)
+{
+}
+
+void LinkBackupBenchmark::initTestCase()
+{
+  QVERIFY(m_tempDir.isValid());
+  m_options.readEnvironment();
+  bool ok;
+  m_repetitions = qEnvironmentVariableIntValue("BENCH_REPETITIONS", &ok);
+  m_repetitions = ok && m_repetitions > 0 ? m_repetitions : 5;
+  m_catalogEntries = qEnvironmentVariableIntValue("BENCH_CATALOG_ENTRIES", &ok);
+  m_catalogEntries = ok && m_catalogEntries > 0 ? m_catalogEntries : 200000;
+  m_copyBytes = qEnvironmentVariable("BENCH_COPY_BYTES").toLongLong(&ok);
+  m_copyBytes = ok && m_copyBytes > 0 ? m_copyBytes : 64L * 1024L * 1024L;
+  m_treeHashBytes = qEnvironmentVariable("BENCH_TREE_HASH_BYTES").toLongLong(&ok);
+  m_treeHashBytes = ok && m_treeHashBytes > 0 ? m_treeHashBytes : 512L * 1024L * 1024L;
+  m_treeChunkBytes = qEnvironmentVariable("BENCH_TREE_CHUNK_BYTES").toLongLong(&ok);
+  m_treeChunkBytes = ok && m_treeChunkBytes > 0 ? m_treeChunkBytes : 4L * 1024L * 1024L;
+
+  m_results.setParameter("tree", m_options.toJson());
+  m_results.setParameter("repetitions", m_repetitions);
+  m_results.setParameter("catalogEntries", m_catalogEntries);
+  m_results.setParameter("copyBytes", m_copyBytes);
+  m_results.setParameter("treeHashBytes", m_treeHashBytes);
+  m_results.setParameter("treeChunkBytes", m_treeChunkBytes);
+
+  getCopyLinkUtil().setBufferSize(1024 * 1024 * 24);
+
+  // The sample backup set supplies realistic filters and match criteria.
+  QVERIFY(m_backupSet.readFile(QString(BENCH_SOURCE_DIR) + "/test1.xml"));
+  m_sourceRoot = m_tempDir.path() + "/source";
+  m_backupRoot = m_tempDir.path() + "/backups";
+  QVERIFY(QDir().mkpath(m_sourceRoot));
+  QVERIFY(QDir().mkpath(m_backupRoot));
+  m_backupSet.setFromPath(m_sourceRoot);
+  m_backupSet.setToPath(m_backupRoot);
+  m_results.setParameter("hash", m_backupSet.getHashCatalogName());
+
+  m_generator = new TreeGenerator(m_options);
+  QElapsedTimer timer;
+  timer.start();
+  QVERIFY(m_generator->generate(m_sourceRoot));
+  m_results.record("generateTree", timer.nsecsElapsed() / 1000000.0, m_generator->numFiles(), m_generator->bytesWritten());
+}
+
+void LinkBackupBenchmark::waitForNextSecond()
+{
+  const QString now = QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss");
+  while (QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss") == now)
+  {
+    QThread::msleep(20);
+  }
+}
+
+void LinkBackupBenchmark::runBackup(const QString& name, const qint64 bytes)
+{
+  waitForNextSecond();
+  getLogger().clearErrorCount();
+  LinkBackupThread thread(m_backupSet);
+  QElapsedTimer timer;
+  timer.start();
+  thread.start();
+  QVERIFY(thread.wait());
+  m_results.record(name, timer.nsecsElapsed() / 1000000.0, m_generator->numFiles(), bytes);
+  QCOMPARE(getLogger().errorCount(), 0L);
+}
+
+void LinkBackupBenchmark::fullBackup()
+{
+  // Every file is copied and hashed.
+  runBackup("fullBackup", m_generator->totalBytes());
+}
+
+void LinkBackupBenchmark::unchangedBackup()
+{
+  // Every file is linked to the previous backup.
+  runBackup("unchangedBackup", 0);
+}
+
+void LinkBackupBenchmark::incrementalBackup()
+{
+  QVERIFY(m_generator->applyChanges(m_sourceRoot));
+  runBackup("incrementalBackup", m_generator->bytesWritten());
+}
+
+DBFileEntries* LinkBackupBenchmark::buildCatalog(const int numEntries, const MatchPlan::Indexes indexes) const
+{
+  DBFileEntries* entries = new DBFileEntries();
+  entries->setIndexes(indexes);
+  const QDateTime baseTime = QDateTime::fromSecsSinceEpoch(1577836800);
+  for (int i=0; i<numEntries; ++i)
+  {
+    DBFileEntry* entry = new DBFileEntry();
+    entry->setPath(QString("source/dir%1/sub%2/file%3.dat").arg(i % 97).arg(i % 13).arg(i));
+    entry->setSize(static_cast<quint64>((static_cast<qint64>(i) * 7919) % 1000003));
+    entry->setTime(baseTime.addSecs(i));
+    entry->setHash(QString("%1").arg(static_cast<quint64>(i) * 2654435761ULL, 40, 16, QChar('0')));
+    entry->setLinkTypeCopy();
+    entries->addEntry(entry);
+  }
+  return entries;
+}
+
+void LinkBackupBenchmark::catalogWrite()
+{
+  DBFileEntries* entries = buildCatalog(m_catalogEntries, MatchPlan::PathIndex | MatchPlan::HashSizeIndex);
+  const QString path = m_tempDir.path() + "/catalog.txt";
+  QVERIFY(m_results.measure("catalogWrite", m_repetitions, m_catalogEntries, 0, nullptr, [&]() {
+    return entries->write(path);
+  }));
+  m_results.setParameter("catalogBytes", QFileInfo(path).size());
+  delete entries;
+}
+
+void LinkBackupBenchmark::catalogRead()
+{
+  const QString path = m_tempDir.path() + "/catalog.txt";
+  QVERIFY(QFile::exists(path));
+  QVERIFY(m_results.measure("catalogRead", m_repetitions, m_catalogEntries, QFileInfo(path).size(), nullptr, [&]() {
+    DBFileEntries* entries = DBFileEntries::read(path);
+    const bool ok = (entries != nullptr && entries->count() == m_catalogEntries);
+    delete entries;
+    return ok;
+  }));
+}
+
+void LinkBackupBenchmark::catalogReadTextStream()
+{
+  // The single threaded QTextStream reader that DBFileEntries::read() used before the CatalogParser.
+  const QString path = m_tempDir.path() + "/catalog.txt";
+  QVERIFY(QFile::exists(path));
+  QVERIFY(m_results.measure("catalogReadTextStream", m_repetitions, m_catalogEntries, QFileInfo(path).size(), nullptr, [&]() {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+      return false;
+    }
+    QTextStream reader(&file);
+    DBFileEntries* entries = DBFileEntries::read(reader);
+    const bool ok = (entries != nullptr && entries->count() == m_catalogEntries);
+    delete entries;
+    return ok;
+  }));
+}
+
+void LinkBackupBenchmark::compareCatalogReaders(const QString& path, const int numEntries)
+{
+  DBFileEntries* parsed = DBFileEntries::read(path);
+  QVERIFY(parsed != nullptr);
+  QFile file(path);
+  QVERIFY(file.open(QIODevice::ReadOnly | QIODevice::Text));
+  QTextStream reader(&file);
+  DBFileEntries* streamed = DBFileEntries::read(reader);
+  QVERIFY(streamed != nullptr);
+  QCOMPARE(parsed->count(), numEntries);
+  QCOMPARE(streamed->count(), numEntries);
+  for (int i=0; i<numEntries; ++i)
+  {
+    const DBFileEntry* expected = streamed->value(i);
+    const DBFileEntry* actual = parsed->value(i);
+    QCOMPARE(actual->getLinkType(), expected->getLinkType());
+    QCOMPARE(actual->getTime(), expected->getTime());
+    QCOMPARE(actual->getHash(), expected->getHash().toUpper());
+    QCOMPARE(actual->getSize(), expected->getSize());
+    QCOMPARE(actual->getPath(), expected->getPath());
+  }
+  delete parsed;
+  delete streamed;
+}
+
+void LinkBackupBenchmark::catalogReadMatchesTextStream()
+{
+  // The timed readers only count the entries, so check once that they read the same values.
+  compareCatalogReaders(m_tempDir.path() + "/catalog.txt", m_catalogEntries);
+
+  // Lines that are easy to get wrong: commas in the path, CRLF endings, UTF-8 paths, and a lower-case hash.
+  const QString path = m_tempDir.path() + "/catalog-edge.txt";
+  QFile file(path);
+  QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+  file.write("C,20200101T10:00:00.000,0123456789ABCDEF0123456789ABCDEF01234567,12,source/a,b,c.txt\n");
+  file.write("L,20200101T10:00:01.250,0123456789abcdef0123456789abcdef01234567,0,source/crlf.txt\r\n");
+  file.write(QString("C,20200102T23:59:59.999,FEDCBA9876543210FEDCBA9876543210FEDCBA98,4096,source/r\u00e9sum\u00e9/\u6587\u4ef6,1.txt\r\n").toUtf8());
+  file.write("K,20200103T00:00:00.000,AAAABBBBCCCCDDDDEEEEFFFF0000111122223333,53687091200,source/vm/disk.img\n");
+  file.write("C,20200104T12:30:00.001,,7,source/no hash.txt\n");
+  file.close();
+  compareCatalogReaders(path, 5);
+}
+
+void LinkBackupBenchmark::catalogFindEntry()
+{
+  MatchPlan plan(m_backupSet.getCriteria());
+  DBFileEntries* entries = buildCatalog(m_catalogEntries, plan.getIndexes());
+
+  // A third of the probes match by path, a third only by hash, and a third miss.
+  QList<DBFileEntry*> probes;
+  const int numProbes = qMin(m_catalogEntries, 100000);
+  for (int i=0; i<numProbes; ++i)
+  {
+    DBFileEntry* probe = new DBFileEntry(*entries->value((i * 7) % m_catalogEntries));
+    if (i % 3 == 1)
+    {
+      probe->setPath(probe->getPath() + ".moved");
+    }
+    else if (i % 3 == 2)
+    {
+      probe->setPath(probe->getPath() + ".new");
+      probe->setHash(QString(40, QChar('f')));
+    }
+    probes.append(probe);
+  }
+
+  QVERIFY(m_results.measure("catalogFindEntry", m_repetitions, numProbes, 0, nullptr, [&]() {
+    int found = 0;
+    for (DBFileEntry* probe : probes)
+    {
+      found += (entries->findEntry(plan, probe, "") != nullptr) ? 1 : 0;
+    }
+    return found > 0;
+  }));
+  qDeleteAll(probes);
+  delete entries;
+}
+
+void LinkBackupBenchmark::backupSetPasses()
+{
+  // Paths look like a developer's home directory so the regular expression filters do work.
+  QList<ScannedEntry> files;
+  for (const QString& path : m_generator->filePaths())
+  {
+    ScannedEntry entry;
+    entry.path = "/home/andy/Devsrc/" + path;
+    entry.name = entry.path.mid(entry.path.lastIndexOf('/') + 1);
+    entry.size = static_cast<quint64>(path.length()) * 4096;
+    entry.mtimeNs = 1577836800LL * 1000000000LL;
+    entry.inode = 0;
+    entry.device = 0;
+    entry.isDir = false;
+    entry.isFile = true;
+    files.append(entry);
+  }
+  QVERIFY(m_results.measure("backupSetPasses", m_repetitions, files.count(), 0, nullptr, [&]() {
+    int passed = 0;
+    for (const ScannedEntry& entry : files)
+    {
+      passed += m_backupSet.passes(entry) ? 1 : 0;
+    }
+    return passed >= 0;
+  }));
+}
+
+void LinkBackupBenchmark::copyFile()
+{
+  // One file of the requested size with the same deterministic content as the tree.
+  TreeGenerator::Options options;
+  options.numFiles = 1;
+  options.depth = 0;
+  options.minSize = m_copyBytes;
+  options.maxSize = m_copyBytes;
+  options.duplicateRatio = 0.0;
+  const QString dir = m_tempDir.path() + "/copy";
+  QVERIFY(QDir().mkpath(dir));
+  TreeGenerator generator(options);
+  QVERIFY(generator.generate(dir));
+  const QString fromPath = dir + "/" + generator.filePaths().first();
+  const QString toPath = dir + "/copied.dat";
+
+  CopyLinkUtil util(m_backupSet.getHashMethod(), 1024 * 1024 * 24);
+  QVERIFY(m_results.measure("copyFile", m_repetitions, 1, m_copyBytes, [&]() { QFile::remove(toPath); }, [&]() {
+    return util.copyFile(fromPath, toPath);
+  }));
+  m_results.setParameter("copySource", fromPath);
+}
+
+void LinkBackupBenchmark::hashFile()
+{
+  const QString dir = m_tempDir.path() + "/copy";
+  const QString fromPath = QDir(dir).entryInfoList(QStringList() << "file*", QDir::Files).first().filePath();
+  CopyLinkUtil util(m_backupSet.getHashMethod(), 1024 * 1024 * 24);
+  QVERIFY(m_results.measure("hashFile", m_repetitions, 1, m_copyBytes, nullptr, [&]() {
+    return util.generateHash(fromPath);
+  }));
+}
+
+void LinkBackupBenchmark::copyFileGenerateHash()
+{
+  const QString dir = m_tempDir.path() + "/copy";
+  const QString fromPath = QDir(dir).entryInfoList(QStringList() << "file*", QDir::Files).first().filePath();
+  const QString toPath = dir + "/copied.dat";
+  CopyLinkUtil util(m_backupSet.getHashMethod(), 1024 * 1024 * 24);
+  QVERIFY(m_results.measure("copyFileGenerateHash", m_repetitions, 1, m_copyBytes, [&]() { QFile::remove(toPath); }, [&]() {
+    return util.copyFileGenerateHash(fromPath, toPath);
+  }));
+}
+
+void LinkBackupBenchmark::hashFileTreeThreads()
+{
+  // A file large enough to have many chunks, so every thread has work.
+  TreeGenerator::Options options;
+  options.numFiles = 1;
+  options.depth = 0;
+  options.minSize = m_treeHashBytes;
+  options.maxSize = m_treeHashBytes;
+  options.duplicateRatio = 0.0;
+  const QString dir = m_tempDir.path() + "/tree";
+  QVERIFY(QDir().mkpath(dir));
+  TreeGenerator generator(options);
+  QVERIFY(generator.generate(dir));
+  const QString fromPath = dir + "/" + generator.filePaths().first();
+
+  // One result for each thread count, so the scaling with the number of cores can be plotted.
+  const int maxThreads = QThread::idealThreadCount();
+  m_results.setParameter("treeHashMaxThreads", maxThreads);
+  QString firstHash;
+  for (int threads=1; threads<=maxThreads; ++threads)
+  {
+    CopyLinkUtil util(m_backupSet.getHashMethod(), 1024 * 1024 * 24);
+    util.setHashChunkSize(m_treeChunkBytes);
+    util.setHashThreadCount(threads);
+    QVERIFY(m_results.measure(QString("hashFileTree%1Threads").arg(threads), m_repetitions, 1, m_treeHashBytes, nullptr, [&]() {
+      return util.generateHash(fromPath);
+    }));
+    // The thread count must never change the hash.
+    if (firstHash.isEmpty())
+    {
+      firstHash = util.getLastHash();
+    }
+    QCOMPARE(util.getLastHash(), firstHash);
+  }
+  QFile::remove(fromPath);
+}
+
+void LinkBackupBenchmark::loggerThroughput()
+{
+  // Format and write every message to a file, as the backup log does.
+  SimpleLoggerADP logger;
+  logger.setFileName(m_tempDir.path() + "/bench.log");
+  SimpleLoggerRoutingInfo routing;
+  routing.addMessageFormat(SimpleLoggerRoutingInfo::MessageDateTime, "");
+  routing.addMessageFormat(SimpleLoggerRoutingInfo::ConstantText, " ");
+  routing.addMessageFormat(SimpleLoggerRoutingInfo::MessageType, "X");
+  routing.addMessageFormat(SimpleLoggerRoutingInfo::ConstantText, " ");
+  routing.addMessageFormat(SimpleLoggerRoutingInfo::MessageLocation, "");
+  routing.addMessageFormat(SimpleLoggerRoutingInfo::ConstantText, " | ");
+  routing.addMessageFormat(SimpleLoggerRoutingInfo::MessageText, "");
+  routing.setCategoryLevel(SimpleLoggerRoutingInfo::InformationMessage, 1);
+  routing.setRoutingOn(SimpleLoggerRoutingInfo::RouteFile);
+  logger.addRouting(routing);
+
+  const int numMessages = 100000;
+  const QString location("linkbackupthread.cpp:300");
+  QVERIFY(m_results.measure("loggerThroughput", m_repetitions, numMessages, 0, nullptr, [&]() {
+    for (int i=0; i<numMessages; ++i)
+    {
+      logger.receiveMessage(QString("C  source/dir/file%1.dat").arg(i), location, QDateTime::currentDateTime(), SimpleLoggerRoutingInfo::InformationMessage, 1);
+    }
+    return true;
+  }));
+}
+
+void LinkBackupBenchmark::cleanupTestCase()
+{
+  delete m_generator;
+  m_generator = nullptr;
+  QString output = qEnvironmentVariable("BENCH_OUTPUT");
+  if (output.isEmpty())
+  {
+    output = QDir::currentPath() + "/linkbackup-bench.json";
+  }
+  QVERIFY(m_results.write(output));
+  qInfo("Results written to %s", qPrintable(output));
+}
+
+// The backup thread needs no widgets, so the benchmarks run without a display.
+QTEST_GUILESS_MAIN(LinkBackupBenchmark)
+#include "linkbackupbenchmark.moc"
@@ -0,0 +1,268 @@
+#include "treegenerator.h"
+
+#include <QDir>
+#include <QFile>
+#include <QVector>
+
+#include <cmath>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+// 2020-01-01 00:00:00 UTC, so modified times do not depend on when the tree is built.
+static const qint64 s_baseModifiedSecs = 1577836800;
+
+// Extensions are chosen so that the sample filters accept most files and reject a few.
+static const char* s_extensions[] = {".txt", ".dat", ".jpg", ".cpp", ".h", ".bak", ".pdf", ".o"};
+static const int s_numExtensions = sizeof(s_extensions) / sizeof(s_extensions[0]);
+
+static const qint64 s_writeBlockSize = 1024 * 1024;
+
+TreeGenerator::Options::Options() : seed(1), numFiles(2000), depth(3), dirsPerLevel(4), minSize(0), maxSize(1024 * 1024), duplicateRatio(0.2), changeRatio(0.05)
+{
+}
+
+void TreeGenerator::Options::readEnvironment()
+{
+  bool ok;
+  int intValue = qEnvironmentVariableIntValue("BENCH_SEED", &ok);
+  if (ok)
+  {
+    seed = static_cast<quint32>(intValue);
+  }
+  intValue = qEnvironmentVariableIntValue("BENCH_FILES", &ok);
+  if (ok)
+  {
+    numFiles = intValue;
+  }
+  intValue = qEnvironmentVariableIntValue("BENCH_DEPTH", &ok);
+  if (ok)
+  {
+    depth = intValue;
+  }
+  intValue = qEnvironmentVariableIntValue("BENCH_DIRS_PER_LEVEL", &ok);
+  if (ok)
+  {
+    dirsPerLevel = intValue;
+  }
+  qint64 sizeValue = qEnvironmentVariable("BENCH_MIN_SIZE").toLongLong(&ok);
+  if (ok)
+  {
+    minSize = sizeValue;
+  }
+  sizeValue = qEnvironmentVariable("BENCH_MAX_SIZE").toLongLong(&ok);
+  if (ok)
+  {
+    maxSize = sizeValue;
+  }
+  double ratio = qEnvironmentVariable("BENCH_DUPLICATE_RATIO").toDouble(&ok);
+  if (ok)
+  {
+    duplicateRatio = ratio;
+  }
+  ratio = qEnvironmentVariable("BENCH_CHANGE_RATIO").toDouble(&ok);
+  if (ok)
+  {
+    changeRatio = ratio;
+  }
+}
+
+QJsonObject TreeGenerator::Options::toJson() const
+{
+  QJsonObject json;
+  json["seed"] = static_cast<qint64>(seed);
+  json["numFiles"] = numFiles;
+  json["depth"] = depth;
+  json["dirsPerLevel"] = dirsPerLevel;
+  json["minSize"] = minSize;
+  json["maxSize"] = maxSize;
+  json["duplicateRatio"] = duplicateRatio;
+  json["changeRatio"] = changeRatio;
+  return json;
+}
+
+TreeGenerator::TreeGenerator(const Options& options) : m_options(options), m_state(0), m_generation(0), m_nextFileNumber(0), m_bytesWritten(0)
+{
+  // xorshift must not start at zero.
+  m_state = (static_cast<quint64>(options.seed) << 1) | 1;
+  for (int i=0; i<8; ++i)
+  {
+    next();
+  }
+
+  // Directories are listed breadth first; files go in any of them.
+  m_dirs.append("");
+  int levelStart = 0;
+  for (int level=0; level<m_options.depth; ++level)
+  {
+    const int levelEnd = m_dirs.count();
+    for (int i=levelStart; i<levelEnd; ++i)
+    {
+      for (int d=0; d<m_options.dirsPerLevel; ++d)
+      {
+        const QString name = QString("dir%1_%2").arg(level).arg(d, 2, 10, QChar('0'));
+        m_dirs.append(m_dirs.at(i).isEmpty() ? name : m_dirs.at(i) + "/" + name);
+      }
+    }
+    levelStart = levelEnd;
+  }
+}
+
+quint64 TreeGenerator::next()
+{
+  m_state ^= m_state >> 12;
+  m_state ^= m_state << 25;
+  m_state ^= m_state >> 27;
+  return m_state * 2685821657736338717ULL;
+}
+
+double TreeGenerator::nextDouble()
+{
+  return (next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+TreeGenerator::FileSpec TreeGenerator::newFile()
+{
+  FileSpec spec;
+  const int fileNumber = m_nextFileNumber++;
+  const QString& dir = m_dirs.at(static_cast<int>(next() % static_cast<quint64>(m_dirs.count())));
+  const QString name = QString("file%1%2").arg(fileNumber, 7, 10, QChar('0')).arg(s_extensions[next() % s_numExtensions]);
+  spec.path = dir.isEmpty() ? name : dir + "/" + name;
+  spec.modifiedSecs = s_baseModifiedSecs + m_generation * 86400 + fileNumber;
+
+  if (!m_files.isEmpty() && nextDouble() < m_options.duplicateRatio)
+  {
+    const FileSpec& original = m_files.at(static_cast<int>(next() % static_cast<quint64>(m_files.count())));
+    spec.size = original.size;
+    spec.contentSeed = original.contentSeed;
+    return spec;
+  }
+
+  // Log-uniform size; one is added so that a zero minimum is allowed.
+  const double lowLog = std::log(static_cast<double>(m_options.minSize) + 1.0);
+  const double highLog = std::log(static_cast<double>(qMax(m_options.maxSize, m_options.minSize)) + 1.0);
+  spec.size = static_cast<qint64>(std::exp(lowLog + (highLog - lowLog) * nextDouble()) - 1.0);
+  spec.size = qBound(m_options.minSize, spec.size, qMax(m_options.maxSize, m_options.minSize));
+  spec.contentSeed = next() | 1;
+  return spec;
+}
+
+bool TreeGenerator::writeFile(const QString& root, const FileSpec& spec)
+{
+  QFile file(root + "/" + spec.path);
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+  {
+    return false;
+  }
+  QVector<quint64> block(static_cast<int>(s_writeBlockSize / sizeof(quint64)));
+  quint64 state = spec.contentSeed;
+  qint64 remaining = spec.size;
+  while (remaining > 0)
+  {
+    for (int i=0; i<block.size(); ++i)
+    {
+      state ^= state >> 12;
+      state ^= state << 25;
+      state ^= state >> 27;
+      block[i] = state * 2685821657736338717ULL;
+    }
+    const qint64 numToWrite = qMin(remaining, s_writeBlockSize);
+    if (file.write(reinterpret_cast<const char*>(block.constData()), numToWrite) != numToWrite)
+    {
+      return false;
+    }
+    remaining -= numToWrite;
+  }
+  file.close();
+  m_bytesWritten += spec.size;
+
+  struct timespec times[2];
+  times[0].tv_sec = spec.modifiedSecs;
+  times[0].tv_nsec = 0;
+  times[1] = times[0];
+  return utimensat(AT_FDCWD, QFile::encodeName(file.fileName()).constData(), times, 0) == 0;
+}
+
+bool TreeGenerator::generate(const QString& root)
+{
+  m_bytesWritten = 0;
+  QDir rootDir(root);
+  for (const QString& dir : m_dirs)
+  {
+    if (!dir.isEmpty() && !rootDir.mkpath(dir))
+    {
+      return false;
+    }
+  }
+  for (int i=0; i<m_options.numFiles; ++i)
+  {
+    FileSpec spec = newFile();
+    if (!writeFile(root, spec))
+    {
+      return false;
+    }
+    m_files.append(spec);
+  }
+  return true;
+}
+
+bool TreeGenerator::applyChanges(const QString& root)
+{
+  ++m_generation;
+  m_bytesWritten = 0;
+  const int numToChange = static_cast<int>(m_files.count() * m_options.changeRatio);
+  int numRemoved = 0;
+  for (int i=0; i<numToChange && !m_files.isEmpty(); ++i)
+  {
+    const int index = static_cast<int>(next() % static_cast<quint64>(m_files.count()));
+    // Seven of ten changes modify a file, the rest remove one; a new file replaces each removed file.
+    if (next() % 10 < 7)
+    {
+      FileSpec& spec = m_files[index];
+      spec.contentSeed = next() | 1;
+      spec.modifiedSecs = s_baseModifiedSecs + m_generation * 86400 + index;
+      if (!writeFile(root, spec))
+      {
+        return false;
+      }
+    }
+    else
+    {
+      if (!QFile::remove(root + "/" + m_files.at(index).path))
+      {
+        return false;
+      }
+      m_files.removeAt(index);
+      ++numRemoved;
+    }
+  }
+  for (int i=0; i<numRemoved; ++i)
+  {
+    FileSpec spec = newFile();
+    if (!writeFile(root, spec))
+    {
+      return false;
+    }
+    m_files.append(spec);
+  }
+  return true;
+}
+
+qint64 TreeGenerator::totalBytes() const
+{
+  qint64 total = 0;
+  for (const FileSpec& spec : m_files)
+  {
+    total += spec.size;
+  }
+  return total;
+}
+
+QStringList TreeGenerator::filePaths() const
+{
+  QStringList paths;
+  for (const FileSpec& spec : m_files)
+  {
+    paths.append(spec.path);
+  }
+  return paths;
+}
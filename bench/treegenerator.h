@@ -0,0 +1,141 @@
+#ifndef TREEGENERATOR_H
+#define TREEGENERATOR_H
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QJsonObject>
+
+//**************************************************************************
+/*! \class TreeGenerator
+ *  \brief Build a synthetic directory tree that is identical for the same options on every machine.
+ *
+ * Every name, size, file content and modified time is derived from the seed, so two runs with
+ * the same options back up exactly the same data. File sizes are log-uniform between the minimum
+ * and maximum, which gives many small files and a few large ones as in a typical home directory.
+ * A fraction of the files are duplicates of an earlier file so that linking by hash is exercised.
+ *
+ * applyChanges() modifies, removes, and adds a fraction of the files to simulate the changes
+ * between two backups, so an incremental backup can be measured.
+ *
+ * \author Andrew Pitonyak
+ * \copyright Andrew Pitonyak, but you may use without restriction.
+ * \date 2026
+ **************************************************************************/
+class TreeGenerator
+{
+public:
+  /*! \brief Shape of the generated tree. */
+  struct Options
+  {
+    /*! \brief Seed for every random choice. */
+    quint32 seed;
+    /*! \brief Number of files in the first generation. */
+    int numFiles;
+    /*! \brief Number of directory levels below the root. */
+    int depth;
+    /*! \brief Number of subdirectories in each directory above the last level. */
+    int dirsPerLevel;
+    /*! \brief Smallest file size in bytes. */
+    qint64 minSize;
+    /*! \brief Largest file size in bytes. */
+    qint64 maxSize;
+    /*! \brief Fraction of the files whose content duplicates an earlier file, zero to one. */
+    double duplicateRatio;
+    /*! \brief Fraction of the files touched by each call to applyChanges(), zero to one. */
+    double changeRatio;
+
+    /*! \brief Constructor with a small tree that builds in a few seconds. */
+    Options();
+
+    //**************************************************************************
+    /*! \brief Override the defaults from environment variables.
+     *
+     *  BENCH_SEED, BENCH_FILES, BENCH_DEPTH, BENCH_DIRS_PER_LEVEL, BENCH_MIN_SIZE,
+     *  BENCH_MAX_SIZE, BENCH_DUPLICATE_RATIO, and BENCH_CHANGE_RATIO are read if set.
+     ***************************************************************************/
+    void readEnvironment();
+
+    /*! \brief Options as JSON so that results record what was measured. */
+    QJsonObject toJson() const;
+  };
+
+  //**************************************************************************
+  /*! \brief Constructor, nothing is written until generate() is called.
+   *
+   *  \param [in] options Shape of the tree.
+   ***************************************************************************/
+  explicit TreeGenerator(const Options& options);
+
+  //**************************************************************************
+  /*! \brief Write the first generation of the tree.
+   *
+   *  \param [in] root Existing empty directory that receives the tree.
+   *  \return True if every directory and file was written.
+   ***************************************************************************/
+  bool generate(const QString& root);
+
+  //**************************************************************************
+  /*! \brief Change the tree written by generate() to simulate the time between two backups.
+   *
+   *  Of the files selected by the change ratio, most are rewritten with new content and a new
+   *  modified time, some are removed, and an equal number of new files are added.
+   *  \param [in] root Directory passed to generate().
+   *  \return True if every change was written.
+   ***************************************************************************/
+  bool applyChanges(const QString& root);
+
+  /*! \brief Number of files currently in the tree. */
+  int numFiles() const;
+
+  /*! \brief Total size of the files currently in the tree. */
+  qint64 totalBytes() const;
+
+  /*! \brief Number of bytes written by the last call to generate() or applyChanges(). */
+  qint64 bytesWritten() const;
+
+  /*! \brief Relative paths of the files currently in the tree. */
+  QStringList filePaths() const;
+
+private:
+  /*! \brief One file; the content is generated from the content seed. */
+  struct FileSpec
+  {
+    QString path;
+    qint64 size;
+    quint64 contentSeed;
+    qint64 modifiedSecs;
+  };
+
+  /*! \brief Next pseudo random number; xorshift64* so the sequence never depends on the Qt version. */
+  quint64 next();
+
+  /*! \brief Pseudo random number from zero to one. */
+  double nextDouble();
+
+  /*! \brief New file in a random directory, possibly with the content of an existing file. */
+  FileSpec newFile();
+
+  /*! \brief Write one file and set the modified time. */
+  bool writeFile(const QString& root, const FileSpec& spec);
+
+  Options m_options;
+  quint64 m_state;
+  int m_generation;
+  int m_nextFileNumber;
+  qint64 m_bytesWritten;
+  QStringList m_dirs;
+  QList<FileSpec> m_files;
+};
+
+inline int TreeGenerator::numFiles() const
+{
+  return m_files.count();
+}
+
+inline qint64 TreeGenerator::bytesWritten() const
+{
+  return m_bytesWritten;
+}
+
+#endif // TREEGENERATOR_H
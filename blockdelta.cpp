@@ -0,0 +1,376 @@
+#include "blockdelta.h"
+#include "backupprogress.h"
+#include "catalogwriter.h"
+#include "copylinkutil.h"
+#include "enhancedqcryptographichash.h"
+#include "filehash.h"
+#include "linkbackupglobals.h"
+#include "perftrace.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char* s_header = "LinkBackupBlocks=1";
+
+BlockMap::BlockMap()
+{
+}
+
+BlockMap::~BlockMap()
+{
+  if (m_file.isOpen())
+  {
+    close(false);
+  }
+}
+
+QString BlockMap::blocksPath(const QString& catalogPath)
+{
+  return catalogPath + ".blocks";
+}
+
+bool BlockMap::open(const QString& path)
+{
+  if (m_file.isOpen())
+  {
+    close(false);
+  }
+  m_path = path;
+  m_file.setFileName(CatalogWriter::partialPath(path));
+  if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+  {
+    WARN_MSG(QString(QObject::tr("Unable to write the block map %1")).arg(m_file.fileName()), 1);
+    return false;
+  }
+  m_file.write(QByteArray(s_header) + "\n");
+  return true;
+}
+
+void BlockMap::add(const QString& path, const BlockMapEntry& entry)
+{
+  if (!m_file.isOpen())
+  {
+    return;
+  }
+  QByteArray line("File=");
+  line.append(QByteArray::number(entry.size)).append(',');
+  line.append(QByteArray::number(entry.blockSize)).append(',');
+  line.append(QByteArray::number(entry.digestLength)).append(',');
+  line.append(QByteArray::number(entry.count())).append(',');
+  line.append(path.toUtf8()).append('\n');
+  m_file.write(line);
+  m_file.write(entry.digests);
+  m_file.write("\n", 1);
+}
+
+bool BlockMap::close(const bool finished)
+{
+  if (!m_file.isOpen())
+  {
+    return false;
+  }
+  const bool written = m_file.flush() && m_file.error() == QFileDevice::NoError;
+  m_file.close();
+  // The partial file of a backup that did not finish is read when the backup is resumed.
+  if (!finished)
+  {
+    return false;
+  }
+  if (!written)
+  {
+    m_file.remove();
+    return false;
+  }
+  QFile::remove(m_path);
+  if (!m_file.rename(m_path))
+  {
+    WARN_MSG(QString(QObject::tr("Unable to rename %1 to %2")).arg(m_file.fileName(), m_path), 1);
+    m_file.remove();
+    return false;
+  }
+  return true;
+}
+
+void BlockMap::clear()
+{
+  m_entries.clear();
+}
+
+bool BlockMap::read(const QString& path, const bool partial)
+{
+  clear();
+  QFile file(path);
+  if (!file.open(QIODevice::ReadOnly))
+  {
+    return false;
+  }
+  if (file.readLine().trimmed() != s_header)
+  {
+    WARN_MSG(QString(QObject::tr("Unknown block map format in %1")).arg(path), 1);
+    return false;
+  }
+  bool valid = true;
+  while (valid && !file.atEnd())
+  {
+    QByteArray line = file.readLine();
+    valid = line.startsWith("File=") && line.endsWith('\n');
+    if (!valid)
+    {
+      break;
+    }
+    line.chop(1);
+    // The path is last, so it may contain commas.
+    qint64 values[4];
+    int start = 5;
+    for (int i=0; valid && i<4; ++i)
+    {
+      const int comma = line.indexOf(',', start);
+      valid = (comma > start);
+      if (valid)
+      {
+        values[i] = line.mid(start, comma - start).toLongLong(&valid);
+        start = comma + 1;
+      }
+    }
+    const qint64 numBytes = valid ? values[2] * values[3] : 0;
+    valid = valid && start < line.length() && values[1] > 0 && values[2] > 0 && numBytes >= 0 && numBytes <= file.bytesAvailable();
+    if (!valid)
+    {
+      break;
+    }
+    BlockMapEntry entry;
+    entry.size = values[0];
+    entry.blockSize = values[1];
+    entry.digestLength = static_cast<int>(values[2]);
+    entry.digests = file.read(numBytes);
+    char newLine = 0;
+    valid = entry.digests.length() == numBytes && file.getChar(&newLine) && newLine == '\n';
+    if (valid)
+    {
+      m_entries.insert(QString::fromUtf8(line.mid(start)), entry);
+    }
+  }
+  // A partial file ends where the interrupted backup stopped writing.
+  if (!valid && !partial)
+  {
+    WARN_MSG(QString(QObject::tr("Invalid record in the block map %1")).arg(path), 1);
+    clear();
+    return false;
+  }
+  return true;
+}
+
+const BlockMapEntry* BlockMap::find(const QString& path) const
+{
+  QHash<QString, BlockMapEntry>::const_iterator it = m_entries.constFind(path);
+  return (it == m_entries.constEnd()) ? nullptr : &it.value();
+}
+
+BlockDelta::BlockDelta() : m_algorithm(EnhancedQCryptographicHash::getDefaultAlgorithm()), m_chunkSize(0), m_progress(nullptr), m_cancelRequested(false), m_numFiles(0), m_numCloned(0), m_bytesReused(0), m_bytesWritten(0), m_bytesHoles(0)
+{
+}
+
+void BlockDelta::setHashMethod(const QCryptographicHash::Algorithm algorithm, const qint64 chunkSize)
+{
+  m_algorithm = algorithm;
+  m_chunkSize = (chunkSize > 0) ? chunkSize : 0;
+}
+
+void BlockDelta::resetStats()
+{
+  m_numFiles = 0;
+  m_numCloned = 0;
+  m_bytesReused = 0;
+  m_bytesWritten = 0;
+  m_bytesHoles = 0;
+}
+
+bool BlockDelta::writeBlock(const int fd, const char* data, const qint64 length, const qint64 offset)
+{
+  qint64 written = 0;
+  while (written < length)
+  {
+    const ssize_t n = pwrite(fd, data + written, static_cast<size_t>(length - written), offset + written);
+    if (n <= 0)
+    {
+      return false;
+    }
+    written += n;
+  }
+  return true;
+}
+
+bool BlockDelta::copyBlock(const int previousFd, const int fd, const qint64 length, const qint64 offset)
+{
+  loff_t readOffset = offset;
+  loff_t writeOffset = offset;
+  qint64 remaining = length;
+  while (remaining > 0)
+  {
+    const ssize_t n = copy_file_range(previousFd, &readOffset, fd, &writeOffset, static_cast<size_t>(remaining), 0);
+    if (n <= 0)
+    {
+      return false;
+    }
+    remaining -= n;
+  }
+  return true;
+}
+
+bool BlockDelta::copy(const QString& fromPath, const QString& toPath, const QString& previousPath, const BlockMapEntry* previous, BlockMapEntry& blocks)
+{
+  PerfScope scope(PerfTrace::Copy);
+  const int digestLength = QCryptographicHash::hashLength(m_algorithm);
+  blocks.size = 0;
+  blocks.blockSize = BlockSize;
+  blocks.digestLength = digestLength;
+  blocks.digests.clear();
+
+  const int fromFd = open(QFile::encodeName(fromPath).constData(), O_RDONLY | O_CLOEXEC);
+  struct stat st;
+  if (fromFd < 0 || fstat(fromFd, &st) != 0)
+  {
+    if (fromFd >= 0)
+    {
+      ::close(fromFd);
+    }
+    return false;
+  }
+  const QByteArray encodedToPath = QFile::encodeName(toPath);
+  const int toFd = open(encodedToPath.constData(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+  if (toFd < 0)
+  {
+    ::close(fromFd);
+    return false;
+  }
+  posix_fadvise(fromFd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  // The previous block map is only used if it describes the previous copy, block for block.
+  int previousFd = -1;
+  if (previous != nullptr && previous->blockSize == BlockSize && previous->digestLength == digestLength)
+  {
+    previousFd = open(QFile::encodeName(previousPath).constData(), O_RDONLY | O_CLOEXEC);
+    struct stat previousSt;
+    if (previousFd >= 0 && (fstat(previousFd, &previousSt) != 0 || previousSt.st_size != previous->size))
+    {
+      ::close(previousFd);
+      previousFd = -1;
+    }
+  }
+  // With a clone, an unchanged block is already in place.
+  const bool cloned = previousFd >= 0 && ioctl(toFd, FICLONE, previousFd) == 0;
+
+  if (m_buffer.isEmpty())
+  {
+    m_buffer.resize(BlockSize);
+  }
+  static const QByteArray zeros(static_cast<int>(BlockSize), '\0');
+  FileHash fileHash(m_algorithm, m_chunkSize);
+  const qint64 expectedSize = static_cast<qint64>(st.st_size);
+  // Holes are only looked for when fewer bytes are allocated than the size.
+  const bool sparse = static_cast<qint64>(st.st_blocks) * 512 < expectedSize;
+  blocks.digests.reserve(static_cast<int>(((expectedSize + BlockSize - 1) / BlockSize) * digestLength));
+  qint64 offset = 0;
+  qint64 reused = 0;
+  qint64 written = 0;
+  qint64 holes = 0;
+  bool ok = true;
+  for (int block = 0; ok && offset < expectedSize && !m_cancelRequested; ++block)
+  {
+    qint64 length = 0;
+    const qint64 wanted = qMin(static_cast<qint64>(BlockSize), expectedSize - offset);
+    // A block that is all hole is hashed as zeros without reading it.
+    qint64 dataStart = offset;
+    qint64 dataEnd = offset + wanted;
+    const bool hole = sparse && !CopyLinkUtil::nextDataExtent(fromFd, offset, offset + wanted, dataStart, dataEnd);
+    if (hole)
+    {
+      length = wanted;
+    }
+    while (length < wanted)
+    {
+      const ssize_t n = pread(fromFd, m_buffer.data() + length, static_cast<size_t>(wanted - length), offset + length);
+      if (n <= 0)
+      {
+        ok = (n == 0);
+        break;
+      }
+      length += n;
+    }
+    if (!ok || length == 0)
+    {
+      // The file became shorter while it was copied.
+      break;
+    }
+
+    const char* data = hole ? zeros.constData() : m_buffer.constData();
+    const QByteArray digest = QCryptographicHash::hash(QByteArrayView(data, length), m_algorithm);
+    fileHash.addData(data, length);
+    blocks.digests.append(digest);
+
+    const bool same = previousFd >= 0 && block < previous->count() && qMin(static_cast<qint64>(BlockSize), previous->size - offset) == length &&
+        memcmp(previous->digests.constData() + block * digestLength, digest.constData(), digestLength) == 0;
+    if (hole)
+    {
+      // Nothing is written, so it stays a hole; a clone that has other data here has it punched out.
+      if (cloned && !same && fallocate(toFd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, length) != 0)
+      {
+        ok = writeBlock(toFd, zeros.constData(), length, offset);
+      }
+      holes += length;
+    }
+    else if (same && (cloned || copyBlock(previousFd, toFd, length, offset)))
+    {
+      reused += length;
+    }
+    else
+    {
+      ok = writeBlock(toFd, m_buffer.constData(), length, offset);
+      written += length;
+      if (m_progress != nullptr)
+      {
+        m_progress->add(BackupProgress::BytesCopied, length);
+      }
+    }
+    offset += length;
+    if (length < wanted)
+    {
+      break;
+    }
+  }
+  // A clone of a longer previous copy is cut to the size of the source, and a hole at the end is only a size.
+  ok = ok && !m_cancelRequested && ftruncate(toFd, offset) == 0 && fchmod(toFd, st.st_mode & 07777) == 0;
+  if (previousFd >= 0)
+  {
+    ::close(previousFd);
+  }
+  ::close(fromFd);
+  ::close(toFd);
+  if (!ok)
+  {
+    unlink(encodedToPath.constData());
+    return false;
+  }
+
+  blocks.size = offset;
+  m_lastHash = QString::fromLatin1(fileHash.result(offset).toHex().toUpper());
+  ++m_numFiles;
+  if (cloned)
+  {
+    ++m_numCloned;
+  }
+  m_bytesReused += reused;
+  m_bytesWritten += written;
+  m_bytesHoles += holes;
+  return true;
+}
+
+QString BlockDelta::summaryText() const
+{
+  return QString(QObject::tr("Block delta: %1 files (%2 cloned), %3 reused from the previous backup, %4 written, %5 left as holes")).arg(m_numFiles).arg(m_numCloned).arg(CopyLinkUtil::getBPS(m_bytesReused, 0), CopyLinkUtil::getBPS(m_bytesWritten, 0), CopyLinkUtil::getBPS(m_bytesHoles, 0));
+}
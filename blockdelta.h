@@ -0,0 +1,246 @@
+#ifndef BLOCKDELTA_H
+#define BLOCKDELTA_H
+
+#include <QByteArray>
+#include <QCryptographicHash>
+#include <QFile>
+#include <QHash>
+#include <QString>
+
+#include <atomic>
+
+class BackupProgress;
+
+//**************************************************************************
+/*! \brief Digest of every block of one file in a backup. */
+//**************************************************************************
+struct BlockMapEntry
+{
+  /*! \brief Size of the file in bytes. */
+  qint64 size;
+  /*! \brief Size of each block; the last block may be shorter. */
+  qint64 blockSize;
+  /*! \brief Length of one digest in bytes. */
+  int digestLength;
+  /*! \brief Digests of the blocks, one after the other. */
+  QByteArray digests;
+
+  /*! \brief Number of blocks. */
+  int count() const;
+
+  /*! \brief Digest of one block. */
+  QByteArray digest(const int block) const;
+};
+
+//**************************************************************************
+/*! \class BlockMap
+ *  \brief Block digests of the large files in a backup, written next to the catalog.
+ *
+ * The file "<catalog>.blocks" holds a header followed by one record for each file:
+ * \code
+ * LinkBackupBlocks=1
+ * File=53687091200,1048576,20,51200,Top/vm/disk.vmdk
+ * <51200 binary digests of 20 bytes>
+ * \endcode
+ *
+ * The values are the file size, the block size, the digest length, the number of blocks, and
+ * the path, the same as in the catalog. The digests follow the line, then a new line.
+ *
+ * A file linked to an earlier backup keeps its record, so the map is carried from backup to
+ * backup and only the files that were copied again are hashed block by block.
+ *
+ * \author Andrew Pitonyak
+ * \copyright Andrew Pitonyak, but you may use without restriction.
+ * \date 2026
+ **************************************************************************/
+class BlockMap
+{
+public:
+  /*! \brief Constructor, nothing is read or open. */
+  BlockMap();
+
+  /*! \brief Destructor, a file still open is discarded. */
+  ~BlockMap();
+
+  /*! \brief Get the path for the block map of a catalog, such as "<backup>/sha1.txt.blocks". */
+  static QString blocksPath(const QString& catalogPath);
+
+  //**************************************************************************
+  /*! \brief Start writing; the records are written to a partial file until close().
+   *
+   *  \param [in] path Full path to the block map.
+   *  \return True if the partial file was created.
+   ***************************************************************************/
+  bool open(const QString& path);
+
+  bool isOpen() const;
+
+  /*! \brief Write the record for a file. */
+  void add(const QString& path, const BlockMapEntry& entry);
+
+  //**************************************************************************
+  /*! \brief Stop writing.
+   *
+   *  \param [in] finished If true, the partial file replaces the block map; otherwise it is kept for a resume.
+   *  \return True if the block map was written.
+   ***************************************************************************/
+  bool close(const bool finished);
+
+  //**************************************************************************
+  /*! \brief Read the records from an earlier backup.
+   *
+   *  \param [in] path Full path to the block map.
+   *  \param [in] partial If true, the file was left by an interrupted backup, so the records
+   *               before an incomplete record are kept.
+   *  \return True if the file was read; false if it is missing or has an unknown format.
+   ***************************************************************************/
+  bool read(const QString& path, const bool partial = false);
+
+  /*! \brief Forget the records read. */
+  void clear();
+
+  /*! \brief Number of records read. */
+  int count() const;
+
+  /*! \brief Find the record for a path; null if there is none. The pointer is valid until the next read(). */
+  const BlockMapEntry* find(const QString& path) const;
+
+private:
+  /*! \brief Disable the copy constructor, the file is owned. */
+  BlockMap(const BlockMap&);
+  BlockMap& operator=(const BlockMap&);
+
+  QFile m_file;
+  QString m_path;
+  QHash<QString, BlockMapEntry> m_entries;
+};
+
+//**************************************************************************
+/*! \class BlockDelta
+ *  \brief Copy a large file that changed a little by reusing the unchanged blocks of the previous copy.
+ *
+ * The source is read once, block by block. Each block is hashed and compared with the block map
+ * of the copy in the previous backup. When the file system shares blocks, the previous copy is
+ * first cloned with FICLONE and only the changed blocks are written over the clone. Otherwise
+ * unchanged blocks are copied from the previous copy with copy_file_range(), which stays on the
+ * backup disk, and changed blocks are written from the source.
+ *
+ * A block of a sparse file that is all hole is not read; it is hashed as zeros and left a hole in
+ * the copy, punched out of a clone if the previous copy had data there.
+ *
+ * The file hash used by the catalog, sequential or tree, is calculated in the same pass, and
+ * the block map of the new copy is returned for the next backup. Without a previous block map
+ * every block is written, which builds the first map.
+ *
+ * \author Andrew Pitonyak
+ * \copyright Andrew Pitonyak, but you may use without restriction.
+ * \date 2026
+ **************************************************************************/
+class BlockDelta
+{
+public:
+  enum {BlockSize = 1024 * 1024};
+
+  /*! \brief Constructor, hashes with the default algorithm and no chunks. */
+  BlockDelta();
+
+  //**************************************************************************
+  /*! \brief Set how the file hash is calculated, the same as the catalog.
+   *
+   *  \param [in] algorithm Hash algorithm, also used for the block digests.
+   *  \param [in] chunkSize Chunk size for a tree hash, zero for a sequential hash.
+   ***************************************************************************/
+  void setHashMethod(const QCryptographicHash::Algorithm algorithm, const qint64 chunkSize);
+
+  /*! \brief Set the progress counters, which are not owned; may be nullptr. */
+  void setProgress(BackupProgress* progress);
+
+  //**************************************************************************
+  /*! \brief Copy a file using the unchanged blocks of its previous copy.
+   *
+   *  \param [in] fromPath Full path to the source file.
+   *  \param [in] toPath Full path to the new copy, which must not exist.
+   *  \param [in] previousPath Full path to the copy in the previous backup.
+   *  \param [in] previous Block map of the previous copy; null if there is none.
+   *  \param [out] blocks Block map of the new copy.
+   *  \return True if the file was copied; on failure the new copy is removed.
+   ***************************************************************************/
+  bool copy(const QString& fromPath, const QString& toPath, const QString& previousPath, const BlockMapEntry* previous, BlockMapEntry& blocks);
+
+  /*! \brief Upper-case hex hash of the last file copied. */
+  const QString& getLastHash() const;
+
+  void setCancelRequested(const bool cancelRequested);
+
+  /*! \brief Reset the counters for a new backup. */
+  void resetStats();
+
+  /*! \brief Summary of the files copied for the log. */
+  QString summaryText() const;
+
+  /*! \brief Number of files copied. */
+  qint64 getNumFiles() const;
+
+private:
+  /*! \brief Write a block at an offset; false on an error. */
+  static bool writeBlock(const int fd, const char* data, const qint64 length, const qint64 offset);
+
+  /*! \brief Copy a block from the previous copy at the same offset; false if it must be written instead. */
+  static bool copyBlock(const int previousFd, const int fd, const qint64 length, const qint64 offset);
+
+  QCryptographicHash::Algorithm m_algorithm;
+  qint64 m_chunkSize;
+  BackupProgress* m_progress;
+  std::atomic<bool> m_cancelRequested;
+
+  QByteArray m_buffer;
+  QString m_lastHash;
+
+  qint64 m_numFiles;
+  qint64 m_numCloned;
+  qint64 m_bytesReused;
+  qint64 m_bytesWritten;
+  qint64 m_bytesHoles;
+};
+
+inline int BlockMapEntry::count() const
+{
+  return (digestLength > 0) ? digests.length() / digestLength : 0;
+}
+
+inline QByteArray BlockMapEntry::digest(const int block) const
+{
+  return digests.mid(block * digestLength, digestLength);
+}
+
+inline bool BlockMap::isOpen() const
+{
+  return m_file.isOpen();
+}
+
+inline int BlockMap::count() const
+{
+  return m_entries.count();
+}
+
+inline void BlockDelta::setProgress(BackupProgress* progress)
+{
+  m_progress = progress;
+}
+
+inline const QString& BlockDelta::getLastHash() const
+{
+  return m_lastHash;
+}
+
+inline void BlockDelta::setCancelRequested(const bool cancelRequested)
+{
+  m_cancelRequested = cancelRequested;
+}
+
+inline qint64 BlockDelta::getNumFiles() const
+{
+  return m_numFiles;
+}
+
+#endif // BLOCKDELTA_H
@@ -0,0 +1,280 @@
+#include "catalogparser.h"
+#include "dbfileentries.h"
+#include "linkbackupglobals.h"
+
+#include <QFile>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+#include <QVector>
+
+#include <cstring>
+
+// Files smaller than this are parsed on the calling thread.
+static const qint64 s_minParallelBytes = 4 * 1024 * 1024;
+
+// Chunks per thread, so that a slow chunk does not leave the other threads idle.
+static const int s_chunksPerThread = 4;
+
+static inline bool isAsciiSpace(const char c)
+{
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+//**************************************************************************
+/*! \brief Parse the lines in one newline aligned chunk of a mapped catalog.
+ ***************************************************************************/
+class CatalogChunkTask : public QRunnable
+{
+public:
+  CatalogChunkTask(const char* begin, const char* end) : m_begin(begin), m_end(end), m_failedEntry(0)
+  {
+    setAutoDelete(false);
+  }
+
+  void run() override
+  {
+    const char* p = m_begin;
+    while (p < m_end)
+    {
+      // The text stream reader skipped white space, including blank lines, before each entry.
+      while (p < m_end && isAsciiSpace(*p))
+      {
+        ++p;
+      }
+      if (p >= m_end)
+      {
+        break;
+      }
+      const char* newLine = static_cast<const char*>(memchr(p, '\n', static_cast<size_t>(m_end - p)));
+      const char* lineEnd = (newLine != nullptr) ? newLine : m_end;
+      const char* fieldsEnd = (lineEnd > p && lineEnd[-1] == '\r') ? lineEnd - 1 : lineEnd;
+
+      DBFileEntry* entry = new DBFileEntry();
+      if (!CatalogParser::parseLine(p, fieldsEnd, *entry))
+      {
+        delete entry;
+        m_failedEntry = m_entries.count() + 1;
+        return;
+      }
+      m_entries.append(entry);
+      p = lineEnd + 1;
+    }
+  }
+
+  /*! \brief Entries in file order; ownership passes to whoever takes them. */
+  QList<DBFileEntry*> m_entries;
+
+  const char* m_begin;
+  const char* m_end;
+
+  /*! \brief One based number of the entry in this chunk that failed, zero if none failed. */
+  int m_failedEntry;
+};
+
+CatalogParser::CatalogParser() : m_threadCount(0), m_ignoreIncompleteLastLine(false)
+{
+}
+
+void CatalogParser::parseTimestamp(const char* text, const int length, QDateTime& dateTime)
+{
+  // yyyyMMddThh:mm:ss.zzz
+  bool fixedFormat = (length == 21 && text[8] == 'T' && text[11] == ':' && text[14] == ':' && text[17] == '.');
+  static const int digitPositions[] = {0, 1, 2, 3, 4, 5, 6, 7, 9, 10, 12, 13, 15, 16, 18, 19, 20};
+  for (int i=0; fixedFormat && i<17; ++i)
+  {
+    const char c = text[digitPositions[i]];
+    fixedFormat = (c >= '0' && c <= '9');
+  }
+  if (!fixedFormat)
+  {
+    dateTime = QDateTime::fromString(QString::fromUtf8(text, length), DBFileEntry::dateTimeFormat);
+    return;
+  }
+
+  auto number = [text](const int start, const int count) {
+    int value = 0;
+    for (int i=start; i<start+count; ++i)
+    {
+      value = value * 10 + (text[i] - '0');
+    }
+    return value;
+  };
+  const QDate date(number(0, 4), number(4, 2), number(6, 2));
+  const QTime time(number(9, 2), number(12, 2), number(15, 2), number(18, 3));
+  if (date.isValid() && time.isValid())
+  {
+    dateTime = QDateTime(date, time);
+  }
+  else
+  {
+    dateTime = QDateTime();
+  }
+}
+
+bool CatalogParser::parseLine(const char* begin, const char* end, DBFileEntry& entry)
+{
+  // The first four commas separate the fields; the path may contain commas.
+  const char* separators[4];
+  const char* p = begin;
+  for (int i=0; i<4; ++i)
+  {
+    const char* comma = static_cast<const char*>(memchr(p, ',', static_cast<size_t>(end - p)));
+    if (comma == nullptr)
+    {
+      return false;
+    }
+    separators[i] = comma;
+    p = comma + 1;
+  }
+
+  if (separators[0] > begin)
+  {
+    const unsigned char c = static_cast<unsigned char>(*begin);
+    entry.setLinkType(c < 0x80 ? QChar(QLatin1Char(static_cast<char>(c))) : QString::fromUtf8(begin, static_cast<int>(separators[0] - begin)).at(0));
+  }
+
+  QDateTime dateTime;
+  parseTimestamp(separators[0] + 1, static_cast<int>(separators[1] - separators[0] - 1), dateTime);
+  entry.setTime(dateTime);
+
+  // Hashes are hexadecimal, so upper case the ASCII directly.
+  const char* hashBegin = separators[1] + 1;
+  const int hashLength = static_cast<int>(separators[2] - hashBegin);
+  QString hash(hashLength, Qt::Uninitialized);
+  QChar* hashData = hash.data();
+  bool ascii = true;
+  for (int i=0; i<hashLength && ascii; ++i)
+  {
+    char c = hashBegin[i];
+    ascii = (static_cast<unsigned char>(c) < 0x80);
+    hashData[i] = QLatin1Char((c >= 'a' && c <= 'z') ? static_cast<char>(c - 'a' + 'A') : c);
+  }
+  entry.setHash(ascii ? hash : QString::fromUtf8(hashBegin, hashLength).toUpper());
+
+  // The size is almost always plain digits; anything else uses the same conversion as the text reader.
+  const char* sizeBegin = separators[2] + 1;
+  const char* sizeEnd = separators[3];
+  quint64 size = 0;
+  bool digitsOnly = (sizeBegin < sizeEnd && sizeEnd - sizeBegin < 20);
+  for (const char* s = sizeBegin; digitsOnly && s < sizeEnd; ++s)
+  {
+    digitsOnly = (*s >= '0' && *s <= '9');
+    size = size * 10 + static_cast<quint64>(*s - '0');
+  }
+  if (!digitsOnly)
+  {
+    bool ok;
+    size = QString::fromUtf8(sizeBegin, static_cast<int>(sizeEnd - sizeBegin)).toULongLong(&ok, 10);
+    if (!ok)
+    {
+      return false;
+    }
+  }
+  entry.setSize(size);
+
+  entry.setPath(QString::fromUtf8(separators[3] + 1, static_cast<int>(end - separators[3] - 1)));
+  return true;
+}
+
+DBFileEntries* CatalogParser::read(const QString& path, const MatchPlan::Indexes indexes) const
+{
+  QFile file(path);
+  if (!file.open(QIODevice::ReadOnly))
+  {
+    ERROR_MSG(QString(QObject::tr("Failed to open file (%1) to read the DB File Entries")).arg(path), 1);
+    return nullptr;
+  }
+
+  DBFileEntries* rc = new DBFileEntries();
+  rc->setIndexes(indexes);
+  const qint64 fileSize = file.size();
+  if (fileSize == 0)
+  {
+    return rc;
+  }
+
+  // Map the file; if the file system does not support it, read it.
+  QByteArray contents;
+  const char* data = reinterpret_cast<const char*>(file.map(0, fileSize));
+  if (data == nullptr)
+  {
+    contents = file.readAll();
+    data = contents.constData();
+  }
+  const char* dataEnd = data + fileSize;
+  if (m_ignoreIncompleteLastLine && dataEnd[-1] != '\n')
+  {
+    const char* lastNewLine = static_cast<const char*>(memrchr(data, '\n', static_cast<size_t>(fileSize)));
+    dataEnd = (lastNewLine != nullptr) ? lastNewLine + 1 : data;
+    WARN_MSG(QString(QObject::tr("Ignoring an incomplete last line in %1")).arg(path), 1);
+  }
+  const qint64 dataSize = dataEnd - data;
+
+  const int threadCount = (m_threadCount > 0) ? m_threadCount : QThread::idealThreadCount();
+  int numChunks = (dataSize < s_minParallelBytes || threadCount < 2) ? 1 : threadCount * s_chunksPerThread;
+
+  // Chunk boundaries are moved forward to the start of the next line.
+  QVector<CatalogChunkTask*> tasks;
+  const char* chunkBegin = data;
+  for (int i=1; i<=numChunks && chunkBegin < dataEnd; ++i)
+  {
+    const char* chunkEnd = (i == numChunks) ? dataEnd : data + (dataSize * i) / numChunks;
+    if (chunkEnd < chunkBegin)
+    {
+      chunkEnd = chunkBegin;
+    }
+    const char* newLine = static_cast<const char*>(memchr(chunkEnd, '\n', static_cast<size_t>(dataEnd - chunkEnd)));
+    chunkEnd = (i == numChunks || newLine == nullptr) ? dataEnd : newLine + 1;
+    tasks.append(new CatalogChunkTask(chunkBegin, chunkEnd));
+    chunkBegin = chunkEnd;
+  }
+
+  if (tasks.count() == 1)
+  {
+    tasks.first()->run();
+  }
+  else
+  {
+    QThreadPool pool;
+    pool.setMaxThreadCount(threadCount);
+    for (CatalogChunkTask* task : tasks)
+    {
+      pool.start(task);
+    }
+    pool.waitForDone();
+  }
+
+  // Merge in file order; the first failure is reported with the same entry number as the text reader.
+  qint64 numEntries = 0;
+  qint64 failedEntry = 0;
+  for (const CatalogChunkTask* task : tasks)
+  {
+    if (failedEntry == 0 && task->m_failedEntry > 0)
+    {
+      failedEntry = numEntries + task->m_failedEntry;
+    }
+    numEntries += task->m_entries.count();
+  }
+  if (failedEntry > 0)
+  {
+    for (CatalogChunkTask* task : tasks)
+    {
+      qDeleteAll(task->m_entries);
+    }
+    qDeleteAll(tasks);
+    delete rc;
+    ERROR_MSG(QString(QObject::tr("Failed reading at DB File Entry %1")).arg(failedEntry), 1);
+    return nullptr;
+  }
+
+  QList<DBFileEntry*> entries;
+  entries.reserve(static_cast<int>(numEntries));
+  for (const CatalogChunkTask* task : tasks)
+  {
+    entries.append(task->m_entries);
+  }
+  qDeleteAll(tasks);
+  rc->addEntries(entries);
+  return rc;
+}
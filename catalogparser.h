@@ -0,0 +1,101 @@
+#ifndef CATALOGPARSER_H
+#define CATALOGPARSER_H
+
+#include "matchplan.h"
+
+#include <QDateTime>
+#include <QString>
+
+class DBFileEntries;
+class DBFileEntry;
+
+//**************************************************************************
+/*! \class CatalogParser
+ *  \brief Read a text catalog (hash.txt) by parsing newline aligned chunks on several threads.
+ *
+ * The catalog is mapped into memory and split into chunks that start and end on a line boundary.
+ * Each chunk is parsed by a thread pool task directly from the UTF-8 bytes: fields are found with
+ * memchr, the size is parsed as ASCII digits, and the fixed format time stamp is decoded without
+ * QDateTime::fromString(). Anything unusual, such as a time stamp in another format, falls back
+ * to the same Qt conversion used by DBFileEntry::readLine(), so the result is identical to reading
+ * the file with a QTextStream.
+ *
+ * The entries from every chunk are then added in file order with one call to DBFileEntries::addEntries(),
+ * which builds the indexes in a single pass.
+ *
+ * \author Andrew Pitonyak
+ * \copyright Andrew Pitonyak, but you may use without restriction.
+ * \date 2026
+ **************************************************************************/
+class CatalogParser
+{
+public:
+  /*! \brief Constructor, uses the ideal thread count. */
+  CatalogParser();
+
+  /*! \brief Set the maximum number of threads; less than 1 means use the ideal thread count. */
+  void setThreadCount(const int threadCount);
+
+  /*! \brief Get the maximum number of threads; less than 1 means use the ideal thread count. */
+  int getThreadCount() const;
+
+  /*! \brief Set to skip a last line that has no new line, as left by a backup that stopped while writing a partial catalog. */
+  void setIgnoreIncompleteLastLine(const bool ignore);
+
+  /*! \brief True if a last line without a new line is skipped. */
+  bool isIgnoreIncompleteLastLine() const;
+
+  //**************************************************************************
+  /*! \brief Read a catalog.
+   *
+   *  \param [in] path Full path to the catalog file.
+   *  \param [in] indexes Indexes built while the entries are added.
+   *  \return New entries, or nullptr if the file cannot be read or a line is not valid.
+   ***************************************************************************/
+  DBFileEntries* read(const QString& path, const MatchPlan::Indexes indexes) const;
+
+  //**************************************************************************
+  /*! \brief Parse one catalog line of the form linkType,time,hash,size,path.
+   *
+   *  \param [in] begin First byte of the line after any leading white space.
+   *  \param [in] end One past the last byte of the line, excluding the new line.
+   *  \param [out] entry Entry set from the line.
+   *  \return True if the line has every field and the size is a number.
+   ***************************************************************************/
+  static bool parseLine(const char* begin, const char* end, DBFileEntry& entry);
+
+  //**************************************************************************
+  /*! \brief Decode a time stamp in the format yyyyMMddThh:mm:ss.zzz as a local time.
+   *
+   *  \param [in] text First character of the time stamp.
+   *  \param [in] length Number of bytes in the time stamp.
+   *  \param [out] dateTime Decoded time; invalid if the text is not a valid date and time.
+   ***************************************************************************/
+  static void parseTimestamp(const char* text, const int length, QDateTime& dateTime);
+
+private:
+  int m_threadCount;
+  bool m_ignoreIncompleteLastLine;
+};
+
+inline void CatalogParser::setThreadCount(const int threadCount)
+{
+  m_threadCount = threadCount;
+}
+
+inline int CatalogParser::getThreadCount() const
+{
+  return m_threadCount;
+}
+
+inline void CatalogParser::setIgnoreIncompleteLastLine(const bool ignore)
+{
+  m_ignoreIncompleteLastLine = ignore;
+}
+
+inline bool CatalogParser::isIgnoreIncompleteLastLine() const
+{
+  return m_ignoreIncompleteLastLine;
+}
+
+#endif // CATALOGPARSER_H
@@ -0,0 +1,247 @@
+#include "catalogsearchindex.h"
+#include "dbfileentries.h"
+#include "dbfileentry.h"
+
+#include <QStringView>
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
+// How often a long loop checks for a cancel request.
+static const int s_cancelCheckInterval = 65536;
+
+CatalogSearchIndex::CatalogSearchIndex() : m_entries(nullptr)
+{
+}
+
+bool CatalogSearchIndex::build(const DBFileEntries* entries, const std::atomic<bool>* cancelRequested)
+{
+  m_entries = entries;
+  m_names.clear();
+  m_nameStart.clear();
+  m_byName.clear();
+  m_byHash.clear();
+  const int numEntries = (entries != nullptr) ? entries->count() : 0;
+
+  QByteArray names;
+  QVector<qsizetype> nameStart(numEntries + 1);
+  for (int i=0; i<numEntries; ++i)
+  {
+    if (cancelRequested != nullptr && (i % s_cancelCheckInterval) == 0 && *cancelRequested)
+    {
+      return false;
+    }
+    const QString& path = entries->value(i)->getPath();
+    nameStart[i] = names.size();
+    names.append(path.mid(path.lastIndexOf('/') + 1).toCaseFolded().toUtf8());
+    names.append('/');
+  }
+  nameStart[numEntries] = names.size();
+
+  QVector<int> byName(numEntries);
+  std::iota(byName.begin(), byName.end(), 0);
+  const char* data = names.constData();
+  std::sort(byName.begin(), byName.end(), [data, &nameStart](const int a, const int b) {
+    const qsizetype lengthA = nameStart.at(a + 1) - nameStart.at(a) - 1;
+    const qsizetype lengthB = nameStart.at(b + 1) - nameStart.at(b) - 1;
+    const int result = memcmp(data + nameStart.at(a), data + nameStart.at(b), static_cast<size_t>(std::min(lengthA, lengthB)));
+    return (result != 0) ? (result < 0) : (lengthA < lengthB);
+  });
+  if (cancelRequested != nullptr && *cancelRequested)
+  {
+    return false;
+  }
+
+  QVector<int> byHash(numEntries);
+  std::iota(byHash.begin(), byHash.end(), 0);
+  std::sort(byHash.begin(), byHash.end(), [entries](const int a, const int b) {
+    return entries->value(a)->getHash() < entries->value(b)->getHash();
+  });
+  if (cancelRequested != nullptr && *cancelRequested)
+  {
+    return false;
+  }
+
+  m_names = names;
+  m_nameStart = nameStart;
+  m_byName = byName;
+  m_byHash = byHash;
+  return true;
+}
+
+bool CatalogSearchIndex::nameStartsWith(const int entry, const QByteArray& prefix) const
+{
+  return nameLength(entry) >= prefix.size() && memcmp(nameData(entry), prefix.constData(), static_cast<size_t>(prefix.size())) == 0;
+}
+
+QVector<int> CatalogSearchIndex::findName(const QString& glob, const int maxResults, bool* truncated) const
+{
+  QVector<int> results;
+  if (truncated != nullptr)
+  {
+    *truncated = false;
+  }
+  const QByteArray pattern = glob.toCaseFolded().toUtf8();
+  if (pattern.isEmpty() || pattern.contains('/') || maxResults < 1)
+  {
+    return results;
+  }
+
+  qsizetype prefixLength = 0;
+  while (prefixLength < pattern.size() && pattern.at(prefixLength) != '*' && pattern.at(prefixLength) != '?')
+  {
+    ++prefixLength;
+  }
+
+  if (prefixLength > 0)
+  {
+    // Every name that can match starts with the literal prefix, one run of the sorted names.
+    const QByteArray prefix = pattern.left(prefixLength);
+    auto it = std::lower_bound(m_byName.constBegin(), m_byName.constEnd(), prefix, [this](const int entry, const QByteArray& value) {
+      const qsizetype length = nameLength(entry);
+      const int result = memcmp(nameData(entry), value.constData(), static_cast<size_t>(std::min(length, value.size())));
+      return (result != 0) ? (result < 0) : (length < value.size());
+    });
+    for (; it != m_byName.constEnd() && nameStartsWith(*it, prefix); ++it)
+    {
+      if (matchGlob(pattern.constData(), pattern.size(), nameData(*it), nameLength(*it)))
+      {
+        if (results.count() >= maxResults)
+        {
+          if (truncated != nullptr)
+          {
+            *truncated = true;
+          }
+          break;
+        }
+        results.append(*it);
+      }
+    }
+    return results;
+  }
+
+  // Find the longest literal run, such as "2013" in "*2013*.jpg".
+  QByteArray literal;
+  for (qsizetype start=0; start<pattern.size(); )
+  {
+    qsizetype end = start;
+    while (end < pattern.size() && pattern.at(end) != '*' && pattern.at(end) != '?')
+    {
+      ++end;
+    }
+    if (end - start > literal.size())
+    {
+      literal = pattern.mid(start, end - start);
+    }
+    start = end + 1;
+  }
+
+  const char* data = m_names.constData();
+  const qsizetype size = m_names.size();
+  for (int entry=0; entry<count(); )
+  {
+    if (!literal.isEmpty())
+    {
+      // Skip to the next name that contains the literal run.
+      const qsizetype from = m_nameStart.at(entry);
+      const void* found = memmem(data + from, static_cast<size_t>(size - from), literal.constData(), static_cast<size_t>(literal.size()));
+      if (found == nullptr)
+      {
+        break;
+      }
+      const qsizetype offset = static_cast<const char*>(found) - data;
+      entry = static_cast<int>(std::upper_bound(m_nameStart.constBegin(), m_nameStart.constEnd(), offset) - m_nameStart.constBegin()) - 1;
+    }
+    if (matchGlob(pattern.constData(), pattern.size(), nameData(entry), nameLength(entry)))
+    {
+      if (results.count() >= maxResults)
+      {
+        if (truncated != nullptr)
+        {
+          *truncated = true;
+        }
+        break;
+      }
+      results.append(entry);
+    }
+    ++entry;
+  }
+  return results;
+}
+
+QVector<int> CatalogSearchIndex::findHash(const QString& prefix, const int maxResults, bool* truncated) const
+{
+  QVector<int> results;
+  if (truncated != nullptr)
+  {
+    *truncated = false;
+  }
+  const QString hashPrefix = prefix.trimmed().toUpper();
+  if (hashPrefix.isEmpty() || maxResults < 1)
+  {
+    return results;
+  }
+  auto it = std::lower_bound(m_byHash.constBegin(), m_byHash.constEnd(), hashPrefix, [this](const int entry, const QString& value) {
+    return m_entries->value(entry)->getHash() < value;
+  });
+  for (; it != m_byHash.constEnd() && m_entries->value(*it)->getHash().startsWith(hashPrefix); ++it)
+  {
+    if (results.count() >= maxResults)
+    {
+      if (truncated != nullptr)
+      {
+        *truncated = true;
+      }
+      break;
+    }
+    results.append(*it);
+  }
+  return results;
+}
+
+bool CatalogSearchIndex::matchGlob(const char* pattern, const qsizetype patternLength, const char* text, const qsizetype textLength)
+{
+  qsizetype p = 0;
+  qsizetype t = 0;
+  qsizetype starPattern = -1;
+  qsizetype starText = 0;
+  while (t < textLength)
+  {
+    if (p < patternLength && pattern[p] == '*')
+    {
+      starPattern = p++;
+      starText = t;
+    }
+    else if (p < patternLength && pattern[p] == '?')
+    {
+      // One character, which may be several UTF-8 bytes.
+      ++p;
+      ++t;
+      while (t < textLength && (static_cast<unsigned char>(text[t]) & 0xC0) == 0x80)
+      {
+        ++t;
+      }
+    }
+    else if (p < patternLength && pattern[p] == text[t])
+    {
+      ++p;
+      ++t;
+    }
+    else if (starPattern >= 0)
+    {
+      // Let the last '*' take one more byte and try again.
+      p = starPattern + 1;
+      t = ++starText;
+    }
+    else
+    {
+      return false;
+    }
+  }
+  while (p < patternLength && pattern[p] == '*')
+  {
+    ++p;
+  }
+  return p == patternLength;
+}
@@ -0,0 +1,109 @@
+#ifndef CATALOGSEARCHINDEX_H
+#define CATALOGSEARCHINDEX_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+#include <atomic>
+
+class DBFileEntries;
+
+//**************************************************************************
+/*! \class CatalogSearchIndex
+ *  \brief Find catalog entries by a glob on the file name or by a hash prefix.
+ *
+ * The index is built once, usually on a worker thread, and is then read only. The case-folded
+ * file names are stored as UTF-8 in one block, each name followed by a '/', with the entries
+ * sorted by name and again by hash. A glob with a literal prefix, such as "report*.pdf", and a
+ * hash prefix are found with a binary search. A glob that starts with a wildcard, such as
+ * "*2013*", scans the block of names for its longest literal run, so only the names that contain
+ * that run are matched against the glob.
+ *
+ * A glob supports '*' for any number of characters and '?' for one character, ignoring case.
+ *
+ * \author Andrew Pitonyak
+ * \copyright Andrew Pitonyak, but you may use without restriction.
+ * \date 2026
+ **************************************************************************/
+class CatalogSearchIndex
+{
+public:
+  CatalogSearchIndex();
+
+  //**************************************************************************
+  /*! \brief Index the entries; the entries must not change or be deleted while the index is used.
+   *
+   *  \param [in] entries Catalog to index.
+   *  \param [in] cancelRequested Stop early when this becomes true; may be nullptr.
+   *  \return True if the index was built, false if it was cancelled.
+   ***************************************************************************/
+  bool build(const DBFileEntries* entries, const std::atomic<bool>* cancelRequested = nullptr);
+
+  //**************************************************************************
+  /*! \brief Find entries whose file name matches a glob.
+   *
+   *  \param [in] glob Pattern such as "*.jpg"; it is matched against the name without the directory.
+   *  \param [in] maxResults Stop after this many matches.
+   *  \param [out] truncated Set to true if there may be more matches than were returned; may be nullptr.
+   *  \return Indexes into the catalog of the matching entries.
+   ***************************************************************************/
+  QVector<int> findName(const QString& glob, const int maxResults, bool* truncated = nullptr) const;
+
+  //**************************************************************************
+  /*! \brief Find entries whose hash starts with a prefix, ignoring case.
+   *
+   *  \param [in] prefix Leading hex digits of the hash.
+   *  \param [in] maxResults Stop after this many matches.
+   *  \param [out] truncated Set to true if there may be more matches than were returned; may be nullptr.
+   *  \return Indexes into the catalog of the matching entries, sorted by hash.
+   ***************************************************************************/
+  QVector<int> findHash(const QString& prefix, const int maxResults, bool* truncated = nullptr) const;
+
+  /*! \brief Number of entries indexed. */
+  int count() const;
+
+  //**************************************************************************
+  /*! \brief Match UTF-8 text against a glob with '*' and '?'.
+   *
+   *  \param [in] pattern Glob, already case folded.
+   *  \param [in] patternLength Bytes in the pattern.
+   *  \param [in] text Text, already case folded.
+   *  \param [in] textLength Bytes in the text.
+   *  \return True if the whole text matches the pattern.
+   ***************************************************************************/
+  static bool matchGlob(const char* pattern, const qsizetype patternLength, const char* text, const qsizetype textLength);
+
+private:
+  const char* nameData(const int entry) const;
+  qsizetype nameLength(const int entry) const;
+  bool nameStartsWith(const int entry, const QByteArray& prefix) const;
+
+  const DBFileEntries* m_entries;
+
+  /*! \brief Case-folded UTF-8 file names, each followed by a '/'. */
+  QByteArray m_names;
+  /*! \brief Offset in m_names of each entry's name, with one extra offset at the end. */
+  QVector<qsizetype> m_nameStart;
+  /*! \brief Entry indexes sorted by case-folded name. */
+  QVector<int> m_byName;
+  /*! \brief Entry indexes sorted by hash. */
+  QVector<int> m_byHash;
+};
+
+inline int CatalogSearchIndex::count() const
+{
+  return m_byName.count();
+}
+
+inline const char* CatalogSearchIndex::nameData(const int entry) const
+{
+  return m_names.constData() + m_nameStart.at(entry);
+}
+
+inline qsizetype CatalogSearchIndex::nameLength(const int entry) const
+{
+  return m_nameStart.at(entry + 1) - m_nameStart.at(entry) - 1;
+}
+
+#endif // CATALOGSEARCHINDEX_H
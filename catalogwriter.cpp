@@ -0,0 +1,230 @@
+#include "catalogwriter.h"
+#include "backupjournal.h"
+#include "linkbackupglobals.h"
+
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include <QTextStream>
+
+#include <cstdio>
+#include <unistd.h>
+
+// Entries waiting for the writer; append() blocks when this many are queued.
+static const int s_maxQueued = 100000;
+
+// A checkpoint is taken after this many entries or this much time, whichever comes first.
+static const qint64 s_checkpointEntries = 10000;
+static const qint64 s_checkpointMillis = 10000;
+
+CatalogWriter::CatalogWriter(QObject *parent) : QThread(parent), m_journal(nullptr), m_closing(false), m_failed(false), m_numWritten(0), m_numCheckpoints(0)
+{
+  setObjectName("CatalogWriter");
+}
+
+CatalogWriter::~CatalogWriter()
+{
+  if (isOpen())
+  {
+    close();
+  }
+}
+
+QString CatalogWriter::partialPath(const QString& path)
+{
+  return path + ".partial";
+}
+
+bool CatalogWriter::isPartialPath(const QString& path)
+{
+  return path.endsWith(".partial", Qt::CaseInsensitive);
+}
+
+bool CatalogWriter::open(const QString& path)
+{
+  if (isOpen())
+  {
+    ERROR_MSG(QString(tr("Catalog (%1) is already open for writing")).arg(m_path), 1);
+    return false;
+  }
+  m_path = path;
+  m_file.setFileName(partialPath(path));
+  if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+  {
+    ERROR_MSG(QString(tr("Failed to open file (%1) to write the DB File Entries")).arg(m_file.fileName()), 1);
+    return false;
+  }
+  m_queue.clear();
+  m_completedDirs.clear();
+  m_closing = false;
+  m_failed = false;
+  m_numWritten = 0;
+  m_numCheckpoints = 0;
+  start();
+  return true;
+}
+
+void CatalogWriter::append(const DBFileEntry& entry)
+{
+  if (!isOpen())
+  {
+    return;
+  }
+  QMutexLocker locker(&m_mutex);
+  while (m_queue.count() >= s_maxQueued && !m_failed)
+  {
+    m_notFull.wait(&m_mutex);
+  }
+  QueuedEntry queued;
+  queued.entry = entry;
+  m_queue.append(queued);
+  m_notEmpty.wakeOne();
+}
+
+void CatalogWriter::directoryCompleted(const QString& dir)
+{
+  if (!isOpen())
+  {
+    return;
+  }
+  QMutexLocker locker(&m_mutex);
+  QueuedEntry queued;
+  queued.completedDir = dir;
+  m_queue.append(queued);
+  m_notEmpty.wakeOne();
+}
+
+bool CatalogWriter::close(const bool finish)
+{
+  if (!isOpen())
+  {
+    return false;
+  }
+  {
+    QMutexLocker locker(&m_mutex);
+    m_closing = true;
+    m_notEmpty.wakeOne();
+  }
+  wait();
+
+  bool rc = !m_failed && checkpoint();
+  m_file.close();
+  if (!rc)
+  {
+    ERROR_MSG(QString(tr("Failed to write the DB File Entries to %1, the partial catalog is left in place")).arg(m_file.fileName()), 1);
+    return false;
+  }
+  if (!finish)
+  {
+    TRACE_MSG(QString(tr("Left %1 DB File Entries in %2")).arg(m_numWritten).arg(m_file.fileName()), 1);
+    return true;
+  }
+  // rename() replaces the final name atomically, so readers see the old catalog or the complete new one.
+  if (::rename(QFile::encodeName(m_file.fileName()).constData(), QFile::encodeName(m_path).constData()) != 0)
+  {
+    ERROR_MSG(QString(tr("Failed to rename %1 to %2")).arg(m_file.fileName(), m_path), 1);
+    return false;
+  }
+  TRACE_MSG(QString(tr("Wrote %1 DB File Entries to %2 with %3 checkpoints")).arg(m_numWritten).arg(m_path).arg(m_numCheckpoints), 1);
+  return true;
+}
+
+bool CatalogWriter::checkpoint()
+{
+  if (!m_file.flush())
+  {
+    return false;
+  }
+  ++m_numCheckpoints;
+  if (::fdatasync(m_file.handle()) != 0)
+  {
+    return false;
+  }
+  // The entries for these directories are now on disk.
+  if (m_journal != nullptr && !m_completedDirs.isEmpty() && !m_journal->writeCompleted(m_completedDirs))
+  {
+    return false;
+  }
+  m_completedDirs.clear();
+  return true;
+}
+
+void CatalogWriter::run()
+{
+  QTextStream writer(&m_file);
+  QList<QueuedEntry> batch;
+  qint64 sinceCheckpoint = 0;
+  QElapsedTimer checkpointTimer;
+  checkpointTimer.start();
+
+  for (;;)
+  {
+    {
+      QMutexLocker locker(&m_mutex);
+      while (m_queue.isEmpty() && !m_closing)
+      {
+        // Wake up now and then so that a slow backup still takes checkpoints.
+        m_notEmpty.wait(&m_mutex, static_cast<unsigned long>(s_checkpointMillis));
+        if (m_queue.isEmpty() && sinceCheckpoint > 0 && checkpointTimer.elapsed() >= s_checkpointMillis)
+        {
+          break;
+        }
+      }
+      if (m_queue.isEmpty() && m_closing)
+      {
+        break;
+      }
+      batch.swap(m_queue);
+      m_notFull.wakeAll();
+    }
+
+    if (!batch.isEmpty() && !m_failed)
+    {
+      PerfScope scope(PerfTrace::CatalogWrite);
+      qint64 numWritten = 0;
+      for (QueuedEntry& queued : batch)
+      {
+        if (!queued.completedDir.isEmpty())
+        {
+          m_completedDirs.append(queued.completedDir);
+        }
+        else if (!queued.entry.writeLine(writer))
+        {
+          ERROR_MSG(QString(tr("Failed to write a DB File Entry")), 1);
+          m_failed = true;
+          break;
+        }
+        else
+        {
+          ++numWritten;
+        }
+      }
+      m_numWritten += numWritten;
+      sinceCheckpoint += numWritten;
+    }
+    batch.clear();
+
+    if (!m_failed && sinceCheckpoint > 0 && (sinceCheckpoint >= s_checkpointEntries || checkpointTimer.elapsed() >= s_checkpointMillis))
+    {
+      writer.flush();
+      if (!checkpoint())
+      {
+        ERROR_MSG(QString(tr("Failed to checkpoint the catalog %1")).arg(m_file.fileName()), 1);
+        m_failed = true;
+      }
+      else
+      {
+        TRACE_MSG(QString(tr("Catalog checkpoint with %1 DB File Entries")).arg(m_numWritten), 2);
+      }
+      sinceCheckpoint = 0;
+      checkpointTimer.restart();
+    }
+
+    if (m_failed)
+    {
+      // Let a blocked append() continue; the entries are dropped and close() reports the failure.
+      QMutexLocker locker(&m_mutex);
+      m_notFull.wakeAll();
+    }
+  }
+  writer.flush();
+}
@@ -0,0 +1,159 @@
+#ifndef CATALOGWRITER_H
+#define CATALOGWRITER_H
+
+#include "dbfileentry.h"
+
+#include <QFile>
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+#include <QThread>
+#include <QWaitCondition>
+
+#include <atomic>
+
+class BackupJournal;
+
+//**************************************************************************
+/*! \class CatalogWriter
+ *  \brief Write the catalog for a running backup on a background thread as entries are produced.
+ *
+ * Entries are appended to a bounded queue and written by the writer thread to
+ * "<catalog>.txt.partial". At a checkpoint, every few thousand entries or every few seconds,
+ * the file is flushed and synced to disk, so after a crash the partial catalog holds at least
+ * every entry up to the last checkpoint and the next backup can link against it.
+ * close() writes the rest, syncs, and renames the partial file to the catalog name, so a
+ * complete catalog is never seen half written.
+ *
+ * Directories reported with directoryCompleted() are queued behind their entries and written
+ * to the BackupJournal only after a checkpoint syncs those entries.
+ *
+ * \author Andrew Pitonyak
+ * \copyright Andrew Pitonyak, but you may use without restriction.
+ * \date 2026
+ **************************************************************************/
+class CatalogWriter : public QThread
+{
+public:
+  /*! \brief Constructor, nothing is written until open() is called. */
+  explicit CatalogWriter(QObject *parent = nullptr);
+
+  /*! \brief Destructor, closes the catalog if it is still open. */
+  virtual ~CatalogWriter();
+
+  //**************************************************************************
+  /*! \brief Create the partial catalog and start the writer thread.
+   *
+   *  \param [in] path Full path to the final catalog, such as "<backup>/sha1.txt".
+   *  \return True if the partial catalog was created.
+   ***************************************************************************/
+  bool open(const QString& path);
+
+  //**************************************************************************
+  /*! \brief Queue an entry to be written; blocks if the writer has fallen far behind.
+   *
+   *  \param [in] entry Entry to write; a copy is queued.
+   ***************************************************************************/
+  void append(const DBFileEntry& entry);
+
+  //**************************************************************************
+  /*! \brief Queue a directory whose entries have all been appended; it is journaled at the next checkpoint.
+   *
+   *  \param [in] dir Directory relative to the snapshot.
+   ***************************************************************************/
+  void directoryCompleted(const QString& dir);
+
+  //**************************************************************************
+  /*! \brief Write the remaining entries and sync; the partial catalog is renamed to the final name when finishing.
+   *
+   *  \param [in] finish True to rename the catalog; False to leave the partial catalog so the backup can be resumed.
+   *  \return True if every entry was written and, when finishing, the catalog was renamed.
+   ***************************************************************************/
+  bool close(const bool finish = true);
+
+  /*! \brief Set the journal that records completed directories; not owned, may be nullptr. */
+  void setJournal(BackupJournal* journal);
+
+  /*! \brief Returns True between open() and close(). */
+  bool isOpen() const;
+
+  /*! \brief Number of entries written to the file so far. */
+  qint64 getNumWritten() const;
+
+  /*! \brief Number of checkpoints taken so far. */
+  qint64 getNumCheckpoints() const;
+
+  /*! \brief Path of the partial catalog written while a backup runs. */
+  static QString partialPath(const QString& path);
+
+  /*! \brief True if the path names a partial catalog. */
+  static bool isPartialPath(const QString& path);
+
+protected:
+  //**************************************************************************
+  /*! \brief Write queued entries until close() is called. */
+  //**************************************************************************
+  virtual void run();
+
+private:
+  /*! \brief Flush and sync the file; called on the writer thread. */
+  bool checkpoint();
+
+  /*! \brief Full path to the final catalog. */
+  QString m_path;
+
+  /*! \brief Partial catalog, only used by the writer thread while it runs. */
+  QFile m_file;
+
+  /*! \brief Protects the queue and the closing flag. */
+  QMutex m_mutex;
+  QWaitCondition m_notEmpty;
+  QWaitCondition m_notFull;
+
+  /*! \brief An entry to write, or a completed directory if completedDir is not empty. */
+  struct QueuedEntry
+  {
+    DBFileEntry entry;
+    QString completedDir;
+  };
+
+  /*! \brief Entries waiting to be written. */
+  QList<QueuedEntry> m_queue;
+
+  /*! \brief Completed directories written to the file but not yet journaled. */
+  QStringList m_completedDirs;
+
+  BackupJournal* m_journal;
+
+  /*! \brief Set by close() so the writer thread stops once the queue is empty. */
+  bool m_closing;
+
+  /*! \brief Set by the writer thread if a write failed. */
+  std::atomic<bool> m_failed;
+
+  std::atomic<qint64> m_numWritten;
+  std::atomic<qint64> m_numCheckpoints;
+};
+
+inline qint64 CatalogWriter::getNumWritten() const
+{
+  return m_numWritten;
+}
+
+inline qint64 CatalogWriter::getNumCheckpoints() const
+{
+  return m_numCheckpoints;
+}
+
+inline void CatalogWriter::setJournal(BackupJournal* journal)
+{
+  m_journal = journal;
+}
+
+inline bool CatalogWriter::isOpen() const
+{
+  return m_file.isOpen();
+}
+
+#endif // CATALOGWRITER_H
@@ -0,0 +1,278 @@
+#include "changejournal.h"
+#include "linkbackupglobals.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QFile>
+
+#include <cerrno>
+#include <cstdio>
+#include <sys/file.h>
+#include <unistd.h>
+
+static const char* s_header = "LinkBackupChanges=1";
+
+ChangeJournal::ChangeJournal() : m_file(nullptr), m_started(0), m_lastOverflow(-1), m_watcherRunning(false), m_numLines(0)
+{
+}
+
+ChangeJournal::~ChangeJournal()
+{
+  close();
+}
+
+QString ChangeJournal::journalPath(const QString& toPath, const QString& fromPath)
+{
+  // Backup sets with different sources may share a backup directory.
+  const QByteArray id = QCryptographicHash::hash(fromPath.toUtf8(), QCryptographicHash::Sha1).toHex().left(12);
+  return toPath + "/.linkbackup-changes-" + QString::fromLatin1(id);
+}
+
+QByteArray ChangeJournal::header() const
+{
+  QByteArray text(s_header);
+  text.append('\n');
+  text.append("From=").append(m_fromPath.toUtf8()).append('\n');
+  text.append("Started=").append(QByteArray::number(m_started)).append('\n');
+  return text;
+}
+
+bool ChangeJournal::create(const QString& path, const QString& fromPath)
+{
+  close();
+  m_fromPath = fromPath;
+  m_started = QDateTime::currentMSecsSinceEpoch();
+  m_lastOverflow = -1;
+  m_dirty.clear();
+  m_pending.clear();
+
+  m_file = new QFile(path);
+  // Opened without truncating so a running watcher's journal is not cleared before the lock is tested.
+  if (!m_file->open(QIODevice::ReadWrite))
+  {
+    ERROR_MSG(QString(QObject::tr("Failed to create the change journal %1")).arg(path), 1);
+    close();
+    return false;
+  }
+  if (::flock(m_file->handle(), LOCK_EX | LOCK_NB) != 0)
+  {
+    ERROR_MSG(QString(QObject::tr("The change journal %1 is used by another watcher")).arg(path), 1);
+    close();
+    return false;
+  }
+  const QByteArray text = header();
+  if (!m_file->resize(0) || m_file->write(text) != text.size() || !m_file->flush() || ::fdatasync(m_file->handle()) != 0)
+  {
+    ERROR_MSG(QString(QObject::tr("Failed to write the change journal %1")).arg(path), 1);
+    close();
+    return false;
+  }
+  m_numLines = 3;
+  return true;
+}
+
+void ChangeJournal::markDirty(const QString& relativeDir)
+{
+  const qint64 now = QDateTime::currentMSecsSinceEpoch();
+  auto it = m_dirty.find(relativeDir);
+  if (it != m_dirty.end())
+  {
+    if (now - it.value() < DedupSeconds * 1000)
+    {
+      return;
+    }
+    it.value() = now;
+  }
+  else
+  {
+    m_dirty.insert(relativeDir, now);
+  }
+  m_pending.append("Dirty=").append(QByteArray::number(now)).append(',').append(relativeDir.toUtf8()).append('\n');
+  ++m_numLines;
+}
+
+void ChangeJournal::markOverflow()
+{
+  m_lastOverflow = QDateTime::currentMSecsSinceEpoch();
+  m_pending.append("Overflow=").append(QByteArray::number(m_lastOverflow)).append('\n');
+  ++m_numLines;
+}
+
+bool ChangeJournal::flush(const bool sync)
+{
+  if (m_file == nullptr)
+  {
+    return false;
+  }
+  if (!m_pending.isEmpty())
+  {
+    // Written at once so a backup reading the journal sees every change the watcher has handled.
+    if (m_file->write(m_pending) != m_pending.size() || !m_file->flush())
+    {
+      ERROR_MSG(QString(QObject::tr("Failed to write the change journal %1")).arg(m_file->fileName()), 1);
+      return false;
+    }
+    m_pending.clear();
+  }
+  return !sync || ::fdatasync(m_file->handle()) == 0;
+}
+
+bool ChangeJournal::compact()
+{
+  if (m_file == nullptr || !flush(false))
+  {
+    return false;
+  }
+  const QString path = m_file->fileName();
+  QFile* file = new QFile(path + ".tmp");
+  QByteArray text = header();
+  for (auto it = m_dirty.constBegin(); it != m_dirty.constEnd(); ++it)
+  {
+    text.append("Dirty=").append(QByteArray::number(it.value())).append(',').append(it.key().toUtf8()).append('\n');
+  }
+  if (m_lastOverflow >= 0)
+  {
+    text.append("Overflow=").append(QByteArray::number(m_lastOverflow)).append('\n');
+  }
+  // The new file is locked before it replaces the old one, so a backup never sees an unlocked journal.
+  if (!file->open(QIODevice::WriteOnly | QIODevice::Truncate) || ::flock(file->handle(), LOCK_EX | LOCK_NB) != 0 ||
+      file->write(text) != text.size() || !file->flush() || ::fdatasync(file->handle()) != 0 ||
+      ::rename(QFile::encodeName(file->fileName()).constData(), QFile::encodeName(path).constData()) != 0)
+  {
+    ERROR_MSG(QString(QObject::tr("Failed to compact the change journal %1")).arg(path), 1);
+    file->remove();
+    delete file;
+    return false;
+  }
+  // QFile keeps the temporary name, so the renamed file is reopened by its descriptor.
+  const int handle = ::dup(file->handle());
+  delete file;
+  delete m_file;
+  m_file = new QFile(path);
+  if (handle < 0 || !m_file->open(handle, QIODevice::WriteOnly | QIODevice::Append, QFileDevice::AutoCloseHandle))
+  {
+    ERROR_MSG(QString(QObject::tr("Failed to reopen the change journal %1")).arg(path), 1);
+    if (handle >= 0)
+    {
+      ::close(handle);
+    }
+    close();
+    return false;
+  }
+  m_numLines = 3 + m_dirty.count() + (m_lastOverflow >= 0 ? 1 : 0);
+  return true;
+}
+
+void ChangeJournal::close()
+{
+  if (m_file != nullptr)
+  {
+    if (m_file->isOpen())
+    {
+      flush(true);
+      m_file->close();
+    }
+    delete m_file;
+    m_file = nullptr;
+  }
+}
+
+bool ChangeJournal::read(const QString& path)
+{
+  close();
+  m_fromPath.clear();
+  m_started = 0;
+  m_lastOverflow = -1;
+  m_watcherRunning = false;
+  m_dirty.clear();
+  m_dirtySince.clear();
+  m_dirtyAncestors.clear();
+
+  QFile file(path);
+  if (!file.open(QIODevice::ReadOnly))
+  {
+    return false;
+  }
+  // The watcher holds an exclusive lock while it runs.
+  if (::flock(file.handle(), LOCK_SH | LOCK_NB) == 0)
+  {
+    ::flock(file.handle(), LOCK_UN);
+  }
+  else
+  {
+    m_watcherRunning = (errno == EWOULDBLOCK);
+  }
+
+  bool validHeader = false;
+  while (!file.atEnd())
+  {
+    // A line without a new line is still being written.
+    QByteArray line = file.readLine();
+    if (!line.endsWith('\n'))
+    {
+      break;
+    }
+    line.chop(1);
+    if (!validHeader)
+    {
+      validHeader = (line == s_header);
+      if (!validHeader)
+      {
+        WARN_MSG(QString(QObject::tr("Unknown change journal format in %1")).arg(path), 1);
+        return false;
+      }
+    }
+    else if (line.startsWith("Dirty="))
+    {
+      const int comma = line.indexOf(',', 6);
+      if (comma > 0)
+      {
+        const qint64 time = line.mid(6, comma - 6).toLongLong();
+        qint64& latest = m_dirty[QString::fromUtf8(line.mid(comma + 1))];
+        latest = qMax(latest, time);
+      }
+    }
+    else if (line.startsWith("Overflow="))
+    {
+      m_lastOverflow = qMax(m_lastOverflow, line.mid(9).toLongLong());
+    }
+    else if (line.startsWith("From="))
+    {
+      m_fromPath = QString::fromUtf8(line.mid(5));
+    }
+    else if (line.startsWith("Started="))
+    {
+      m_started = line.mid(8).toLongLong();
+    }
+  }
+  return validHeader && m_started > 0;
+}
+
+bool ChangeJournal::useSince(const qint64 sinceMSecs)
+{
+  m_dirtySince.clear();
+  m_dirtyAncestors.clear();
+  if (!m_watcherRunning || m_started > sinceMSecs || m_lastOverflow >= sinceMSecs)
+  {
+    return false;
+  }
+  for (auto it = m_dirty.constBegin(); it != m_dirty.constEnd(); ++it)
+  {
+    if (it.value() < sinceMSecs)
+    {
+      continue;
+    }
+    const QString& dir = it.key();
+    m_dirtySince.insert(dir);
+    for (int slash = dir.lastIndexOf('/'); slash > 0; slash = dir.lastIndexOf('/', slash - 1))
+    {
+      const QString parent = dir.left(slash);
+      if (m_dirtyAncestors.contains(parent))
+      {
+        break;
+      }
+      m_dirtyAncestors.insert(parent);
+    }
+  }
+  return true;
+}
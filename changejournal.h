@@ -0,0 +1,158 @@
+#ifndef CHANGEJOURNAL_H
+#define CHANGEJOURNAL_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QSet>
+#include <QString>
+
+class QFile;
+
+//**************************************************************************
+/*! \class ChangeJournal
+ *  \brief Directories changed in a backup source, written by a ChangeWatcher and read by a backup.
+ *
+ * The journal sits in the backup "to" directory and holds one "key=value" per line:
+ * \code
+ * LinkBackupChanges=1
+ * From=/home/andy/Documents
+ * Started=1767225600000
+ * Dirty=1767229200000,Documents/letters
+ * Overflow=1767232800000
+ * \endcode
+ *
+ * Times are milliseconds since the epoch. "Started" is when every directory in the source was
+ * being watched. A "Dirty" line names a directory, relative to the parent of the source, whose
+ * entries changed at that time. An "Overflow" line means that changes may have been lost.
+ *
+ * The watcher holds an exclusive lock on the journal for as long as it runs. A backup trusts the
+ * journal only if the watcher still holds the lock, the watcher started before the previous
+ * backup, and nothing overflowed since. A directory is then clean if neither it nor any directory
+ * below it changed since the previous backup, so its files can be linked from the previous
+ * catalog without reading the source.
+ *
+ * A directory is written at most once every DedupSeconds, so a backup looks back
+ * SinceMarginSeconds before the start of the previous backup.
+ *
+ * \author Andrew Pitonyak
+ * \copyright Andrew Pitonyak, but you may use without restriction.
+ * \date 2026
+ **************************************************************************/
+class ChangeJournal
+{
+public:
+  enum {DedupSeconds = 10, SinceMarginSeconds = 60};
+
+  /*! \brief Constructor, the journal is not open. */
+  ChangeJournal();
+
+  /*! \brief Destructor, closes the journal and releases the lock. */
+  ~ChangeJournal();
+
+  /*! \brief Get the journal path for a source in a backup directory. */
+  static QString journalPath(const QString& toPath, const QString& fromPath);
+
+  //**************************************************************************
+  /*! \brief Create an empty journal and lock it; used by the watcher.
+   *
+   *  \param [in] path Full path to the journal.
+   *  \param [in] fromPath Canonical path of the directory being watched.
+   *  \return True if the journal was written and locked; false if another watcher holds it.
+   ***************************************************************************/
+  bool create(const QString& path, const QString& fromPath);
+
+  /*! \brief Record that a directory changed now. */
+  void markDirty(const QString& relativeDir);
+
+  /*! \brief Record that changes may have been lost now. */
+  void markOverflow();
+
+  //**************************************************************************
+  /*! \brief Write the lines recorded since the last flush.
+   *
+   *  \param [in] sync If true, also sync the journal to the disk.
+   *  \return True if the lines were written.
+   ***************************************************************************/
+  bool flush(const bool sync);
+
+  /*! \brief Rewrite the journal with one line for each directory; the lock is kept. */
+  bool compact();
+
+  /*! \brief Number of lines in the journal file. */
+  int numLines() const;
+
+  void close();
+
+  //**************************************************************************
+  /*! \brief Read a journal; used by a backup.
+   *
+   *  \param [in] path Full path to the journal.
+   *  \return True if the journal exists and has a valid header.
+   ***************************************************************************/
+  bool read(const QString& path);
+
+  /*! \brief True if a watcher held the lock when the journal was read. */
+  bool isWatcherRunning() const;
+
+  const QString& getFromPath() const;
+
+  //**************************************************************************
+  /*! \brief Select the changes since a time, if the journal covers that time.
+   *
+   *  \param [in] sinceMSecs Start of the previous backup, less SinceMarginSeconds.
+   *  \return True if the watcher was running since that time and nothing was lost.
+   ***************************************************************************/
+  bool useSince(const qint64 sinceMSecs);
+
+  /*! \brief True if no directory at or below this one changed since the time given to useSince(). */
+  bool isCleanSubtree(const QString& relativeDir) const;
+
+  /*! \brief Number of directories changed since the time given to useSince(). */
+  int numDirty() const;
+
+private:
+  QByteArray header() const;
+
+  QFile* m_file;
+  QString m_fromPath;
+  qint64 m_started;
+  qint64 m_lastOverflow;
+  bool m_watcherRunning;
+  int m_numLines;
+
+  /*! \brief Latest change time for each directory. */
+  QHash<QString, qint64> m_dirty;
+  /*! \brief Lines not yet written. */
+  QByteArray m_pending;
+
+  QSet<QString> m_dirtySince;
+  /*! \brief Parents of every directory in m_dirtySince. */
+  QSet<QString> m_dirtyAncestors;
+};
+
+inline int ChangeJournal::numLines() const
+{
+  return m_numLines;
+}
+
+inline bool ChangeJournal::isWatcherRunning() const
+{
+  return m_watcherRunning;
+}
+
+inline const QString& ChangeJournal::getFromPath() const
+{
+  return m_fromPath;
+}
+
+inline bool ChangeJournal::isCleanSubtree(const QString& relativeDir) const
+{
+  return !m_dirtySince.contains(relativeDir) && !m_dirtyAncestors.contains(relativeDir);
+}
+
+inline int ChangeJournal::numDirty() const
+{
+  return m_dirtySince.count();
+}
+
+#endif // CHANGEJOURNAL_H
@@ -0,0 +1,239 @@
+#include "changewatcher.h"
+#include "linkbackupglobals.h"
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QStringList>
+
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const uint32_t s_watchMask = IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVED_FROM | IN_MOVED_TO |
+                                    IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK;
+// The journal is synced, and compacted when it grows, this often.
+static const qint64 s_syncMillis = 5000;
+static const int s_compactLines = 100000;
+
+ChangeWatcher::ChangeWatcher() : m_fd(-1), m_incomplete(false), m_stopRequested(false)
+{
+}
+
+ChangeWatcher::~ChangeWatcher()
+{
+  m_journal.close();
+  if (m_fd >= 0)
+  {
+    ::close(m_fd);
+  }
+}
+
+bool ChangeWatcher::start(const QString& fromPath, const QString& toPath)
+{
+  QDir fromDir(fromPath);
+  const QString canonicalPath = fromDir.canonicalPath();
+  m_topDir = fromDir.dirName();
+  if (canonicalPath.isEmpty() || m_topDir.isEmpty())
+  {
+    ERROR_MSG(QString(QObject::tr("Directory %1 does not exist")).arg(fromPath), 1);
+    return false;
+  }
+  // The same relative paths as the backup catalog.
+  m_fromParent = canonicalPath.left(canonicalPath.length() - m_topDir.length());
+
+  m_fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+  if (m_fd < 0)
+  {
+    ERROR_MSG(QString(QObject::tr("Unable to start inotify: %1")).arg(QString::fromLocal8Bit(strerror(errno))), 1);
+    return false;
+  }
+  addWatches(m_topDir, false);
+  if (m_incomplete)
+  {
+    ERROR_MSG(QString(QObject::tr("Unable to watch every directory in %1; raise fs.inotify.max_user_watches")).arg(canonicalPath), 1);
+    return false;
+  }
+  // Started once every directory is watched; changes made while the watches were added are still queued.
+  if (!m_journal.create(ChangeJournal::journalPath(toPath, canonicalPath), canonicalPath))
+  {
+    return false;
+  }
+  INFO_MSG(QString(QObject::tr("Watching %1 directories in %2")).arg(m_wdPaths.count()).arg(canonicalPath), 1);
+  return true;
+}
+
+void ChangeWatcher::addWatches(const QString& relativeDir, const bool isNew)
+{
+  QStringList pending(relativeDir);
+  while (!pending.isEmpty())
+  {
+    const QString dir = pending.takeLast();
+    const QByteArray path = QFile::encodeName(m_fromParent + dir);
+    const int wd = inotify_add_watch(m_fd, path.constData(), s_watchMask);
+    if (wd < 0)
+    {
+      // A directory removed before it was watched needs no watch.
+      if (errno == ENOSPC || errno == ENOMEM)
+      {
+        if (!m_incomplete)
+        {
+          ERROR_MSG(QString(QObject::tr("Unable to watch %1: %2")).arg(QString::fromLocal8Bit(path), QString::fromLocal8Bit(strerror(errno))), 1);
+        }
+        m_incomplete = true;
+        m_journal.markOverflow();
+      }
+      continue;
+    }
+    m_wdPaths.insert(wd, dir);
+    if (isNew)
+    {
+      m_journal.markDirty(dir);
+    }
+
+    DIR* dirp = opendir(path.constData());
+    if (dirp == nullptr)
+    {
+      continue;
+    }
+    while (struct dirent* entry = readdir(dirp))
+    {
+      if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+      {
+        continue;
+      }
+      bool isDir = (entry->d_type == DT_DIR);
+      if (entry->d_type == DT_UNKNOWN)
+      {
+        // Symbolic links are not followed, the same as the backup.
+        struct stat st;
+        isDir = fstatat(dirfd(dirp), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode);
+      }
+      if (isDir)
+      {
+        pending.append(dir + "/" + QFile::decodeName(entry->d_name));
+      }
+    }
+    closedir(dirp);
+  }
+}
+
+void ChangeWatcher::removeWatches(const QString& relativeDir)
+{
+  const QString prefix = relativeDir + "/";
+  for (auto it = m_wdPaths.begin(); it != m_wdPaths.end(); )
+  {
+    if (it.value() == relativeDir || it.value().startsWith(prefix))
+    {
+      inotify_rm_watch(m_fd, it.key());
+      it = m_wdPaths.erase(it);
+    }
+    else
+    {
+      ++it;
+    }
+  }
+}
+
+void ChangeWatcher::handleEvents(const char* buffer, const qint64 length)
+{
+  for (const char* p = buffer; p < buffer + length; )
+  {
+    const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(p);
+    p += sizeof(struct inotify_event) + event->len;
+
+    if (event->mask & IN_Q_OVERFLOW)
+    {
+      WARN_MSG(QObject::tr("The inotify queue overflowed; the next backup reads every directory"), 1);
+      m_journal.markOverflow();
+      continue;
+    }
+    const auto it = m_wdPaths.constFind(event->wd);
+    if (it == m_wdPaths.constEnd())
+    {
+      continue;
+    }
+    const QString dir = it.value();
+    if (event->mask & IN_IGNORED)
+    {
+      m_wdPaths.remove(event->wd);
+      continue;
+    }
+    if ((event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) && dir == m_topDir)
+    {
+      WARN_MSG(QObject::tr("The watched directory was moved or removed"), 1);
+      m_journal.markOverflow();
+      continue;
+    }
+    m_journal.markDirty(dir);
+
+    if ((event->mask & IN_ISDIR) && event->len > 0)
+    {
+      const QString child = dir + "/" + QFile::decodeName(event->name);
+      if (event->mask & IN_MOVED_FROM)
+      {
+        removeWatches(child);
+      }
+      else if (event->mask & (IN_CREATE | IN_MOVED_TO))
+      {
+        addWatches(child, true);
+      }
+    }
+  }
+}
+
+void ChangeWatcher::run()
+{
+  // Large enough for many events; each event is aligned for struct inotify_event.
+  alignas(struct inotify_event) char buffer[64 * 1024];
+  QElapsedTimer syncTimer;
+  syncTimer.start();
+  m_stopRequested = false;
+  while (!m_stopRequested)
+  {
+    struct pollfd pfd;
+    pfd.fd = m_fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    const int ready = poll(&pfd, 1, 1000);
+    if (ready < 0 && errno != EINTR)
+    {
+      ERROR_MSG(QString(QObject::tr("Failed to wait for changes: %1")).arg(QString::fromLocal8Bit(strerror(errno))), 1);
+      m_journal.markOverflow();
+      break;
+    }
+    if (ready > 0)
+    {
+      for (;;)
+      {
+        const ssize_t length = read(m_fd, buffer, sizeof(buffer));
+        if (length <= 0)
+        {
+          break;
+        }
+        handleEvents(buffer, length);
+      }
+      m_journal.flush(false);
+    }
+    if (syncTimer.elapsed() >= s_syncMillis)
+    {
+      if (m_incomplete)
+      {
+        m_journal.markOverflow();
+      }
+      m_journal.flush(true);
+      if (m_journal.numLines() > s_compactLines + 2 * m_wdPaths.count())
+      {
+        m_journal.compact();
+      }
+      syncTimer.restart();
+    }
+  }
+  // A journal left by a stopped watcher is not trusted, because it is no longer locked.
+  m_journal.close();
+  INFO_MSG(QObject::tr("Stopped watching for changes"), 1);
+}
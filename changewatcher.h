@@ -0,0 +1,78 @@
+#ifndef CHANGEWATCHER_H
+#define CHANGEWATCHER_H
+
+#include "changejournal.h"
+
+#include <QHash>
+#include <QString>
+
+#include <atomic>
+
+//**************************************************************************
+/*! \class ChangeWatcher
+ *  \brief Watch a backup source with inotify and record changed directories in a ChangeJournal.
+ *
+ * Every directory below the source is watched. A change to an entry in a directory marks that
+ * directory dirty. A directory created or moved into the source is watched, and it and every
+ * directory below it are marked dirty because the previous backup does not have them. A
+ * directory moved out of the source stops being watched.
+ *
+ * inotify needs no special privileges, but each directory uses one watch, limited by
+ * fs.inotify.max_user_watches. If the limit is reached, or the kernel queue overflows, the
+ * journal records an overflow and the next backup walks the whole source.
+ *
+ * \author Andrew Pitonyak
+ * \copyright Andrew Pitonyak, but you may use without restriction.
+ * \date 2026
+ **************************************************************************/
+class ChangeWatcher
+{
+public:
+  ChangeWatcher();
+  ~ChangeWatcher();
+
+  //**************************************************************************
+  /*! \brief Watch every directory in the source, then create the journal.
+   *
+   *  \param [in] fromPath Directory to watch.
+   *  \param [in] toPath Backup directory that holds the journal.
+   *  \return True if every directory is watched and the journal is locked.
+   ***************************************************************************/
+  bool start(const QString& fromPath, const QString& toPath);
+
+  /*! \brief Record changes until requestStop() is called. */
+  void run();
+
+  /*! \brief Stop run(); safe to call from a signal handler. */
+  void requestStop();
+
+  /*! \brief Number of directories watched. */
+  int numWatches() const;
+
+private:
+  void addWatches(const QString& relativeDir, const bool isNew);
+  void removeWatches(const QString& relativeDir);
+  void handleEvents(const char* buffer, const qint64 length);
+
+  int m_fd;
+  /*! \brief Parent of the source with a trailing '/', so a relative directory starts with the source name. */
+  QString m_fromParent;
+  QString m_topDir;
+  QHash<int, QString> m_wdPaths;
+  ChangeJournal m_journal;
+  /*! \brief Set when a directory could not be watched; every flush then records an overflow. */
+  bool m_incomplete;
+  std::atomic<bool> m_stopRequested;
+};
+
+inline void ChangeWatcher::requestStop()
+{
+  m_stopRequested = true;
+}
+
+inline int ChangeWatcher::numWatches() const
+{
+  return m_wdPaths.count();
+}
+
+#endif // CHANGEWATCHER_H
@@ -0,0 +1,655 @@
+#include "chunkstore.h"
+#include "backupprogress.h"
+#include "catalogwriter.h"
+#include "copylinkutil.h"
+#include "enhancedqcryptographichash.h"
+#include "filehash.h"
+#include "linkbackupglobals.h"
+#include "perftrace.h"
+
+#include <QDir>
+#include <QFile>
+#include <QRegularExpression>
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char* s_header = "LinkBackupChunks=1";
+
+static const char* s_modesHeader = "LinkBackupModes=1";
+
+// The digest names the chunk, so it does not depend on the hash method of a backup set.
+static const QCryptographicHash::Algorithm s_chunkAlgorithm = QCryptographicHash::Sha256;
+
+// A chunk is hashed with a buffer of this size.
+static const qint64 s_hashBufferSize = 1024 * 1024;
+
+// A cut needs the top bits of the gear hash to be zero: more bits below the average size, fewer above.
+static const quint64 s_maskSmall = ~0ULL << (64 - 22);
+static const quint64 s_maskLarge = ~0ULL << (64 - 18);
+
+//**************************************************************************
+/*! \brief Random value for each byte, from a fixed seed so chunk boundaries are the same in every backup. */
+//**************************************************************************
+struct GearTable
+{
+  GearTable()
+  {
+    // SplitMix64
+    quint64 state = 0x4C696E6B4261636BULL;
+    for (int i=0; i<256; ++i)
+    {
+      quint64 z = (state += 0x9E3779B97F4A7C15ULL);
+      z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+      z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+      values[i] = z ^ (z >> 31);
+    }
+  }
+
+  quint64 values[256];
+};
+
+static const GearTable s_gear;
+
+static bool writeAll(const int fd, const char* data, qint64 length)
+{
+  while (length > 0)
+  {
+    const ssize_t n = write(fd, data, static_cast<size_t>(length));
+    if (n <= 0)
+    {
+      return false;
+    }
+    data += n;
+    length -= n;
+  }
+  return true;
+}
+
+//**************************************************************************
+/*! \brief Open and lock the lock file of a store; -1 if it is locked the other way or can not be opened. */
+//**************************************************************************
+static int lockStore(const QString& storePath, const int operation)
+{
+  const int fd = ::open(QFile::encodeName(storePath + "/lock").constData(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd >= 0 && flock(fd, operation | LOCK_NB) != 0)
+  {
+    ::close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+ChunkStore::ChunkStore() : m_lockFd(-1), m_algorithm(EnhancedQCryptographicHash::getDefaultAlgorithm()), m_chunkSize(0), m_progress(nullptr), m_cancelRequested(false), m_numFiles(0), m_numChunks(0), m_numNewChunks(0), m_bytesStored(0), m_bytesWritten(0)
+{
+}
+
+ChunkStore::~ChunkStore()
+{
+  close();
+}
+
+QString ChunkStore::storePath(const QString& toPath)
+{
+  return toPath + "/.linkbackup-chunks";
+}
+
+QString ChunkStore::listPath(const QString& storePath, const QString& hash, const quint64 size)
+{
+  return storePath + "/lists/" + hash.left(2) + "/" + hash + "-" + QString::number(size);
+}
+
+QString ChunkStore::chunkPath(const QString& storePath, const QByteArray& digest)
+{
+  return storePath + "/chunks/" + QString::fromLatin1(digest.left(2)) + "/" + QString::fromLatin1(digest);
+}
+
+bool ChunkStore::open(const QString& toPath)
+{
+  close();
+  const QString path = storePath(toPath);
+  QDir dir;
+  if (!dir.mkpath(path + "/chunks") || !dir.mkpath(path + "/lists"))
+  {
+    WARN_MSG(QString(QObject::tr("Unable to create the chunk store %1")).arg(path), 1);
+    return false;
+  }
+  // Chunk digests are lower-case hex and file hashes upper-case hex.
+  for (int i=0; i<256; ++i)
+  {
+    const QString name = QString("%1").arg(i, 2, 16, QLatin1Char('0'));
+    const QByteArray chunkDir = QFile::encodeName(path + "/chunks/" + name);
+    const QByteArray listDir = QFile::encodeName(path + "/lists/" + name.toUpper());
+    if ((mkdir(chunkDir.constData(), 0777) != 0 && errno != EEXIST) || (mkdir(listDir.constData(), 0777) != 0 && errno != EEXIST))
+    {
+      WARN_MSG(QString(QObject::tr("Unable to create the chunk store %1: %2")).arg(path, QString::fromLocal8Bit(strerror(errno))), 1);
+      return false;
+    }
+  }
+  // The garbage collector does not run while a backup may add chunks a catalog does not list yet.
+  m_lockFd = lockStore(path, LOCK_SH);
+  if (m_lockFd < 0)
+  {
+    WARN_MSG(QString(QObject::tr("The chunk store %1 is being cleaned, it is not used")).arg(path), 1);
+    return false;
+  }
+  m_storePath = path;
+  return true;
+}
+
+void ChunkStore::close()
+{
+  if (m_lockFd >= 0)
+  {
+    ::close(m_lockFd);
+    m_lockFd = -1;
+  }
+  m_storePath.clear();
+  m_known.clear();
+  m_buffer.clear();
+}
+
+void ChunkStore::setHashMethod(const QCryptographicHash::Algorithm algorithm, const qint64 chunkSize)
+{
+  m_algorithm = algorithm;
+  m_chunkSize = (chunkSize > 0) ? chunkSize : 0;
+}
+
+void ChunkStore::resetStats()
+{
+  m_numFiles = 0;
+  m_numChunks = 0;
+  m_numNewChunks = 0;
+  m_bytesStored = 0;
+  m_bytesWritten = 0;
+}
+
+qint64 ChunkStore::cutPoint(const uchar* data, const qint64 length)
+{
+  if (length <= MinChunkSize)
+  {
+    return length;
+  }
+  const qint64 end = qMin(length, static_cast<qint64>(MaxChunkSize));
+  const qint64 normal = qMin(end, static_cast<qint64>(AverageChunkSize));
+  // No chunk is shorter than the minimum, so the bytes before it are never hashed.
+  quint64 hash = 0;
+  qint64 i = MinChunkSize;
+  for (; i < normal; ++i)
+  {
+    hash = (hash << 1) + s_gear.values[data[i]];
+    if ((hash & s_maskSmall) == 0)
+    {
+      return i + 1;
+    }
+  }
+  for (; i < end; ++i)
+  {
+    hash = (hash << 1) + s_gear.values[data[i]];
+    if ((hash & s_maskLarge) == 0)
+    {
+      return i + 1;
+    }
+  }
+  return end;
+}
+
+bool ChunkStore::writeFile(const QString& path, const char* data, const qint64 length)
+{
+  const QByteArray encodedPath = QFile::encodeName(path);
+  const QByteArray partialPath = QFile::encodeName(CatalogWriter::partialPath(path));
+  const int fd = ::open(partialPath.constData(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0)
+  {
+    return false;
+  }
+  // The data is on the disk before the name is, the same as the catalog that refers to it.
+  const bool written = writeAll(fd, data, length) && ::fdatasync(fd) == 0;
+  if (::close(fd) != 0 || !written || rename(partialPath.constData(), encodedPath.constData()) != 0)
+  {
+    unlink(partialPath.constData());
+    return false;
+  }
+  return true;
+}
+
+bool ChunkStore::writeChunk(const QByteArray& digest, const char* data, const qint64 length, bool& isNew)
+{
+  isNew = false;
+  if (m_known.contains(digest))
+  {
+    return true;
+  }
+  // A chunk with the wrong length is incomplete, so it is written again.
+  const QString path = chunkPath(m_storePath, digest);
+  struct stat st;
+  if (stat(QFile::encodeName(path).constData(), &st) != 0 || st.st_size != length)
+  {
+    if (!writeFile(path, data, length))
+    {
+      WARN_MSG(QString(QObject::tr("Unable to write the chunk %1: %2")).arg(path, QString::fromLocal8Bit(strerror(errno))), 1);
+      return false;
+    }
+    isNew = true;
+  }
+  m_known.insert(digest);
+  return true;
+}
+
+bool ChunkStore::store(const QString& fromPath, QString& hash, quint64& size)
+{
+  PerfScope scope(PerfTrace::Copy);
+  if (!isOpen())
+  {
+    return false;
+  }
+  const int fd = ::open(QFile::encodeName(fromPath).constData(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+  {
+    return false;
+  }
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  // The buffer holds at least one full chunk, unless the file ends sooner.
+  if (m_buffer.isEmpty())
+  {
+    m_buffer.resize(2 * MaxChunkSize);
+  }
+  char* buffer = m_buffer.data();
+  const qint64 bufferSize = m_buffer.size();
+  FileHash fileHash(m_algorithm, m_chunkSize);
+  QByteArray list(s_header);
+  list.append('\n');
+  qint64 start = 0;
+  qint64 end = 0;
+  qint64 total = 0;
+  qint64 numChunks = 0;
+  qint64 numNewChunks = 0;
+  qint64 written = 0;
+  bool atEnd = false;
+  bool ok = true;
+  while (ok && !m_cancelRequested)
+  {
+    if (!atEnd && end - start < MaxChunkSize)
+    {
+      memmove(buffer, buffer + start, static_cast<size_t>(end - start));
+      end -= start;
+      start = 0;
+      while (end < bufferSize)
+      {
+        const ssize_t n = read(fd, buffer + end, static_cast<size_t>(bufferSize - end));
+        if (n <= 0)
+        {
+          ok = (n == 0);
+          atEnd = true;
+          break;
+        }
+        end += n;
+      }
+    }
+    if (!ok || start == end)
+    {
+      break;
+    }
+
+    const qint64 length = cutPoint(reinterpret_cast<const uchar*>(buffer + start), end - start);
+    fileHash.addData(buffer + start, length);
+    const QByteArray digest = QCryptographicHash::hash(QByteArrayView(buffer + start, length), s_chunkAlgorithm).toHex();
+    bool isNew = false;
+    ok = writeChunk(digest, buffer + start, length, isNew);
+    if (isNew)
+    {
+      ++numNewChunks;
+      written += length;
+      if (m_progress != nullptr)
+      {
+        m_progress->add(BackupProgress::BytesCopied, length);
+      }
+    }
+    list.append(digest).append(',').append(QByteArray::number(length)).append('\n');
+    ++numChunks;
+    start += length;
+    total += length;
+  }
+  ::close(fd);
+  if (!ok || m_cancelRequested)
+  {
+    return false;
+  }
+
+  hash = QString::fromLatin1(fileHash.result(total).toHex().toUpper());
+  size = static_cast<quint64>(total);
+  const QString path = listPath(m_storePath, hash, size);
+  if (!QFile::exists(path) && !writeFile(path, list.constData(), list.length()))
+  {
+    WARN_MSG(QString(QObject::tr("Unable to write the chunk list %1: %2")).arg(path, QString::fromLocal8Bit(strerror(errno))), 1);
+    return false;
+  }
+  ++m_numFiles;
+  m_numChunks += numChunks;
+  m_numNewChunks += numNewChunks;
+  m_bytesStored += total;
+  m_bytesWritten += written;
+  return true;
+}
+
+bool ChunkStore::hasList(const QString& hash, const quint64 size) const
+{
+  return isOpen() && !hash.isEmpty() && QFile::exists(listPath(m_storePath, hash, size));
+}
+
+bool ChunkStore::readList(const QString& storePath, const QString& hash, const quint64 size, QList<Chunk>& chunks)
+{
+  chunks.clear();
+  QFile list(listPath(storePath, hash, size));
+  if (!list.open(QIODevice::ReadOnly) || list.readLine().trimmed() != s_header)
+  {
+    return false;
+  }
+  quint64 total = 0;
+  while (!list.atEnd())
+  {
+    const QByteArray line = list.readLine().trimmed();
+    const int comma = line.indexOf(',');
+    bool ok = (comma > 0);
+    const qint64 length = ok ? line.mid(comma + 1).toLongLong(&ok) : 0;
+    if (!ok || length < 0 || length > MaxChunkSize)
+    {
+      return false;
+    }
+    chunks.append(Chunk(line.left(comma), length));
+    total += static_cast<quint64>(length);
+  }
+  return total == size;
+}
+
+bool ChunkStore::hashChunk(const QString& path, QByteArray& digest)
+{
+  QFile file(path);
+  if (!file.open(QIODevice::ReadOnly))
+  {
+    return false;
+  }
+  QCryptographicHash hash(s_chunkAlgorithm);
+  QByteArray buffer(s_hashBufferSize, Qt::Uninitialized);
+  for (;;)
+  {
+    const qint64 n = file.read(buffer.data(), buffer.size());
+    if (n < 0)
+    {
+      return false;
+    }
+    if (n == 0)
+    {
+      break;
+    }
+    hash.addData(QByteArrayView(buffer.constData(), n));
+  }
+  digest = hash.result().toHex();
+  return true;
+}
+
+bool ChunkStore::restore(const QString& storePath, const QString& hash, const quint64 size, const QString& toPath)
+{
+  PerfScope scope(PerfTrace::Copy);
+  QList<Chunk> chunks;
+  if (!readList(storePath, hash, size, chunks))
+  {
+    return false;
+  }
+  const QByteArray encodedToPath = QFile::encodeName(toPath);
+  const int fd = ::open(encodedToPath.constData(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+  if (fd < 0)
+  {
+    return false;
+  }
+  bool ok = true;
+  for (int i=0; ok && i<chunks.count(); ++i)
+  {
+    const qint64 length = chunks.at(i).second;
+    QFile chunk(chunkPath(storePath, chunks.at(i).first));
+    ok = chunk.open(QIODevice::ReadOnly) && chunk.size() == length;
+    if (ok)
+    {
+      const QByteArray data = chunk.readAll();
+      ok = (data.length() == length) && writeAll(fd, data.constData(), length);
+    }
+  }
+  ok = (::close(fd) == 0) && ok;
+  if (!ok)
+  {
+    unlink(encodedToPath.constData());
+  }
+  return ok;
+}
+
+bool ChunkStore::collectGarbage(const QString& toPath, qint64& numRemoved, qint64& bytesFreed)
+{
+  numRemoved = 0;
+  bytesFreed = 0;
+  const QString path = storePath(toPath);
+  if (!QFileInfo::exists(path))
+  {
+    return true;
+  }
+  const int lockFd = lockStore(path, LOCK_EX);
+  if (lockFd < 0)
+  {
+    WARN_MSG(QString(QObject::tr("The chunk store %1 is in use, it is not cleaned")).arg(path), 1);
+    return false;
+  }
+
+  // Mark: the chunk lists named by every K entry in every catalog, finished or not, of every backup set.
+  QSet<QString> liveLists;
+  bool ok = true;
+  QDir toDir(toPath);
+  toDir.setFilter(QDir::Dirs | QDir::NoDotAndDotDot);
+  QRegularExpression dirNameRegExp("^\\d{8}-\\d{6}$");
+  const QFileInfoList snapshots = toDir.entryInfoList();
+  for (int i=0; ok && i<snapshots.count(); ++i)
+  {
+    if (!dirNameRegExp.match(snapshots.at(i).fileName()).hasMatch())
+    {
+      continue;
+    }
+    QDir snapshotDir(snapshots.at(i).filePath());
+    const QFileInfoList catalogs = snapshotDir.entryInfoList(QStringList() << "*.txt" << "*.txt.partial", QDir::Files);
+    for (int j=0; ok && j<catalogs.count(); ++j)
+    {
+      QFile file(catalogs.at(j).filePath());
+      ok = file.open(QIODevice::ReadOnly);
+      while (ok && !file.atEnd())
+      {
+        // K,time,hash,size,path
+        const QByteArray line = file.readLine();
+        if (!line.startsWith("K,"))
+        {
+          continue;
+        }
+        const int comma2 = line.indexOf(',', 2);
+        const int comma3 = (comma2 < 0) ? -1 : line.indexOf(',', comma2 + 1);
+        const int comma4 = (comma3 < 0) ? -1 : line.indexOf(',', comma3 + 1);
+        if (comma4 > comma3 + 1 && comma3 > comma2 + 1)
+        {
+          liveLists.insert(QString::fromLatin1(line.mid(comma2 + 1, comma3 - comma2 - 1).toUpper() + "-" + line.mid(comma3 + 1, comma4 - comma3 - 1)));
+        }
+      }
+      if (!ok)
+      {
+        WARN_MSG(QString(QObject::tr("Unable to read %1, the chunk store is not cleaned")).arg(file.fileName()), 1);
+      }
+    }
+  }
+
+  // Sweep the lists, keeping the chunks of the lists that are used.
+  QSet<QByteArray> liveChunks;
+  QDir listsDir(path + "/lists");
+  const QStringList listDirs = ok ? listsDir.entryList(QDir::Dirs | QDir::NoDotAndDotDot) : QStringList();
+  for (const QString& listDir : listDirs)
+  {
+    QDir dir(listsDir.filePath(listDir));
+    for (const QString& name : dir.entryList(QDir::Files))
+    {
+      // A partial list is left by a backup that stopped, as no backup has the store open.
+      const int dash = name.lastIndexOf('-');
+      QList<Chunk> chunks;
+      if (liveLists.contains(name) && dash > 0 && readList(path, name.left(dash), name.mid(dash + 1).toULongLong(), chunks))
+      {
+        for (const Chunk& chunk : chunks)
+        {
+          liveChunks.insert(QByteArray::fromHex(chunk.first));
+        }
+      }
+      else if (liveLists.contains(name))
+      {
+        // The chunks of a list that can not be read are not known, so no chunk is removed.
+        WARN_MSG(QString(QObject::tr("Unable to read chunk list %1, no chunks are removed")).arg(dir.filePath(name)), 1);
+        ok = false;
+      }
+      else if (dir.remove(name))
+      {
+        ++numRemoved;
+      }
+    }
+  }
+
+  // Sweep the chunks.
+  QDir chunksDir(path + "/chunks");
+  const QStringList chunkDirs = ok ? chunksDir.entryList(QDir::Dirs | QDir::NoDotAndDotDot) : QStringList();
+  for (const QString& chunkDir : chunkDirs)
+  {
+    QDir dir(chunksDir.filePath(chunkDir));
+    for (const QFileInfo& info : dir.entryInfoList(QDir::Files))
+    {
+      if (info.fileName().endsWith(".partial") || !liveChunks.contains(QByteArray::fromHex(info.fileName().toLatin1())))
+      {
+        const qint64 length = info.size();
+        if (dir.remove(info.fileName()))
+        {
+          ++numRemoved;
+          bytesFreed += length;
+        }
+      }
+    }
+  }
+  ::close(lockFd);
+  return ok;
+}
+
+QString ChunkStore::summaryText() const
+{
+  return QString(QObject::tr("Chunk store: %1 files in %2 chunks, %3 new chunks, %4 of %5 written")).arg(m_numFiles).arg(m_numChunks).arg(m_numNewChunks).arg(CopyLinkUtil::getBPS(m_bytesWritten, 0), CopyLinkUtil::getBPS(m_bytesStored, 0));
+}
+
+ChunkModes::ChunkModes()
+{
+}
+
+ChunkModes::~ChunkModes()
+{
+  if (m_file.isOpen())
+  {
+    close(false);
+  }
+}
+
+QString ChunkModes::modesPath(const QString& catalogPath)
+{
+  return catalogPath + ".modes";
+}
+
+bool ChunkModes::open(const QString& path)
+{
+  if (m_file.isOpen())
+  {
+    close(false);
+  }
+  m_path = path;
+  m_file.setFileName(CatalogWriter::partialPath(path));
+  if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+  {
+    WARN_MSG(QString(QObject::tr("Unable to write the permissions %1")).arg(m_file.fileName()), 1);
+    return false;
+  }
+  m_file.write(QByteArray(s_modesHeader) + "\n");
+  return true;
+}
+
+void ChunkModes::add(const QString& path, const uint mode)
+{
+  if (m_file.isOpen())
+  {
+    m_file.write(QByteArray::number(mode & 07777, 8) + ',' + path.toUtf8() + '\n');
+  }
+}
+
+bool ChunkModes::close(const bool finished)
+{
+  if (!m_file.isOpen())
+  {
+    return false;
+  }
+  const bool written = m_file.flush() && m_file.error() == QFileDevice::NoError;
+  m_file.close();
+  if (!finished)
+  {
+    return false;
+  }
+  QFile::remove(m_path);
+  if (!written || !m_file.rename(m_path))
+  {
+    WARN_MSG(QString(QObject::tr("Unable to rename %1 to %2")).arg(m_file.fileName(), m_path), 1);
+    m_file.remove();
+    return false;
+  }
+  return true;
+}
+
+void ChunkModes::clear()
+{
+  m_modes.clear();
+}
+
+bool ChunkModes::read(const QString& path)
+{
+  clear();
+  QFile file(path);
+  if (!file.open(QIODevice::ReadOnly))
+  {
+    return false;
+  }
+  if (file.readLine().trimmed() != s_modesHeader)
+  {
+    WARN_MSG(QString(QObject::tr("Unknown permissions format in %1")).arg(path), 1);
+    return false;
+  }
+  while (!file.atEnd())
+  {
+    QByteArray line = file.readLine();
+    // The path is last, so it may contain commas.
+    const int comma = line.indexOf(',');
+    bool ok = false;
+    const uint mode = (comma > 0) ? line.left(comma).toUInt(&ok, 8) : 0;
+    if (ok && line.endsWith('\n') && comma + 2 < line.length())
+    {
+      line.chop(1);
+      m_modes.insert(QString::fromUtf8(line.mid(comma + 1)), mode);
+    }
+  }
+  return true;
+}
+
+bool ChunkModes::find(const QString& path, uint& mode) const
+{
+  QHash<QString, uint>::const_iterator it = m_modes.constFind(path);
+  if (it == m_modes.constEnd())
+  {
+    return false;
+  }
+  mode = it.value();
+  return true;
+}
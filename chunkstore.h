@@ -0,0 +1,301 @@
+#ifndef CHUNKSTORE_H
+#define CHUNKSTORE_H
+
+#include <QByteArray>
+#include <QCryptographicHash>
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <QSet>
+#include <QString>
+
+#include <atomic>
+
+class BackupProgress;
+
+//**************************************************************************
+/*! \class ChunkStore
+ *  \brief Store large files as content-defined chunks, each chunk once for every backup in the To path.
+ *
+ * A hard link only shares a file that is identical. A log that grows, or an archive with a small
+ * edit, is a new file that is copied in full. In the chunk store a file is cut into chunks where
+ * the content says so, using the gear hash of FastCDC, so an insert or an append only changes the
+ * chunks around the change. Each chunk is named by its SHA-256 digest and written once.
+ *
+ * The store is the directory ".linkbackup-chunks" in the To path:
+ * \code
+ * chunks/3f/3fa4...e1            one chunk, named by its digest
+ * lists/9A/9AC0...7D-53687091200 chunk list of a file, named by its file hash and size
+ * \endcode
+ *
+ * A chunk list holds a header followed by one line for each chunk, in order:
+ * \code
+ * LinkBackupChunks=1
+ * 3fa4...e1,1048576
+ * \endcode
+ *
+ * A file in the store has the link type K in the catalog; its hash and size name its chunk list,
+ * so the same content in any backup shares the list. Nothing is written to the backup directory,
+ * and the file is put back together by restore(). The list is shared by files with different
+ * permissions, so the permissions of each file are kept next to the catalog by ChunkModes.
+ *
+ * Chunks and lists are written to a partial file, synced, and renamed, so a crash never leaves
+ * part of one in the store. A backup holds a shared lock on the store while it is open;
+ * collectGarbage() takes the lock exclusively, keeps every list named by a K entry in any
+ * catalog in the To path, and removes every chunk that no kept list uses.
+ *
+ * \author Andrew Pitonyak
+ * \copyright Andrew Pitonyak, but you may use without restriction.
+ * \date 2026
+ **************************************************************************/
+class ChunkStore
+{
+public:
+  /*! \brief A chunk in a chunk list: lower-case hex digest and length. */
+  typedef QPair<QByteArray, qint64> Chunk;
+
+  /*! \brief Chunk sizes; a cut is more likely past the average, so most chunks are close to it. */
+  enum {MinChunkSize = 256 * 1024, AverageChunkSize = 1024 * 1024, MaxChunkSize = 4 * 1024 * 1024};
+
+  /*! \brief Constructor, no store is open. */
+  ChunkStore();
+
+  /*! \brief Destructor, releases the lock on the store. */
+  ~ChunkStore();
+
+  /*! \brief Get the path for the chunk store of a To path, such as "<to>/.linkbackup-chunks". */
+  static QString storePath(const QString& toPath);
+
+  //**************************************************************************
+  /*! \brief Use the chunk store in a To path, creating it if needed, and hold a shared lock on it.
+   *
+   *  \param [in] toPath Directory that holds the backups.
+   *  \return True if the store exists and is not being cleaned by collectGarbage().
+   ***************************************************************************/
+  bool open(const QString& toPath);
+
+  void close();
+
+  bool isOpen() const;
+
+  //**************************************************************************
+  /*! \brief Set how the file hash is calculated, the same as the catalog.
+   *
+   *  \param [in] algorithm Hash algorithm for the file hash; chunks always use SHA-256.
+   *  \param [in] chunkSize Chunk size for a tree hash, zero for a sequential hash.
+   ***************************************************************************/
+  void setHashMethod(const QCryptographicHash::Algorithm algorithm, const qint64 chunkSize);
+
+  /*! \brief Set the progress counters, which are not owned; may be nullptr. */
+  void setProgress(BackupProgress* progress);
+
+  //**************************************************************************
+  /*! \brief Store a file; only chunks not in the store are written.
+   *
+   *  \param [in] fromPath Full path to the source file.
+   *  \param [out] hash Upper-case hex file hash of the bytes stored.
+   *  \param [out] size Number of bytes stored.
+   *  \return True if every chunk and the chunk list were written.
+   ***************************************************************************/
+  bool store(const QString& fromPath, QString& hash, quint64& size);
+
+  /*! \brief Returns True if the store has the chunk list for a file. */
+  bool hasList(const QString& hash, const quint64 size) const;
+
+  //**************************************************************************
+  /*! \brief Put a file back together from its chunks; safe to call from several threads.
+   *
+   *  \param [in] storePath Full path to the chunk store.
+   *  \param [in] hash File hash from the catalog.
+   *  \param [in] size File size from the catalog.
+   *  \param [in] toPath Full path to the file to create, which must not exist.
+   *  \return True if the file was written with the size in the catalog; on failure it is removed.
+   ***************************************************************************/
+  static bool restore(const QString& storePath, const QString& hash, const quint64 size, const QString& toPath);
+
+  //**************************************************************************
+  /*! \brief Read the chunk list for a file.
+   *
+   *  \param [in] storePath Full path to the chunk store.
+   *  \param [in] hash File hash from the catalog.
+   *  \param [in] size File size from the catalog.
+   *  \param [out] chunks Chunks of the file in order.
+   *  \return True if the list was read and every line is valid.
+   ***************************************************************************/
+  static bool readList(const QString& storePath, const QString& hash, const quint64 size, QList<Chunk>& chunks);
+
+  //**************************************************************************
+  /*! \brief Hash a chunk file, to compare with the digest that names it.
+   *
+   *  \param [in] path Full path to the chunk.
+   *  \param [out] digest Lower-case hex SHA-256 digest of the file.
+   *  \return True if the file was read.
+   ***************************************************************************/
+  static bool hashChunk(const QString& path, QByteArray& digest);
+
+  //**************************************************************************
+  /*! \brief Remove the chunk lists and chunks that no backup in the To path uses.
+   *
+   *  Every catalog in every backup directory is read, including the partial catalog of a backup
+   *  that did not finish. Nothing is removed if a catalog can not be read or a backup has the
+   *  store open.
+   *
+   *  \param [in] toPath Directory that holds the backups.
+   *  \param [out] numRemoved Number of chunks and chunk lists removed.
+   *  \param [out] bytesFreed Bytes in the chunks removed.
+   *  \return True if the store was cleaned, or there is no store.
+   ***************************************************************************/
+  static bool collectGarbage(const QString& toPath, qint64& numRemoved, qint64& bytesFreed);
+
+  /*! \brief Get the path to the chunk list for a file. */
+  static QString listPath(const QString& storePath, const QString& hash, const quint64 size);
+
+  /*! \brief Get the path to a chunk from its lower-case hex digest. */
+  static QString chunkPath(const QString& storePath, const QByteArray& digest);
+
+  //**************************************************************************
+  /*! \brief Find where the next chunk ends.
+   *
+   *  \param [in] data Start of the chunk.
+   *  \param [in] length Bytes available; at least MaxChunkSize unless the file ends sooner.
+   *  \return Length of the chunk.
+   ***************************************************************************/
+  static qint64 cutPoint(const uchar* data, const qint64 length);
+
+  void setCancelRequested(const bool cancelRequested);
+
+  /*! \brief Reset the counters for a new backup. */
+  void resetStats();
+
+  /*! \brief Summary of the files stored for the log. */
+  QString summaryText() const;
+
+  /*! \brief Number of files stored. */
+  qint64 getNumFiles() const;
+
+private:
+  /*! \brief Write a chunk unless the store has it with the same length; isNew is set if it was written. */
+  bool writeChunk(const QByteArray& digest, const char* data, const qint64 length, bool& isNew);
+
+  /*! \brief Write a file to a partial file, then rename it, so a reader never sees part of it. */
+  static bool writeFile(const QString& path, const char* data, const qint64 length);
+
+  QString m_storePath;
+  /*! \brief Lock file of the store, -1 if not open. */
+  int m_lockFd;
+  QCryptographicHash::Algorithm m_algorithm;
+  qint64 m_chunkSize;
+  BackupProgress* m_progress;
+  std::atomic<bool> m_cancelRequested;
+
+  QByteArray m_buffer;
+  /*! \brief Digests of chunks known to be in the store, so they are not checked again. */
+  QSet<QByteArray> m_known;
+
+  qint64 m_numFiles;
+  qint64 m_numChunks;
+  qint64 m_numNewChunks;
+  qint64 m_bytesStored;
+  qint64 m_bytesWritten;
+};
+
+//**************************************************************************
+/*! \class ChunkModes
+ *  \brief Permissions of the files in the chunk store for one backup, written next to the catalog.
+ *
+ * The file "<catalog>.modes" holds a header followed by one line for each K entry:
+ * \code
+ * LinkBackupModes=1
+ * 640,Top/vm/disk.vmdk
+ * \endcode
+ *
+ * The permission bits are in octal, and the path is the same as in the catalog.
+ *
+ * \author Andrew Pitonyak
+ * \copyright Andrew Pitonyak, but you may use without restriction.
+ * \date 2026
+ **************************************************************************/
+class ChunkModes
+{
+public:
+  /*! \brief Constructor, nothing is read or open. */
+  ChunkModes();
+
+  /*! \brief Destructor, a file still open is discarded. */
+  ~ChunkModes();
+
+  /*! \brief Get the path for the permissions of a catalog, such as "<backup>/sha1.txt.modes". */
+  static QString modesPath(const QString& catalogPath);
+
+  //**************************************************************************
+  /*! \brief Start writing; the lines are written to a partial file until close().
+   *
+   *  \param [in] path Full path to the permissions file.
+   *  \return True if the partial file was created.
+   ***************************************************************************/
+  bool open(const QString& path);
+
+  bool isOpen() const;
+
+  /*! \brief Write the permission bits of a file. */
+  void add(const QString& path, const uint mode);
+
+  //**************************************************************************
+  /*! \brief Stop writing.
+   *
+   *  \param [in] finished If true, the partial file replaces the permissions file; otherwise it is kept for a resume.
+   *  \return True if the permissions file was written.
+   ***************************************************************************/
+  bool close(const bool finished);
+
+  //**************************************************************************
+  /*! \brief Read the permissions of a backup.
+   *
+   *  \param [in] path Full path to the permissions file, or to the partial file of an interrupted backup.
+   *  \return True if the file was read; a line that is not complete is ignored.
+   ***************************************************************************/
+  bool read(const QString& path);
+
+  /*! \brief Forget the lines read. */
+  void clear();
+
+  /*! \brief Find the permission bits of a file; returns False if there are none. */
+  bool find(const QString& path, uint& mode) const;
+
+private:
+  /*! \brief Disable the copy constructor, the file is owned. */
+  ChunkModes(const ChunkModes&);
+  ChunkModes& operator=(const ChunkModes&);
+
+  QFile m_file;
+  QString m_path;
+  QHash<QString, uint> m_modes;
+};
+
+inline bool ChunkModes::isOpen() const
+{
+  return m_file.isOpen();
+}
+
+inline bool ChunkStore::isOpen() const
+{
+  return !m_storePath.isEmpty();
+}
+
+inline void ChunkStore::setProgress(BackupProgress* progress)
+{
+  m_progress = progress;
+}
+
+inline void ChunkStore::setCancelRequested(const bool cancelRequested)
+{
+  m_cancelRequested = cancelRequested;
+}
+
+inline qint64 ChunkStore::getNumFiles() const
+{
+  return m_numFiles;
+}
+
+#endif // CHUNKSTORE_H
@@ -0,0 +1,219 @@
+#include "contentindex.h"
+#include "linkbackupglobals.h"
+#include "stringhelper.h"
+
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QStringList>
+#include <QTextStream>
+
+#include <sys/stat.h>
+
+ContentIndex::ContentIndex() : m_maxLinks(s_defaultMaxLinks), m_hits(0), m_rollovers(0), m_modified(false)
+{
+}
+
+QString ContentIndex::indexPath(const QString& toPath, const QString& catalogName)
+{
+  return toPath + "/ContentIndex-" + catalogName + ".txt";
+}
+
+QString ContentIndex::makeKey(const QString& hash, const quint64 size)
+{
+  return QString("%1:%2").arg(hash.toUpper(), QString::number(size));
+}
+
+bool ContentIndex::read(const QString& toPath, const QString& catalogName)
+{
+  m_entries.clear();
+  m_hits = 0;
+  m_rollovers = 0;
+  m_modified = false;
+  // Paths in the backup are canonical, so the root must be as well.
+  m_toPath = QDir(toPath).canonicalPath();
+  if (m_toPath.isEmpty())
+  {
+    m_toPath = toPath;
+  }
+  StringHelper::ForceLastChar(m_toPath, '/');
+  m_indexPath = indexPath(toPath, catalogName);
+
+  QFile file(m_indexPath);
+  if (!file.exists())
+  {
+    return true;
+  }
+  if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+  {
+    ERROR_MSG(QString(QObject::tr("Failed to open content index %1")).arg(m_indexPath), 1);
+    return false;
+  }
+  QTextStream reader(&file);
+  long lineNumber = 0;
+  while (!reader.atEnd())
+  {
+    ++lineNumber;
+    QString line = reader.readLine();
+    if (line.isEmpty())
+    {
+      continue;
+    }
+    QStringList tokens = StringHelper::split(',', line, 4);
+    bool sizeOK = false;
+    bool inodeOK = false;
+    if (tokens.count() == 4)
+    {
+      quint64 size = tokens[1].toULongLong(&sizeOK);
+      Canonical canonical;
+      canonical.inode = tokens[2].toULongLong(&inodeOK);
+      canonical.relativePath = tokens[3];
+      if (sizeOK && inodeOK)
+      {
+        m_entries.insert(makeKey(tokens[0], size), canonical);
+        continue;
+      }
+    }
+    WARN_MSG(QString(QObject::tr("Ignoring invalid line %1 in content index %2")).arg(lineNumber).arg(m_indexPath), 1);
+  }
+  return true;
+}
+
+bool ContentIndex::write() const
+{
+  QSaveFile file(m_indexPath);
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+  {
+    ERROR_MSG(QString(QObject::tr("Failed to open content index %1 to write")).arg(m_indexPath), 1);
+    return false;
+  }
+  QTextStream writer(&file);
+  QHash<QString, Canonical>::const_iterator i = m_entries.constBegin();
+  while (i != m_entries.constEnd())
+  {
+    // Key is hash:size
+    int pos = i.key().lastIndexOf(':');
+    writer << i.key().left(pos) << ',' << i.key().mid(pos + 1) << ',' << i.value().inode << ',' << i.value().relativePath << "\n";
+    ++i;
+  }
+  writer.flush();
+  if (writer.status() != QTextStream::Ok || !file.commit())
+  {
+    ERROR_MSG(QString(QObject::tr("Failed to write content index %1")).arg(m_indexPath), 1);
+    return false;
+  }
+  return true;
+}
+
+bool ContentIndex::find(const QString& hash, const quint64 size, QString& fullPath)
+{
+  if (hash.isEmpty())
+  {
+    return false;
+  }
+  QString key = makeKey(hash, size);
+  QHash<QString, Canonical>::iterator i = m_entries.find(key);
+  if (i == m_entries.end())
+  {
+    return false;
+  }
+
+  QString path = m_toPath + i.value().relativePath;
+  struct stat st;
+  if (lstat(QFile::encodeName(path).constData(), &st) != 0 || !S_ISREG(st.st_mode) ||
+      static_cast<quint64>(st.st_ino) != i.value().inode || static_cast<quint64>(st.st_size) != size)
+  {
+    // Deleted or replaced, so it can not be used.
+    m_entries.erase(i);
+    m_modified = true;
+    return false;
+  }
+  if (static_cast<quint64>(st.st_nlink) >= m_maxLinks)
+  {
+    // Too many links, the next copy becomes the canonical file.
+    TRACE_MSG(QString("Canonical file %1 has %2 links, rolling over").arg(path).arg(st.st_nlink), 2);
+    m_entries.erase(i);
+    m_modified = true;
+    ++m_rollovers;
+    return false;
+  }
+  fullPath = path;
+  ++m_hits;
+  return true;
+}
+
+void ContentIndex::insert(const QString& key, const QString& fullPath, const bool replaceExisting)
+{
+  if (!fullPath.startsWith(m_toPath))
+  {
+    ERROR_MSG(QString(QObject::tr("File %1 is not in the backup root %2")).arg(fullPath, m_toPath), 1);
+    return;
+  }
+  if (!replaceExisting && m_entries.contains(key))
+  {
+    return;
+  }
+  struct stat st;
+  if (lstat(QFile::encodeName(fullPath).constData(), &st) != 0)
+  {
+    return;
+  }
+  Canonical canonical;
+  canonical.inode = static_cast<quint64>(st.st_ino);
+  canonical.relativePath = fullPath.mid(m_toPath.length());
+  m_entries.insert(key, canonical);
+  m_modified = true;
+}
+
+bool ContentIndex::splitPath(const QString& fullPath, QString& backupDir, QString& relativePath) const
+{
+  const int slash = fullPath.startsWith(m_toPath) ? fullPath.indexOf('/', m_toPath.length()) : -1;
+  if (slash <= m_toPath.length())
+  {
+    return false;
+  }
+  backupDir = fullPath.left(slash);
+  relativePath = fullPath.mid(slash + 1);
+  return true;
+}
+
+void ContentIndex::add(const QString& hash, const quint64 size, const QString& fullPath)
+{
+  if (!hash.isEmpty())
+  {
+    insert(makeKey(hash, size), fullPath, false);
+  }
+}
+
+void ContentIndex::replace(const QString& hash, const quint64 size, const QString& fullPath)
+{
+  if (!hash.isEmpty())
+  {
+    insert(makeKey(hash, size), fullPath, true);
+  }
+}
+
+int ContentIndex::garbageCollect()
+{
+  int numRemoved = 0;
+  QHash<QString, Canonical>::iterator i = m_entries.begin();
+  while (i != m_entries.end())
+  {
+    struct stat st;
+    QString path = m_toPath + i.value().relativePath;
+    if (lstat(QFile::encodeName(path).constData(), &st) != 0 || static_cast<quint64>(st.st_ino) != i.value().inode)
+    {
+      i = m_entries.erase(i);
+      ++numRemoved;
+    }
+    else
+    {
+      ++i;
+    }
+  }
+  if (numRemoved > 0)
+  {
+    m_modified = true;
+  }
+  return numRemoved;
+}
@@ -0,0 +1,176 @@
+#ifndef CONTENTINDEX_H
+#define CONTENTINDEX_H
+
+#include <QString>
+#include <QHash>
+
+//**************************************************************************
+/*! \class ContentIndex
+ *  \brief Global content addressed index that maps a hash and file size to one canonical file in the backup root.
+ *
+ * Without this index, a file is only linked against the newest backup and the current backup.
+ * The index is shared by every backup (and every backup set) that writes to the same "to" path
+ * with the same hash method, so a file that existed two backups ago, or in a different backup set,
+ * is linked rather than copied.
+ *
+ * The index is stored as a text file in the "to" path named "ContentIndex-<hash catalog name>.txt".
+ * Each line is "hash,size,inode,path" where the path is relative to the "to" path. The path is last
+ * so that a comma in the path does not cause a problem.
+ *
+ * A canonical file is validated before it is used; if it was deleted, replaced, or has
+ * reached the maximum link count, it is dropped so that the next copy becomes the new canonical file.
+ *
+ * \author Andrew Pitonyak
+ * \copyright Andrew Pitonyak, but you may use without restriction.
+ * \date 2026
+ **************************************************************************/
+class ContentIndex
+{
+public:
+  /*! \brief Default maximum link count for a canonical file; ext4 allows 65000 links. */
+  static constexpr quint64 s_defaultMaxLinks = 60000;
+
+  /*! \brief Constructor, the index is empty. */
+  ContentIndex();
+
+  //**************************************************************************
+  /*! \brief Full path to the index file for a backup root and hash catalog name.
+   *
+   *  \param [in] toPath Backup root directory.
+   *  \param [in] catalogName Hash catalog name such as Sha1.
+   *  \return Full path to the index file.
+   ***************************************************************************/
+  static QString indexPath(const QString& toPath, const QString& catalogName);
+
+  //**************************************************************************
+  /*! \brief Read the index. A missing file is an empty index.
+   *
+   *  \param [in] toPath Backup root directory.
+   *  \param [in] catalogName Hash catalog name such as Sha1.
+   *  \return True unless the index exists and could not be read.
+   ***************************************************************************/
+  bool read(const QString& toPath, const QString& catalogName);
+
+  //**************************************************************************
+  /*! \brief Write the index to the file from which it was read; the file is replaced atomically.
+   *
+   *  \return True on success.
+   ***************************************************************************/
+  bool write() const;
+
+  //**************************************************************************
+  /*! \brief Find a canonical file with this content that can accept another link.
+   *
+   *  \param [in] hash Hash value of the content.
+   *  \param [in] size File size in bytes.
+   *  \param [out] fullPath Full path to the canonical file.
+   *  \return True if a usable canonical file exists.
+   ***************************************************************************/
+  bool find(const QString& hash, const quint64 size, QString& fullPath);
+
+  //**************************************************************************
+  /*! \brief Register a file as the canonical file for its content if there is no usable canonical file.
+   *
+   *  \param [in] hash Hash value of the content.
+   *  \param [in] size File size in bytes.
+   *  \param [in] fullPath Full path to the file, which must be inside the backup root.
+   ***************************************************************************/
+  void add(const QString& hash, const quint64 size, const QString& fullPath);
+
+  //**************************************************************************
+  /*! \brief Make a file the canonical file for its content, replacing any existing canonical file.
+   *
+   *  Used when the existing canonical file can not accept more links.
+   *  \param [in] hash Hash value of the content.
+   *  \param [in] size File size in bytes.
+   *  \param [in] fullPath Full path to the file, which must be inside the backup root.
+   ***************************************************************************/
+  void replace(const QString& hash, const quint64 size, const QString& fullPath);
+
+  //**************************************************************************
+  /*! \brief Remove every entry whose canonical file no longer exists or was replaced.
+   *
+   *  \return Number of entries removed.
+   ***************************************************************************/
+  int garbageCollect();
+
+  //**************************************************************************
+  /*! \brief Split a full path into the backup directory that holds it and the path in that backup.
+   *
+   *  \param [in] fullPath Full path to a file inside the backup root, such as one returned by find().
+   *  \param [out] backupDir Full path to the backup directory, such as "<to>/20260101-120000".
+   *  \param [out] relativePath Path relative to the backup directory, as in its catalog.
+   *  \return True if the path is inside a backup directory of the backup root.
+   ***************************************************************************/
+  bool splitPath(const QString& fullPath, QString& backupDir, QString& relativePath) const;
+
+  /*! \brief Set the link count at which a canonical file is no longer used. */
+  void setMaxLinks(const quint64 maxLinks);
+
+  /*! \brief Number of entries in the index. */
+  int count() const;
+
+  /*! \brief Number of times find() returned a canonical file. */
+  qint64 getHits() const;
+
+  /*! \brief Number of canonical files dropped because they reached the maximum link count. */
+  qint64 getRollovers() const;
+
+  /*! \brief Returns True if the index changed since it was read. */
+  bool isModified() const;
+
+private:
+  /*! \brief Canonical file for a single hash and size. */
+  struct Canonical
+  {
+    quint64 inode;
+    QString relativePath;
+  };
+
+  /*! \brief Key for the hash and size. */
+  static QString makeKey(const QString& hash, const quint64 size);
+
+  /*! \brief Insert an entry, the path must be inside the backup root. */
+  void insert(const QString& key, const QString& fullPath, const bool replaceExisting);
+
+  /*! \brief Backup root directory, always ends with a '/'. */
+  QString m_toPath;
+
+  /*! \brief Full path to the index file. */
+  QString m_indexPath;
+
+  /*! \brief Map hash and size to the canonical file. */
+  QHash<QString, Canonical> m_entries;
+
+  quint64 m_maxLinks;
+  qint64 m_hits;
+  qint64 m_rollovers;
+  bool m_modified;
+};
+
+inline void ContentIndex::setMaxLinks(const quint64 maxLinks)
+{
+  m_maxLinks = maxLinks;
+}
+
+inline int ContentIndex::count() const
+{
+  return m_entries.count();
+}
+
+inline qint64 ContentIndex::getHits() const
+{
+  return m_hits;
+}
+
+inline qint64 ContentIndex::getRollovers() const
+{
+  return m_rollovers;
+}
+
+inline bool ContentIndex::isModified() const
+{
+  return m_modified;
+}
+
+#endif // CONTENTINDEX_H
@@ -1,22 +1,90 @@
 #include "copylinkutil.h"
 #include "enhancedqcryptographichash.h"
+#include "backupprogress.h"
+#include "perftrace.h"
 
 #include <QElapsedTimer>
 #include <QFile>
 #include <QFileInfo>
 #include <QDir>
 #include <QDebug>
+#include <QRegularExpression>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+#include <QVector>
 #include <unistd.h>  // Contains the "link" method.
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+
+// Largest request passed to copy_file_range(), so that cancel is checked now and then.
+static const qint64 s_kernelCopyChunk = 256L * 1024L * 1024L;
+
+// Holes in a sparse file are hashed from a block of zeros, and data is read in blocks of the same size.
+static const qint64 s_sparseBlockSize = 1024L * 1024L;
+
+//**************************************************************************
+/*! \brief Returns True if fewer bytes are allocated to a file than its size, so it has holes. */
+//**************************************************************************
+static bool hasHoles(const int fd, const qint64 size)
+{
+  struct stat st;
+  return fd >= 0 && size > 0 && fstat(fd, &st) == 0 && static_cast<qint64>(st.st_blocks) * 512 < size;
+}
+
+//**************************************************************************
+/*! \brief Hash part of a sparse file; holes are hashed as zeros without reading them.
+ *
+ *  \param [in] fd Open file.
+ *  \param [in] offset First byte to hash.
+ *  \param [in] length Number of bytes to hash.
+ *  \param [in,out] hash Hash that receives the data.
+ *  \param [in] cancelRequested Stop when set.
+ *  \param [in,out] holeBytes Incremented by the number of bytes in holes.
+ *  \return True if every byte was hashed.
+ ***************************************************************************/
+static bool hashSparseRange(const int fd, qint64 offset, const qint64 length, QCryptographicHash& hash, const std::atomic<bool>& cancelRequested, qint64& holeBytes)
+{
+  static const QByteArray zeros(static_cast<int>(s_sparseBlockSize), '\0');
+  QByteArray buffer(static_cast<int>(s_sparseBlockSize), Qt::Uninitialized);
+  const qint64 end = offset + length;
+  while (offset < end && !cancelRequested)
+  {
+    qint64 dataStart = end;
+    qint64 dataEnd = end;
+    CopyLinkUtil::nextDataExtent(fd, offset, end, dataStart, dataEnd);
+    while (offset < dataStart)
+    {
+      const qint64 n = qMin(dataStart - offset, s_sparseBlockSize);
+      hash.addData(QByteArrayView(zeros.constData(), n));
+      holeBytes += n;
+      offset += n;
+    }
+    while (offset < dataEnd && !cancelRequested)
+    {
+      const ssize_t n = pread(fd, buffer.data(), static_cast<size_t>(qMin(dataEnd - offset, s_sparseBlockSize)), offset);
+      if (n <= 0)
+      {
+        return false;
+      }
+      hash.addData(QByteArrayView(buffer.constData(), n));
+      offset += n;
+    }
+  }
+  return offset == end;
+}
 
 // Report every 2GB of data.
 qint64 CopyLinkUtil::s_readReportBytes = 2L * 1024L * 1024L * 1024L;
 
-CopyLinkUtil::CopyLinkUtil() : m_bytesCopied(0), m_bytesLinked(0), m_bytesHashed(0), m_bytesCopiedHashed(0), m_millisCopied(0), m_millisLinked(0), m_millisHashed(0), m_millisCopiedHashed(0), m_buffer(nullptr), m_bufferSize(0), m_hashGenerator(nullptr), m_timer(nullptr), m_cancelRequested(false), m_useHardLink(true), m_hashMethod(EnhancedQCryptographicHash::getDefaultAlgorithm())
+CopyLinkUtil::CopyLinkUtil() : m_bytesCopied(0), m_bytesLinked(0), m_bytesHashed(0), m_bytesCopiedHashed(0), m_millisCopied(0), m_millisLinked(0), m_millisHashed(0), m_millisCopiedHashed(0), m_linkRollovers(0), m_bytesHoles(0), m_lastLinkErrno(0), m_buffer(nullptr), m_bufferSize(0), m_hashGenerator(nullptr), m_timer(nullptr), m_cancelRequested(false), m_useHardLink(true), m_hashMethod(EnhancedQCryptographicHash::getDefaultAlgorithm()), m_hashChunkSize(0), m_hashThreadPool(nullptr), m_hashThreadCount(0), m_hashCache(nullptr), m_progress(nullptr), m_createDirectories(true)
 {
   m_timer = new QElapsedTimer();
 }
 
-CopyLinkUtil::CopyLinkUtil(const CopyLinkUtil& obj) : m_bytesCopied(obj.m_bytesCopied), m_bytesLinked(obj.m_bytesLinked), m_bytesHashed(obj.m_bytesHashed), m_bytesCopiedHashed(obj.m_bytesCopiedHashed), m_millisCopied(obj.m_millisCopied), m_millisLinked(obj.m_millisLinked), m_millisHashed(obj.m_millisHashed), m_millisCopiedHashed(obj.m_millisCopiedHashed), m_buffer(nullptr), m_bufferSize(0), m_hashGenerator(nullptr), m_timer(nullptr), m_cancelRequested(false), m_useHardLink(true), m_hashMethod(obj.m_hashMethod)
+CopyLinkUtil::CopyLinkUtil(const CopyLinkUtil& obj) : m_bytesCopied(obj.m_bytesCopied), m_bytesLinked(obj.m_bytesLinked), m_bytesHashed(obj.m_bytesHashed), m_bytesCopiedHashed(obj.m_bytesCopiedHashed), m_millisCopied(obj.m_millisCopied), m_millisLinked(obj.m_millisLinked), m_millisHashed(obj.m_millisHashed), m_millisCopiedHashed(obj.m_millisCopiedHashed), m_linkRollovers(obj.m_linkRollovers), m_bytesHoles(obj.m_bytesHoles), m_lastLinkErrno(0), m_buffer(nullptr), m_bufferSize(0), m_hashGenerator(nullptr), m_timer(nullptr), m_cancelRequested(false), m_useHardLink(true), m_hashMethod(obj.m_hashMethod), m_hashChunkSize(obj.m_hashChunkSize), m_hashThreadPool(nullptr), m_hashThreadCount(obj.m_hashThreadCount), m_hashCache(obj.m_hashCache), m_progress(obj.m_progress), m_createDirectories(obj.m_createDirectories)
 {
   m_timer = new QElapsedTimer();
   if (obj.m_hashGenerator != nullptr)
@@ -60,6 +128,12 @@ CopyLinkUtil::~CopyLinkUtil()
     delete m_hashGenerator;
     m_hashGenerator = nullptr;
   }
+  if (m_hashThreadPool != nullptr)
+  {
+    m_hashThreadPool->waitForDone();
+    delete m_hashThreadPool;
+    m_hashThreadPool = nullptr;
+  }
 }
 
 void CopyLinkUtil::resetStats()
@@ -72,6 +146,9 @@ void CopyLinkUtil::resetStats()
     m_millisLinked = 0;
     m_millisHashed = 0;
     m_millisCopiedHashed = 0;
+    m_linkRollovers = 0;
+    m_bytesHoles = 0;
+    m_lastLinkErrno = 0;
     if (m_timer != nullptr)
     {
       delete m_timer;
@@ -101,6 +178,11 @@ qint64 CopyLinkUtil::getBytesCopiedHashed() const
   return m_bytesCopiedHashed;
 }
 
+qint64 CopyLinkUtil::getBytesHoles() const
+{
+  return m_bytesHoles;
+}
+
 qint64 CopyLinkUtil::getMillisCopied() const
 {
   return m_millisCopied;
@@ -171,6 +253,170 @@ bool CopyLinkUtil::setHashType(QCryptographicHash::Algorithm hashType)
     m_hashGenerator = nullptr;
   }
   m_hashGenerator = new EnhancedQCryptographicHash(hashType);
+  m_hashMethod = hashType;
+  return true;
+}
+
+void CopyLinkUtil::setHashChunkSize(const qint64 chunkSize)
+{
+  m_hashChunkSize = (chunkSize > 0) ? chunkSize : 0;
+}
+
+void CopyLinkUtil::setHashThreadCount(const int threadCount)
+{
+  m_hashThreadCount = threadCount;
+  if (m_hashThreadPool != nullptr)
+  {
+    m_hashThreadPool->setMaxThreadCount(m_hashThreadCount > 0 ? m_hashThreadCount : QThread::idealThreadCount());
+  }
+}
+
+QString CopyLinkUtil::hashModeName(const QString& hashMethod, const qint64 chunkSize)
+{
+  if (chunkSize <= 0)
+  {
+    return hashMethod;
+  }
+  const qint64 oneMB = 1024L * 1024L;
+  if (chunkSize % oneMB == 0)
+  {
+    return QString("%1-Tree%2M").arg(hashMethod, QString::number(chunkSize / oneMB));
+  }
+  return QString("%1-Tree%2").arg(hashMethod, QString::number(chunkSize));
+}
+
+bool CopyLinkUtil::parseHashModeName(const QString& name, QString& hashMethod, qint64& chunkSize)
+{
+  QRegularExpression modeRegExp("^([A-Za-z0-9]+)(-Tree(\\d+)(M?))?$", QRegularExpression::CaseInsensitiveOption);
+  QRegularExpressionMatch match = modeRegExp.match(name);
+  if (!match.hasMatch())
+  {
+    return false;
+  }
+  bool ok = false;
+  EnhancedQCryptographicHash::toAlgorithm(match.captured(1), &ok);
+  if (!ok)
+  {
+    return false;
+  }
+  hashMethod = match.captured(1);
+  chunkSize = 0;
+  if (!match.captured(2).isEmpty())
+  {
+    chunkSize = match.captured(3).toLongLong();
+    if (!match.captured(4).isEmpty())
+    {
+      chunkSize *= 1024L * 1024L;
+    }
+  }
+  return true;
+}
+
+//**************************************************************************
+/*! \brief Hash one chunk of a file for a tree hash. Each chunk opens its own copy of the file.
+ ***************************************************************************/
+class TreeHashChunkTask : public QRunnable
+{
+public:
+  TreeHashChunkTask(const QString& path, qint64 offset, qint64 length, QCryptographicHash::Algorithm algorithm, const std::atomic<bool>& cancelRequested, QByteArray* result, qint64* holeBytes) :
+    m_path(path), m_offset(offset), m_length(length), m_algorithm(algorithm), m_cancelRequested(cancelRequested), m_result(result), m_holeBytes(holeBytes)
+  {
+  }
+
+  void run() override
+  {
+    PerfScope scope(PerfTrace::HashChunk);
+    QFile file(m_path);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+      return;
+    }
+    if (m_holeBytes != nullptr)
+    {
+      QCryptographicHash hash(m_algorithm);
+      if (hashSparseRange(file.handle(), m_offset, m_length, hash, m_cancelRequested, *m_holeBytes))
+      {
+        *m_result = hash.result();
+      }
+      return;
+    }
+    if (!file.seek(m_offset))
+    {
+      return;
+    }
+    // Read in smaller blocks so that many threads do not consume a huge amount of memory.
+    const qint64 blockSize = qMin(m_length, s_blockSize);
+    QByteArray buffer(static_cast<int>(qMax(blockSize, qint64(1))), Qt::Uninitialized);
+    QCryptographicHash hash(m_algorithm);
+    qint64 remaining = m_length;
+    while (remaining > 0 && !m_cancelRequested)
+    {
+      qint64 numRead = file.read(buffer.data(), qMin(remaining, blockSize));
+      if (numRead <= 0)
+      {
+        return;
+      }
+      hash.addData(QByteArrayView(buffer.constData(), numRead));
+      remaining -= numRead;
+    }
+    if (remaining == 0)
+    {
+      *m_result = hash.result();
+    }
+  }
+
+private:
+  static constexpr qint64 s_blockSize = 4L * 1024L * 1024L;
+  QString m_path;
+  qint64 m_offset;
+  qint64 m_length;
+  QCryptographicHash::Algorithm m_algorithm;
+  const std::atomic<bool>& m_cancelRequested;
+  QByteArray* m_result;
+  /*! \brief Bytes in holes in the chunk; null unless the file is sparse. */
+  qint64* m_holeBytes;
+};
+
+bool CopyLinkUtil::generateTreeHash(const QString& path, const qint64 fileSize, const bool sparse, qint64& holeBytes)
+{
+  if (m_hashThreadPool == nullptr)
+  {
+    m_hashThreadPool = new QThreadPool();
+    m_hashThreadPool->setMaxThreadCount(m_hashThreadCount > 0 ? m_hashThreadCount : QThread::idealThreadCount());
+  }
+
+  // An empty file is a single empty chunk.
+  const qint64 numChunks = qMax(qint64(1), (fileSize + m_hashChunkSize - 1) / m_hashChunkSize);
+  QVector<QByteArray> chunkDigests(static_cast<int>(numChunks));
+  QVector<qint64> chunkHoles(sparse ? static_cast<int>(numChunks) : 0, 0);
+  for (qint64 i=0; i<numChunks; ++i)
+  {
+    const qint64 offset = i * m_hashChunkSize;
+    const qint64 length = qMin(m_hashChunkSize, fileSize - offset);
+    m_hashThreadPool->start(new TreeHashChunkTask(path, offset, length, m_hashMethod, m_cancelRequested, &chunkDigests[static_cast<int>(i)], sparse ? &chunkHoles[static_cast<int>(i)] : nullptr));
+  }
+  m_hashThreadPool->waitForDone();
+  holeBytes = 0;
+  for (const qint64 holes : chunkHoles)
+  {
+    holeBytes += holes;
+  }
+
+  if (isCancelRequested())
+  {
+    return false;
+  }
+  QCryptographicHash treeHash(m_hashMethod);
+  for (const QByteArray& digest : chunkDigests)
+  {
+    if (digest.isEmpty())
+    {
+      qDebug() << QString("Failed to hash a chunk of file: %1").arg(path);
+      return false;
+    }
+    treeHash.addData(digest);
+  }
+  m_lastTreeHash = treeHash.result();
   return true;
 }
 
@@ -185,10 +431,16 @@ bool CopyLinkUtil::linkFile(const QString& linkToThisFile, const QString& placeL
       std::cout << qPrintable(QString("??? HELP: Linking to %1").arg(placeLinkHere)) << std::endl;
       qDebug() << QString("??? HELP: Linking to %1").arg(placeLinkHere);
   }
+  PerfScope scope(PerfTrace::Link);
   m_timer->restart();
+  m_lastLinkErrno = 0;
   if (isUseHardLink())
   {
     noError = link(qPrintable(linkToThisFile), qPrintable(placeLinkHere)) == 0;
+    if (!noError)
+    {
+      m_lastLinkErrno = errno;
+    }
   }
   else
   {
@@ -209,6 +461,7 @@ bool CopyLinkUtil::copyFile(const QString& copyFromPath, const QString& copyToPa
 
 bool CopyLinkUtil::generateHash(const QString& copyFromPath)
 {
+  PerfScope scope(PerfTrace::Hash);
   QFile fileToRead(copyFromPath);
 
   QFileInfo fileInfo(copyFromPath);
@@ -226,9 +479,44 @@ bool CopyLinkUtil::generateHash(const QString& copyFromPath)
   }
 
   m_timer->restart();
+  qint64 totalRead = fileToRead.size();
+  const bool sparse = hasHoles(fileToRead.handle(), totalRead);
+  qint64 holeBytes = 0;
+  if (isTreeHash())
+  {
+    bool hashOK = generateTreeHash(copyFromPath, totalRead, sparse, holeBytes);
+    fileToRead.close();
+    if (hashOK)
+    {
+      m_millisHashed += m_timer->elapsed();
+      m_bytesHashed += totalRead - holeBytes;
+      m_bytesHoles += holeBytes;
+      if (m_progress != nullptr)
+      {
+        m_progress->add(BackupProgress::BytesHashed, totalRead);
+      }
+    }
+    return hashOK;
+  }
   m_hashGenerator->reset();
+  if (sparse)
+  {
+    const bool hashOK = hashSparseRange(fileToRead.handle(), 0, totalRead, *m_hashGenerator, m_cancelRequested, holeBytes);
+    fileToRead.close();
+    if (hashOK && !isCancelRequested())
+    {
+      m_millisHashed += m_timer->elapsed();
+      m_bytesHashed += totalRead - holeBytes;
+      m_bytesHoles += holeBytes;
+      if (m_progress != nullptr)
+      {
+        m_progress->add(BackupProgress::BytesHashed, totalRead);
+      }
+      return true;
+    }
+    return false;
+  }
   m_hashGenerator->addData(&fileToRead);
-  qint64 totalRead = fileToRead.size();
   /***
   qint64 totalRead = 0;
   qint64 numRead = fileToRead.read(m_buffer, m_bufferSize);
@@ -253,6 +541,10 @@ bool CopyLinkUtil::generateHash(const QString& copyFromPath)
   {
     m_millisHashed += m_timer->elapsed();
     m_bytesHashed += totalRead;
+    if (m_progress != nullptr)
+    {
+      m_progress->add(BackupProgress::BytesHashed, totalRead);
+    }
     fileToRead.close();
     return true;
   }
@@ -264,6 +556,128 @@ bool CopyLinkUtil::copyFileGenerateHash(const QString& copyFromPath, const QStri
   return internalCopyFile(copyFromPath, copyToPath, true);
 }
 
+CopyLinkUtil::KernelCopyResult CopyLinkUtil::kernelCopy(QFile& fileToRead, QFile& fileToWrite, qint64& numCopied)
+{
+  numCopied = 0;
+  const int readFd = fileToRead.handle();
+  const int writeFd = fileToWrite.handle();
+  const qint64 size = fileToRead.size();
+  if (readFd < 0 || writeFd < 0)
+  {
+    return KernelCopyUnsupported;
+  }
+
+  // A reflink shares the blocks, so nothing is read or written.
+  if (size > 0 && ioctl(writeFd, FICLONE, readFd) == 0)
+  {
+    numCopied = size;
+    if (m_progress != nullptr)
+    {
+      m_progress->add(BackupProgress::BytesCopied, size);
+    }
+    return KernelCopyDone;
+  }
+  if (hasHoles(readFd, size))
+  {
+    return sparseCopy(readFd, writeFd, size, numCopied);
+  }
+
+  qint64 remaining = size;
+  while (remaining > 0 && !isCancelRequested())
+  {
+    const ssize_t n = copy_file_range(readFd, nullptr, writeFd, nullptr, static_cast<size_t>(qMin(remaining, s_kernelCopyChunk)), 0);
+    if (n < 0)
+    {
+      // Old kernels and some file systems do not support it; nothing was copied, so buffered copy starts over.
+      if (numCopied == 0 && (errno == ENOSYS || errno == EXDEV || errno == EOPNOTSUPP || errno == EINVAL))
+      {
+        return KernelCopyUnsupported;
+      }
+      return KernelCopyFailed;
+    }
+    if (n == 0)
+    {
+      // The file became shorter while it was copied.
+      break;
+    }
+    numCopied += n;
+    remaining -= n;
+    if (m_progress != nullptr)
+    {
+      m_progress->add(BackupProgress::BytesCopied, n);
+    }
+  }
+  return (remaining == 0) ? KernelCopyDone : KernelCopyFailed;
+}
+
+CopyLinkUtil::KernelCopyResult CopyLinkUtil::sparseCopy(const int readFd, const int writeFd, const qint64 size, qint64& numCopied)
+{
+  numCopied = 0;
+  QByteArray buffer;
+  bool useKernel = true;
+  qint64 offset = 0;
+  qint64 end = size;
+  while (offset < end && !isCancelRequested())
+  {
+    qint64 dataStart;
+    qint64 dataEnd;
+    if (!nextDataExtent(readFd, offset, end, dataStart, dataEnd))
+    {
+      break;
+    }
+    // Nothing is written for a hole, so it stays a hole in the copy.
+    m_bytesHoles += dataStart - offset;
+    offset = dataStart;
+    while (offset < dataEnd && !isCancelRequested())
+    {
+      const qint64 length = qMin(dataEnd - offset, s_kernelCopyChunk);
+      ssize_t n = -1;
+      if (useKernel)
+      {
+        loff_t readOffset = offset;
+        loff_t writeOffset = offset;
+        n = copy_file_range(readFd, &readOffset, writeFd, &writeOffset, static_cast<size_t>(length), 0);
+        useKernel = (n >= 0 || (errno != ENOSYS && errno != EXDEV && errno != EOPNOTSUPP && errno != EINVAL));
+      }
+      if (!useKernel)
+      {
+        if (buffer.isEmpty())
+        {
+          buffer.resize(static_cast<int>(s_sparseBlockSize));
+        }
+        n = pread(readFd, buffer.data(), static_cast<size_t>(qMin(length, s_sparseBlockSize)), offset);
+        if (n > 0 && pwrite(writeFd, buffer.constData(), static_cast<size_t>(n), offset) != n)
+        {
+          n = -1;
+        }
+      }
+      if (n < 0)
+      {
+        return KernelCopyFailed;
+      }
+      if (n == 0)
+      {
+        // The file became shorter while it was copied.
+        end = offset;
+        break;
+      }
+      offset += n;
+      numCopied += n;
+      if (m_progress != nullptr)
+      {
+        m_progress->add(BackupProgress::BytesCopied, n);
+      }
+    }
+  }
+  if (isCancelRequested())
+  {
+    return KernelCopyFailed;
+  }
+  m_bytesHoles += end - offset;
+  // A hole at the end is only a size.
+  return (ftruncate(writeFd, end) == 0) ? KernelCopyDone : KernelCopyFailed;
+}
+
 bool CopyLinkUtil::internalCopyFile(const QString& copyFromPath, const QString& copyToPath, const bool doHash)
 {
   //qDebug() << qPrintable(QString("Ready to read from : %1").arg(copyFromPath);
@@ -283,7 +697,7 @@ bool CopyLinkUtil::internalCopyFile(const QString& copyFromPath, const QString&
   }
 
   QDir dirFileToWrite(pathToFileToWrite);
-  if (!dirFileToWrite.exists(pathToFileToWrite) && !dirFileToWrite.mkpath(pathToFileToWrite))
+  if (m_createDirectories && !dirFileToWrite.exists(pathToFileToWrite) && !dirFileToWrite.mkpath(pathToFileToWrite))
   {
     // Failed to create the path to the file.
     // Generate error and get out.
@@ -322,23 +736,82 @@ bool CopyLinkUtil::internalCopyFile(const QString& copyFromPath, const QString&
   }
 
   m_timer->restart();
+  // Only the data extents of a sparse file are read, hashed, and written.
+  const bool sparse = hasHoles(fileToRead.handle(), fileToRead.size());
   if (doHash) {
-      m_hashGenerator->addData(&fileToRead);
-      fileToRead.close();
-      if (!fileToRead.open(QIODevice::ReadOnly)) {
-          qDebug() << QString("Failed to open file to read/copy: %1").arg(copyFromPath);
+      // The hash is read before the copy, so each is timed separately.
+      bool hashOK = true;
+      {
+          PerfScope hashScope(PerfTrace::Hash);
+          if (isTreeHash()) {
+              qint64 holeBytes = 0;
+              hashOK = generateTreeHash(copyFromPath, fileToRead.size(), sparse, holeBytes);
+          } else if (sparse) {
+              // The holes are counted by the copy.
+              qint64 holeBytes = 0;
+              hashOK = hashSparseRange(fileToRead.handle(), 0, fileToRead.size(), *m_hashGenerator, m_cancelRequested, holeBytes);
+          } else {
+              m_hashGenerator->addData(&fileToRead);
+          }
+      }
+      if (!hashOK) {
+          qDebug() << QString("Failed to generate a tree hash while copying: %1").arg(copyFromPath);
           fileToWrite.close();
+          fileToRead.close();
           fileToWrite.remove();
           return false;
       }
+      if (!isTreeHash() && !sparse) {
+          fileToRead.close();
+          if (!fileToRead.open(QIODevice::ReadOnly)) {
+              qDebug() << QString("Failed to open file to read/copy: %1").arg(copyFromPath);
+              fileToWrite.close();
+              fileToWrite.remove();
+              return false;
+          }
+      }
   }
 
+  PerfScope copyScope(PerfTrace::Copy);
   qint64 totalRead = 0;
+  // Without a hash, or with the hash already read above, the data need not pass through this process.
+  const KernelCopyResult kernelResult = kernelCopy(fileToRead, fileToWrite, totalRead);
+  if (kernelResult != KernelCopyUnsupported)
+  {
+    fileToWrite.close();
+    fileToRead.close();
+    if (kernelResult == KernelCopyFailed || isCancelRequested())
+    {
+      qDebug() << QString("Removing file because error encountered : %1").arg(copyToPath);
+      fileToWrite.remove();
+      return false;
+    }
+    if (doHash)
+    {
+      m_millisCopiedHashed += m_timer->elapsed();
+      m_bytesCopiedHashed += totalRead;
+      if (m_progress != nullptr)
+      {
+        m_progress->add(BackupProgress::BytesHashed, totalRead);
+      }
+    }
+    else
+    {
+      m_millisCopied += m_timer->elapsed();
+      m_bytesCopied += totalRead;
+    }
+    fileToWrite.setPermissions(fileToRead.permissions());
+    return true;
+  }
   qint64 numRead = fileToRead.read(m_buffer, m_bufferSize);
   while (numRead > 0 && fileToRead.error() == QFile::NoError && fileToWrite.error() == QFile::NoError && !isCancelRequested())
   {
     totalRead += numRead;
     fileToWrite.write(m_buffer, numRead);
+    if (m_progress != nullptr)
+    {
+      m_progress->add(BackupProgress::BytesCopied, numRead);
+    }
     // QT Deprecated addData in this way so do it first
     // Takes longer but not worth the trouble to figure out
     // how to do this efficiently using a QByteArrayView
@@ -368,6 +841,10 @@ bool CopyLinkUtil::internalCopyFile(const QString& copyFromPath, const QString&
     {
       m_millisCopiedHashed += m_timer->elapsed();
       m_bytesCopiedHashed += totalRead;
+      if (m_progress != nullptr)
+      {
+        m_progress->add(BackupProgress::BytesHashed, totalRead);
+      }
     }
     else
     {
@@ -384,6 +861,10 @@ bool CopyLinkUtil::internalCopyFile(const QString& copyFromPath, const QString&
 
 QString CopyLinkUtil::getLastHash() const
 {
+  if (isTreeHash())
+  {
+    return m_lastTreeHash.toHex().toUpper();
+  }
   return m_hashGenerator->result().toHex().toUpper();
 }
 
@@ -406,6 +887,14 @@ QString CopyLinkUtil::getStats() const
   {
     sList.append(QString("%1 Linked in %2 seconds").arg(getBPS(getBytesLinked(), 0), QString::number(getMillisLinked() / 1000)));
   }
+  if (getBytesHoles() > 0)
+  {
+    sList.append(QString("%1 skipped as holes in sparse files").arg(getBPS(getBytesHoles(), 0)));
+  }
+  if (getLinkRollovers() > 0)
+  {
+    sList.append(QString("%1 files copied because the link target reached the maximum number of links").arg(getLinkRollovers()));
+  }
   sList.append(QString("%1 total copied and %2 total read (copied and hashed)").arg(getBPS(getBytesCopiedHashed() + getBytesCopied(), 0), getBPS(getBytesCopiedHashed() + getBytesCopied() + getBytesHashed(), 0)));
   QString s;
   for (int i=0; i<sList.count(); ++i)
@@ -448,4 +937,27 @@ QString CopyLinkUtil::getBPS(const qint64 numBytes, const qint64 millis)
   }
 }
 
+bool CopyLinkUtil::nextDataExtent(const int fd, const qint64 offset, const qint64 end, qint64& dataStart, qint64& dataEnd)
+{
+  const off_t data = lseek(fd, offset, SEEK_DATA);
+  if (data < 0)
+  {
+    if (errno == ENXIO)
+    {
+      return false;
+    }
+    dataStart = offset;
+    dataEnd = end;
+    return true;
+  }
+  if (data >= end)
+  {
+    return false;
+  }
+  const off_t hole = lseek(fd, data, SEEK_HOLE);
+  dataStart = data;
+  dataEnd = (hole < 0) ? end : qMin(static_cast<qint64>(hole), end);
+  return true;
+}
+
 
@@ -2,9 +2,17 @@
 #define COPYLINKUTIL_H
 
 #include <QString>
+#include <QByteArray>
 #include "enhancedqcryptographichash.h"
 
+#include <atomic>
+#include <cerrno>
+
 class QElapsedTimer;
+class QFile;
+class QThreadPool;
+class HashCache;
+class BackupProgress;
 
 
 //**************************************************************************
@@ -67,6 +75,9 @@ public:
     /*! \brief Get number of bytes copied and hashed (at the same time) during the backup. */
     qint64 getBytesCopiedHashed() const;
 
+    /*! \brief Get number of bytes in holes in sparse files, which were neither read nor written. */
+    qint64 getBytesHoles() const;
+
     /*! \brief Get number of milliseconds used to copy data. */
     qint64 getMillisCopied() const;
 
@@ -110,6 +121,80 @@ public:
      ***************************************************************************/
     bool setHashType(QCryptographicHash::Algorithm hashType);
 
+    //**************************************************************************
+    /*! \brief Set the chunk size used for a chunked tree hash.
+     *
+     *  When the chunk size is greater than zero, a file is split into fixed size chunks,
+     *  each chunk is hashed on a thread pool, and the hash of the concatenated chunk digests
+     *  is the file's hash. A tree hash is NOT the same value as a sequential hash of the file.
+     *
+     *  \param [in] chunkSize Chunk size in bytes, zero (the default) hashes sequentially.
+     ***************************************************************************/
+    void setHashChunkSize(const qint64 chunkSize);
+
+    /*! \brief Get the tree hash chunk size in bytes; zero means a sequential hash is used. */
+    qint64 getHashChunkSize() const;
+
+    /*! \brief Returns True if a chunked tree hash is generated rather than a sequential hash. */
+    bool isTreeHash() const;
+
+    //**************************************************************************
+    /*! \brief Set the maximum number of threads used to hash the chunks for a tree hash.
+     *
+     *  \param [in] threadCount Number of threads; less than 1 uses QThread::idealThreadCount().
+     ***************************************************************************/
+    void setHashThreadCount(const int threadCount);
+
+    //**************************************************************************
+    /*! \brief Build the name that identifies a hash method and mode, such as "Sha1" or "Sha1-Tree64M".
+     *
+     *  This name is used to name the file entries written with each backup so that hash values
+     *  are only compared with values generated the same way.
+     *
+     *  \param [in] hashMethod Hash method such as Sha1.
+     *  \param [in] chunkSize Tree hash chunk size, zero for a sequential hash.
+     *  \return Name that identifies the hash method and mode.
+     ***************************************************************************/
+    static QString hashModeName(const QString& hashMethod, const qint64 chunkSize);
+
+    //**************************************************************************
+    /*! \brief Parse a name created by hashModeName().
+     *
+     *  \param [in] name Hash mode name such as "Sha1-Tree64M"; case does not matter.
+     *  \param [out] hashMethod Hash method such as Sha1.
+     *  \param [out] chunkSize Tree hash chunk size, zero for a sequential hash.
+     *  \return True if the name is recognized.
+     ***************************************************************************/
+    static bool parseHashModeName(const QString& name, QString& hashMethod, qint64& chunkSize);
+
+    //**************************************************************************
+    /*! \brief Set the persistent hash cache consulted before a file is hashed.
+     *
+     *  The cache is not owned by this object.
+     *  \param [in] hashCache Open cache, or nullptr to not use a cache.
+     ***************************************************************************/
+    void setHashCache(HashCache* hashCache);
+
+    /*! \brief Get the persistent hash cache, which may be nullptr. */
+    HashCache* getHashCache() const;
+
+    //**************************************************************************
+    /*! \brief Set the progress counters advanced as data is copied and hashed.
+     *
+     *  The progress object is not owned by this object.
+     *  \param [in] progress Progress for the running backup, or nullptr to not publish progress.
+     ***************************************************************************/
+    void setProgress(BackupProgress* progress);
+
+    /*! \brief Get the progress counters, which may be nullptr. */
+    BackupProgress* getProgress() const;
+
+    /*! \brief Set if a copy creates the directory that receives the file; false when the caller creates every directory first. */
+    void setCreateDirectories(const bool createDirectories);
+
+    /*! \brief Returns True if a copy creates the directory that receives the file, which is the default. */
+    bool isCreateDirectories() const;
+
     //**************************************************************************
     /*! \brief Copy a file without calculating the hash.
      *
@@ -152,6 +237,19 @@ public:
      ***************************************************************************/
     bool linkFile(const QString& linkToThisFile, const QString& placeLinkHere);
 
+    //**************************************************************************
+    /*! \brief Returns True if the last call to linkFile() failed because the existing file has the maximum number of links (EMLINK).
+     *
+     *  The caller is expected to copy the file instead; the copy becomes the new link target.
+     ***************************************************************************/
+    bool isLastLinkTooManyLinks() const;
+
+    /*! \brief Record that a file was copied because the link target had the maximum number of links. */
+    void addLinkRollover();
+
+    /*! \brief Get number of files copied because the link target had the maximum number of links. */
+    qint64 getLinkRollovers() const;
+
     /*! \brief Get a upper-case representation of the current hash generator. */
     QString getLastHash() const;
 
@@ -177,6 +275,20 @@ public:
      ***************************************************************************/
     static QString getBPS(const qint64 numBytes, const qint64 millis);
 
+    //**************************************************************************
+    /*! \brief Find the next data extent at or after an offset with SEEK_DATA and SEEK_HOLE.
+     *
+     *  A file system without SEEK_DATA reports everything as data.
+     *
+     *  \param [in] fd Open file.
+     *  \param [in] offset Where to start looking.
+     *  \param [in] end Where to stop looking, usually the file size.
+     *  \param [out] dataStart Start of the data.
+     *  \param [out] dataEnd End of the data, where the next hole starts, no larger than end.
+     *  \return False if there is only a hole from offset to end.
+     ***************************************************************************/
+    static bool nextDataExtent(const int fd, const qint64 offset, const qint64 end, qint64& dataStart, qint64& dataEnd);
+
     /*! \brief Reset the stats for a new backup. */
     void resetStats();
 
@@ -205,6 +317,41 @@ private:
      */
     bool internalCopyFile(const QString& copyFromPath, const QString& copyToPath, const bool doHash);
 
+    /*! \brief Result of kernelCopy(). */
+    enum KernelCopyResult {KernelCopyDone, KernelCopyUnsupported, KernelCopyFailed};
+
+    //**************************************************************************
+    /*! \brief Copy an open file inside the kernel, as a reflink (FICLONE) if the file system shares blocks, otherwise with copy_file_range().
+     *
+     *  \param [in] fileToRead Open file to copy from.
+     *  \param [in] fileToWrite Empty open file to copy to.
+     *  \param [out] numCopied Number of bytes copied.
+     *  \return KernelCopyUnsupported if nothing was copied and the buffered copy should be used.
+     */
+    KernelCopyResult kernelCopy(QFile& fileToRead, QFile& fileToWrite, qint64& numCopied);
+
+    //**************************************************************************
+    /*! \brief Copy only the data extents of a sparse file, found with SEEK_DATA and SEEK_HOLE, so the holes stay holes.
+     *
+     *  \param [in] readFd File to copy from.
+     *  \param [in] writeFd Empty file to copy to.
+     *  \param [in] size Size of the file to copy.
+     *  \param [out] numCopied Number of bytes of data copied, not counting holes.
+     *  \return KernelCopyDone if the file was copied, otherwise KernelCopyFailed.
+     */
+    KernelCopyResult sparseCopy(const int readFd, const int writeFd, const qint64 size, qint64& numCopied);
+
+    //**************************************************************************
+    /*! \brief Generate a chunked tree hash for a file using the hash thread pool. Statistics are not updated.
+     *
+     *  \param [in] path Full path to an existing file.
+     *  \param [in] fileSize Size of the file in bytes.
+     *  \param [in] sparse If true, holes are hashed as zeros without reading them.
+     *  \param [out] holeBytes Number of bytes in holes; zero unless sparse.
+     *  \return True on success, false otherwise. On success, the result is saved for getLastHash().
+     */
+    bool generateTreeHash(const QString& path, const qint64 fileSize, const bool sparse, qint64& holeBytes);
+
     /*! \brief Total number of bytes copied (without generating a hash at the same time) since the stats were reset by resetStats(). */
     qint64 m_bytesCopied;
     /*! \brief Total number of bytes linked since the stats were reset by resetStats(). */
@@ -223,6 +370,15 @@ private:
     /*! \brief Total number of milliseconds while files were copied and hashed at the same time since the stats were reset by resetStats(). */
     qint64 m_millisCopiedHashed;
 
+    /*! \brief Total number of files copied because the link target had the maximum number of links since the stats were reset by resetStats(). */
+    qint64 m_linkRollovers;
+
+    /*! \brief Total number of bytes in holes that were skipped while copying or hashing sparse files since the stats were reset by resetStats(). */
+    qint64 m_bytesHoles;
+
+    /*! \brief Value of errno from the last call to linkFile(), zero if the link succeeded. */
+    int m_lastLinkErrno;
+
     //**************************************************************************
     /*! \brief Internal buffer used while reading files for copying and hashing.
      *  \sa CopyLinkUtil::setBufferSize()
@@ -244,8 +400,8 @@ private:
     /*! \brief Used to time operations such as copy, hash, and link. */
     QElapsedTimer * m_timer;
 
-    /*! \brief If true, then a cancel has been requested and copying / hashing is aborted; this is why I use my own copy routines, there is no way to cancel a built-in copy. */
-    bool m_cancelRequested;
+    /*! \brief If true, then a cancel has been requested and copying / hashing is aborted; this is why I use my own copy routines, there is no way to cancel a built-in copy. Checked by the hash threads. */
+    std::atomic<bool> m_cancelRequested;
 
     //**************************************************************************
     /*! \brief If set to true, hard links are used to reference "duplicate" files. This is expected to always be true.
@@ -259,6 +415,27 @@ private:
      *  \sa CopyLinkUtil::setHashType()
      ***************************************************************************/
     QCryptographicHash::Algorithm m_hashMethod;
+
+    /*! \brief Chunk size for a tree hash, zero for a sequential hash. */
+    qint64 m_hashChunkSize;
+
+    /*! \brief Result of the last tree hash. */
+    QByteArray m_lastTreeHash;
+
+    /*! \brief Threads used to hash the chunks of a single file. Created when first needed. */
+    QThreadPool* m_hashThreadPool;
+
+    /*! \brief Maximum number of threads used to generate a tree hash; less than 1 means use the ideal thread count. */
+    int m_hashThreadCount;
+
+    /*! \brief Persistent hash cache, which is not owned by this object. */
+    HashCache* m_hashCache;
+
+    /*! \brief Progress counters, which are not owned by this object. */
+    BackupProgress* m_progress;
+
+    /*! \brief If true, a copy checks for and creates the directory that receives the file. */
+    bool m_createDirectories;
 };
 
 inline bool CopyLinkUtil::isCancelRequested() const
@@ -271,6 +448,61 @@ inline void CopyLinkUtil::setCancelRequested(bool cancelRequested)
     m_cancelRequested = cancelRequested;
 }
 
+inline bool CopyLinkUtil::isLastLinkTooManyLinks() const
+{
+    return m_lastLinkErrno == EMLINK;
+}
+
+inline void CopyLinkUtil::addLinkRollover()
+{
+    ++m_linkRollovers;
+}
+
+inline qint64 CopyLinkUtil::getLinkRollovers() const
+{
+    return m_linkRollovers;
+}
+
+inline qint64 CopyLinkUtil::getHashChunkSize() const
+{
+    return m_hashChunkSize;
+}
+
+inline bool CopyLinkUtil::isTreeHash() const
+{
+    return m_hashChunkSize > 0;
+}
+
+inline void CopyLinkUtil::setHashCache(HashCache* hashCache)
+{
+    m_hashCache = hashCache;
+}
+
+inline HashCache* CopyLinkUtil::getHashCache() const
+{
+    return m_hashCache;
+}
+
+inline void CopyLinkUtil::setProgress(BackupProgress* progress)
+{
+    m_progress = progress;
+}
+
+inline BackupProgress* CopyLinkUtil::getProgress() const
+{
+    return m_progress;
+}
+
+inline void CopyLinkUtil::setCreateDirectories(const bool createDirectories)
+{
+    m_createDirectories = createDirectories;
+}
+
+inline bool CopyLinkUtil::isCreateDirectories() const
+{
+    return m_createDirectories;
+}
+
 inline bool CopyLinkUtil::isUseHardLink() const
 {
     return m_useHardLink;
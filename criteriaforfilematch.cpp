@@ -5,31 +5,26 @@
 #include <QMetaEnum>
 #include <QMetaObject>
 
-CriteriaForFileMatch::CriteriaForFileMatch(QObject *parent) : QObject(parent), m_criteria(new QMap<CriteriaField, bool>())
+CriteriaForFileMatch::CriteriaForFileMatch(QObject *parent) : QObject(parent)
 {
     setField(CriteriaField::FileName | CriteriaField::Time, false);
     setField(CriteriaField::FullPath | CriteriaField::Size | CriteriaField::Hash, true);
 }
 
-CriteriaForFileMatch::CriteriaForFileMatch(const CriteriaForFileMatch& criteria, QObject *parent) : QObject(parent), m_criteria(new QMap<CriteriaField, bool>())
+CriteriaForFileMatch::CriteriaForFileMatch(const CriteriaForFileMatch& criteria, QObject *parent) : QObject(parent)
 {
   copy(criteria);
 }
 
 CriteriaForFileMatch::~CriteriaForFileMatch()
 {
-    if (m_criteria != nullptr)
-    {
-        delete m_criteria;
-        m_criteria = nullptr;
-    }
 }
 
 CriteriaForFileMatch& CriteriaForFileMatch::operator=(const CriteriaForFileMatch& criteria)
 {
   if (this != & criteria)
   {
-      *m_criteria = *criteria.m_criteria;
+      m_criteria = criteria.m_criteria;
   }
   return *this;
 }
@@ -39,29 +34,16 @@ const CriteriaForFileMatch& CriteriaForFileMatch::copy(const CriteriaForFileMatc
   return operator=(criteria);
 }
 
-bool CriteriaForFileMatch::getField(CriteriaField field) const
-{
-    return ((m_criteria != nullptr) && (m_criteria->contains(field))) ? (*m_criteria)[field] : false;
-}
-
 void CriteriaForFileMatch::setField(CriteriaFields fields, bool value)
 {
     TRACE_MSG(QString(tr("Enter CriteriaForFileMatch::setField(%1, %2)")).arg(fields).arg(value), 10);
-    if (m_criteria == nullptr)
+    if (value)
     {
-        m_criteria = new QMap<CriteriaField, bool>();
+        m_criteria |= fields;
     }
-
-    const QMetaObject* metaObj = metaObject();
-    QMetaEnum metaEnum = metaObj->enumerator(metaObj->indexOfEnumerator("CriteriaField"));
-    for (int i=0; i<metaEnum.keyCount(); ++i)
+    else
     {
-      CriteriaField criteria = static_cast<CriteriaField>(metaEnum.value(i));
-      if ((fields & criteria) == criteria)
-      {
-        TRACE_MSG(QString(tr("Inserting(%1, %2)")).arg(criteria).arg(value), 15);
-        m_criteria->insert(criteria, value);
-      }
+        m_criteria &= ~fields;
     }
 }
 
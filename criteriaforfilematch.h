@@ -4,7 +4,6 @@
 #include <QObject>
 #include <QXmlStreamWriter>
 #include <QXmlStreamReader>
-#include <QMap>
 
 //**************************************************************************
 /*! \class CriteriaForFileMatch
@@ -174,6 +173,14 @@ public:
    ***************************************************************************/
   void setField(CriteriaFields fields, bool value);
 
+  //**************************************************************************
+  //! Get every field used as a matching criteria.
+  /*!
+   * \returns Flags with one bit set for each field used to match.
+   *
+   ***************************************************************************/
+  CriteriaFields getFields() const;
+
   //**************************************************************************
   //! Stream this criteria object as XML to the writer.
   /*!
@@ -235,8 +242,8 @@ public slots:
   void setAllDefault();
 
 private:
-  /*! \brief holds the criteria values. */
-  QMap<CriteriaField, bool>* m_criteria;
+  /*! \brief holds the criteria values; a set bit means the field is used to match. */
+  CriteriaFields m_criteria;
 };
 
 Q_DECLARE_OPERATORS_FOR_FLAGS(CriteriaForFileMatch::CriteriaFields)
@@ -252,6 +259,16 @@ inline QXmlStreamReader& operator>>(QXmlStreamReader& reader, CriteriaForFileMat
 }
 
 
+inline bool CriteriaForFileMatch::getField(CriteriaField field) const
+{
+    return m_criteria.testFlag(field);
+}
+
+inline CriteriaForFileMatch::CriteriaFields CriteriaForFileMatch::getFields() const
+{
+    return m_criteria;
+}
+
 inline bool CriteriaForFileMatch::isFileName() const
 {
     return getField(CriteriaField::FileName);
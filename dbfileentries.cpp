@@ -1,13 +1,15 @@
 #include "dbfileentries.h"
-#include "criteriaforfilematch.h"
 #include "linkbackupglobals.h"
+#include "hashcache.h"
+#include "catalogparser.h"
+#include "catalogwriter.h"
 #include <QFileInfo>
 #include <QTextStream>
 #include <QCryptographicHash>
 #include <QString>
 
 
-DBFileEntries::DBFileEntries()
+DBFileEntries::DBFileEntries() : m_indexes(MatchPlan::PathIndex | MatchPlan::HashSizeIndex)
 {
 }
 
@@ -20,7 +22,33 @@ void DBFileEntries::addEntry(DBFileEntry *entry)
   if (entry != nullptr) {
     int n = m_entries.count();
     m_entries.append(entry);
+    indexEntry(entry, n);
+  }
+}
+
+void DBFileEntries::addEntries(const QList<DBFileEntry*>& entries)
+{
+  const int first = m_entries.count();
+  m_entries.reserve(first + entries.count());
+  if (m_indexes.testFlag(MatchPlan::PathIndex)) {
+    m_pathToEntry.reserve(first + entries.count());
+  }
+  for (DBFileEntry* entry : entries) {
+    if (entry != nullptr) {
+      m_entries.append(entry);
+    }
+  }
+  for (int n=first; n<m_entries.count(); ++n) {
+    indexEntry(m_entries.at(n), n);
+  }
+}
+
+void DBFileEntries::indexEntry(const DBFileEntry* entry, const int n)
+{
+  if (m_indexes.testFlag(MatchPlan::PathIndex)) {
     m_pathToEntry.insert(entry->getPath(), n);
+  }
+  if (m_indexes.testFlag(MatchPlan::HashSizeIndex)) {
     if (!m_hashToSizeToEntry.contains(entry->getHash())) {
       QMultiHash<quint64, int> *hash = new QMultiHash<quint64, int>();
       hash->insert(entry->getSize(), n);
@@ -29,68 +57,106 @@ void DBFileEntries::addEntry(DBFileEntry *entry)
       m_hashToSizeToEntry.value(entry->getHash())->insert(entry->getSize(), n);
     }
   }
+  if (m_indexes.testFlag(MatchPlan::NameSizeIndex)) {
+    m_nameSizeToEntry.insert(qMakePair(fileNameOf(entry->getPath()), entry->getSize()), n);
+  }
+  if (m_indexes.testFlag(MatchPlan::SizeTimeIndex)) {
+    m_sizeTimeToEntry.insert(qMakePair(entry->getSize(), entry->getTime().toMSecsSinceEpoch()), n);
+  }
+  if (m_indexes.testFlag(MatchPlan::NameIndex)) {
+    m_nameToEntry.insert(fileNameOf(entry->getPath()), n);
+  }
+  if (m_indexes.testFlag(MatchPlan::SizeIndex)) {
+    m_sizeToEntry.insert(entry->getSize(), n);
+  }
+  if (m_indexes.testFlag(MatchPlan::TimeIndex)) {
+    m_timeToEntry.insert(entry->getTime().toMSecsSinceEpoch(), n);
+  }
 }
 
-void DBFileEntries::clear()
+void DBFileEntries::clearIndexes()
 {
   m_pathToEntry.clear();
-  qDeleteAll(m_entries);
-  m_entries.clear();
 
   QHash<QString, QMultiHash<quint64, int>* >::iterator i = m_hashToSizeToEntry.begin();
   while (i != m_hashToSizeToEntry.end()) {
     delete i.value();
     ++i;
   }
-
   m_hashToSizeToEntry.clear();
+
+  m_nameSizeToEntry.clear();
+  m_sizeTimeToEntry.clear();
+  m_nameToEntry.clear();
+  m_sizeToEntry.clear();
+  m_timeToEntry.clear();
+}
+
+void DBFileEntries::clear()
+{
+  clearIndexes();
+  qDeleteAll(m_entries);
+  m_entries.clear();
+}
+
+void DBFileEntries::setIndexes(const MatchPlan::Indexes indexes)
+{
+  if (indexes == m_indexes) {
+    return;
+  }
+  clearIndexes();
+  m_indexes = indexes;
+  for (int n=0; n<m_entries.count(); ++n) {
+    indexEntry(m_entries.at(n), n);
+  }
+}
+
+QString DBFileEntries::fileNameOf(const QString& path)
+{
+  return path.mid(path.lastIndexOf('/') + 1);
 }
 
 bool DBFileEntries::entriesMatch(const CriteriaForFileMatch& criteria, const DBFileEntry* myEntry, DBFileEntry* entryToMatch, const QString& matchInitialPath)
+{
+  return entriesMatch(criteria.getFields(), myEntry, entryToMatch, matchInitialPath);
+}
+
+bool DBFileEntries::entriesMatch(const CriteriaForFileMatch::CriteriaFields fields, const DBFileEntry* myEntry, DBFileEntry* entryToMatch, const QString& matchInitialPath)
 {
   if (myEntry == nullptr || entryToMatch == nullptr)
   {
     return false;
   }
-  if (criteria.isFullPath())
+  if (fields.testFlag(CriteriaForFileMatch::FullPath))
   {
     if (myEntry->getPath().compare(entryToMatch->getPath(), Qt::CaseSensitive) != 0)
     {
       return false;
     }
   }
-  else if (criteria.isFileName())
+  else if (fields.testFlag(CriteriaForFileMatch::FileName))
   {
     // I do not need to check file name if the full path is the same.
-    QFileInfo fileOne(myEntry->getPath());
-    QFileInfo fileTwo(entryToMatch->getPath());
-    if (fileOne.fileName().compare(fileTwo.fileName(), Qt::CaseSensitive))
+    if (fileNameOf(myEntry->getPath()).compare(fileNameOf(entryToMatch->getPath()), Qt::CaseSensitive))
     {
       return false;
     }
   }
 
-  if (criteria.isFileSize() && myEntry->getSize() != entryToMatch->getSize())
+  if (fields.testFlag(CriteriaForFileMatch::Size) && myEntry->getSize() != entryToMatch->getSize())
   {
     return false;
   }
-  if (criteria.isDateTime() && myEntry->getTime() != entryToMatch->getTime())
+  if (fields.testFlag(CriteriaForFileMatch::Time) && myEntry->getTime() != entryToMatch->getTime())
   {
     return false;
   }
 
-  if (criteria.isFileHash())
+  if (fields.testFlag(CriteriaForFileMatch::Hash))
   {
-    if (entryToMatch->getHash().length() == 0)
+    if (entryToMatch->getHash().length() == 0 && !generateHash(entryToMatch, matchInitialPath))
     {
-      if (::getCopyLinkUtil().generateHash(matchInitialPath + "/" + entryToMatch->getPath()))
-      {
-        entryToMatch->setHash(::getCopyLinkUtil().getLastHash());
-      }
-      else
-      {
-        return false;
-      }
+      return false;
     }
     if (entryToMatch->getHash().compare(myEntry->getHash(), Qt::CaseInsensitive) != 0)
     {
@@ -100,73 +166,122 @@ bool DBFileEntries::entriesMatch(const CriteriaForFileMatch& criteria, const DBF
   return true;
 }
 
-const DBFileEntry* DBFileEntries::findEntry(const CriteriaForFileMatch& criteria, DBFileEntry* entry, const QString& matchInitialPath) const
+bool DBFileEntries::generateHash(DBFileEntry* entry, const QString& matchInitialPath)
 {
-  if (entry == nullptr) {
-    return nullptr;
+  QString fullPath = matchInitialPath + "/" + entry->getPath();
+  HashCache* hashCache = ::getCopyLinkUtil().getHashCache();
+  HashCacheKey key;
+  bool haveKey = (hashCache != nullptr) && HashCache::keyForFile(fullPath, key);
+  QString hash;
+  if (haveKey && hashCache->find(key, hash))
+  {
+    entry->setHash(hash);
+    return true;
   }
-  DBFileEntry* foundEntry = nullptr;
+  if (!::getCopyLinkUtil().generateHash(fullPath))
+  {
+    return false;
+  }
+  entry->setHash(::getCopyLinkUtil().getLastHash());
+  if (haveKey)
+  {
+    hashCache->insert(key, entry->getHash());
+  }
+  return true;
+}
 
-  // There can be only one full path, so, check that first.
-  if (criteria.isFullPath())
+void DBFileEntries::cacheHash(const QString& fullPath, const QString& hash)
+{
+  HashCache* hashCache = ::getCopyLinkUtil().getHashCache();
+  HashCacheKey key;
+  if (hashCache != nullptr && HashCache::keyForFile(fullPath, key))
   {
-    if (!m_pathToEntry.contains(entry->getPath()))
-    {
-      return nullptr;
-    }
-    foundEntry = m_entries.value(m_pathToEntry.value(entry->getPath()));
-    if (entriesMatch(criteria, foundEntry, entry, matchInitialPath))
+    hashCache->insert(key, hash);
+  }
+}
+
+const DBFileEntry* DBFileEntries::findEntry(const CriteriaForFileMatch& criteria, DBFileEntry* entry, const QString& matchInitialPath) const
+{
+  MatchPlan::Probe probe;
+  probe.fields = criteria.getFields();
+  probe.index = MatchPlan::indexFor(probe.fields);
+  return findEntry(probe, entry, matchInitialPath);
+}
+
+template <class Key>
+static const DBFileEntry* findInIndex(const QMultiHash<Key, int>& index, const Key& key, const QList<DBFileEntry *>& entries, const CriteriaForFileMatch::CriteriaFields fields, DBFileEntry* entry, const QString& matchInitialPath)
+{
+  auto range = index.equal_range(key);
+  for (auto i = range.first; i != range.second; ++i)
+  {
+    DBFileEntry* foundEntry = entries.value(*i);
+    if (DBFileEntries::entriesMatch(fields, foundEntry, entry, matchInitialPath))
     {
       return foundEntry;
     }
+  }
+  return nullptr;
+}
+
+const DBFileEntry* DBFileEntries::findEntry(const MatchPlan::Probe& probe, DBFileEntry* entry, const QString& matchInitialPath) const
+{
+  if (entry == nullptr || probe.index == MatchPlan::NoIndex) {
     return nullptr;
   }
 
-  // Now, try using criteria that will reduce the size the fastest.
-  if (criteria.isFileHash())
+  if (!m_indexes.testFlag(probe.index))
   {
-    if (entry->getHash().length() == 0)
+    // The caller did not build the index for this probe with setIndexes(), so every entry must be checked.
+    WARN_MSG(QString(QObject::tr("No index for the match criteria, checking every entry for %1")).arg(entry->getPath()), 3);
+    for (DBFileEntry* foundEntry : m_entries)
     {
-      if (!::getCopyLinkUtil().generateHash(matchInitialPath + "/" + entry->getPath()))
+      if (entriesMatch(probe.fields, foundEntry, entry, matchInitialPath))
       {
-        ERROR_MSG(QString(QObject::tr("Error generating hash for %1")).arg(entry->getPath()), 1);
-        return nullptr;
+        return foundEntry;
       }
-      entry->setHash(getCopyLinkUtil().getLastHash());
     }
+    return nullptr;
+  }
 
-    // Sadly, I now enforce that the file size and the hash match, regardless.
-    QMultiHash<quint64, int> *hash = m_hashToSizeToEntry.value(entry->getHash());
-    if (hash != nullptr && hash->contains(entry->getSize()))
+  switch (probe.index)
+  {
+  case MatchPlan::PathIndex:
+  {
+    // There can be only one full path.
+    QHash<QString, int>::const_iterator i = m_pathToEntry.constFind(entry->getPath());
+    if (i != m_pathToEntry.constEnd())
     {
-      QList<int> entries = hash->values(entry->getSize());
-      QList<int>::const_iterator i = entries.constBegin();
-      while (i != entries.constEnd())
+      DBFileEntry* foundEntry = m_entries.value(i.value());
+      if (entriesMatch(probe.fields, foundEntry, entry, matchInitialPath))
       {
-        foundEntry = m_entries.value(*i);
-        if (entriesMatch(criteria, foundEntry, entry, matchInitialPath))
-        {
-          return foundEntry;
-        }
-        ++i;
+        return foundEntry;
       }
     }
-    // Failed to match on hash.
     return nullptr;
   }
-
-  // We now know that we need not match full path or file hash, so, we must traverse the entire list
-  // to see what matches. If we get here,
-  if (criteria.isFileSize() || criteria.isDateTime() || criteria.isFileName())
+  case MatchPlan::HashSizeIndex:
   {
-    // This is simply crazy, do not do this!
-    foreach (foundEntry, m_entries)
+    if (entry->getHash().length() == 0 && !generateHash(entry, matchInitialPath))
     {
-      if (entriesMatch(criteria, foundEntry, entry, matchInitialPath))
-      {
-        return foundEntry;
-      }
+      ERROR_MSG(QString(QObject::tr("Error generating hash for %1")).arg(entry->getPath()), 1);
+      return nullptr;
     }
+    // Sadly, I now enforce that the file size and the hash match, regardless.
+    QMultiHash<quint64, int> *hash = m_hashToSizeToEntry.value(entry->getHash());
+    return (hash != nullptr) ? findInIndex(*hash, entry->getSize(), m_entries, probe.fields, entry, matchInitialPath) : nullptr;
+  }
+  case MatchPlan::NameSizeIndex:
+    return findInIndex(m_nameSizeToEntry, qMakePair(fileNameOf(entry->getPath()), entry->getSize()), m_entries, probe.fields, entry, matchInitialPath);
+  case MatchPlan::SizeTimeIndex:
+    return findInIndex(m_sizeTimeToEntry, qMakePair(entry->getSize(), entry->getTime().toMSecsSinceEpoch()), m_entries, probe.fields, entry, matchInitialPath);
+  case MatchPlan::NameIndex:
+    return findInIndex(m_nameToEntry, fileNameOf(entry->getPath()), m_entries, probe.fields, entry, matchInitialPath);
+  case MatchPlan::SizeIndex:
+    return findInIndex(m_sizeToEntry, entry->getSize(), m_entries, probe.fields, entry, matchInitialPath);
+  case MatchPlan::TimeIndex:
+    return findInIndex(m_timeToEntry, entry->getTime().toMSecsSinceEpoch(), m_entries, probe.fields, entry, matchInitialPath);
+  default:
+    break;
   }
   return nullptr;
 }
@@ -185,17 +300,31 @@ const DBFileEntry* DBFileEntries::findEntry(const QList<CriteriaForFileMatch>& c
   return foundEntry;
 }
 
-DBFileEntries* DBFileEntries::read(const QString& path)
+const DBFileEntry* DBFileEntries::findEntry(const MatchPlan& plan, DBFileEntry* entry, const QString& matchInitialPath) const
 {
-  DBFileEntries* rc = nullptr;
-  QFile file(path);
-  if (file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-    QTextStream reader(&file);
-    rc = read(reader);
-  } else {
-    ERROR_MSG(QString(QObject::tr("Failed to open file (%1) to read the DB File Entries")).arg(path), 1);
+  const DBFileEntry* foundEntry = nullptr;
+  if (m_entries.size() > 0)
+  {
+    QList<MatchPlan::Probe>::const_iterator i = plan.getProbes().constBegin();
+    while (i != plan.getProbes().constEnd() && foundEntry == nullptr) {
+      foundEntry = findEntry(*i, entry, matchInitialPath);
+      ++i;
+    }
   }
-  return rc;
+  return foundEntry;
+}
+
+const DBFileEntry* DBFileEntries::findPath(const QString& path) const
+{
+  QHash<QString, int>::const_iterator i = m_pathToEntry.constFind(path);
+  return (i != m_pathToEntry.constEnd()) ? m_entries.value(i.value()) : nullptr;
+}
+
+DBFileEntries* DBFileEntries::read(const QString& path, const MatchPlan::Indexes indexes)
+{
+  CatalogParser parser;
+  parser.setIgnoreIncompleteLastLine(CatalogWriter::isPartialPath(path));
+  return parser.read(path, indexes);
 }
 
 DBFileEntries* DBFileEntries::read(QTextStream& reader)
@@ -250,3 +379,13 @@ bool DBFileEntries::write(QTextStream& writer) const
   }
   return true;
 }
+
+qint64 DBFileEntries::totalSize() const
+{
+  qint64 total = 0;
+  for (const DBFileEntry* entry : m_entries)
+  {
+    total += static_cast<qint64>(entry->getSize());
+  }
+  return total;
+}
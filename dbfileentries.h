@@ -2,10 +2,10 @@
 #define DBFILEENTRIES_H
 
 #include "dbfileentry.h"
+#include "matchplan.h"
 #include <QList>
 #include <QMultiHash>
-
-class CriteriaForFileMatch;
+#include <QPair>
 
 //**************************************************************************
 //! Collection of file entries. This may represent a previous backup set or a new backup set as it is created.
@@ -30,9 +30,23 @@ public:
     /*! Add a new file entry object. This object takes ownership of the file entry. All related datastructures are updated. */
     void addEntry(DBFileEntry *entry);
 
+    /*! \brief Add many file entries at once, taking ownership of each; the indexes are reserved and built in one pass. */
+    void addEntries(const QList<DBFileEntry*>& entries);
+
     /*! Clear all entries, deleting each file entry. */
     void clear();
 
+    /*! \brief Set the indexes that are maintained, building new indexes from the existing entries.
+     *
+     *  By default, only the full path and the hash and size indexes are built. A probe whose index
+     *  is not built checks every entry, so use the indexes from the MatchPlan used with findEntry().
+     *  \param [in] indexes Indexes to build.
+     */
+    void setIndexes(const MatchPlan::Indexes indexes);
+
+    /*! \brief Get the indexes that are maintained. */
+    MatchPlan::Indexes getIndexes() const;
+
     /*! \brief Find an entry that matches as specified by the criteria.
      *
      *  A match is not done exactly as might be expected, a few simple "cheat" rules are used.
@@ -55,6 +69,33 @@ public:
      */
     const DBFileEntry* findEntry(const QList<CriteriaForFileMatch>& criteria, DBFileEntry* entry, const QString& matchInitialPath) const;
 
+    /*! \brief Find an entry that matches at least one probe in a compiled plan.
+     *
+     *  Probes are tried in plan order. The first to match is returned.
+     *  \param [in] plan Compiled match criteria.
+     *  \param [in, out] entry File entry to match.
+     *  \param [in] matchInitialPath When prepended to entry, this yields the full path to the file on disk.
+     *  \return Pointer to the file entry, or null if no match is found.
+     */
+    const DBFileEntry* findEntry(const MatchPlan& plan, DBFileEntry* entry, const QString& matchInitialPath) const;
+
+    /*! \brief Find an entry using a single probe.
+     *
+     *  Candidates are found with the probe's index and checked against the probe's fields.
+     *  \param [in] probe Index and fields to match.
+     *  \param [in, out] entry File entry to match.
+     *  \param [in] matchInitialPath When prepended to entry, this yields the full path to the file on disk.
+     *  \return Pointer to the file entry, or null if no match is found.
+     */
+    const DBFileEntry* findEntry(const MatchPlan::Probe& probe, DBFileEntry* entry, const QString& matchInitialPath) const;
+
+    /*! \brief Find the entry with a path; requires the path index.
+     *
+     *  \param [in] path Path relative to the backup, as stored in the entry.
+     *  \return Pointer to the file entry, or null if there is no entry with the path.
+     */
+    const DBFileEntry* findPath(const QString& path) const;
+
     /*! \brief Get an entry by index; useful to get all entries.
      *
      *  \param [in] index.
@@ -72,12 +113,43 @@ public:
      */
     static bool entriesMatch(const CriteriaForFileMatch& criteria, const DBFileEntry* myEntry, DBFileEntry* entryToMatch, const QString& matchInitialPath);
 
+    /*! \brief Determine if an external entry matches an internal entry based on the provided fields.
+     *
+     *  \param [in] fields Fields that must match.
+     *  \param [in] myEntry Internal entry that may match the external entry.
+     *  \param [in, out] entryToMatch External entry, we want to find an entry that matches this one.The Hash will be calculated if it is needed.
+     *  \param [in] matchInitialPath When prepended to entry, this yields the full path to the file on disk.
+     *  \return True if the entries match.
+     */
+    static bool entriesMatch(const CriteriaForFileMatch::CriteriaFields fields, const DBFileEntry* myEntry, DBFileEntry* entryToMatch, const QString& matchInitialPath);
+
+    /*! \brief File name portion of a path stored in an entry. */
+    static QString fileNameOf(const QString& path);
+
+    /*! \brief Set the hash for an entry, using the persistent hash cache before generating the hash.
+     *
+     *  A newly generated hash is added to the hash cache.
+     *  \param [in, out] entry File entry whose hash is set.
+     *  \param [in] matchInitialPath When prepended to entry, this yields the full path to the file on disk.
+     *  \return True if the hash was found or generated.
+     */
+    static bool generateHash(DBFileEntry* entry, const QString& matchInitialPath);
+
+    /*! \brief Add an already computed hash to the persistent hash cache (if there is one).
+     *
+     *  \param [in] fullPath Full path to the file on disk.
+     *  \param [in] hash Hash value for the file.
+     */
+    static void cacheHash(const QString& fullPath, const QString& hash);
+
     /*! \brief Read entry file from the path specified. The file name is not part of the path.
      *
+     *  The file is parsed in parallel by a CatalogParser.
      *  \param [in] path Full path to the directory containing the db entry file.
+     *  \param [in] indexes Indexes to build while the entries are added.
      *  \return New class containing the read data, and null if not cannot read.
      */
-    static DBFileEntries* read(const QString& path);
+    static DBFileEntries* read(const QString& path, const MatchPlan::Indexes indexes = MatchPlan::PathIndex | MatchPlan::HashSizeIndex);
 
     /*! \brief Read entry file from the text stream reader.
      *
@@ -103,7 +175,19 @@ public:
     /*! \brief Number of entries in the list. */
     int count() const;
 
+    /*! \brief Sum of the sizes of every entry in the list. */
+    qint64 totalSize() const;
+
 private:
+    /*! Add one entry to each index that is maintained. */
+    void indexEntry(const DBFileEntry* entry, const int n);
+
+    /*! Clear every index without deleting entries. */
+    void clearIndexes();
+
+    /*! Indexes that are maintained. */
+    MatchPlan::Indexes m_indexes;
+
     /*! List of files with file size, time, full path, hash value, and the link type on disk in the backup location. Contained entries are owned by this object. */
     QList<DBFileEntry *> m_entries;
 
@@ -112,6 +196,21 @@ private:
 
     /*! Use the full path to find the file's index in the m_entries variable. */
     QHash<QString, int> m_pathToEntry;
+
+    /*! File name and size to the file's index in m_entries; built only if NameSizeIndex is used. */
+    QMultiHash<QPair<QString, quint64>, int> m_nameSizeToEntry;
+
+    /*! Size and modified time (milliseconds since the epoch) to the file's index in m_entries; built only if SizeTimeIndex is used. */
+    QMultiHash<QPair<quint64, qint64>, int> m_sizeTimeToEntry;
+
+    /*! File name to the file's index in m_entries; built only if NameIndex is used. */
+    QMultiHash<QString, int> m_nameToEntry;
+
+    /*! Size to the file's index in m_entries; built only if SizeIndex is used. */
+    QMultiHash<quint64, int> m_sizeToEntry;
+
+    /*! Modified time (milliseconds since the epoch) to the file's index in m_entries; built only if TimeIndex is used. */
+    QMultiHash<qint64, int> m_timeToEntry;
 };
 
 inline int DBFileEntries::count() const
@@ -119,6 +218,11 @@ inline int DBFileEntries::count() const
   return m_entries.count();
 }
 
+inline MatchPlan::Indexes DBFileEntries::getIndexes() const
+{
+  return m_indexes;
+}
+
 inline const DBFileEntry* DBFileEntries::value(const int index) const
 {
     return m_entries.value(index, nullptr);
@@ -1,153 +1,773 @@
 #include "dbfileentriestreemodel.h"
+#include "catalogsearchindex.h"
 #include "dbfileentries.h"
 #include "dbfileentry.h"
-#include "dbfileentrytreeitem.h"
+#include "linkbackupglobals.h"
 
-#include <QStringList>
+#include <QCollator>
+#include <QElapsedTimer>
+#include <QStringView>
+#include <QThread>
 
-DBFileEntriesTreeModel::DBFileEntriesTreeModel(QObject *parent) :
-    QAbstractItemModel(parent), m_rootItem(nullptr)
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+//**************************************************************************
+/*! \brief Stable sort a run of ids on keys computed once, one key for each id.
+ *
+ *  \param [in,out] begin First id to sort.
+ *  \param [in,out] end One past the last id to sort.
+ *  \param [in] keys Key for each id in [begin, end), in the same order.
+ *  \param [in] less Compare two keys.
+ *  \param [in] order Ascending or descending.
+ ***************************************************************************/
+template <typename Key, typename Less>
+static void sortByKeys(int* begin, int* end, const std::vector<Key>& keys, Less less, const Qt::SortOrder order)
+{
+  std::vector<int> positions(static_cast<size_t>(end - begin));
+  std::iota(positions.begin(), positions.end(), 0);
+  std::stable_sort(positions.begin(), positions.end(), [&keys, &less, order](const int a, const int b) {
+    return (order == Qt::AscendingOrder) ? less(keys[a], keys[b]) : less(keys[b], keys[a]);
+  });
+  std::vector<int> sorted(positions.size());
+  for (size_t i=0; i<positions.size(); ++i)
+  {
+    sorted[i] = begin[positions[i]];
+  }
+  std::copy(sorted.begin(), sorted.end(), begin);
+}
+
+static void initCollator(QCollator& collator)
 {
-    m_rootItem = new DBFileEntryTreeItem();
+  collator.setCaseSensitivity(Qt::CaseInsensitive);
+  collator.setNumericMode(true);
+}
+
+DBFileEntriesTreeModel::DBFileEntriesTreeModel(QObject *parent) : QAbstractItemModel(parent), m_entries(nullptr),
+  m_sortColumn(Name), m_sortOrder(Qt::AscendingOrder), m_sortedColumn(-1), m_sortedOrder(Qt::AscendingOrder),
+  m_worker(nullptr), m_workPending(false), m_generation(0), m_cancelRequested(false)
+{
+  buildIndex();
 }
 
 DBFileEntriesTreeModel::~DBFileEntriesTreeModel()
 {
-    delete m_rootItem;
+  stopWorker();
+  m_searchIndex.reset();
+  delete m_entries;
 }
 
-QVariant DBFileEntriesTreeModel::data(const QModelIndex &index, const int role) const
+void DBFileEntriesTreeModel::setEntries(DBFileEntries* entries)
 {
-    if (!index.isValid())
-         return QVariant();
+  // The worker reads the entries, so it stops before they are deleted.
+  stopWorker();
+  ++m_generation;
+  beginResetModel();
+  m_searchIndex.reset();
+  if (m_entries != entries)
+  {
+    delete m_entries;
+  }
+  m_entries = entries;
+  m_sortedColumn = -1;
+  buildIndex();
+  endResetModel();
+  if (m_entries != nullptr && m_entries->count() > 0)
+  {
+    startWorker();
+  }
+}
+
+int DBFileEntriesTreeModel::findOrAddDir(const QString& path)
+{
+  const auto it = m_dirIds.constFind(path);
+  if (it != m_dirIds.constEnd())
+  {
+    return it.value();
+  }
+  const int slash = path.lastIndexOf('/');
+  const int parent = (slash < 0) ? 0 : findOrAddDir(path.left(slash));
+  DirNode node;
+  node.parent = parent;
+  node.firstFile = 0;
+  node.numFiles = 0;
+  node.firstSubDir = 0;
+  node.numSubDirs = 0;
+  node.size = 0;
+  const int id = m_dirs.count();
+  m_dirs.append(node);
+  m_dirNames.append(path.mid(slash + 1));
+  ++m_dirs[parent].numSubDirs;
+  m_dirIds.insert(path, id);
+  return id;
+}
+
+void DBFileEntriesTreeModel::buildIndex()
+{
+  QElapsedTimer timer;
+  timer.start();
+
+  m_dirs.clear();
+  m_dirNames.clear();
+  m_dirFiles.clear();
+  m_subDirs.clear();
+  m_items.clear();
+  m_children.clear();
+  m_dirIds.clear();
 
-     if (role != Qt::DisplayRole)
-         return QVariant();
+  DirNode root;
+  root.parent = -1;
+  root.firstFile = 0;
+  root.numFiles = 0;
+  root.firstSubDir = 0;
+  root.numSubDirs = 0;
+  root.size = 0;
+  m_dirs.append(root);
+  m_dirNames.append(QString());
+  m_dirIds.insert(QString(), 0);
 
-     DBFileEntryTreeItem *item = static_cast<DBFileEntryTreeItem*>(index.internalPointer());
+  const int numEntries = (m_entries != nullptr) ? m_entries->count() : 0;
 
-     return item->data(index.column());
+  // One pass assigns every entry to its directory. A directory is written as one run of
+  // lines in a catalog, so the previous directory usually matches without a hash lookup.
+  QVector<int> entryDir(numEntries);
+  QString lastDirPath;
+  int lastDir = 0;
+  for (int i=0; i<numEntries; ++i)
+  {
+    const DBFileEntry* entry = m_entries->value(i);
+    const QString& path = entry->getPath();
+    const int slash = path.lastIndexOf('/');
+    int dir = 0;
+    if (slash > 0)
+    {
+      if (slash != lastDirPath.length() || !path.startsWith(lastDirPath))
+      {
+        lastDirPath = path.left(slash);
+        lastDir = findOrAddDir(lastDirPath);
+      }
+      dir = lastDir;
+    }
+    entryDir[i] = dir;
+    ++m_dirs[dir].numFiles;
+    m_dirs[dir].size += static_cast<qint64>(entry->getSize());
+  }
+  m_dirIds.clear();
+  m_dirIds.squeeze();
+
+  // Group the files and the subdirectories by directory with a counting sort.
+  int numFiles = 0;
+  int numSubDirs = 0;
+  for (DirNode& node : m_dirs)
+  {
+    node.firstFile = numFiles;
+    node.firstSubDir = numSubDirs;
+    numFiles += node.numFiles;
+    numSubDirs += node.numSubDirs;
+  }
+  QVector<int> cursor(m_dirs.count());
+  for (int d=0; d<m_dirs.count(); ++d)
+  {
+    cursor[d] = m_dirs.at(d).firstFile;
+  }
+  m_dirFiles.resize(numEntries);
+  for (int i=0; i<numEntries; ++i)
+  {
+    m_dirFiles[cursor[entryDir.at(i)]++] = i;
+  }
+  entryDir.clear();
+  entryDir.squeeze();
+
+  for (int d=0; d<m_dirs.count(); ++d)
+  {
+    cursor[d] = m_dirs.at(d).firstSubDir;
+  }
+  m_subDirs.resize(numSubDirs);
+  for (int d=1; d<m_dirs.count(); ++d)
+  {
+    m_subDirs[cursor[m_dirs.at(d).parent]++] = d;
+  }
+
+  // A directory is always added after its parent, so one backward pass sums every subtree.
+  for (int d=m_dirs.count()-1; d>0; --d)
+  {
+    m_dirs[m_dirs.at(d).parent].size += m_dirs.at(d).size;
+  }
+
+  Item rootItem;
+  rootItem.parent = -1;
+  rootItem.row = 0;
+  rootItem.dir = 0;
+  rootItem.entry = -1;
+  rootItem.firstChild = 0;
+  rootItem.numChildren = 0;
+  rootItem.fetched = false;
+  m_items.append(rootItem);
+
+  if (numEntries > 0)
+  {
+    DEBUG_MSG(QString(tr("Indexed %1 entries in %2 directories in %3 ms")).arg(numEntries).arg(m_dirs.count() - 1).arg(timer.elapsed()), 1);
+  }
 }
 
-Qt::ItemFlags DBFileEntriesTreeModel::flags(const QModelIndex &index) const
+int DBFileEntriesTreeModel::itemId(const QModelIndex& index) const
 {
-    if (!index.isValid())
-         return QFlag(0);
+  return index.isValid() ? static_cast<int>(index.internalId()) : 0;
+}
 
-     return Qt::ItemIsEnabled | Qt::ItemIsSelectable;
+bool DBFileEntriesTreeModel::isDirWithChildren(const Item& item) const
+{
+  if (item.dir < 0)
+  {
+    return false;
+  }
+  const DirNode& node = m_dirs.at(item.dir);
+  return node.numFiles > 0 || node.numSubDirs > 0;
 }
 
-QVariant DBFileEntriesTreeModel::headerData(const int section, Qt::Orientation orientation, const int role) const
+QString DBFileEntriesTreeModel::fileName(const int entry) const
 {
-    if (orientation == Qt::Horizontal && role == Qt::DisplayRole)
-    {
-        switch(section)
-        {
-        case 0:
-            return "Name";
-          break;
-        case 1:
-            return "Size";
-          break;
-        case 2:
-            return "Time";
-          break;
-        case 3:
-            return "L/C";
-          break;
-        case 4:
-            return "Hash";
-          break;
-        default:
-          break;
-        }
-    }
-
-     return QVariant();
+  const QString& path = m_entries->value(entry)->getPath();
+  return path.mid(path.lastIndexOf('/') + 1);
 }
 
-QModelIndex DBFileEntriesTreeModel::index(const int row, const int column, const QModelIndex &parent) const
+bool DBFileEntriesTreeModel::hasChildren(const QModelIndex &parent) const
+{
+  if (parent.column() > 0)
+  {
+    return false;
+  }
+  return isDirWithChildren(m_items.at(itemId(parent)));
+}
+
+bool DBFileEntriesTreeModel::canFetchMore(const QModelIndex &parent) const
 {
-    if (!hasIndex(row, column, parent))
-         return QModelIndex();
+  if (parent.column() > 0)
+  {
+    return false;
+  }
+  const Item& item = m_items.at(itemId(parent));
+  return !item.fetched && isDirWithChildren(item);
+}
 
-     DBFileEntryTreeItem *parentItem;
+void DBFileEntriesTreeModel::fetchMore(const QModelIndex &parent)
+{
+  if (!canFetchMore(parent))
+  {
+    return;
+  }
+  const int id = itemId(parent);
+  const DirNode& node = m_dirs.at(m_items.at(id).dir);
 
-     if (!parent.isValid())
-         parentItem = m_rootItem;
-     else
-         parentItem = static_cast<DBFileEntryTreeItem*>(parent.internalPointer());
+  // Directories first, then files, in the published sort order.
+  QVector<int> dirs(m_subDirs.constBegin() + node.firstSubDir, m_subDirs.constBegin() + node.firstSubDir + node.numSubDirs);
+  QVector<int> files(m_dirFiles.constBegin() + node.firstFile, m_dirFiles.constBegin() + node.firstFile + node.numFiles);
+  if (m_sortedColumn < 0)
+  {
+    // The worker has not finished the first sort, so sort just this directory.
+    QCollator collator;
+    initCollator(collator);
+    sortDirs(dirs.data(), dirs.data() + dirs.count(), m_dirs, m_dirNames, collator, m_sortColumn, m_sortOrder, false);
+    sortFiles(files.data(), files.data() + files.count(), m_entries, collator, m_sortColumn, m_sortOrder, false);
+  }
 
-     DBFileEntryTreeItem *childItem = parentItem->child(row);
-     if (childItem)
-         return createIndex(row, column, childItem);
-     else
-         return QModelIndex();
+  const int numChildren = dirs.count() + files.count();
+  const int firstChild = m_children.count();
+  beginInsertRows(parent, 0, numChildren - 1);
+  m_items.reserve(m_items.count() + numChildren);
+  m_children.reserve(firstChild + numChildren);
+  Item child;
+  child.parent = id;
+  child.firstChild = 0;
+  child.numChildren = 0;
+  child.fetched = false;
+  child.row = 0;
+  for (const int dir : dirs)
+  {
+    child.dir = dir;
+    child.entry = -1;
+    m_children.append(m_items.count());
+    m_items.append(child);
+    ++child.row;
+  }
+  for (const int entry : files)
+  {
+    child.dir = -1;
+    child.entry = entry;
+    child.fetched = true;
+    m_children.append(m_items.count());
+    m_items.append(child);
+    ++child.row;
+  }
+  Item& item = m_items[id];
+  item.firstChild = firstChild;
+  item.numChildren = numChildren;
+  item.fetched = true;
+  endInsertRows();
 }
 
-QModelIndex DBFileEntriesTreeModel::parent(const QModelIndex &index) const
+void DBFileEntriesTreeModel::sort(int column, Qt::SortOrder order)
 {
-    if (!index.isValid())
-        return QModelIndex();
+  if (column < 0 || column >= NumColumns)
+  {
+    return;
+  }
+  m_sortColumn = column;
+  m_sortOrder = order;
+  if (m_entries != nullptr && m_entries->count() > 0)
+  {
+    startWorker();
+  }
+}
 
-    DBFileEntryTreeItem *childItem = static_cast<DBFileEntryTreeItem*>(index.internalPointer());
-    DBFileEntryTreeItem *parentItem = childItem->parent();
+void DBFileEntriesTreeModel::sortDirs(int* begin, int* end, const QVector<DirNode>& dirs, const QVector<QString>& dirNames, const QCollator& collator, const int column, const Qt::SortOrder order, const bool nameSorted)
+{
+  if (end - begin < 2)
+  {
+    return;
+  }
+  // Sort by name first so equal keys stay in name order.
+  if (!nameSorted || column == Name)
+  {
+    std::vector<QCollatorSortKey> keys;
+    keys.reserve(static_cast<size_t>(end - begin));
+    for (const int* it=begin; it!=end; ++it)
+    {
+      keys.push_back(collator.sortKey(dirNames.at(*it)));
+    }
+    sortByKeys(begin, end, keys, [](const QCollatorSortKey& a, const QCollatorSortKey& b) { return a.compare(b) < 0; }, (column == Name) ? order : Qt::AscendingOrder);
+  }
+  // Only the name and size apply to a directory.
+  if (column == Size)
+  {
+    std::vector<qint64> keys;
+    keys.reserve(static_cast<size_t>(end - begin));
+    for (const int* it=begin; it!=end; ++it)
+    {
+      keys.push_back(dirs.at(*it).size);
+    }
+    sortByKeys(begin, end, keys, std::less<qint64>(), order);
+  }
+}
 
-    if (parentItem == m_rootItem)
-        return QModelIndex();
+void DBFileEntriesTreeModel::sortFiles(int* begin, int* end, const DBFileEntries* entries, const QCollator& collator, const int column, const Qt::SortOrder order, const bool nameSorted)
+{
+  if (end - begin < 2)
+  {
+    return;
+  }
+  const size_t count = static_cast<size_t>(end - begin);
+  if (!nameSorted || column == Name)
+  {
+    std::vector<QCollatorSortKey> keys;
+    keys.reserve(count);
+    for (const int* it=begin; it!=end; ++it)
+    {
+      const QString& path = entries->value(*it)->getPath();
+      keys.push_back(collator.sortKey(path.mid(path.lastIndexOf('/') + 1)));
+    }
+    sortByKeys(begin, end, keys, [](const QCollatorSortKey& a, const QCollatorSortKey& b) { return a.compare(b) < 0; }, (column == Name) ? order : Qt::AscendingOrder);
+  }
 
-    return createIndex(parentItem->row(), 0, parentItem);
+  switch (column)
+  {
+  case Size:
+    {
+      std::vector<quint64> keys;
+      keys.reserve(count);
+      for (const int* it=begin; it!=end; ++it)
+      {
+        keys.push_back(entries->value(*it)->getSize());
+      }
+      sortByKeys(begin, end, keys, std::less<quint64>(), order);
+    }
+    break;
+  case TimeStamp:
+    {
+      std::vector<qint64> keys;
+      keys.reserve(count);
+      for (const int* it=begin; it!=end; ++it)
+      {
+        const QDateTime& time = entries->value(*it)->getTime();
+        keys.push_back(time.isValid() ? time.toMSecsSinceEpoch() : std::numeric_limits<qint64>::min());
+      }
+      sortByKeys(begin, end, keys, std::less<qint64>(), order);
+    }
+    break;
+  case LinkType:
+    {
+      std::vector<char16_t> keys;
+      keys.reserve(count);
+      for (const int* it=begin; it!=end; ++it)
+      {
+        keys.push_back(entries->value(*it)->getLinkType().unicode());
+      }
+      sortByKeys(begin, end, keys, std::less<char16_t>(), order);
+    }
+    break;
+  case Hash:
+    {
+      std::vector<QString> keys;
+      keys.reserve(count);
+      for (const int* it=begin; it!=end; ++it)
+      {
+        keys.push_back(entries->value(*it)->getHash());
+      }
+      sortByKeys(begin, end, keys, std::less<QString>(), order);
+    }
+    break;
+  default:
+    break;
+  }
 }
 
-int DBFileEntriesTreeModel::rowCount(const QModelIndex &parent) const
+void DBFileEntriesTreeModel::startWorker()
+{
+  if (m_worker != nullptr)
+  {
+    // Run again with the latest sort when this one is done.
+    m_workPending = true;
+    return;
+  }
+  m_workPending = false;
+
+  QSharedPointer<WorkerResult> result(new WorkerResult);
+  result->generation = m_generation;
+  result->column = m_sortColumn;
+  result->order = m_sortOrder;
+  result->sorted = false;
+  // Implicitly shared; the worker detaches its own copies.
+  result->subDirs = m_subDirs;
+  result->dirFiles = m_dirFiles;
+
+  const QVector<DirNode> dirs = m_dirs;
+  const QVector<QString> dirNames = m_dirNames;
+  const DBFileEntries* entries = m_entries;
+  const bool nameSorted = (m_sortedColumn == Name && m_sortedOrder == Qt::AscendingOrder);
+  const bool buildSearch = m_searchIndex.isNull();
+  const std::atomic<bool>* cancelRequested = &m_cancelRequested;
+
+  m_worker = QThread::create([this, result, dirs, dirNames, entries, nameSorted, buildSearch, cancelRequested]() {
+    QElapsedTimer timer;
+    timer.start();
+    QCollator collator;
+    initCollator(collator);
+    int* subDirs = result->subDirs.data();
+    int* dirFiles = result->dirFiles.data();
+    for (int d=0; d<dirs.count() && !*cancelRequested; ++d)
+    {
+      const DirNode& node = dirs.at(d);
+      sortDirs(subDirs + node.firstSubDir, subDirs + node.firstSubDir + node.numSubDirs, dirs, dirNames, collator, result->column, result->order, nameSorted);
+      sortFiles(dirFiles + node.firstFile, dirFiles + node.firstFile + node.numFiles, entries, collator, result->column, result->order, nameSorted);
+    }
+    result->sorted = !*cancelRequested;
+    if (result->sorted)
+    {
+      DEBUG_MSG(QString(QObject::tr("Sorted %1 entries in %2 ms")).arg(entries->count()).arg(timer.elapsed()), 1);
+    }
+
+    if (buildSearch && !*cancelRequested)
+    {
+      timer.restart();
+      QSharedPointer<CatalogSearchIndex> searchIndex(new CatalogSearchIndex());
+      if (searchIndex->build(entries, cancelRequested))
+      {
+        result->searchIndex = searchIndex;
+        DEBUG_MSG(QString(QObject::tr("Built the search index for %1 entries in %2 ms")).arg(entries->count()).arg(timer.elapsed()), 1);
+      }
+    }
+    if (!*cancelRequested)
+    {
+      QMetaObject::invokeMethod(this, [this, result]() { publish(result); }, Qt::QueuedConnection);
+    }
+  });
+  QThread* worker = m_worker;
+  connect(worker, &QThread::finished, worker, &QObject::deleteLater);
+  connect(worker, &QThread::finished, this, [this, worker]() {
+    if (m_worker == worker)
+    {
+      m_worker = nullptr;
+      if (m_workPending)
+      {
+        startWorker();
+      }
+    }
+  });
+  worker->start(QThread::LowPriority);
+}
+
+void DBFileEntriesTreeModel::stopWorker()
 {
-    if (parent.column() > 0)
-        return 0;
+  if (m_worker != nullptr)
+  {
+    m_cancelRequested = true;
+    m_worker->wait();
+    // The thread deletes itself when its finished signal is delivered.
+    m_worker = nullptr;
+    m_cancelRequested = false;
+  }
+  m_workPending = false;
+}
 
-    DBFileEntryTreeItem *parentItem = parent.isValid() ? static_cast<DBFileEntryTreeItem*>(parent.internalPointer()) : m_rootItem;
+void DBFileEntriesTreeModel::publish(const QSharedPointer<WorkerResult>& result)
+{
+  if (result->generation != m_generation)
+  {
+    return;
+  }
+  if (!result->searchIndex.isNull())
+  {
+    m_searchIndex = result->searchIndex;
+    emit searchReady();
+  }
+  if (!result->sorted)
+  {
+    return;
+  }
 
-    return parentItem->childCount();
+  emit layoutAboutToBeChanged(QList<QPersistentModelIndex>(), QAbstractItemModel::VerticalSortHint);
+  m_subDirs = result->subDirs;
+  m_dirFiles = result->dirFiles;
+  m_sortedColumn = result->column;
+  m_sortedOrder = result->order;
+  for (int id=0; id<m_items.count(); ++id)
+  {
+    if (m_items.at(id).dir >= 0 && m_items.at(id).numChildren > 0)
+    {
+      placeChildren(id);
+    }
+  }
+  // An item keeps its id, which is the internal id of its index, and only its row changes.
+  const QModelIndexList oldList = persistentIndexList();
+  QModelIndexList newList;
+  newList.reserve(oldList.count());
+  for (const QModelIndex& oldIndex : oldList)
+  {
+    newList.append(createIndex(m_items.at(itemId(oldIndex)).row, oldIndex.column(), oldIndex.internalId()));
+  }
+  changePersistentIndexList(oldList, newList);
+  emit layoutChanged(QList<QPersistentModelIndex>(), QAbstractItemModel::VerticalSortHint);
+  emit sortFinished();
 }
 
-int DBFileEntriesTreeModel::columnCount(const QModelIndex &parent) const
+void DBFileEntriesTreeModel::placeChildren(const int id)
 {
-    if (parent.isValid())
-         return static_cast<DBFileEntryTreeItem*>(parent.internalPointer())->columnCount();
-     else
-         return m_rootItem->columnCount();
+  const Item& item = m_items.at(id);
+  const DirNode& node = m_dirs.at(item.dir);
+  QHash<int, int> dirItems;
+  QHash<int, int> fileItems;
+  for (int row=0; row<item.numChildren; ++row)
+  {
+    const int childId = m_children.at(item.firstChild + row);
+    const Item& child = m_items.at(childId);
+    if (child.dir >= 0)
+    {
+      dirItems.insert(child.dir, childId);
+    }
+    else
+    {
+      fileItems.insert(child.entry, childId);
+    }
+  }
+
+  int row = 0;
+  const int firstChild = item.firstChild;
+  for (int i=0; i<node.numSubDirs; ++i, ++row)
+  {
+    const int childId = dirItems.value(m_subDirs.at(node.firstSubDir + i));
+    m_children[firstChild + row] = childId;
+    m_items[childId].row = row;
+  }
+  for (int i=0; i<node.numFiles; ++i, ++row)
+  {
+    const int childId = fileItems.value(m_dirFiles.at(node.firstFile + i));
+    m_children[firstChild + row] = childId;
+    m_items[childId].row = row;
+  }
+}
+
+QVector<int> DBFileEntriesTreeModel::findName(const QString& glob, const int maxResults, bool* truncated) const
+{
+  if (m_searchIndex.isNull())
+  {
+    if (truncated != nullptr)
+    {
+      *truncated = false;
+    }
+    return QVector<int>();
+  }
+  return m_searchIndex->findName(glob, maxResults, truncated);
 }
 
-void DBFileEntriesTreeModel::setupModelData(const QStringList &lines, DBFileEntryTreeItem *parent)
+QVector<int> DBFileEntriesTreeModel::findHash(const QString& prefix, const int maxResults, bool* truncated) const
 {
-    if (m_rootItem != nullptr)
+  if (m_searchIndex.isNull())
+  {
+    if (truncated != nullptr)
     {
-        delete m_rootItem;
+      *truncated = false;
     }
-    m_rootItem = parent;
+    return QVector<int>();
+  }
+  return m_searchIndex->findHash(prefix, maxResults, truncated);
 }
 
-void DBFileEntriesTreeModel::setupModelData(const QStringList &lines, const DBFileEntries *entries)
+QModelIndex DBFileEntriesTreeModel::indexForEntry(const int entry)
 {
-    if (entries == nullptr || entries->count() < 1)
+  if (m_entries == nullptr || entry < 0 || entry >= m_entries->count())
+  {
+    return QModelIndex();
+  }
+  const QStringList names = m_entries->value(entry)->getPath().split('/');
+  QModelIndex parentIndex;
+  for (int i=0; i<names.count(); ++i)
+  {
+    if (canFetchMore(parentIndex))
+    {
+      fetchMore(parentIndex);
+    }
+    const bool isFile = (i == names.count() - 1);
+    const Item& parentItem = m_items.at(itemId(parentIndex));
+    QModelIndex found;
+    for (int row=0; row<parentItem.numChildren; ++row)
+    {
+      const Item& child = m_items.at(m_children.at(parentItem.firstChild + row));
+      if (isFile ? (child.entry == entry) : (child.dir >= 0 && m_dirNames.at(child.dir) == names.at(i)))
+      {
+        found = index(row, 0, parentIndex);
+        break;
+      }
+    }
+    if (!found.isValid())
     {
-        QStringList lst;
-        setupModelData(lst, new DBFileEntryTreeItem());
-        return;
+      return QModelIndex();
     }
-    QString shortestPath = "";
-    for (int i=0; i<entries->count(); ++i)
+    parentIndex = found;
+  }
+  return parentIndex;
+}
+
+QVariant DBFileEntriesTreeModel::data(const QModelIndex &index, const int role) const
+{
+  if (!index.isValid())
+  {
+    return QVariant();
+  }
+  const Item& item = m_items.at(itemId(index));
+  if (role == Qt::TextAlignmentRole)
+  {
+    return (index.column() == Size) ? QVariant(int(Qt::AlignRight | Qt::AlignVCenter)) : QVariant();
+  }
+  if (role != Qt::DisplayRole)
+  {
+    return QVariant();
+  }
+
+  if (item.dir >= 0)
+  {
+    switch (index.column())
     {
-        const DBFileEntry* entry = entries->value(i);
-        // This should never be null, but, I hate taking chances.
-        if (entry != nullptr)
-        {
-            QString path = entry->getPath();
-            // While path is not in my map of paths to DBFileEntryTreeItem things,
-            //   build the tree.
-            // Add this entry to the tree
+    case Name:
+      return m_dirNames.at(item.dir);
+    case Size:
+      return m_dirs.at(item.dir).size;
+    default:
+      return QVariant();
+    }
+  }
+
+  const DBFileEntry* entry = m_entries->value(item.entry);
+  switch (index.column())
+  {
+  case Name:
+    return fileName(item.entry);
+  case Size:
+    return entry->getSize();
+  case TimeStamp:
+    return entry->getTime();
+  case LinkType:
+    return QString(entry->getLinkType());
+  case Hash:
+    return entry->getHash();
+  default:
+    break;
+  }
+  return QVariant();
+}
 
-        }
+Qt::ItemFlags DBFileEntriesTreeModel::flags(const QModelIndex &index) const
+{
+  if (!index.isValid())
+  {
+    return Qt::NoItemFlags;
+  }
+  return Qt::ItemIsEnabled | Qt::ItemIsSelectable;
+}
+
+QVariant DBFileEntriesTreeModel::headerData(const int section, Qt::Orientation orientation, const int role) const
+{
+  if (orientation == Qt::Horizontal && role == Qt::DisplayRole)
+  {
+    switch (section)
+    {
+    case Name:
+      return tr("Name");
+    case Size:
+      return tr("Size");
+    case TimeStamp:
+      return tr("Time");
+    case LinkType:
+      return tr("L/C");
+    case Hash:
+      return tr("Hash");
+    default:
+      break;
     }
-    // Sort the list by name.
+  }
+  return QVariant();
 }
 
+QModelIndex DBFileEntriesTreeModel::index(const int row, const int column, const QModelIndex &parent) const
+{
+  if (row < 0 || column < 0 || column >= NumColumns || parent.column() > 0)
+  {
+    return QModelIndex();
+  }
+  const Item& parentItem = m_items.at(itemId(parent));
+  if (row >= parentItem.numChildren)
+  {
+    return QModelIndex();
+  }
+  return createIndex(row, column, static_cast<quintptr>(m_children.at(parentItem.firstChild + row)));
+}
+
+QModelIndex DBFileEntriesTreeModel::parent(const QModelIndex &index) const
+{
+  if (!index.isValid())
+  {
+    return QModelIndex();
+  }
+  const int parentId = m_items.at(itemId(index)).parent;
+  if (parentId <= 0)
+  {
+    return QModelIndex();
+  }
+  return createIndex(m_items.at(parentId).row, 0, static_cast<quintptr>(parentId));
+}
+
+int DBFileEntriesTreeModel::rowCount(const QModelIndex &parent) const
+{
+  if (parent.column() > 0)
+  {
+    return 0;
+  }
+  return m_items.at(itemId(parent)).numChildren;
+}
+
+int DBFileEntriesTreeModel::columnCount(const QModelIndex &) const
+{
+  return NumColumns;
+}
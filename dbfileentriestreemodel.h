@@ -2,35 +2,192 @@
 #define DBFILEENTRIESTREEMODEL_H
 
 #include <QAbstractItemModel>
+#include <QHash>
+#include <QSharedPointer>
+#include <QString>
+#include <QVector>
 
-class DBFileEntryTreeItem;
+#include <atomic>
+
+class CatalogSearchIndex;
 class DBFileEntries;
+class QCollator;
+class QThread;
 
+//**************************************************************************
+/*! \class DBFileEntriesTreeModel
+ *  \brief Show the entries in a backup catalog as a tree of directories and files.
+ *
+ * The catalog is indexed once when it is set: one compact node for each directory, the catalog
+ * entries grouped by directory in a single flat array, and the size of every directory summed
+ * bottom-up. No item is created for a file or directory until its parent is expanded; the view
+ * asks with canFetchMore() and fetchMore(), and only then are the children of that one directory
+ * created. Every item stores its row and the range of its children, so index() and parent() are
+ * constant time.
+ *
+ * Sorting and the search index are built on a worker thread. The worker sorts the children of
+ * every directory on collation keys computed once per sort, then the new order is published to
+ * the view in one layout change; expanded directories stay expanded. Until the first sort is
+ * published, a directory is sorted when it is fetched. Once the search index is ready,
+ * findName() and findHash() return matching entries in milliseconds, even for millions of
+ * entries, and indexForEntry() expands the tree to show a match.
+ *
+ * \author Andrew Pitonyak
+ * \copyright Andrew Pitonyak, but you may use without restriction.
+ * \date 2026
+ **************************************************************************/
 class DBFileEntriesTreeModel : public QAbstractItemModel
 {
-    Q_OBJECT
+  Q_OBJECT
 public:
-    explicit DBFileEntriesTreeModel(QObject *parent = 0);
-    ~DBFileEntriesTreeModel();
-    
-    QVariant data(const QModelIndex &index, const int role) const;
-    Qt::ItemFlags flags(const QModelIndex &index) const;
-    QVariant headerData(const int section, Qt::Orientation orientation, const int role = Qt::DisplayRole) const;
-    QModelIndex index(const int row, const int column, const QModelIndex &parent = QModelIndex()) const;
-    QModelIndex parent(const QModelIndex &index) const;
-    int rowCount(const QModelIndex &parent = QModelIndex()) const;
-    int columnCount(const QModelIndex &parent = QModelIndex()) const;
-
-    void setupModelData(const QStringList &lines, DBFileEntryTreeItem *parent);
-    void setupModelData(const QStringList &lines, const DBFileEntries *entries);
+  enum Columns {Name, Size, TimeStamp, LinkType, Hash, NumColumns};
+
+  explicit DBFileEntriesTreeModel(QObject *parent = nullptr);
+  ~DBFileEntriesTreeModel();
+
+  QVariant data(const QModelIndex &index, const int role) const override;
+  Qt::ItemFlags flags(const QModelIndex &index) const override;
+  QVariant headerData(const int section, Qt::Orientation orientation, const int role = Qt::DisplayRole) const override;
+  QModelIndex index(const int row, const int column, const QModelIndex &parent = QModelIndex()) const override;
+  QModelIndex parent(const QModelIndex &index) const override;
+  int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+  int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+  bool hasChildren(const QModelIndex &parent = QModelIndex()) const override;
+  bool canFetchMore(const QModelIndex &parent) const override;
+  void fetchMore(const QModelIndex &parent) override;
+
+  /*! \brief Sort on a worker thread; the view is updated when the sort is done. */
+  void sort(int column, Qt::SortOrder order = Qt::AscendingOrder) override;
+
+  //**************************************************************************
+  /*! \brief Show a catalog; the model takes ownership of the entries and deletes the previous ones.
+   *
+   *  \param [in] entries Catalog to show; nullptr shows an empty tree.
+   ***************************************************************************/
+  void setEntries(DBFileEntries* entries);
+
+  const DBFileEntries* getEntries() const;
+
+  /*! \brief True once the search index is built; searches before then find nothing. */
+  bool isSearchReady() const;
+
+  /*! \brief Find entries whose file name matches a glob, see CatalogSearchIndex::findName(). */
+  QVector<int> findName(const QString& glob, const int maxResults, bool* truncated = nullptr) const;
+
+  /*! \brief Find entries whose hash starts with a prefix, see CatalogSearchIndex::findHash(). */
+  QVector<int> findHash(const QString& prefix, const int maxResults, bool* truncated = nullptr) const;
+
+  //**************************************************************************
+  /*! \brief Get the index of a catalog entry, fetching the directories above it.
+   *
+   *  \param [in] entry Index of the entry in the catalog.
+   *  \return Index of the entry in this model, or an invalid index.
+   ***************************************************************************/
+  QModelIndex indexForEntry(const int entry);
 
 signals:
-    
-public slots:
+  /*! \brief The search index is ready. */
+  void searchReady();
+
+  /*! \brief A sort was published to the view. */
+  void sortFinished();
 
 private:
-   DBFileEntryTreeItem *m_rootItem;
-    
+  /*! \brief A directory in the catalog, built when the entries are set. */
+  struct DirNode
+  {
+    int parent;
+    /*! \brief Index in m_dirFiles of the first entry in this directory. */
+    int firstFile;
+    int numFiles;
+    /*! \brief Index in m_subDirs of the first subdirectory. */
+    int firstSubDir;
+    int numSubDirs;
+    /*! \brief Size of every file below this directory. */
+    qint64 size;
+  };
+
+  /*! \brief A row shown in the view, created when its parent is fetched. */
+  struct Item
+  {
+    int parent;
+    int row;
+    /*! \brief Directory node, or -1 for a file. */
+    int dir;
+    /*! \brief Catalog entry, or -1 for a directory. */
+    int entry;
+    /*! \brief Children are m_children[firstChild, firstChild + numChildren) once fetched. */
+    int firstChild;
+    int numChildren;
+    bool fetched;
+  };
+
+  /*! \brief Sorted children and the search index built by the worker. */
+  struct WorkerResult
+  {
+    int generation;
+    int column;
+    Qt::SortOrder order;
+    bool sorted;
+    QVector<int> subDirs;
+    QVector<int> dirFiles;
+    QSharedPointer<CatalogSearchIndex> searchIndex;
+  };
+
+  void buildIndex();
+  void startWorker();
+  void stopWorker();
+  void publish(const QSharedPointer<WorkerResult>& result);
+  void placeChildren(const int id);
+
+  static void sortDirs(int* begin, int* end, const QVector<DirNode>& dirs, const QVector<QString>& dirNames, const QCollator& collator, const int column, const Qt::SortOrder order, const bool nameSorted);
+  static void sortFiles(int* begin, int* end, const DBFileEntries* entries, const QCollator& collator, const int column, const Qt::SortOrder order, const bool nameSorted);
+
+  int findOrAddDir(const QString& path);
+  int itemId(const QModelIndex& index) const;
+  bool isDirWithChildren(const Item& item) const;
+  QString fileName(const int entry) const;
+
+  DBFileEntries* m_entries;
+
+  QVector<DirNode> m_dirs;
+  QVector<QString> m_dirNames;
+  /*! \brief Catalog entry indexes grouped by directory. */
+  QVector<int> m_dirFiles;
+  /*! \brief Directory node indexes grouped by parent. */
+  QVector<int> m_subDirs;
+  /*! \brief Directory path to node, only while the index is built. */
+  QHash<QString, int> m_dirIds;
+
+  /*! \brief Item zero is the hidden root. */
+  QVector<Item> m_items;
+  /*! \brief Item ids of the children of each fetched item, in row order. */
+  QVector<int> m_children;
+
+  /*! \brief Sort requested by the view. */
+  int m_sortColumn;
+  Qt::SortOrder m_sortOrder;
+  /*! \brief Sort of m_subDirs and m_dirFiles, or -1 for catalog order. */
+  int m_sortedColumn;
+  Qt::SortOrder m_sortedOrder;
+
+  QSharedPointer<CatalogSearchIndex> m_searchIndex;
+
+  QThread* m_worker;
+  bool m_workPending;
+  /*! \brief Incremented when the entries change, so a stale worker result is ignored. */
+  int m_generation;
+  std::atomic<bool> m_cancelRequested;
 };
 
+inline const DBFileEntries* DBFileEntriesTreeModel::getEntries() const
+{
+  return m_entries;
+}
+
+inline bool DBFileEntriesTreeModel::isSearchReady() const
+{
+  return !m_searchIndex.isNull();
+}
+
 #endif // DBFILEENTRIESTREEMODEL_H
@@ -1,5 +1,6 @@
 #include "dbfileentry.h"
 #include "stringhelper.h"
+#include "directoryscanner.h"
 
 #include <QTextStream>
 #include <QStringList>
@@ -32,6 +33,19 @@ DBFileEntry::DBFileEntry(const QFileInfo& info, const QString& rootPath) : m_siz
   }
 }
 
+DBFileEntry::DBFileEntry(const ScannedEntry& info, const QString& rootPath) : m_size(info.size), m_time(info.lastModified()), m_path(info.path)
+{
+  if (rootPath.length() > 0)
+  {
+    if (m_path.startsWith(rootPath, Qt::CaseSensitive)) {
+      // Remove the root-path from the full path.
+      m_path = m_path.right(m_path.length() - rootPath.length());
+    } else {
+      qDebug() << QString("File path (%1) does not contain root path (%2)").arg(m_path, rootPath);
+    }
+  }
+}
+
 DBFileEntry::~DBFileEntry()
 {
 }
@@ -6,6 +6,7 @@
 
 class QTextStream;
 class QFileInfo;
+struct ScannedEntry;
 
 //**************************************************************************
 //! Encapsulate the data about a single file used to determine if it matches another. This includes file's size, time, full path, hash value, and the link type on disk in the backup location.
@@ -48,6 +49,15 @@ public:
      ***************************************************************************/
     DBFileEntry(const QFileInfo& info, const QString& rootPath);
 
+    //**************************************************************************
+    //! Constructor that sets data from a scanned directory entry, but does not set the hash.
+    /*!
+     * \param [in] info Entry read by the DirectoryScanner. Used to set file size, last modified time, and path.
+     * \param [in] rootPath The path to the file is assumed to start after this path.
+     *
+     ***************************************************************************/
+    DBFileEntry(const ScannedEntry& info, const QString& rootPath);
+
     //**************************************************************************
     //! Get the file size in bytes.
     /*!
@@ -65,17 +75,17 @@ public:
     void setSize(const quint64 fileSize);
 
     //**************************************************************************
-    //! Get character representing how the file is copied. C means copy and L means Link.
+    //! Get character representing how the file is copied. C means copy, L means Link, and K means the file is in the chunk store.
     /*!
-     * \returns Character representing how the file is copied. C means copy and L means Link.
+     * \returns Character representing how the file is copied. C means copy, L means Link, and K means the file is in the chunk store.
      *
      ***************************************************************************/
     QChar getLinkType() const;
 
     //**************************************************************************
-    //! Set character representing how the file is copied. C means copy and L means Link.
+    //! Set character representing how the file is copied. C means copy, L means Link, and K means the file is in the chunk store.
     /*!
-     * \param [in] C character representing how the file is copied. C means copy and L means Link.
+     * \param [in] C character representing how the file is copied. C means copy, L means Link, and K means the file is in the chunk store.
      *
      ***************************************************************************/
     void setLinkType(const QChar c);
@@ -94,6 +104,13 @@ public:
      ***************************************************************************/
     void setLinkTypeLink();
 
+    //**************************************************************************
+    //! Shortcut for setting the link type to K, the file is in the chunk store.
+    /*!
+     *
+     ***************************************************************************/
+    void setLinkTypeChunks();
+
     //**************************************************************************
     //! Get the file last modified date and time.
     /*!
@@ -243,4 +260,9 @@ inline void DBFileEntry::setLinkTypeLink()
   setLinkType('L');
 }
 
+inline void DBFileEntry::setLinkTypeChunks()
+{
+  setLinkType('K');
+}
+
 #endif // DBFILEENTRY_H
@@ -0,0 +1,202 @@
+#include "directorycatalog.h"
+#include "catalogwriter.h"
+#include "linkbackupglobals.h"
+
+#include <QList>
+
+static const char* s_header = "LinkBackupDirs=1";
+static const int s_numValues = 6;
+
+DirectoryCatalog::DirectoryCatalog()
+{
+}
+
+DirectoryCatalog::~DirectoryCatalog()
+{
+  if (m_file.isOpen())
+  {
+    close(false);
+  }
+}
+
+QString DirectoryCatalog::dirsPath(const QString& catalogPath)
+{
+  return catalogPath + ".dirs";
+}
+
+bool DirectoryCatalog::open(const QString& path, const QString& filtersFingerprint)
+{
+  if (m_file.isOpen())
+  {
+    close(false);
+  }
+  m_path = path;
+  m_file.setFileName(CatalogWriter::partialPath(path));
+  if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+  {
+    WARN_MSG(QString(QObject::tr("Unable to write the directory catalog %1")).arg(m_file.fileName()), 1);
+    return false;
+  }
+  m_file.write(QByteArray(s_header) + "\nFilters=" + filtersFingerprint.toLatin1() + "\n");
+  return true;
+}
+
+void DirectoryCatalog::add(const QString& relativeDir, const DirectoryRecord& record)
+{
+  if (!m_file.isOpen())
+  {
+    return;
+  }
+  QByteArray line;
+  line.reserve(64 + relativeDir.length());
+  line.append(QByteArray::number(record.stamp.mtimeNs)).append(',');
+  line.append(QByteArray::number(record.stamp.ctimeNs)).append(',');
+  line.append(QByteArray::number(record.stamp.numLinks)).append(',');
+  line.append(QByteArray::number(record.numSubDirs)).append(',');
+  line.append(QByteArray::number(record.numFiles)).append(',');
+  line.append(QByteArray::number(record.numSkipped)).append(',');
+  line.append(relativeDir.toUtf8()).append('\n');
+  m_file.write(line);
+}
+
+bool DirectoryCatalog::close(const bool finished)
+{
+  if (!m_file.isOpen())
+  {
+    return false;
+  }
+  const bool written = m_file.flush() && m_file.error() == QFileDevice::NoError;
+  m_file.close();
+  // The partial file of a backup that did not finish is read when the backup is resumed.
+  if (!finished)
+  {
+    return false;
+  }
+  if (!written)
+  {
+    m_file.remove();
+    return false;
+  }
+  QFile::remove(m_path);
+  if (!m_file.rename(m_path))
+  {
+    WARN_MSG(QString(QObject::tr("Unable to rename %1 to %2")).arg(m_file.fileName(), m_path), 1);
+    m_file.remove();
+    return false;
+  }
+  return true;
+}
+
+void DirectoryCatalog::clear()
+{
+  m_filtersFingerprint.clear();
+  m_records.clear();
+  m_subDirs.clear();
+}
+
+bool DirectoryCatalog::read(const QString& path)
+{
+  clear();
+
+  QFile file(path);
+  if (!file.open(QIODevice::ReadOnly))
+  {
+    return false;
+  }
+  QByteArray line = file.readLine();
+  if (line.trimmed() != s_header)
+  {
+    WARN_MSG(QString(QObject::tr("Unknown directory catalog format in %1")).arg(path), 1);
+    return false;
+  }
+  line = file.readLine().trimmed();
+  if (!line.startsWith("Filters="))
+  {
+    WARN_MSG(QString(QObject::tr("Unknown directory catalog format in %1")).arg(path), 1);
+    return false;
+  }
+  m_filtersFingerprint = QString::fromLatin1(line.mid(8));
+
+  while (!file.atEnd())
+  {
+    line = file.readLine();
+    if (!line.endsWith('\n'))
+    {
+      break;
+    }
+    line.chop(1);
+    // The directory is last, so it may contain commas.
+    qint64 values[s_numValues];
+    int start = 0;
+    bool ok = true;
+    for (int i=0; ok && i<s_numValues; ++i)
+    {
+      const int comma = line.indexOf(',', start);
+      ok = (comma > start);
+      if (ok)
+      {
+        values[i] = line.mid(start, comma - start).toLongLong(&ok);
+        start = comma + 1;
+      }
+    }
+    if (!ok || start >= line.length())
+    {
+      WARN_MSG(QString(QObject::tr("Invalid line in the directory catalog %1")).arg(path), 1);
+      continue;
+    }
+    DirectoryRecord record;
+    record.stamp.mtimeNs = values[0];
+    record.stamp.ctimeNs = values[1];
+    record.stamp.numLinks = static_cast<quint64>(values[2]);
+    record.numSubDirs = static_cast<int>(values[3]);
+    record.numFiles = static_cast<int>(values[4]);
+    record.numSkipped = static_cast<int>(values[5]);
+    const QString relativeDir = QString::fromUtf8(line.mid(start));
+    m_records.insert(relativeDir, record);
+    const int slash = relativeDir.lastIndexOf('/');
+    if (slash > 0)
+    {
+      m_subDirs[relativeDir.left(slash)].append(relativeDir.mid(slash + 1));
+    }
+  }
+  return true;
+}
+
+bool DirectoryCatalog::find(const QString& relativeDir, DirectoryRecord& record) const
+{
+  QHash<QString, DirectoryRecord>::const_iterator it = m_records.constFind(relativeDir);
+  if (it == m_records.constEnd())
+  {
+    return false;
+  }
+  record = it.value();
+  return true;
+}
+
+QStringList DirectoryCatalog::directories() const
+{
+  return m_records.keys();
+}
+
+QStringList DirectoryCatalog::subDirNames(const QString& relativeDir) const
+{
+  return m_subDirs.value(relativeDir);
+}
+
+void DirectoryCatalog::copySubtree(const QString& relativeDir, DirectoryCatalog& to) const
+{
+  QStringList pending(relativeDir);
+  while (!pending.isEmpty())
+  {
+    const QString dir = pending.takeLast();
+    DirectoryRecord record;
+    if (find(dir, record))
+    {
+      to.add(dir, record);
+    }
+    for (const QString& name : m_subDirs.value(dir))
+    {
+      pending.append(dir + "/" + name);
+    }
+  }
+}
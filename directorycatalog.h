@@ -0,0 +1,148 @@
+#ifndef DIRECTORYCATALOG_H
+#define DIRECTORYCATALOG_H
+
+#include "directoryscanner.h"
+
+#include <QFile>
+#include <QHash>
+#include <QString>
+#include <QStringList>
+
+//**************************************************************************
+/*! \brief What a backup recorded about one source directory. */
+//**************************************************************************
+struct DirectoryRecord
+{
+  /*! \brief Time stamps of the source directory, read before it was listed. */
+  DirectoryStamp stamp;
+  /*! \brief Number of subdirectories that passed the filters. */
+  int numSubDirs;
+  /*! \brief Number of files that passed the filters. */
+  int numFiles;
+  /*! \brief Number of files and directories rejected by the filters or not readable. */
+  int numSkipped;
+};
+
+//**************************************************************************
+/*! \class DirectoryCatalog
+ *  \brief Time stamps of every source directory in a backup, written next to the catalog.
+ *
+ * The file "<catalog>.dirs" holds a header followed by one line for each directory:
+ * \code
+ * LinkBackupDirs=1
+ * Filters=3f786850e387550fdab836ed7e6dc881de23001b
+ * 1767225600123456789,1767225600123456789,4,2,17,0,Documents/letters
+ * \endcode
+ *
+ * The values are the modified and change times in nanoseconds, the link count, the number of
+ * subdirectories and files that passed the filters, the number skipped, and the directory relative
+ * to the parent of the source, the same form as the parent of a catalog path. "Filters" is a hash
+ * of the backup set filters in effect.
+ *
+ * If a directory has the same time stamps now, no entry was added, removed, or renamed, so the
+ * names are the subdirectories recorded here and the files in the previous catalog. The files are
+ * still stat'ed, because editing a file does not change its directory.
+ *
+ * \author Andrew Pitonyak
+ * \copyright Andrew Pitonyak, but you may use without restriction.
+ * \date 2026
+ **************************************************************************/
+class DirectoryCatalog
+{
+public:
+  /*! \brief Constructor, nothing is read or open. */
+  DirectoryCatalog();
+
+  /*! \brief Destructor, a file still open is discarded. */
+  ~DirectoryCatalog();
+
+  /*! \brief Get the path for the directory catalog of a catalog, such as "<backup>/sha1.txt.dirs". */
+  static QString dirsPath(const QString& catalogPath);
+
+  //**************************************************************************
+  /*! \brief Start writing; the records are written to a partial file until close().
+   *
+   *  \param [in] path Full path to the directory catalog.
+   *  \param [in] filtersFingerprint Hash of the backup set filters.
+   *  \return True if the partial file was created.
+   ***************************************************************************/
+  bool open(const QString& path, const QString& filtersFingerprint);
+
+  bool isOpen() const;
+
+  /*! \brief Write the record for a directory. */
+  void add(const QString& relativeDir, const DirectoryRecord& record);
+
+  //**************************************************************************
+  /*! \brief Stop writing.
+   *
+   *  \param [in] finished If true, the partial file replaces the directory catalog; otherwise it is kept for a resume.
+   *  \return True if the directory catalog was written.
+   ***************************************************************************/
+  bool close(const bool finished);
+
+  //**************************************************************************
+  /*! \brief Read the records from an earlier backup.
+   *
+   *  \param [in] path Full path to the directory catalog, or to the partial file of an interrupted backup.
+   *  \return True if the file was read; false if it is missing or has an unknown format.
+   ***************************************************************************/
+  bool read(const QString& path);
+
+  /*! \brief Forget the records read. */
+  void clear();
+
+  /*! \brief Hash of the filters recorded by read(). */
+  const QString& getFiltersFingerprint() const;
+
+  /*! \brief Number of records read. */
+  int count() const;
+
+  //**************************************************************************
+  /*! \brief Find the record for a directory.
+   *
+   *  \param [in] relativeDir Directory relative to the parent of the source.
+   *  \param [out] record Record, set if found.
+   *  \return True if the directory has a record.
+   ***************************************************************************/
+  bool find(const QString& relativeDir, DirectoryRecord& record) const;
+
+  /*! \brief Every directory with a record, in no particular order. */
+  QStringList directories() const;
+
+  /*! \brief Names of the subdirectories of a directory that have a record. */
+  QStringList subDirNames(const QString& relativeDir) const;
+
+  /*! \brief Write the records of a directory and every directory below it, read from an earlier backup, to the open file of another. */
+  void copySubtree(const QString& relativeDir, DirectoryCatalog& to) const;
+
+private:
+  /*! \brief Disable the copy constructor, the file is owned. */
+  DirectoryCatalog(const DirectoryCatalog&);
+  DirectoryCatalog& operator=(const DirectoryCatalog&);
+
+  QFile m_file;
+  QString m_path;
+
+  QString m_filtersFingerprint;
+  QHash<QString, DirectoryRecord> m_records;
+  /*! \brief Names of the subdirectories with a record, by the parent directory. */
+  QHash<QString, QStringList> m_subDirs;
+};
+
+inline bool DirectoryCatalog::isOpen() const
+{
+  return m_file.isOpen();
+}
+
+inline const QString& DirectoryCatalog::getFiltersFingerprint() const
+{
+  return m_filtersFingerprint;
+}
+
+inline int DirectoryCatalog::count() const
+{
+  return m_records.count();
+}
+
+#endif // DIRECTORYCATALOG_H
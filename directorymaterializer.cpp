@@ -0,0 +1,258 @@
+#include "directorymaterializer.h"
+
+#include <QFile>
+#include <QMap>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QVector>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//**************************************************************************
+/*! \brief A parent directory and the children to create in it. */
+//**************************************************************************
+struct MaterializeParent
+{
+  /*! \brief Parent relative to the root, empty for the root itself. */
+  QString parent;
+  QStringList names;
+  /*! \brief Children made by mkdirat, relative to the root. */
+  QStringList created;
+  /*! \brief Children that already existed, relative to the root. */
+  QStringList found;
+};
+
+//**************************************************************************
+/*! \brief Create the children of parents until every parent at one depth is taken; one task per thread. */
+//**************************************************************************
+class MaterializeTask : public QRunnable
+{
+public:
+  MaterializeTask(const int rootFd, QVector<MaterializeParent>* parents, std::atomic<int>* next) : m_rootFd(rootFd), m_parents(parents), m_next(next)
+  {
+    setAutoDelete(false);
+  }
+
+  void run() override
+  {
+    for (;;)
+    {
+      const int i = m_next->fetch_add(1);
+      if (i >= m_parents->count())
+      {
+        return;
+      }
+      createChildren((*m_parents)[i]);
+    }
+  }
+
+private:
+  void createChildren(MaterializeParent& parent)
+  {
+    int parentFd = m_rootFd;
+    if (!parent.parent.isEmpty())
+    {
+      parentFd = openat(m_rootFd, QFile::encodeName(parent.parent).constData(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+      if (parentFd < 0)
+      {
+        return;
+      }
+    }
+    const QString prefix = parent.parent.isEmpty() ? QString() : parent.parent + "/";
+    for (const QString& name : parent.names)
+    {
+      if (mkdirat(parentFd, QFile::encodeName(name).constData(), 0777) == 0)
+      {
+        parent.created.append(prefix + name);
+      }
+      else if (errno == EEXIST)
+      {
+        parent.found.append(prefix + name);
+      }
+    }
+    if (parentFd != m_rootFd)
+    {
+      ::close(parentFd);
+    }
+  }
+
+  int m_rootFd;
+  QVector<MaterializeParent>* m_parents;
+  std::atomic<int>* m_next;
+};
+
+DirectoryMaterializer::DirectoryMaterializer() : m_rootFd(-1)
+{
+}
+
+DirectoryMaterializer::~DirectoryMaterializer()
+{
+  close();
+}
+
+bool DirectoryMaterializer::open(const QString& rootPath)
+{
+  close();
+  m_rootFd = ::open(QFile::encodeName(rootPath).constData(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+  return m_rootFd >= 0;
+}
+
+void DirectoryMaterializer::close()
+{
+  if (m_rootFd >= 0)
+  {
+    ::close(m_rootFd);
+    m_rootFd = -1;
+  }
+  m_created.clear();
+}
+
+int DirectoryMaterializer::createAll(const QStringList& relativeDirs, const int threadCount)
+{
+  if (m_rootFd < 0)
+  {
+    return 0;
+  }
+  // Children by parent for each depth, so a parent is always created before its children.
+  QMap<int, QMap<QString, QStringList> > levels;
+  for (const QString& dir : relativeDirs)
+  {
+    if (dir.isEmpty() || m_created.contains(dir))
+    {
+      continue;
+    }
+    const int slash = dir.lastIndexOf('/');
+    levels[dir.count('/')][(slash > 0) ? dir.left(slash) : QString()].append(dir.mid(slash + 1));
+  }
+
+  int numCreated = 0;
+  for (auto level = levels.constBegin(); level != levels.constEnd(); ++level)
+  {
+    QVector<MaterializeParent> parents;
+    for (auto it = level.value().constBegin(); it != level.value().constEnd(); ++it)
+    {
+      if (!it.key().isEmpty() && !m_created.contains(it.key()))
+      {
+        continue;
+      }
+      MaterializeParent parent;
+      parent.parent = it.key();
+      parent.names = it.value();
+      parents.append(parent);
+    }
+
+    std::atomic<int> next(0);
+    const int numTasks = qMin(qMax(threadCount, 1), parents.count());
+    QVector<MaterializeTask*> tasks;
+    {
+      QThreadPool pool;
+      pool.setMaxThreadCount(numTasks);
+      for (int i=0; i<numTasks; ++i)
+      {
+        tasks.append(new MaterializeTask(m_rootFd, &parents, &next));
+        pool.start(tasks.last());
+      }
+      pool.waitForDone();
+    }
+    qDeleteAll(tasks);
+
+    for (const MaterializeParent& parent : parents)
+    {
+      for (const QString& dir : parent.created)
+      {
+        m_created.insert(dir, false);
+      }
+      // A directory that was not made here may hold anything, so it is never removed.
+      for (const QString& dir : parent.found)
+      {
+        m_created.insert(dir, true);
+      }
+      numCreated += parent.created.count() + parent.found.count();
+    }
+  }
+  return numCreated;
+}
+
+bool DirectoryMaterializer::create(const QString& relativeDir, const bool acceptExisting)
+{
+  QHash<QString, bool>::iterator it = m_created.find(relativeDir);
+  if (it != m_created.end())
+  {
+    it.value() = true;
+    return true;
+  }
+  if (m_rootFd < 0)
+  {
+    errno = EBADF;
+    return false;
+  }
+
+  const QByteArray encodedDir = QFile::encodeName(relativeDir);
+  int result = mkdirat(m_rootFd, encodedDir.constData(), 0777);
+  if (result != 0 && errno == ENOENT)
+  {
+    // A parent is missing, as QDir::mkpath() would create it.
+    const int slash = relativeDir.lastIndexOf('/');
+    if (slash > 0 && create(relativeDir.left(slash), true))
+    {
+      result = mkdirat(m_rootFd, encodedDir.constData(), 0777);
+    }
+  }
+  if (result != 0 && !(acceptExisting && errno == EEXIST))
+  {
+    return false;
+  }
+  m_created.insert(relativeDir, true);
+  return true;
+}
+
+void DirectoryMaterializer::markUsed(const QSet<QString>& relativeDirs)
+{
+  if (relativeDirs.isEmpty())
+  {
+    return;
+  }
+  for (auto it = m_created.begin(); it != m_created.end(); ++it)
+  {
+    // The directory or one of its parents.
+    QString dir = it.key();
+    while (!it.value() && !dir.isEmpty())
+    {
+      if (relativeDirs.contains(dir))
+      {
+        it.value() = true;
+      }
+      const int slash = dir.lastIndexOf('/');
+      dir = (slash > 0) ? dir.left(slash) : QString();
+    }
+  }
+}
+
+int DirectoryMaterializer::removeUnused()
+{
+  QStringList unused;
+  for (auto it = m_created.constBegin(); it != m_created.constEnd(); ++it)
+  {
+    if (!it.value())
+    {
+      unused.append(it.key());
+    }
+  }
+  // A child sorts after its parent, so reversed order removes children first.
+  std::sort(unused.begin(), unused.end());
+  int numRemoved = 0;
+  for (int i=unused.count() - 1; i>=0; --i)
+  {
+    if (m_rootFd >= 0 && unlinkat(m_rootFd, QFile::encodeName(unused.at(i)).constData(), AT_REMOVEDIR) == 0)
+    {
+      m_created.remove(unused.at(i));
+      ++numRemoved;
+    }
+  }
+  return numRemoved;
+}
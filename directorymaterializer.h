@@ -0,0 +1,106 @@
+#ifndef DIRECTORYMATERIALIZER_H
+#define DIRECTORYMATERIALIZER_H
+
+#include <QHash>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+
+//**************************************************************************
+/*! \class DirectoryMaterializer
+ *  \brief Create the directories of a backup relative to an open handle, and remember them.
+ *
+ * Before the files are backed up, createAll() creates the directories expected in the backup,
+ * usually every directory in the previous backup. The directories are created one depth at a
+ * time; at each depth a pool of threads opens each parent once and calls mkdirat for its
+ * children, so no path is resolved more than once.
+ *
+ * Every directory created is remembered, so create() for a known directory is a hash lookup.
+ * A directory made up front that the backup never asks for no longer exists in the source;
+ * removeUnused() removes it when the backup finishes. A directory that already existed, such
+ * as one written by an interrupted backup, is never removed.
+ *
+ * Paths are relative to the root, such as "Documents/letters".
+ *
+ * \author Andrew Pitonyak
+ * \copyright Andrew Pitonyak, but you may use without restriction.
+ * \date 2026
+ **************************************************************************/
+class DirectoryMaterializer
+{
+public:
+  /*! \brief Constructor, no root is open. */
+  DirectoryMaterializer();
+
+  /*! \brief Destructor, closes the root. */
+  ~DirectoryMaterializer();
+
+  //**************************************************************************
+  /*! \brief Open the directory that receives the backup; forgets every directory created before.
+   *
+   *  \param [in] rootPath Full path to an existing directory.
+   *  \return True if the directory was opened; on failure errno describes the problem.
+   ***************************************************************************/
+  bool open(const QString& rootPath);
+
+  /*! \brief Close the root and forget every directory created. */
+  void close();
+
+  //**************************************************************************
+  /*! \brief Create directories up front, parents before children.
+   *
+   *  A directory that already exists is treated as created, and as used. A directory whose
+   *  parent could not be created is skipped, and is created later by create() if the backup asks for it.
+   *
+   *  \param [in] relativeDirs Directories relative to the root, in any order.
+   *  \param [in] threadCount Maximum number of threads creating directories.
+   *  \return Number of directories created or found.
+   ***************************************************************************/
+  int createAll(const QStringList& relativeDirs, const int threadCount);
+
+  //**************************************************************************
+  /*! \brief Create one directory, and any missing parent, unless it is already known.
+   *
+   *  \param [in] relativeDir Directory relative to the root.
+   *  \param [in] acceptExisting If true, a directory that already exists is used; otherwise it is an error.
+   *  \return True if the directory exists; on failure errno describes the problem.
+   ***************************************************************************/
+  bool create(const QString& relativeDir, const bool acceptExisting);
+
+  /*! \brief Returns True if the directory was created by this object. */
+  bool isCreated(const QString& relativeDir) const;
+
+  //**************************************************************************
+  /*! \brief Mark directories, and every directory below them, as used without asking for them.
+   *
+   *  \param [in] relativeDirs Directories relative to the root, such as those completed by an interrupted backup.
+   ***************************************************************************/
+  void markUsed(const QSet<QString>& relativeDirs);
+
+  //**************************************************************************
+  /*! \brief Remove the directories made by createAll() that were never asked for or marked used.
+   *
+   *  Only empty directories are removed, deepest first.
+   *
+   *  \return Number of directories removed.
+   ***************************************************************************/
+  int removeUnused();
+
+private:
+  /*! \brief Disable the copy constructor, the root handle is owned. */
+  DirectoryMaterializer(const DirectoryMaterializer&);
+  DirectoryMaterializer& operator=(const DirectoryMaterializer&);
+
+  /*! \brief Handle for the root directory, -1 if not open. */
+  int m_rootFd;
+
+  /*! \brief Directories created, true once create() asked for it. */
+  QHash<QString, bool> m_created;
+};
+
+inline bool DirectoryMaterializer::isCreated(const QString& relativeDir) const
+{
+  return m_created.contains(relativeDir);
+}
+
+#endif // DIRECTORYMATERIALIZER_H
@@ -0,0 +1,241 @@
+#include "directoryscanner.h"
+
+#include <QFile>
+#include <QFileInfo>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+// Large enough that most directories are read with one getdents64 call.
+static const int s_scanBufferSize = 256 * 1024;
+
+//**************************************************************************
+/*! \brief Record returned by the getdents64 system call. */
+//**************************************************************************
+struct LinuxDirent64
+{
+  quint64 d_ino;
+  qint64 d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[1];
+};
+
+QDateTime ScannedEntry::lastModified() const
+{
+  return QDateTime::fromMSecsSinceEpoch(mtimeNs / 1000000);
+}
+
+QString ScannedEntry::parentPath() const
+{
+  int i = path.lastIndexOf('/');
+  return (i > 0) ? path.left(i) : QString("/");
+}
+
+ScannedEntry ScannedEntry::fromFileInfo(const QFileInfo& info)
+{
+  ScannedEntry entry;
+  entry.name = info.fileName();
+  entry.path = info.canonicalFilePath();
+  entry.size = static_cast<quint64>(info.size());
+  entry.mtimeNs = info.lastModified().toMSecsSinceEpoch() * 1000000;
+  entry.inode = 0;
+  entry.device = 0;
+  entry.isDir = info.isDir();
+  entry.isFile = info.isFile();
+  return entry;
+}
+
+DirectoryScanner::DirectoryScanner() : m_buffer(new char[s_scanBufferSize]), m_euid(geteuid()), m_numStats(0)
+{
+  m_groups.append(getegid());
+  int numGroups = getgroups(0, nullptr);
+  if (numGroups > 0)
+  {
+    QVector<gid_t> groups(numGroups);
+    numGroups = getgroups(numGroups, groups.data());
+    for (int i=0; i<numGroups; ++i)
+    {
+      m_groups.append(groups[i]);
+    }
+  }
+}
+
+DirectoryScanner::~DirectoryScanner()
+{
+  delete[] m_buffer;
+}
+
+bool DirectoryScanner::isReadable(const quint32 uid, const quint32 gid, const quint32 mode) const
+{
+  if (m_euid == 0)
+  {
+    return true;
+  }
+  if (uid == m_euid)
+  {
+    return (mode & S_IRUSR) != 0;
+  }
+  if (m_groups.contains(gid))
+  {
+    return (mode & S_IRGRP) != 0;
+  }
+  return (mode & S_IROTH) != 0;
+}
+
+bool DirectoryScanner::statEntry(const int dirFd, const char* name, const QString& prefix, ScannedEntry& entry)
+{
+  struct statx stx;
+  ++m_numStats;
+  if (statx(dirFd, name, AT_SYMLINK_NOFOLLOW | AT_STATX_SYNC_AS_STAT, STATX_TYPE | STATX_MODE | STATX_UID | STATX_GID | STATX_SIZE | STATX_MTIME | STATX_INO, &stx) != 0)
+  {
+    return false;
+  }
+  entry.isDir = S_ISDIR(stx.stx_mode);
+  entry.isFile = S_ISREG(stx.stx_mode);
+  if (!entry.isDir && !entry.isFile)
+  {
+    return false;
+  }
+  if (!isReadable(stx.stx_uid, stx.stx_gid, stx.stx_mode))
+  {
+    // Still a file or directory, so the caller can count it.
+    errno = EACCES;
+    return false;
+  }
+  entry.name = QFile::decodeName(name);
+  entry.path = prefix + entry.name;
+  entry.size = stx.stx_size;
+  entry.mtimeNs = static_cast<qint64>(stx.stx_mtime.tv_sec) * 1000000000LL + stx.stx_mtime.tv_nsec;
+  entry.inode = stx.stx_ino;
+  entry.device = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+  return true;
+}
+
+bool DirectoryScanner::scan(const QString& dirPath, QList<ScannedEntry>& dirs, QList<ScannedEntry>& files, int* numUnreadable)
+{
+  dirs.clear();
+  files.clear();
+  if (numUnreadable != nullptr)
+  {
+    *numUnreadable = 0;
+  }
+  int dirFd = open(QFile::encodeName(dirPath).constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dirFd < 0)
+  {
+    return false;
+  }
+
+  const QString prefix = dirPath.endsWith('/') ? dirPath : dirPath + '/';
+  bool ok = true;
+  for (;;)
+  {
+    long numRead = syscall(SYS_getdents64, dirFd, m_buffer, s_scanBufferSize);
+    if (numRead <= 0)
+    {
+      ok = (numRead == 0);
+      break;
+    }
+    for (long offset = 0; offset < numRead; )
+    {
+      const LinuxDirent64* dirent = reinterpret_cast<const LinuxDirent64*>(m_buffer + offset);
+      offset += dirent->d_reclen;
+      const char* name = dirent->d_name;
+      if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+      {
+        continue;
+      }
+      // Symbolic links and special files are never backed up, so do not stat them.
+      if (dirent->d_type != DT_DIR && dirent->d_type != DT_REG && dirent->d_type != DT_UNKNOWN)
+      {
+        continue;
+      }
+
+      ScannedEntry entry;
+      errno = 0;
+      if (!statEntry(dirFd, name, prefix, entry))
+      {
+        // Deleted since the directory was read, a special file, or not readable.
+        if (errno == EACCES && numUnreadable != nullptr)
+        {
+          ++*numUnreadable;
+        }
+        continue;
+      }
+      if (entry.isDir)
+      {
+        dirs.append(entry);
+      }
+      else
+      {
+        files.append(entry);
+      }
+    }
+  }
+  int savedErrno = errno;
+  close(dirFd);
+  errno = savedErrno;
+
+  auto byName = [](const ScannedEntry& a, const ScannedEntry& b) { return a.name.compare(b.name, Qt::CaseInsensitive) < 0; };
+  std::sort(dirs.begin(), dirs.end(), byName);
+  std::sort(files.begin(), files.end(), byName);
+  return ok;
+}
+
+bool DirectoryScanner::statNames(const QString& dirPath, const QStringList& dirNames, const QStringList& fileNames, QList<ScannedEntry>& dirs, QList<ScannedEntry>& files)
+{
+  dirs.clear();
+  files.clear();
+  int dirFd = open(QFile::encodeName(dirPath).constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dirFd < 0)
+  {
+    return false;
+  }
+
+  const QString prefix = dirPath.endsWith('/') ? dirPath : dirPath + '/';
+  bool ok = true;
+  for (int i=0; ok && i<dirNames.count(); ++i)
+  {
+    ScannedEntry entry;
+    ok = statEntry(dirFd, QFile::encodeName(dirNames.at(i)).constData(), prefix, entry) && entry.isDir;
+    dirs.append(entry);
+  }
+  for (int i=0; ok && i<fileNames.count(); ++i)
+  {
+    ScannedEntry entry;
+    ok = statEntry(dirFd, QFile::encodeName(fileNames.at(i)).constData(), prefix, entry) && entry.isFile;
+    files.append(entry);
+  }
+  close(dirFd);
+  if (!ok)
+  {
+    dirs.clear();
+    files.clear();
+    return false;
+  }
+
+  auto byName = [](const ScannedEntry& a, const ScannedEntry& b) { return a.name.compare(b.name, Qt::CaseInsensitive) < 0; };
+  std::sort(dirs.begin(), dirs.end(), byName);
+  std::sort(files.begin(), files.end(), byName);
+  return true;
+}
+
+bool DirectoryScanner::statDir(const QString& dirPath, DirectoryStamp& stamp)
+{
+  struct statx stx;
+  ++m_numStats;
+  if (statx(AT_FDCWD, QFile::encodeName(dirPath).constData(), AT_SYMLINK_NOFOLLOW | AT_STATX_SYNC_AS_STAT, STATX_MTIME | STATX_CTIME | STATX_NLINK, &stx) != 0)
+  {
+    return false;
+  }
+  stamp.mtimeNs = static_cast<qint64>(stx.stx_mtime.tv_sec) * 1000000000LL + stx.stx_mtime.tv_nsec;
+  stamp.ctimeNs = static_cast<qint64>(stx.stx_ctime.tv_sec) * 1000000000LL + stx.stx_ctime.tv_nsec;
+  stamp.numLinks = stx.stx_nlink;
+  return true;
+}
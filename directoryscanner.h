@@ -0,0 +1,173 @@
+#ifndef DIRECTORYSCANNER_H
+#define DIRECTORYSCANNER_H
+
+#include <QString>
+#include <QStringList>
+#include <QDateTime>
+#include <QList>
+#include <QVector>
+
+class QFileInfo;
+
+//**************************************************************************
+/*! \brief Metadata for one directory entry, read with a single statx call.
+ *
+ * This is the lightweight replacement for QFileInfo used while a backup runs;
+ * filters and file entries are built from it without resolving the path again.
+ ***************************************************************************/
+struct ScannedEntry
+{
+  /*! \brief File name without the path. */
+  QString name;
+  /*! \brief Full path built from the parent directory path; canonical if the scanned directory path is canonical. */
+  QString path;
+  /*! \brief Size in bytes. */
+  quint64 size;
+  /*! \brief Last modified time in nanoseconds since the epoch. */
+  qint64 mtimeNs;
+  /*! \brief Inode number. */
+  quint64 inode;
+  /*! \brief Device containing the file. */
+  quint64 device;
+  /*! \brief True for a directory. */
+  bool isDir;
+  /*! \brief True for a regular file. */
+  bool isFile;
+
+  /*! \brief Last modified time as a local date time, the same value returned by QFileInfo::lastModified(). */
+  QDateTime lastModified() const;
+
+  /*! \brief Path of the directory containing the entry, the same value returned by QFileInfo::canonicalPath(). */
+  QString parentPath() const;
+
+  //**************************************************************************
+  /*! \brief Build an entry from a QFileInfo for code that does not use the scanner.
+   *
+   *  \param [in] info File of interest.
+   *  \return Entry with the canonical path and the metadata from info.
+   ***************************************************************************/
+  static ScannedEntry fromFileInfo(const QFileInfo& info);
+};
+
+//**************************************************************************
+/*! \brief Time stamps of a directory, which change when an entry is added, removed, or renamed.
+ *
+ * The modified time changes when an entry is created, removed, or renamed; the change time also
+ * changes when the directory itself is renamed or its permissions change. The link count
+ * changes with the number of subdirectories.
+ ***************************************************************************/
+struct DirectoryStamp
+{
+  /*! \brief Last modified time in nanoseconds since the epoch. */
+  qint64 mtimeNs;
+  /*! \brief Last status change time in nanoseconds since the epoch. */
+  qint64 ctimeNs;
+  /*! \brief Number of hard links. */
+  quint64 numLinks;
+
+  bool operator==(const DirectoryStamp& stamp) const;
+  bool operator!=(const DirectoryStamp& stamp) const;
+};
+
+//**************************************************************************
+/*! \class DirectoryScanner
+ *  \brief Read a directory with getdents64 and statx relative to the directory handle.
+ *
+ * QDir::entryInfoList() followed by QFileInfo::canonicalFilePath() and QFileInfo::lastModified()
+ * resolves the full path several times for every file. The scanner opens the directory once,
+ * reads the names with getdents64 into a large buffer, and calls statx once for each name relative
+ * to the open directory, so no path is resolved. Paths are built by appending the name to the
+ * directory path.
+ *
+ * Like the QDir filters previously used by the backup, hidden entries are returned, symbolic links
+ * and other special files are skipped, and entries that the process can not read are skipped.
+ *
+ * \author Andrew Pitonyak
+ * \copyright Andrew Pitonyak, but you may use without restriction.
+ * \date 2026
+ **************************************************************************/
+class DirectoryScanner
+{
+public:
+  /*! \brief Constructor, reads the effective user and groups used for the readable check. */
+  DirectoryScanner();
+
+  /*! \brief Destructor, frees the read buffer. */
+  ~DirectoryScanner();
+
+  //**************************************************************************
+  /*! \brief Read one directory.
+   *
+   *  Each list is sorted by name, ignoring case, as QDir does by default.
+   *
+   *  \param [in] dirPath Full path to the directory without a trailing '/'.
+   *  \param [out] dirs Subdirectories.
+   *  \param [out] files Regular files.
+   *  \param [out] numUnreadable If not null, set to the number of files and directories skipped because they can not be read.
+   *  \return True if the directory was read; on failure errno describes the problem.
+   ***************************************************************************/
+  bool scan(const QString& dirPath, QList<ScannedEntry>& dirs, QList<ScannedEntry>& files, int* numUnreadable = nullptr);
+
+  //**************************************************************************
+  /*! \brief Stat known names in a directory without reading the directory.
+   *
+   *  Used when the directory has not changed since its names were recorded. The same entries are
+   *  returned as from scan(), sorted the same way, but a name that no longer exists, is no longer
+   *  readable, or changed between a file and a directory is a failure.
+   *
+   *  \param [in] dirPath Full path to the directory without a trailing '/'.
+   *  \param [in] dirNames Names of the subdirectories.
+   *  \param [in] fileNames Names of the regular files.
+   *  \param [out] dirs Subdirectories.
+   *  \param [out] files Regular files.
+   *  \return True if every name was found with the expected type.
+   ***************************************************************************/
+  bool statNames(const QString& dirPath, const QStringList& dirNames, const QStringList& fileNames, QList<ScannedEntry>& dirs, QList<ScannedEntry>& files);
+
+  //**************************************************************************
+  /*! \brief Read the time stamps of a directory.
+   *
+   *  \param [in] dirPath Full path to the directory.
+   *  \param [out] stamp Time stamps and link count.
+   *  \return True if the directory exists; on failure errno describes the problem.
+   ***************************************************************************/
+  bool statDir(const QString& dirPath, DirectoryStamp& stamp);
+
+  /*! \brief Number of statx calls since the scanner was created. */
+  qint64 getNumStats() const;
+
+private:
+  /*! \brief Returns True if the effective user can read a file with this owner and mode. */
+  bool isReadable(const quint32 uid, const quint32 gid, const quint32 mode) const;
+
+  /*! \brief Stat one name relative to an open directory and build the entry; false if it is not a readable file or directory. */
+  bool statEntry(const int dirFd, const char* name, const QString& prefix, ScannedEntry& entry);
+
+  /*! \brief Disable the copy constructor, the buffer is owned. */
+  DirectoryScanner(const DirectoryScanner&);
+  DirectoryScanner& operator=(const DirectoryScanner&);
+
+  /*! \brief Buffer for getdents64. */
+  char* m_buffer;
+
+  quint32 m_euid;
+  QVector<quint32> m_groups;
+  qint64 m_numStats;
+};
+
+inline bool DirectoryStamp::operator==(const DirectoryStamp& stamp) const
+{
+  return mtimeNs == stamp.mtimeNs && ctimeNs == stamp.ctimeNs && numLinks == stamp.numLinks;
+}
+
+inline bool DirectoryStamp::operator!=(const DirectoryStamp& stamp) const
+{
+  return !(*this == stamp);
+}
+
+inline qint64 DirectoryScanner::getNumStats() const
+{
+  return m_numStats;
+}
+
+#endif // DIRECTORYSCANNER_H
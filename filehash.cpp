@@ -0,0 +1,39 @@
+#include "filehash.h"
+
+FileHash::FileHash(const QCryptographicHash::Algorithm algorithm, const qint64 chunkSize) : m_hash(algorithm), m_chunk(algorithm), m_chunkSize(chunkSize), m_inChunk(0)
+{
+}
+
+void FileHash::addData(const char* data, qint64 length)
+{
+  if (m_chunkSize <= 0)
+  {
+    m_hash.addData(QByteArrayView(data, length));
+    return;
+  }
+  while (length > 0)
+  {
+    const qint64 n = qMin(length, m_chunkSize - m_inChunk);
+    m_chunk.addData(QByteArrayView(data, n));
+    m_inChunk += n;
+    data += n;
+    length -= n;
+    if (m_inChunk == m_chunkSize)
+    {
+      m_hash.addData(m_chunk.result());
+      m_chunk.reset();
+      m_inChunk = 0;
+    }
+  }
+}
+
+QByteArray FileHash::result(const qint64 size)
+{
+  // An empty file is a single empty chunk.
+  if (m_chunkSize > 0 && (m_inChunk > 0 || size == 0))
+  {
+    m_hash.addData(m_chunk.result());
+    m_inChunk = 0;
+  }
+  return m_hash.result();
+}
@@ -0,0 +1,43 @@
+#ifndef FILEHASH_H
+#define FILEHASH_H
+
+#include <QByteArray>
+#include <QCryptographicHash>
+
+//**************************************************************************
+/*! \class FileHash
+ *  \brief Hash a file as CopyLinkUtil does, sequential or as a tree of chunks, from blocks of any size.
+ *
+ * With a chunk size, each chunk is hashed and the file hash is the hash of the chunk hashes,
+ * the same as the tree hash in the catalog. Data may be added in pieces that do not line up
+ * with the chunks.
+ *
+ * \author Andrew Pitonyak
+ * \copyright Andrew Pitonyak, but you may use without restriction.
+ * \date 2026
+ **************************************************************************/
+class FileHash
+{
+public:
+  //**************************************************************************
+  /*! \brief Constructor.
+   *
+   *  \param [in] algorithm Hash algorithm.
+   *  \param [in] chunkSize Chunk size for a tree hash, zero for a sequential hash.
+   ***************************************************************************/
+  FileHash(const QCryptographicHash::Algorithm algorithm, const qint64 chunkSize);
+
+  /*! \brief Add the next bytes of the file. */
+  void addData(const char* data, qint64 length);
+
+  /*! \brief Hash of the file after every byte was added. */
+  QByteArray result(const qint64 size);
+
+private:
+  QCryptographicHash m_hash;
+  QCryptographicHash m_chunk;
+  qint64 m_chunkSize;
+  qint64 m_inChunk;
+};
+
+#endif // FILEHASH_H
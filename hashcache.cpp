@@ -0,0 +1,367 @@
+#include "hashcache.h"
+#include "linkbackupglobals.h"
+
+#include <QByteArray>
+#include <QVector>
+#include <QDebug>
+
+#include <algorithm>
+#include <cstring>
+#include <sys/stat.h>
+
+//**************************************************************************
+/*! \brief First 128 bytes of the cache file. */
+//**************************************************************************
+struct HashCache::Header
+{
+  char magic[8];
+  quint32 version;
+  quint32 digestSize;
+  quint32 numSets;
+  quint32 run;
+  quint64 clock;
+  char reserved[96];
+};
+
+//**************************************************************************
+/*! \brief One cached digest. lastUsed is zero for an empty record. Records are 128 bytes so that a record never spans a page. */
+//**************************************************************************
+struct HashCache::Record
+{
+  quint64 device;
+  quint64 inode;
+  quint64 size;
+  qint64 mtimeNs;
+  qint64 ctimeNs;
+  quint64 lastUsed;
+  quint64 check;
+  quint32 run;
+  quint32 reserved;
+  uchar digest[HashCache::s_maxDigestSize];
+};
+
+static const char s_hashCacheMagic[8] = {'L', 'B', 'H', 'C', 'A', 'C', 'H', 'E'};
+static const quint32 s_hashCacheVersion = 1;
+
+HashCache::HashCache() : m_map(nullptr), m_header(nullptr), m_records(nullptr), m_hits(0), m_misses(0)
+{
+  static_assert(sizeof(Header) == 128, "HashCache::Header must be 128 bytes");
+  static_assert(sizeof(Record) == 128, "HashCache::Record must be 128 bytes");
+}
+
+HashCache::~HashCache()
+{
+  close();
+}
+
+bool HashCache::createFile(const QString& path, const quint32 numSets, const int digestSize, const quint32 run)
+{
+  QFile file(path);
+  if (!file.open(QIODevice::ReadWrite | QIODevice::Truncate))
+  {
+    ERROR_MSG(QString(QObject::tr("Failed to create hash cache %1")).arg(path), 1);
+    return false;
+  }
+  Header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, s_hashCacheMagic, sizeof(header.magic));
+  header.version = s_hashCacheVersion;
+  header.digestSize = static_cast<quint32>(digestSize);
+  header.numSets = numSets;
+  header.run = run;
+  header.clock = 0;
+  bool rc = file.write(reinterpret_cast<const char*>(&header), sizeof(header)) == sizeof(header);
+  // Resizing fills with zeros, which is an empty record.
+  rc = rc && file.resize(sizeof(Header) + static_cast<qint64>(numSets) * s_ways * sizeof(Record));
+  file.close();
+  return rc;
+}
+
+bool HashCache::mapFile()
+{
+  m_map = m_file.map(0, m_file.size());
+  if (m_map == nullptr)
+  {
+    return false;
+  }
+  m_header = reinterpret_cast<Header*>(m_map);
+  m_records = reinterpret_cast<Record*>(m_map + sizeof(Header));
+  return true;
+}
+
+bool HashCache::open(const QString& path, const quint32 capacity, const int digestSize)
+{
+  close();
+  if (capacity == 0 || digestSize <= 0 || digestSize > s_maxDigestSize)
+  {
+    return false;
+  }
+  const quint32 numSets = (capacity + s_ways - 1) / s_ways;
+
+  m_file.setFileName(path);
+  bool recreate = !m_file.exists();
+  bool resize = false;
+  quint32 run = 0;
+  if (!recreate)
+  {
+    if (!m_file.open(QIODevice::ReadOnly))
+    {
+      recreate = true;
+    }
+    else
+    {
+      Header header;
+      if (m_file.read(reinterpret_cast<char*>(&header), sizeof(header)) != sizeof(header) ||
+          memcmp(header.magic, s_hashCacheMagic, sizeof(header.magic)) != 0 ||
+          header.version != s_hashCacheVersion || header.digestSize != static_cast<quint32>(digestSize) ||
+          m_file.size() != static_cast<qint64>(sizeof(Header) + static_cast<qint64>(header.numSets) * s_ways * sizeof(Record)))
+      {
+        WARN_MSG(QString(QObject::tr("Hash cache %1 is not usable, creating a new one.")).arg(path), 1);
+        recreate = true;
+      }
+      else
+      {
+        resize = (header.numSets != numSets);
+        run = header.run;
+      }
+      m_file.close();
+    }
+  }
+
+  if (recreate && !createFile(path, numSets, digestSize, 0))
+  {
+    return false;
+  }
+  if (resize)
+  {
+    INFO_MSG(QString(QObject::tr("Resizing hash cache %1 to %2 entries")).arg(path).arg(numSets * s_ways), 1);
+    if (!compact(path, numSets * s_ways, run + 1) && !createFile(path, numSets, digestSize, 0))
+    {
+      return false;
+    }
+  }
+
+  if (!m_file.open(QIODevice::ReadWrite) || !mapFile())
+  {
+    ERROR_MSG(QString(QObject::tr("Failed to map hash cache %1")).arg(path), 1);
+    close();
+    return false;
+  }
+  ++m_header->run;
+  m_hits = 0;
+  m_misses = 0;
+  return true;
+}
+
+void HashCache::close()
+{
+  if (m_map != nullptr)
+  {
+    m_file.unmap(m_map);
+    m_map = nullptr;
+    m_header = nullptr;
+    m_records = nullptr;
+  }
+  if (m_file.isOpen())
+  {
+    m_file.close();
+  }
+}
+
+quint32 HashCache::getCapacity() const
+{
+  return (m_header != nullptr) ? m_header->numSets * s_ways : 0;
+}
+
+bool HashCache::keyForFile(const QString& path, HashCacheKey& key)
+{
+  struct stat st;
+  if (stat(QFile::encodeName(path).constData(), &st) != 0)
+  {
+    return false;
+  }
+  key.device = static_cast<quint64>(st.st_dev);
+  key.inode = static_cast<quint64>(st.st_ino);
+  key.size = static_cast<quint64>(st.st_size);
+  key.mtimeNs = static_cast<qint64>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+  key.ctimeNs = static_cast<qint64>(st.st_ctim.tv_sec) * 1000000000LL + st.st_ctim.tv_nsec;
+  return true;
+}
+
+HashCache::Record* HashCache::setForKey(const HashCacheKey& key) const
+{
+  // splitmix64 finalizer on the identity; the inode and device are enough to spread the keys.
+  quint64 x = key.inode ^ (key.device * 0x9E3779B97F4A7C15ULL);
+  x ^= x >> 30;
+  x *= 0xBF58476D1CE4E5B9ULL;
+  x ^= x >> 27;
+  x *= 0x94D049BB133111EBULL;
+  x ^= x >> 31;
+  return m_records + (x % m_header->numSets) * s_ways;
+}
+
+bool HashCache::keyMatches(const Record& record, const HashCacheKey& key)
+{
+  return record.lastUsed != 0 && record.inode == key.inode && record.device == key.device &&
+      record.size == key.size && record.mtimeNs == key.mtimeNs && record.ctimeNs == key.ctimeNs;
+}
+
+quint64 HashCache::recordCheck(const Record& record)
+{
+  // FNV-1a over the key and the digest; detects a record that was only partially written.
+  quint64 h = 0xCBF29CE484222325ULL;
+  const uchar* p = reinterpret_cast<const uchar*>(&record);
+  const size_t keyBytes = 5 * sizeof(quint64);
+  for (size_t i=0; i<keyBytes; ++i)
+  {
+    h = (h ^ p[i]) * 0x100000001B3ULL;
+  }
+  for (int i=0; i<s_maxDigestSize; ++i)
+  {
+    h = (h ^ record.digest[i]) * 0x100000001B3ULL;
+  }
+  return h;
+}
+
+bool HashCache::find(const HashCacheKey& key, QString& hash)
+{
+  if (!isOpen())
+  {
+    return false;
+  }
+  Record* set = setForKey(key);
+  for (quint32 i=0; i<s_ways; ++i)
+  {
+    Record& record = set[i];
+    if (keyMatches(record, key) && record.check == recordCheck(record))
+    {
+      record.lastUsed = ++m_header->clock;
+      record.run = m_header->run;
+      hash = QByteArray(reinterpret_cast<const char*>(record.digest), static_cast<int>(m_header->digestSize)).toHex().toUpper();
+      ++m_hits;
+      return true;
+    }
+  }
+  ++m_misses;
+  return false;
+}
+
+void HashCache::insert(const HashCacheKey& key, const QString& hash)
+{
+  if (!isOpen())
+  {
+    return;
+  }
+  QByteArray digest = QByteArray::fromHex(hash.toLatin1());
+  if (digest.size() != static_cast<int>(m_header->digestSize))
+  {
+    return;
+  }
+  insertDigest(key, reinterpret_cast<const uchar*>(digest.constData()), ++m_header->clock, m_header->run);
+}
+
+void HashCache::insertDigest(const HashCacheKey& key, const uchar* digest, const quint64 lastUsed, const quint32 run)
+{
+  Record* set = setForKey(key);
+  Record* target = nullptr;
+  for (quint32 i=0; i<s_ways && target == nullptr; ++i)
+  {
+    if (set[i].lastUsed == 0 || keyMatches(set[i], key))
+    {
+      target = &set[i];
+    }
+  }
+  if (target == nullptr)
+  {
+    // Set is full, replace the least recently used record.
+    target = set;
+    for (quint32 i=1; i<s_ways; ++i)
+    {
+      if (set[i].lastUsed < target->lastUsed)
+      {
+        target = &set[i];
+      }
+    }
+  }
+
+  // Mark the record empty while it is changed so that a crash never leaves a record
+  // that looks valid with a mix of old and new values.
+  target->lastUsed = 0;
+  target->device = key.device;
+  target->inode = key.inode;
+  target->size = key.size;
+  target->mtimeNs = key.mtimeNs;
+  target->ctimeNs = key.ctimeNs;
+  target->run = run;
+  target->reserved = 0;
+  memset(target->digest, 0, sizeof(target->digest));
+  memcpy(target->digest, digest, m_header->digestSize);
+  target->check = recordCheck(*target);
+  target->lastUsed = lastUsed;
+}
+
+bool HashCache::compact(const QString& path, const quint32 newCapacity, const quint32 maxRunAge)
+{
+  HashCache oldCache;
+  oldCache.m_file.setFileName(path);
+  if (!oldCache.m_file.open(QIODevice::ReadOnly) || !oldCache.mapFile() ||
+      memcmp(oldCache.m_header->magic, s_hashCacheMagic, sizeof(s_hashCacheMagic)) != 0)
+  {
+    ERROR_MSG(QString(QObject::tr("Failed to open hash cache %1 to compact it")).arg(path), 1);
+    return false;
+  }
+
+  const quint32 run = oldCache.m_header->run;
+  const int digestSize = static_cast<int>(oldCache.m_header->digestSize);
+  const quint32 capacity = (newCapacity > 0) ? newCapacity : oldCache.getCapacity();
+  const quint32 numSets = (capacity + s_ways - 1) / s_ways;
+
+  // Keep recently used records, oldest first, so that the newest win.
+  QVector<const Record*> keep;
+  const quint64 numRecords = static_cast<quint64>(oldCache.m_header->numSets) * s_ways;
+  for (quint64 i=0; i<numRecords; ++i)
+  {
+    const Record& record = oldCache.m_records[i];
+    if (record.lastUsed != 0 && record.check == recordCheck(record) && run - record.run < maxRunAge)
+    {
+      keep.append(&record);
+    }
+  }
+  std::sort(keep.begin(), keep.end(), [](const Record* a, const Record* b) { return a->lastUsed < b->lastUsed; });
+
+  QString compactPath = path + ".compact";
+  HashCache newCache;
+  if (!createFile(compactPath, numSets, digestSize, run))
+  {
+    return false;
+  }
+  newCache.m_file.setFileName(compactPath);
+  if (!newCache.m_file.open(QIODevice::ReadWrite) || !newCache.mapFile())
+  {
+    ERROR_MSG(QString(QObject::tr("Failed to map compacted hash cache %1")).arg(compactPath), 1);
+    return false;
+  }
+  quint64 clock = 0;
+  for (const Record* record : keep)
+  {
+    HashCacheKey key;
+    key.device = record->device;
+    key.inode = record->inode;
+    key.size = record->size;
+    key.mtimeNs = record->mtimeNs;
+    key.ctimeNs = record->ctimeNs;
+    newCache.insertDigest(key, record->digest, ++clock, record->run);
+  }
+  newCache.m_header->clock = clock;
+  newCache.close();
+  oldCache.close();
+
+  QFile::remove(path);
+  if (!QFile::rename(compactPath, path))
+  {
+    ERROR_MSG(QString(QObject::tr("Failed to replace hash cache %1")).arg(path), 1);
+    return false;
+  }
+  INFO_MSG(QString(QObject::tr("Compacted hash cache %1: kept %2 of %3 entries")).arg(path).arg(keep.size()).arg(numRecords), 1);
+  return true;
+}
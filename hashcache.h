@@ -0,0 +1,180 @@
+#ifndef HASHCACHE_H
+#define HASHCACHE_H
+
+#include <QString>
+#include <QFile>
+
+//**************************************************************************
+/*! \brief Identify a file by file system identity rather than by path.
+ *
+ * If any of these values change, the file is assumed to have changed.
+ ***************************************************************************/
+struct HashCacheKey
+{
+  /*! \brief Device containing the file (st_dev). */
+  quint64 device;
+  /*! \brief Inode number (st_ino). */
+  quint64 inode;
+  /*! \brief File size in bytes. */
+  quint64 size;
+  /*! \brief Last modified time in nanoseconds since the epoch. */
+  qint64 mtimeNs;
+  /*! \brief Last status change time in nanoseconds since the epoch. */
+  qint64 ctimeNs;
+};
+
+//**************************************************************************
+/*! \class HashCache
+ *  \brief Persistent memory mapped cache of hash values keyed by file system identity.
+ *
+ * Hash values are otherwise only found by full path in the previous backup, so a
+ * renamed or moved directory causes every file to be hashed again. The cache lives in the
+ * backup root and uses (device, inode, size, mtime, ctime) as the key.
+ *
+ * The file is a fixed size set associative table, so it never grows beyond the capacity
+ * given when it is opened. Each key maps to one set of s_ways records; when the set is full,
+ * the least recently used record in the set is replaced.
+ *
+ * One cache file exists per hash method and mode, because digests from different
+ * methods can not be compared.
+ *
+ * \author Andrew Pitonyak
+ * \copyright Andrew Pitonyak, but you may use without restriction.
+ * \date 2026
+ **************************************************************************/
+class HashCache
+{
+public:
+  /*! \brief Number of records in each set. */
+  static constexpr quint32 s_ways = 8;
+
+  /*! \brief Maximum digest length in bytes (Sha512). */
+  static constexpr int s_maxDigestSize = 64;
+
+  /*! \brief Default number of backups an entry may go unused before compaction removes it. */
+  static constexpr quint32 s_defaultCompactRunAge = 30;
+
+  /*! \brief Constructor, the cache is not open. */
+  HashCache();
+
+  /*! \brief Destructor, closes the cache. */
+  ~HashCache();
+
+  //**************************************************************************
+  /*! \brief Open (or create) the cache file.
+   *
+   *  If the file exists with a different capacity, it is compacted to the new capacity.
+   *  If the file has a different digest size or is not a cache file, it is recreated.
+   *
+   *  \param [in] path Full path to the cache file.
+   *  \param [in] capacity Maximum number of entries, rounded up to a multiple of s_ways.
+   *  \param [in] digestSize Number of bytes in a digest for the hash method.
+   *  \return True if the cache is open and ready for use.
+   ***************************************************************************/
+  bool open(const QString& path, const quint32 capacity, const int digestSize);
+
+  /*! \brief Flush and close the cache. */
+  void close();
+
+  /*! \brief Returns True if the cache is open. */
+  bool isOpen() const;
+
+  //**************************************************************************
+  /*! \brief Build the cache key for a file on disk.
+   *
+   *  \param [in] path Full path to the file.
+   *  \param [out] key Identity of the file.
+   *  \return True if the file could be stat'ed.
+   ***************************************************************************/
+  static bool keyForFile(const QString& path, HashCacheKey& key);
+
+  //**************************************************************************
+  /*! \brief Find a hash value for a key.
+   *
+   *  \param [in] key Identity of the file.
+   *  \param [out] hash Upper case hex representation of the digest if found.
+   *  \return True if the key was found.
+   ***************************************************************************/
+  bool find(const HashCacheKey& key, QString& hash);
+
+  //**************************************************************************
+  /*! \brief Add or replace a hash value for a key.
+   *
+   *  \param [in] key Identity of the file.
+   *  \param [in] hash Hex representation of the digest.
+   ***************************************************************************/
+  void insert(const HashCacheKey& key, const QString& hash);
+
+  /*! \brief Number of successful lookups since the cache was opened. */
+  quint64 getHits() const;
+
+  /*! \brief Number of failed lookups since the cache was opened. */
+  quint64 getMisses() const;
+
+  /*! \brief Maximum number of entries that the cache can hold. */
+  quint32 getCapacity() const;
+
+  //**************************************************************************
+  /*! \brief Rewrite a cache file, removing old entries and changing the capacity.
+   *
+   *  Entries are inserted from least to most recently used so that the most recently
+   *  used entries survive when the new capacity is smaller.
+   *
+   *  \param [in] path Full path to the cache file, which must not be open.
+   *  \param [in] newCapacity Capacity of the compacted cache; zero keeps the current capacity.
+   *  \param [in] maxRunAge Entries not used in this many backups are removed.
+   *  \return True on success.
+   ***************************************************************************/
+  static bool compact(const QString& path, const quint32 newCapacity, const quint32 maxRunAge = s_defaultCompactRunAge);
+
+private:
+  struct Header;
+  struct Record;
+
+  /*! \brief Create a new empty cache file. */
+  static bool createFile(const QString& path, const quint32 numSets, const int digestSize, const quint32 run);
+
+  /*! \brief Map the open file into memory. */
+  bool mapFile();
+
+  /*! \brief Find the set used by the key. */
+  Record* setForKey(const HashCacheKey& key) const;
+
+  /*! \brief Insert raw digest bytes with a specific use counter and run number. */
+  void insertDigest(const HashCacheKey& key, const uchar* digest, const quint64 lastUsed, const quint32 run);
+
+  static bool keyMatches(const Record& record, const HashCacheKey& key);
+  static quint64 recordCheck(const Record& record);
+
+  /*! \brief The cache file. */
+  QFile m_file;
+
+  /*! \brief Start of the memory mapped file. */
+  uchar* m_map;
+
+  /*! \brief Cached pointer to the header in the mapped file. */
+  Header* m_header;
+
+  /*! \brief Cached pointer to the first record in the mapped file. */
+  Record* m_records;
+
+  quint64 m_hits;
+  quint64 m_misses;
+};
+
+inline bool HashCache::isOpen() const
+{
+  return m_map != nullptr;
+}
+
+inline quint64 HashCache::getHits() const
+{
+  return m_hits;
+}
+
+inline quint64 HashCache::getMisses() const
+{
+  return m_misses;
+}
+
+#endif // HASHCACHE_H
@@ -1,5 +1,6 @@
 #include "linkbackfilter.h"
 #include "linkbackupglobals.h"
+#include "directoryscanner.h"
 
 #include <QFileInfo>
 #include <QDebug>
@@ -307,11 +308,16 @@ void LinkBackFilter::setValueDefault()
 
 bool LinkBackFilter::applicable(const QFileInfo& fileInfo) const
 {
-  if (isFilterFiles() && fileInfo.isFile())
+  return applicable(ScannedEntry::fromFileInfo(fileInfo));
+}
+
+bool LinkBackFilter::applicable(const ScannedEntry& fileInfo) const
+{
+  if (isFilterFiles() && fileInfo.isFile)
   {
     return true;
   }
-  if (isFilterDirs() && fileInfo.isDir())
+  if (isFilterDirs() && fileInfo.isDir)
   {
     return true;
   }
@@ -319,6 +325,11 @@ bool LinkBackFilter::applicable(const QFileInfo& fileInfo) const
 }
 
 bool LinkBackFilter::passes(const QFileInfo& fileInfo) const
+{
+  return passes(ScannedEntry::fromFileInfo(fileInfo));
+}
+
+bool LinkBackFilter::passes(const ScannedEntry& fileInfo) const
 {
   if (!applicable(fileInfo))
   {
@@ -337,16 +348,16 @@ bool LinkBackFilter::passes(const QFileInfo& fileInfo) const
     filterPass = compareValues(fileInfo.lastModified());
     break;
   case LinkBackFilter::Name:
-    filterPass = compareValues(fileInfo.fileName());
+    filterPass = compareValues(fileInfo.name);
     break;
   case LinkBackFilter::FullPath:
-    filterPass = compareValues(fileInfo.canonicalFilePath());
+    filterPass = compareValues(fileInfo.path);
     break;
   case LinkBackFilter::PathOnly:
-    filterPass = compareValues(fileInfo.canonicalPath());
+    filterPass = compareValues(fileInfo.parentPath());
     break;
   case LinkBackFilter::Size:
-    filterPass = compareValues(fileInfo.size());
+    filterPass = compareValues(static_cast<qlonglong>(fileInfo.size));
     break;
   case LinkBackFilter::Time:
     filterPass = compareValues(fileInfo.lastModified().time());
@@ -9,6 +9,7 @@
 #include <QXmlStreamReader>
 
 class QFileInfo;
+struct ScannedEntry;
 class QRegularExpression;
 
 //**************************************************************************
@@ -98,6 +99,14 @@ public:
      ***************************************************************************/
     bool passes(const QFileInfo& fileInfo) const;
 
+    //**************************************************************************
+    /*! \brief Determine if a scanned directory entry passes the filter.
+     *
+     *  \param [in] fileInfo Information about the file to compare.
+     *  \return True if the object passes the filter.
+     ***************************************************************************/
+    bool passes(const ScannedEntry& fileInfo) const;
+
     //**************************************************************************
     /*! \brief Determine if this filter is applicable to the fileInfo type. In other words, some filters apply to directories, and some to filenames.
      *
@@ -107,6 +116,9 @@ public:
      ***************************************************************************/
     bool applicable(const QFileInfo& fileInfo) const;
 
+    /*! \brief Determine if this filter is applicable to a scanned directory entry. */
+    bool applicable(const ScannedEntry& fileInfo) const;
+
     //**************************************************************************
     /*! \brief Get the compare type; equal, less than, greater than, etc...
      ***************************************************************************/
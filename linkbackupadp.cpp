@@ -7,20 +7,26 @@
 #include "logroutinginfodialog.h"
 #include "logconfigdialog.h"
 #include "dbfileentries.h"
+#include "hashcache.h"
+#include "contentindex.h"
+#include "snapshotretention.h"
 
 #include "backupsetdialog.h"
 #include "ui_backupsetdialog.h"
 #include "restorebackup.h"
+#include "restorethread.h"
 
 #include <QDir>
+#include <QFile>
 #include <QFileInfoList>
 #include <QMessageBox>
 #include <QSettings>
+#include <QThread>
 #include <QTimer>
 #include <QFileDialog>
 
 LinkBackupADP::LinkBackupADP(QWidget *parent)
-    : QMainWindow(parent), ui(new Ui::LinkBackupADP), m_backupThread(0),
+    : QMainWindow(parent), ui(new Ui::LinkBackupADP), m_backupThread(0), m_restoreThread(0),
       m_numLinesInEditor(0), m_maxLinesInEditor(1024), m_numLinesDelete(100)
 {
     ui->setupUi(this);
@@ -36,11 +42,19 @@ LinkBackupADP::LinkBackupADP(QWidget *parent)
     connect(logProcessingTimer, SIGNAL(timeout()), &getLogger(), SLOT(processQueuedMessages()));
     logProcessingTimer->start(2000);
     getLogger().enableMessageQueue();
+
+    // The backup thread only updates counters; sample them twice a second.
+    QTimer* progressTimer = new QTimer(this);
+    connect(progressTimer, SIGNAL(timeout()), this, SLOT(updateProgress()));
+    progressTimer->start(500);
 }
 
 LinkBackupADP::~LinkBackupADP()
 {
   cancelBackup();
+  if (m_restoreThread != 0) {
+    m_restoreThread->wait();
+  }
   delete ui;
 }
 
@@ -52,6 +66,15 @@ void LinkBackupADP::on_actionExit_triggered()
   QApplication::quit();
 }
 
+void LinkBackupADP::updateProgress()
+{
+  if (m_restoreThread != 0 && m_restoreThread->isRunning()) {
+    statusBar()->showMessage(m_restoreThread->getProgress().sample().toString());
+  } else if (m_backupThread != 0) {
+    statusBar()->showMessage(m_backupThread->getProgress().sample().toString());
+  }
+}
+
 void LinkBackupADP::on_actionEditBackup_triggered()
 {
   BackupSetDialog dlg(m_backupSet, this);
@@ -69,6 +92,10 @@ void LinkBackupADP::on_actionEditBackup_triggered()
 
 void LinkBackupADP::on_actionStartBackup_triggered()
 {
+  if (m_restoreThread != 0 && m_restoreThread->isRunning()) {
+    QMessageBox::warning(this, tr("Restore Running"), tr("A backup can not be started while a restore is running."));
+    return;
+  }
   cancelBackup();
   if (m_backupThread != 0) {
     delete m_backupThread;
@@ -131,11 +158,116 @@ void LinkBackupADP::on_actionCancelBackup_triggered()
   cancelBackup();
 }
 
+void LinkBackupADP::on_actionCompactHashCache_triggered()
+{
+  if (m_backupThread != 0 && m_backupThread->isRunning()) {
+    QMessageBox::warning(this, tr("Backup Running"), tr("The hash cache can not be compacted while a backup is running."));
+    return;
+  }
+  QString message = validateDestinationPath();
+  if (!message.isEmpty()) {
+    QMessageBox::critical(this, tr("Error"), message);
+    return;
+  }
+  QString cachePath = m_backupSet.getHashCachePath();
+  if (!QFile::exists(cachePath)) {
+    QMessageBox::information(this, tr("No Hash Cache"), QString(tr("There is no hash cache at %1")).arg(cachePath));
+  } else if (!HashCache::compact(cachePath, m_backupSet.getHashCacheSize())) {
+    QMessageBox::warning(this, tr("Compact Failed"), QString(tr("Failed to compact the hash cache %1")).arg(cachePath));
+  }
+}
+
+void LinkBackupADP::on_actionCleanContentIndex_triggered()
+{
+  if (m_backupThread != 0 && m_backupThread->isRunning()) {
+    QMessageBox::warning(this, tr("Backup Running"), tr("The content index can not be cleaned while a backup is running."));
+    return;
+  }
+  QString message = validateDestinationPath();
+  if (!message.isEmpty()) {
+    QMessageBox::critical(this, tr("Error"), message);
+    return;
+  }
+  ContentIndex contentIndex;
+  if (!contentIndex.read(m_backupSet.getToPath(), m_backupSet.getHashCatalogName())) {
+    QMessageBox::warning(this, tr("Clean Failed"), tr("Failed to read the content index."));
+    return;
+  }
+  int numRemoved = contentIndex.garbageCollect();
+  if (numRemoved > 0 && !contentIndex.write()) {
+    QMessageBox::warning(this, tr("Clean Failed"), tr("Failed to write the content index."));
+    return;
+  }
+  INFO_MSG(QString(tr("Removed %1 entries from the content index, %2 remain.")).arg(numRemoved).arg(contentIndex.count()), 1);
+}
+
+bool LinkBackupADP::planRetention(SnapshotRetention& retention)
+{
+  if (m_backupThread != 0 && m_backupThread->isRunning()) {
+    QMessageBox::warning(this, tr("Backup Running"), tr("Backups can not be pruned while a backup is running."));
+    return false;
+  }
+  QString message = validateDestinationPath();
+  if (!message.isEmpty()) {
+    QMessageBox::critical(this, tr("Error"), message);
+    return false;
+  }
+  if (!m_backupSet.hasRetention()) {
+    QMessageBox::information(this, tr("No Retention Rules"), tr("The backup set does not contain KeepDaily, KeepWeekly, or KeepMonthly, so nothing is pruned."));
+    return false;
+  }
+  retention.setKeepDaily(m_backupSet.getKeepDaily());
+  retention.setKeepWeekly(m_backupSet.getKeepWeekly());
+  retention.setKeepMonthly(m_backupSet.getKeepMonthly());
+  if (!retention.plan(m_backupSet.getToPath(), QDir(m_backupSet.getFromPath()).dirName(), m_backupSet.getHashCatalogName())) {
+    QMessageBox::warning(this, tr("Prune Failed"), tr("Failed to find the backups."));
+    return false;
+  }
+  INFO_MSG(retention.report(), 1);
+  return true;
+}
+
+void LinkBackupADP::on_actionPruneReport_triggered()
+{
+  SnapshotRetention retention;
+  if (planRetention(retention)) {
+    QMessageBox::information(this, tr("Prune Report"), QString(tr("%1 of %2 backups would be deleted, freeing %3. See the log for details.")).arg(retention.numPruned()).arg(retention.getSnapshots().count()).arg(CopyLinkUtil::getBPS(retention.getBytesFreed(), 0)));
+  }
+}
+
+void LinkBackupADP::on_actionPruneBackups_triggered()
+{
+  SnapshotRetention retention;
+  if (!planRetention(retention)) {
+    return;
+  }
+  if (retention.numPruned() == 0) {
+    QMessageBox::information(this, tr("Prune Backups"), tr("No backups need to be deleted."));
+    return;
+  }
+  QString question = QString(tr("Delete %1 of %2 backups, freeing %3? See the log for details.")).arg(retention.numPruned()).arg(retention.getSnapshots().count()).arg(CopyLinkUtil::getBPS(retention.getBytesFreed(), 0));
+  if (QMessageBox::question(this, tr("Prune Backups"), question, QMessageBox::Yes|QMessageBox::No) != QMessageBox::Yes) {
+    return;
+  }
+  int numDeleted = retention.prune();
+  INFO_MSG(QString(tr("Deleted %1 backups.")).arg(numDeleted), 1);
+
+  // Canonical files in the deleted backups can no longer be linked.
+  ContentIndex contentIndex;
+  if (QFile::exists(ContentIndex::indexPath(m_backupSet.getToPath(), m_backupSet.getHashCatalogName())) &&
+      contentIndex.read(m_backupSet.getToPath(), m_backupSet.getHashCatalogName()) && contentIndex.garbageCollect() > 0) {
+    contentIndex.write();
+  }
+}
+
 void LinkBackupADP::cancelBackup()
 {
   if (m_backupThread != 0) {
     m_backupThread->requestCancel();
   }
+  if (m_restoreThread != 0) {
+    m_restoreThread->requestCancel();
+  }
 }
 
 void LinkBackupADP::formattedMessage(const QString& formattedMessage, const SimpleLoggerRoutingInfo::MessageCategory category)
@@ -217,6 +349,26 @@ void LinkBackupADP::on_actionConfigureLog_triggered()
   }
 }
 
+void LinkBackupADP::on_actionBrowseBackup_triggered()
+{
+  QSettings settings;
+  QString filePath = QFileDialog::getOpenFileName(this, tr("Browse Backup"), settings.value("LastRestoreBasePath").toString(), tr("Text files (*.txt)"));
+  if (filePath.isEmpty()) {
+    return;
+  }
+  settings.setValue("LastRestoreBasePath", filePath);
+  // The tree builds its own indexes, so the catalog needs none.
+  DBFileEntries* entries = DBFileEntries::read(filePath, MatchPlan::NoIndex);
+  if (entries == nullptr) {
+    QMessageBox::warning(this, tr("Browse Failed"), QString(tr("Failed to read the catalog %1")).arg(filePath));
+    return;
+  }
+  RestoreBackup dlg(this);
+  dlg.setWindowTitle(QString(tr("Browse %1")).arg(filePath));
+  dlg.setEntries(entries);
+  dlg.exec();
+}
+
 void LinkBackupADP::on_actionRestore_triggered()
 {
   //QMessageBox msgBox;
@@ -231,6 +383,15 @@ void LinkBackupADP::on_actionRestore_triggered()
   // Select file
   // Display Backup
 
+  if (m_backupThread != 0 && m_backupThread->isRunning()) {
+    QMessageBox::warning(this, tr("Backup Running"), tr("A restore can not be started while a backup is running."));
+    return;
+  }
+  if (m_restoreThread != 0 && m_restoreThread->isRunning()) {
+    QMessageBox::warning(this, tr("Restore Running"), tr("A restore is already running."));
+    return;
+  }
+
   QString defaultExtension = tr("Text files (*.txt)");
 
   QSettings settings;
@@ -238,19 +399,19 @@ void LinkBackupADP::on_actionRestore_triggered()
   QString filePath = QFileDialog::getOpenFileName(this, "Open File", currentPath, tr("Text files (*.txt);;XML files (*.xml)"), &defaultExtension);
   if (!filePath.isEmpty())
   {
-    DBFileEntries *fileEntries = DBFileEntries::read(filePath);
-    TRACE_MSG("Read file entries", 10);
-    if (fileEntries != nullptr)
+    settings.setValue("LastRestoreBasePath", filePath);
+    QString targetPath = QFileDialog::getExistingDirectory(this, tr("Restore To"), settings.value("LastRestoreTargetPath").toString());
+    if (!targetPath.isEmpty())
     {
-      settings.setValue("LastRestoreBasePath", filePath);
-      delete fileEntries;
-      fileEntries = nullptr;
-      //RestoreBackup restore(this);
-      //restore.exec();
-    }
-    else
-    {
-      QMessageBox::warning(this, tr("File NOT Read"), QString(tr("Failed to read from %1").arg(filePath)));
+      settings.setValue("LastRestoreTargetPath", targetPath);
+      // The restore runs in the background like a backup, with the same progress and cancel.
+      if (m_restoreThread != 0) {
+        delete m_restoreThread;
+        m_restoreThread = 0;
+      }
+      m_restoreThread = new RestoreThread(filePath, targetPath, this);
+      connect(m_restoreThread, SIGNAL(finished()), this, SLOT(restoreFinished()));
+      m_restoreThread->start();
     }
   }
   TRACE_MSG("Leaving loadBackupSet", 10);
@@ -258,3 +419,15 @@ void LinkBackupADP::on_actionRestore_triggered()
 
 }
 
+void LinkBackupADP::restoreFinished()
+{
+  if (m_restoreThread == 0) {
+    return;
+  }
+  statusBar()->showMessage(m_restoreThread->getProgress().sample().toString());
+  if (m_restoreThread->isRestored()) {
+    QMessageBox::information(this, tr("Restore Finished"), m_restoreThread->summaryText());
+  } else {
+    QMessageBox::warning(this, tr("Restore Failed"), QString(tr("%1\nSee the log for details.")).arg(m_restoreThread->summaryText()));
+  }
+}
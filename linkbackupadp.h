@@ -13,6 +13,8 @@ class LinkBackupADP;
 }
 
 class LinkBackupThread;
+class RestoreThread;
+class SnapshotRetention;
 
 //**************************************************************************
 /*! \class LinkBackupADP
@@ -40,7 +42,7 @@ public:
     ~LinkBackupADP();
 
     //**************************************************************************
-    /*! \brief Cancels any currently running backup threads.
+    /*! \brief Cancels any currently running backup or restore threads.
      ***************************************************************************/
     void cancelBackup();
 
@@ -56,6 +58,14 @@ public:
      ***************************************************************************/
     QString validateDestinationPath() const;
 
+    //**************************************************************************
+    /*! \brief Build the retention plan for the current backup set.
+     *
+     *  \param [out] retention Plan for the current backup set.
+     *  \return True if the plan was built, otherwise the user was told why.
+     ***************************************************************************/
+    bool planRetention(SnapshotRetention& retention);
+
     //**************************************************************************
     /*! \brief Validate that the source and destination path exists.
      *  \return Error message describing the error, or an empty string if no error.
@@ -93,10 +103,48 @@ private slots:
    ***************************************************************************/
   void on_actionCancelBackup_triggered();
 
+  //**************************************************************************
+  /*! \brief Compact the persistent hash cache for the current backup set, removing entries that have not been used recently.
+   ***************************************************************************/
+  void on_actionCompactHashCache_triggered();
+
+  //**************************************************************************
+  /*! \brief Remove entries from the content index whose canonical file no longer exists.
+   ***************************************************************************/
+  void on_actionCleanContentIndex_triggered();
+
+  //**************************************************************************
+  /*! \brief Report which backups the retention rules keep and how much space pruning frees, without deleting anything.
+   ***************************************************************************/
+  void on_actionPruneReport_triggered();
+
+  //**************************************************************************
+  /*! \brief Delete the backups that the retention rules do not keep after the user confirms the report.
+   ***************************************************************************/
+  void on_actionPruneBackups_triggered();
+
   void on_actionConfigureLog_triggered();
 
+  //**************************************************************************
+  /*! \brief Browse and search the files in a backup selected by its catalog.
+   ***************************************************************************/
+  void on_actionBrowseBackup_triggered();
+
+  //**************************************************************************
+  /*! \brief Restore a backup selected by its catalog to a directory in the background.
+   ***************************************************************************/
   void on_actionRestore_triggered();
 
+  //**************************************************************************
+  /*! \brief Tell the user how the restore ended; called when the restore thread finishes.
+   ***************************************************************************/
+  void restoreFinished();
+
+  //**************************************************************************
+  /*! \brief Sample the progress of the backup thread and show it in the status bar; called by a timer.
+   ***************************************************************************/
+  void updateProgress();
+
 
 private:
   /*!  \brief The User Interface portion of the GUI. */
@@ -105,6 +153,9 @@ private:
   /*!  \brief Any existing backup thread. */
   LinkBackupThread* m_backupThread;
 
+  /*!  \brief Any existing restore thread. */
+  RestoreThread* m_restoreThread;
+
   /*!  \brief Full path to the cofiguration file (for the BackupSet). */
   QString m_configFilePath;
 
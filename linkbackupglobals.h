@@ -4,6 +4,7 @@
 #include "copylinkutil.h"
 #include "simpleloggeradp.h"
 #include "qtenummapper.h"
+#include "perftrace.h"
 #include <QDateTime>
 #include <QLoggingCategory>
 
@@ -27,6 +28,13 @@ CopyLinkUtil& getCopyLinkUtil();
  ***************************************************************************/
 SimpleLoggerADP& getLogger();
 
+//**************************************************************************
+/*! \brief Get the single global instance of the per-phase performance timers.
+ *
+ * \returns The single global instance used by PerfScope.
+ ***************************************************************************/
+PerfTrace& getPerfTrace();
+
 QtEnumMapper& getEnumMapper();
 
 #define ERROR_MSG(msg, level) errorMessage((msg), QString(QObject::tr("%1:%2")).arg(__FILE__, QString::number(__LINE__)), QDateTime::currentDateTime(), (level));
@@ -6,11 +6,20 @@
 #include <QMessageBox>
 #include <QRegularExpression>
 
-LinkBackupThread::LinkBackupThread(QObject *parent) : QThread(parent), m_cancelRequested(false), m_currentEntries(nullptr), m_oldEntries(nullptr)
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// A directory changed this recently may change again without changing its time stamps.
+static const qint64 s_racyStampNs = 2000000000LL;
+
+LinkBackupThread::LinkBackupThread(QObject *parent) : QThread(parent), m_cancelRequested(false), m_currentEntries(nullptr), m_resumeEntries(nullptr), m_useChangeJournal(false), m_numDirsReused(0), m_useContentIndex(false)
 {
 }
 
-LinkBackupThread::LinkBackupThread(const BackupSet& backupSet, QObject *parent) : QThread(parent), m_cancelRequested(false), m_currentEntries(nullptr), m_oldEntries(nullptr)
+LinkBackupThread::LinkBackupThread(const BackupSet& backupSet, QObject *parent) : QThread(parent), m_cancelRequested(false), m_currentEntries(nullptr), m_resumeEntries(nullptr), m_useChangeJournal(false), m_numDirsReused(0), m_useContentIndex(false)
 {
     setBackupSet(backupSet);
 }
@@ -19,16 +28,8 @@ LinkBackupThread::LinkBackupThread(const BackupSet& backupSet, QObject *parent)
 LinkBackupThread::~LinkBackupThread()
 {
   DBFileEntries* entries = nullptr;
-  setOldEntries(entries);
   setCurrentEntries(entries);
-}
-
-void LinkBackupThread::setOldEntries(DBFileEntries* entries)
-{
-  if (m_oldEntries != nullptr) {
-    delete m_oldEntries;
-  }
-  m_oldEntries = entries;
+  delete m_resumeEntries;
 }
 
 void LinkBackupThread::setCurrentEntries(DBFileEntries* entries)
@@ -53,34 +54,116 @@ void LinkBackupThread::run()
     ERROR_MSG(QString(tr("Failed to setup hash generator.")), 0);
     return;
   }
+  ::getCopyLinkUtil().setHashChunkSize(m_backupSet.getHashChunkSize());
   ::getCopyLinkUtil().resetStats();
+  m_progress.start(0, 0);
+  ::getCopyLinkUtil().setProgress(&m_progress);
+  QThread::currentThread()->setObjectName("Backup");
+  getPerfTrace().start(m_backupSet.isWritePerfTrace());
 
-  setOldEntries(nullptr);
+  if (m_backupSet.getHashCacheSize() > 0)
+  {
+    bool ok;
+    QCryptographicHash::Algorithm algorithm = EnhancedQCryptographicHash::toAlgorithm(m_backupSet.getHashMethod(), &ok);
+    if (ok && m_hashCache.open(m_backupSet.getHashCachePath(), m_backupSet.getHashCacheSize(), QCryptographicHash::hashLength(algorithm)))
+    {
+      ::getCopyLinkUtil().setHashCache(&m_hashCache);
+    }
+    else
+    {
+      WARN_MSG(QString(tr("Unable to use the hash cache %1")).arg(m_backupSet.getHashCachePath()), 1);
+    }
+  }
+
+  // Compile the criteria once; the file entries only build the indexes the plan needs.
+  m_matchPlan.compile(m_backupSet.getCriteria());
+  INFO_MSG(QString(tr("Match plan: %1")).arg(m_matchPlan.toString()), 1);
+
+  m_linkBase.clear();
   setCurrentEntries(new DBFileEntries());
+  // Every entry is streamed to the catalog; only copies are kept as link targets for the rest of this backup.
+  m_currentEntries->setIndexes(m_matchPlan.getIndexes());
+  m_rolloverTargets.clear();
 
   m_cancelRequested = false;
-  m_previousDirRoot = newestBackDirectory(m_backupSet.getToPath());
-  if (m_previousDirRoot.length() > 0) {
-    INFO_MSG(QString(tr("Found previous backup in %1")).arg(m_previousDirRoot), 1);
 
-    QString previousDBFileEntries = findHashFileCaseInsensitive(m_previousDirRoot, m_backupSet.getHashMethod());
-    if (previousDBFileEntries.isEmpty())
+  // A backup of this set that did not finish is resumed rather than started over.
+  const QString catalogName = m_backupSet.getHashCatalogName();
+  BackupJournal interruptedJournal;
+  QString resumeDirRoot = interruptedBackDirectory(m_backupSet.getToPath());
+  if (!resumeDirRoot.isEmpty())
+  {
+    if (!interruptedJournal.read(resumeDirRoot) || interruptedJournal.getCatalogName() != catalogName || interruptedJournal.getFromPath() != m_backupSet.getFromPath())
     {
-        WARN_MSG(QString(tr("Although a previous backup was found in %1, file entries were not found for hash method %2.")).arg(m_previousDirRoot, m_backupSet.getHashMethod()), 1);
+      resumeDirRoot.clear();
     }
-    else
+    else if (QFileInfo::exists(resumeDirRoot + "/" + catalogName + ".txt"))
     {
-        setOldEntries(DBFileEntries::read(previousDBFileEntries));
-        INFO_MSG(QString(tr("Found %1 entries in previous backup.")).arg(numOldEntries()), 1);
+      // The catalog was renamed, but the backup stopped before removing the journal.
+      QFile::remove(BackupJournal::journalPath(resumeDirRoot));
+      resumeDirRoot.clear();
     }
+  }
+
+  // Earlier backups to link against, newest first; older catalogs are only read if needed.
+  m_linkBase.open(m_backupSet.getToPath(), catalogName, m_backupSet.getLinkBaseDepth(), m_matchPlan.getIndexes());
+  m_previousDirRoot = m_linkBase.newestPath();
+  if (m_previousDirRoot.length() > 0) {
+    INFO_MSG(QString(tr("Found previous backup in %1, linking against %2 backups")).arg(m_previousDirRoot).arg(m_linkBase.count()), 1);
+    // The previous backup is the best estimate of the work to do.
+    const DBFileEntries* previousEntries = m_linkBase.newestEntries();
+    m_progress.setExpected(previousEntries->count(), previousEntries->totalSize());
   } else {
     WARN_MSG(QString(tr("No previous backup found.")), 1);
   }
-  if (m_oldEntries == nullptr)
+
+  delete m_resumeEntries;
+  m_resumeEntries = nullptr;
+  m_completedDirs.clear();
+  if (!resumeDirRoot.isEmpty())
   {
-    m_oldEntries = new DBFileEntries();
+    INFO_MSG(QString(tr("Resuming the interrupted backup in %1")).arg(resumeDirRoot), 1);
+    m_toDirRoot = resumeDirRoot;
+    const QString partialCatalog = CatalogWriter::partialPath(m_toDirRoot + "/" + catalogName + ".txt");
+    if (QFileInfo::exists(partialCatalog))
+    {
+      m_resumeEntries = DBFileEntries::read(partialCatalog, MatchPlan::PathIndex);
+    }
+    if (m_resumeEntries == nullptr)
+    {
+      // Without the entries a completed directory can not be trusted, so every file is checked.
+      m_resumeEntries = new DBFileEntries();
+      m_resumeEntries->setIndexes(MatchPlan::PathIndex);
+    }
+    else
+    {
+      m_completedDirs = interruptedJournal.getCompleted();
+    }
+    INFO_MSG(QString(tr("Found %1 entries and %2 completed directories in the interrupted backup.")).arg(m_resumeEntries->count()).arg(m_completedDirs.count()), 1);
+  }
+  else
+  {
+    m_toDirRoot = createBackDirectory(m_backupSet.getToPath());
+  }
+
+  // The content index is only meaningful when files are matched by hash.
+  m_useContentIndex = false;
+  if (m_backupSet.isUseContentIndex())
+  {
+    m_useContentIndex = m_matchPlan.usesHash();
+    if (!m_useContentIndex)
+    {
+      WARN_MSG(QString(tr("The content index is not used because no match criteria uses the file hash.")), 1);
+    }
+    else if (!m_contentIndex.read(m_backupSet.getToPath(), m_backupSet.getHashCatalogName()))
+    {
+      m_useContentIndex = false;
+    }
+    else
+    {
+      INFO_MSG(QString(tr("Content index contains %1 files.")).arg(m_contentIndex.count()), 1);
+    }
   }
-  m_toDirRoot = createBackDirectory(m_backupSet.getToPath());
 
   QDir topFromDir(m_backupSet.getFromPath());
 
@@ -88,28 +171,276 @@ void LinkBackupThread::run()
   QString topFromDirName = topFromDir.dirName();
   if (!topFromDir.exists() || topFromDirName.length() == 0) {
     WARN_MSG(QString(tr("Diretcory does not exist, or no directory name in %1, aborting backup.")).arg(m_backupSet.getFromPath()), 1);
+    ::getCopyLinkUtil().setHashCache(nullptr);
+    m_hashCache.close();
+    ::getCopyLinkUtil().setProgress(nullptr);
+    m_progress.finish();
+    getPerfTrace().stop();
     return;
   }
 
   QString canonicalPath = topFromDir.canonicalPath();
   m_fromDirWithoutTopDirName = canonicalPath.left(canonicalPath.length() - topFromDirName.length());
 
-  QDir toDirLocation(m_toDirRoot);
-  toDirLocation.mkdir(topFromDirName);
-  toDirLocation.cd(topFromDirName);
+  // With a watcher running since the previous backup, only changed directories are read.
+  m_useChangeJournal = false;
+  if (!m_previousDirRoot.isEmpty() && m_changeJournal.read(ChangeJournal::journalPath(m_backupSet.getToPath(), canonicalPath)))
+  {
+    const QDateTime previousStart = QDateTime::fromString(QFileInfo(m_previousDirRoot).fileName(), "yyyyMMdd-hhmmss");
+    if (!m_changeJournal.isWatcherRunning())
+    {
+      WARN_MSG(QString(tr("The change watcher for %1 is not running, every directory is read.")).arg(canonicalPath), 1);
+    }
+    else if (m_changeJournal.getFromPath() != canonicalPath || !previousStart.isValid() ||
+             !m_changeJournal.useSince(previousStart.toMSecsSinceEpoch() - ChangeJournal::SinceMarginSeconds * 1000))
+    {
+      INFO_MSG(QString(tr("The change journal does not cover the time since %1, every directory is read.")).arg(m_previousDirRoot), 1);
+    }
+    else
+    {
+      m_useChangeJournal = true;
+      INFO_MSG(QString(tr("Change journal: %1 directories changed since %2.")).arg(m_changeJournal.numDirty()).arg(m_previousDirRoot), 1);
+    }
+  }
+
+  // A directory whose time stamps did not change since the previous backup is not read again.
+  m_previousDirs.clear();
+  m_previousFilesByDir.clear();
+  m_numDirsReused = 0;
+  if (!m_previousDirRoot.isEmpty() && m_previousDirs.read(DirectoryCatalog::dirsPath(m_previousDirRoot + "/" + catalogName + ".txt")))
+  {
+    if (m_previousDirs.getFiltersFingerprint() != m_backupSet.getFiltersFingerprint())
+    {
+      INFO_MSG(QString(tr("The filters changed since %1, every directory is read.")).arg(m_previousDirRoot), 1);
+      m_previousDirs.clear();
+    }
+    else if (m_backupSet.isStrictScan())
+    {
+      INFO_MSG(QString(tr("Strict scan, every directory is read.")), 1);
+    }
+  }
+  // A clean directory is linked from its record in the previous backup, which must use the same filters.
+  if (m_useChangeJournal && (m_previousDirs.count() == 0 || m_backupSet.isStrictScan()))
+  {
+    INFO_MSG(QString(tr("The change journal is not used without the directory catalog of %1 for the same filters.")).arg(m_previousDirRoot), 1);
+    m_useChangeJournal = false;
+  }
+  // A clean directory is linked without looking at the files written by the interrupted backup.
+  if (m_useChangeJournal && m_resumeEntries != nullptr)
+  {
+    INFO_MSG(QString(tr("The change journal is not used while resuming %1.")).arg(m_toDirRoot), 1);
+    m_useChangeJournal = false;
+  }
+
+  // The directories of the previous backup are created up front; new ones as they are found.
+  {
+    PerfScope scope(PerfTrace::Mkdir);
+    if (!m_materializer.open(m_toDirRoot))
+    {
+      ERROR_MSG(QString(tr("Unable to open %1: %2")).arg(m_toDirRoot, QString::fromLocal8Bit(strerror(errno))), 1);
+    }
+    else if (m_previousDirs.count() > 0)
+    {
+      const int numCreated = m_materializer.createAll(m_previousDirs.directories(), QThread::idealThreadCount());
+      INFO_MSG(QString(tr("Created %1 directories from the previous backup.")).arg(numCreated), 1);
+    }
+    // A completed directory is not read again, so nothing below it is asked for.
+    m_materializer.markUsed(m_completedDirs);
+    m_materializer.create(topFromDirName, true);
+  }
+  // Every directory exists before a file is copied into it.
+  ::getCopyLinkUtil().setCreateDirectories(false);
+
+  // The journal is written first so the snapshot is never seen as complete before the catalog is renamed.
+  const QString catalogPath = m_toDirRoot + "/" + catalogName + ".txt";
+  m_journal.create(m_toDirRoot, catalogName, m_backupSet.getFromPath());
+  m_catalogWriter.setJournal(m_journal.isOpen() ? &m_journal : nullptr);
+  m_catalogWriter.open(catalogPath);
+  // The records of the directories completed by the interrupted backup are read before its partial file is replaced.
+  DirectoryCatalog resumeDirs;
+  if (m_resumeEntries != nullptr)
+  {
+    resumeDirs.read(CatalogWriter::partialPath(DirectoryCatalog::dirsPath(catalogPath)));
+  }
+  m_dirCatalog.open(DirectoryCatalog::dirsPath(catalogPath), m_backupSet.getFiltersFingerprint());
+  if (resumeDirs.count() > 0 && resumeDirs.getFiltersFingerprint() == m_backupSet.getFiltersFingerprint())
+  {
+    DirectoryRecord record;
+    for (const QString& dir : m_completedDirs)
+    {
+      if (resumeDirs.find(dir, record))
+      {
+        m_dirCatalog.add(dir, record);
+      }
+    }
+  }
+  // Large files are copied as block deltas; the block map is carried to the next backup.
+  m_previousBlocks.clear();
+  m_blockDelta.resetStats();
+  m_blockDelta.setCancelRequested(false);
+  if (m_backupSet.getDeltaThreshold() > 0)
+  {
+    bool ok;
+    const QCryptographicHash::Algorithm algorithm = EnhancedQCryptographicHash::toAlgorithm(m_backupSet.getHashMethod(), &ok);
+    if (!ok)
+    {
+      WARN_MSG(QString(tr("Block deltas are not used with the hash method %1")).arg(m_backupSet.getHashMethod()), 1);
+    }
+    else
+    {
+      // The records written by the interrupted backup are read before its partial file is replaced.
+      if (m_resumeEntries != nullptr && m_resumeBlocks.read(CatalogWriter::partialPath(BlockMap::blocksPath(catalogPath)), true))
+      {
+        DEBUG_MSG(QString("Found block maps for %1 files in the interrupted backup").arg(m_resumeBlocks.count()), 1);
+      }
+      if (m_blockMap.open(BlockMap::blocksPath(catalogPath)))
+      {
+        m_blockDelta.setHashMethod(algorithm, m_backupSet.getHashChunkSize());
+        m_blockDelta.setProgress(&m_progress);
+        if (!m_previousDirRoot.isEmpty() && m_previousBlocks.read(BlockMap::blocksPath(m_previousDirRoot + "/" + catalogName + ".txt")))
+        {
+          INFO_MSG(QString(tr("Found block maps for %1 files in %2")).arg(m_previousBlocks.count()).arg(m_previousDirRoot), 1);
+        }
+      }
+    }
+  }
+  // Large files are stored as chunks shared by every backup in the To path; a store that exists is
+  // always opened, so files already in it are referenced rather than copied.
+  m_chunkStore.resetStats();
+  m_chunkStore.setCancelRequested(false);
+  if (m_backupSet.getChunkThreshold() > 0 || QFileInfo::exists(ChunkStore::storePath(m_backupSet.getToPath())))
+  {
+    bool ok;
+    const QCryptographicHash::Algorithm algorithm = EnhancedQCryptographicHash::toAlgorithm(m_backupSet.getHashMethod(), &ok);
+    if (!ok)
+    {
+      WARN_MSG(QString(tr("The chunk store is not used with the hash method %1")).arg(m_backupSet.getHashMethod()), 1);
+    }
+    else if (m_chunkStore.open(m_backupSet.getToPath()))
+    {
+      m_chunkStore.setHashMethod(algorithm, m_backupSet.getHashChunkSize());
+      m_chunkStore.setProgress(&m_progress);
+      // The chunk list is shared by content, so the permissions of each file are kept with the backup.
+      if (m_resumeEntries != nullptr)
+      {
+        m_resumeModes.read(CatalogWriter::partialPath(ChunkModes::modesPath(catalogPath)));
+      }
+      if (!m_previousDirRoot.isEmpty())
+      {
+        m_previousModes.read(ChunkModes::modesPath(m_previousDirRoot + "/" + catalogName + ".txt"));
+      }
+      m_chunkModes.open(ChunkModes::modesPath(catalogPath));
+    }
+  }
+  if (m_resumeEntries != nullptr)
+  {
+    resumeCompletedDirs();
+  }
 
   DEBUG_MSG(QString(tr("toDirRoot:%1 topFromDirName:%2 m_fromDir:%3")).arg(m_toDirRoot, topFromDirName, canonicalPath), 1);
   INFO_MSG(QString(tr("toDirRoot:%1 topFromDirName:%2 m_fromDir:%3")).arg(m_toDirRoot, topFromDirName, canonicalPath), 0);
 
-  processDir(topFromDir, toDirLocation);
-  TRACE_MSG(QString("Ready to write final hash summary %1").arg(m_toDirRoot + "/" + m_backupSet.getHashMethod() + ".txt"), 1);
-  m_currentEntries->write(m_toDirRoot + "/" + m_backupSet.getHashMethod() + ".txt");
+  // Paths are built from the canonical top directory; symbolic links are never followed, so every path is canonical.
+  processDir(canonicalPath, m_toDirRoot + "/" + topFromDirName);
+  ::getCopyLinkUtil().setCreateDirectories(true);
+  {
+    PerfScope scope(PerfTrace::Mkdir);
+    // After a cancel, a directory that was not asked for may not have been reached.
+    if (!isCancelRequested())
+    {
+      const int numRemoved = m_materializer.removeUnused();
+      if (numRemoved > 0)
+      {
+        INFO_MSG(QString(tr("Removed %1 directories no longer in the source.")).arg(numRemoved), 1);
+      }
+    }
+    m_materializer.close();
+  }
+  TRACE_MSG(QString("Ready to write final hash summary %1").arg(catalogPath), 1);
+  // A cancelled backup keeps its journal and partial catalog so the next run resumes it.
+  const bool finished = !isCancelRequested();
+  bool catalogWritten;
+  {
+    PerfScope scope(PerfTrace::CatalogWrite);
+    catalogWritten = m_catalogWriter.close(finished);
+    m_dirCatalog.close(finished && catalogWritten);
+    m_blockMap.close(finished && catalogWritten);
+    m_chunkModes.close(finished && catalogWritten);
+  }
+  if (finished && catalogWritten)
+  {
+    m_journal.remove();
+  }
+  else
+  {
+    m_journal.close();
+    WARN_MSG(QString(tr("The backup in %1 did not finish; it will be resumed by the next backup.")).arg(m_toDirRoot), 1);
+  }
+  m_catalogWriter.setJournal(nullptr);
+  setCurrentEntries(nullptr);
+  delete m_resumeEntries;
+  m_resumeEntries = nullptr;
+  m_previousDirs.clear();
+  m_previousFilesByDir.clear();
+  m_previousBlocks.clear();
+  m_resumeBlocks.clear();
+  qDeleteAll(m_olderBlocks);
+  m_olderBlocks.clear();
+  m_blockDelta.setProgress(nullptr);
+  if (m_blockDelta.getNumFiles() > 0)
+  {
+    INFO_MSG(m_blockDelta.summaryText(), 1);
+  }
+  m_chunkStore.setProgress(nullptr);
+  m_chunkStore.close();
+  m_previousModes.clear();
+  m_resumeModes.clear();
+  if (m_chunkStore.getNumFiles() > 0)
+  {
+    INFO_MSG(m_chunkStore.summaryText(), 1);
+  }
+  if (m_numDirsReused > 0)
+  {
+    INFO_MSG(QString(tr("Listed %1 unchanged directories from the previous backup.")).arg(m_numDirsReused), 1);
+  }
+
+  if (m_useContentIndex)
+  {
+    INFO_MSG(QString(tr("Content index: %1 links to earlier backups, %2 rollovers, %3 files.")).arg(m_contentIndex.getHits()).arg(m_contentIndex.getRollovers()).arg(m_contentIndex.count()), 1);
+    if (m_contentIndex.isModified())
+    {
+      m_contentIndex.write();
+    }
+  }
+
+  if (m_hashCache.isOpen())
+  {
+    INFO_MSG(QString(tr("Hash cache: %1 hits, %2 misses")).arg(m_hashCache.getHits()).arg(m_hashCache.getMisses()), 1);
+    ::getCopyLinkUtil().setHashCache(nullptr);
+    m_hashCache.close();
+  }
 
+  ::getCopyLinkUtil().setProgress(nullptr);
+  m_progress.finish();
+  getPerfTrace().stop();
+  if (m_linkBase.getFallbackHits() > 0)
+  {
+    INFO_MSG(QString(tr("Link base: %1 files found in older backups, %2 of %3 catalogs read.")).arg(m_linkBase.getFallbackHits()).arg(m_linkBase.numLoaded()).arg(m_linkBase.count()), 1);
+  }
   INFO_MSG(QString(tr("Backup finished.")), 0);
   INFO_MSG(::getCopyLinkUtil().getStats(), 0);
+  INFO_MSG(m_progress.sample().toString(), 0);
+  INFO_MSG(getPerfTrace().summaryText(), 1);
+
+  // The timing files sit next to the catalog so each backup keeps its own.
+  getPerfTrace().writeSummary(m_toDirRoot + "/" + m_backupSet.getHashCatalogName() + "-perf.json");
+  if (m_backupSet.isWritePerfTrace())
+  {
+    getPerfTrace().writeChromeTrace(m_toDirRoot + "/" + m_backupSet.getHashCatalogName() + "-trace.json");
+  }
 }
 
-void LinkBackupThread::processDir(QDir& currentFromDir, QDir& currentToDir)
+void LinkBackupThread::processDir(const QString& currentFromPath, const QString& currentToPath)
 {
   long numErrors = getLogger().errorCount();
   if (numErrors > 1000)
@@ -123,130 +454,643 @@ void LinkBackupThread::processDir(QDir& currentFromDir, QDir& currentToDir)
       }
   }
 
-  TRACE_MSG(QString("Processing directory %1").arg(currentFromDir.canonicalPath()), 1);
+  // Directory relative to the backup, the same form as the parent of an entry path.
+  const QString relativeToPath = currentToPath.mid(m_toDirRoot.length() + 1);
+  if (m_completedDirs.contains(relativeToPath))
+  {
+    TRACE_MSG(QString("Directory completed by the interrupted backup %1").arg(currentFromPath), 1);
+    return;
+  }
+
+  TRACE_MSG(QString("Processing directory %1").arg(currentFromPath), 1);
+  // Every error in the backup is counted, so a change in the count is an error in this subtree.
+  const qint64 errorsAtStart = m_progress.value(BackupProgress::Errors);
+  QList<ScannedEntry> dirs;
+  QList<ScannedEntry> files;
+  // The directory is stat'ed before it is read, so a change while it is read is seen by the next backup.
+  DirectoryRecord record;
+  record.numSubDirs = 0;
+  record.numFiles = 0;
+  record.numSkipped = 0;
+  bool scanned;
+  {
+    PerfScope scope(PerfTrace::Listing);
+    const bool stamped = m_scanner.statDir(currentFromPath, record.stamp);
+    if (!stamped)
+    {
+      record.stamp.mtimeNs = 0;
+      record.stamp.ctimeNs = 0;
+      record.stamp.numLinks = 0;
+    }
+    scanned = (stamped && listUnchangedDir(currentFromPath, relativeToPath, record.stamp, dirs, files)) ||
+              m_scanner.scan(currentFromPath, dirs, files, &record.numSkipped);
+  }
+  if (!scanned)
+  {
+    ERROR_MSG(QString("Failed to read directory %1: %2").arg(currentFromPath, QString::fromLocal8Bit(strerror(errno))), 1);
+    m_progress.add(BackupProgress::Errors);
+    return;
+  }
+  // Entries changed in the same clock tick as the time stamps can not be seen, so recent stamps are not kept.
+  if (record.stamp.ctimeNs >= QDateTime::currentMSecsSinceEpoch() * 1000000LL - s_racyStampNs)
+  {
+    record.stamp.mtimeNs = 0;
+    record.stamp.ctimeNs = 0;
+  }
+
   // Process directories, then process files.
-  QList<QFileInfo> list = currentFromDir.entryInfoList(QDir::Dirs | QDir::NoDotAndDotDot | QDir::NoSymLinks | QDir::Hidden | QDir::Readable);
-  QFileInfo info;
-  foreach (info, list) {
+  for (const ScannedEntry& info : dirs) {
     if (isCancelRequested()) {
       return;
     }
-    TRACE_MSG(QString("Found Dir to processes %1").arg(info.canonicalFilePath()), 2);
+    TRACE_MSG(QString("Found Dir to processes %1").arg(info.path), 2);
     if (passes(info))
     {
-      DEBUG_MSG(QString("Dir Passes: %1").arg(info.canonicalFilePath()), 2);
-      if (!currentToDir.mkdir(info.fileName())) {
-        ERROR_MSG(QString("Failed to create directory %1/%2").arg(currentToDir.canonicalPath(), info.fileName()), 1);
-      } else if (!currentToDir.cd(info.fileName())) {
-        ERROR_MSG(QString("Failed to cd to directory %1/%2").arg(currentToDir.canonicalPath(), info.fileName()), 1);
-      } else if (!currentFromDir.cd(info.fileName())) {
-        ERROR_MSG(QString("Failed to cd to directory %1/%2").arg(currentFromDir.canonicalPath(), info.fileName()), 1);
-        if (!currentToDir.cdUp()) {
-          ERROR_MSG("Failed to cd up a directory for the to directory", 1);
-          requestCancel();
-          return;
-        }
+      ++record.numSubDirs;
+      DEBUG_MSG(QString("Dir Passes: %1").arg(info.path), 2);
+      QString toPath = currentToPath + "/" + info.name;
+      bool created;
+      {
+        PerfScope scope(PerfTrace::Mkdir);
+        created = m_materializer.create(relativeToPath + "/" + info.name, m_resumeEntries != nullptr);
+      }
+      if (!created) {
+        ERROR_MSG(QString("Failed to create directory %1").arg(toPath), 1);
+        m_progress.add(BackupProgress::Errors);
+      } else if (m_useChangeJournal && m_changeJournal.isCleanSubtree(toPath.mid(m_toDirRoot.length() + 1)) &&
+                 linkCleanSubtree(toPath.mid(m_toDirRoot.length() + 1))) {
+        // Linked from the previous backup without reading the source.
       } else {
-        processDir(currentFromDir, currentToDir);
-        if (!currentToDir.cdUp()) {
-          ERROR_MSG("Failed to cd up a directory for the to directory", 1);
-          requestCancel();
-          return;
-        }
-        if (!currentFromDir.cdUp()) {
-          ERROR_MSG("Failed to cd up a directory for the from directory", 1);
-          requestCancel();
-          return;
-        }
+        processDir(info.path, toPath);
       }
     }
     else
     {
-      DEBUG_MSG(QString("Skipping Dir: %1").arg(info.canonicalFilePath()), 2);
+      ++record.numSkipped;
+      DEBUG_MSG(QString("Skipping Dir: %1").arg(info.path), 2);
     }
   }
   // Now handle files
-  list = currentFromDir.entryInfoList(QDir::Files | QDir::NoSymLinks | QDir::Hidden | QDir::Readable);
-  foreach (info, list) {
+  for (const ScannedEntry& info : files) {
     if (isCancelRequested()) {
       return;
     }
-    QString fullPathFileToRead = info.canonicalFilePath();
+    const QString& fullPathFileToRead = info.path;
+    m_progress.add(BackupProgress::FilesScanned);
+    m_progress.add(BackupProgress::BytesScanned, static_cast<qint64>(info.size));
     //TRACE_MSG(QString("Found File to test %1").arg(fullPathFileToRead), 2);
-    if (passes(info))
+    if (!passes(info))
+    {
+      ++record.numSkipped;
+      m_progress.add(BackupProgress::FilesSkipped);
+    }
+    else
     {
+      ++record.numFiles;
       //TRACE_MSG(QString("File passes %1").arg(fullPathFileToRead), 2);
-      QFile fileToRead(fullPathFileToRead);
-      // Just in case someone deleted the file.
-      if (fileToRead.exists())
+      DBFileEntry* currentEntry = new DBFileEntry(info, m_fromDirWithoutTopDirName);
+      if (m_resumeEntries != nullptr && resumeFile(currentEntry))
       {
-        DBFileEntry* currentEntry = new DBFileEntry(info, m_fromDirWithoutTopDirName);
-        const DBFileEntry* linkEntry = m_oldEntries->findEntry(m_backupSet.getCriteria(), currentEntry, m_fromDirWithoutTopDirName);
-
-        QString pathToLinkFile = m_previousDirRoot;
+        delete currentEntry;
+        continue;
+      }
+      const DBFileEntry* linkEntry;
+      QString pathToLinkFile;
+      {
+        PerfScope scope(PerfTrace::Lookup);
+        linkEntry = m_linkBase.findEntry(m_matchPlan, currentEntry, m_fromDirWithoutTopDirName, pathToLinkFile);
 
-        // If not in the old backup, search the current backup.
+        // If not in an earlier backup, search the current backup.
         if (linkEntry == nullptr)
         {
-          linkEntry = m_currentEntries->findEntry(m_backupSet.getCriteria(), currentEntry, m_fromDirWithoutTopDirName);
+          linkEntry = m_currentEntries->findEntry(m_matchPlan, currentEntry, m_fromDirWithoutTopDirName);
           pathToLinkFile = m_toDirRoot;
         }
+      }
 
-        if (linkEntry == nullptr)
+      // A file in the chunk store has no copy to link to; the new entry shares its chunk list.
+      if (linkEntry != nullptr && linkEntry->getLinkType() == QLatin1Char('K'))
+      {
+        if (referenceChunks(currentEntry, linkEntry, fullPathFileToRead))
+        {
+          delete currentEntry;
+          continue;
+        }
+        linkEntry = nullptr;
+      }
+
+      // Full path to the file to link against.
+      QString linkTarget;
+      if (linkEntry != nullptr)
+      {
+        linkTarget = pathToLinkFile + "/" + linkEntry->getPath();
+        currentEntry->setHash(linkEntry->getHash());
+      }
+      else if (m_useContentIndex &&
+               (currentEntry->getHash().length() > 0 || DBFileEntries::generateHash(currentEntry, m_fromDirWithoutTopDirName)))
+      {
+        // Search every earlier backup and backup set for the same content.
+        PerfScope scope(PerfTrace::Lookup);
+        m_contentIndex.find(currentEntry->getHash(), currentEntry->getSize(), linkTarget);
+      }
+
+      if (linkTarget.isEmpty() && storeChunks(currentEntry, fullPathFileToRead))
+      {
+        m_progress.add(BackupProgress::FilesCopied);
+        INFO_MSG(QString(tr("K  %1")).arg(currentEntry->getPath()), 1);
+        // Later files with the same content in this backup share the chunk list.
+        m_catalogWriter.append(*currentEntry);
+        m_currentEntries->addEntry(currentEntry);
+        continue;
+      }
+      // A file the cancel stopped part way is backed up by the resume.
+      if (isCancelRequested())
+      {
+        delete currentEntry;
+        return;
+      }
+
+      // Set if the link target has the maximum number of links, so the file is copied instead.
+      bool rollover = false;
+      quint64 rolloverInode = 0;
+      if (!linkTarget.isEmpty())
+      {
+        // A target that reached the link limit earlier in this backup was replaced by a copy.
+        if (!m_rolloverTargets.isEmpty() && fileInode(linkTarget, rolloverInode))
         {
-          bool failedToCopy = false;
-          QString fullFileNameToWrite = m_toDirRoot + "/" + currentEntry->getPath();
-          bool needHash = (currentEntry->getHash().length() == 0);
-          if (needHash)
+          linkTarget = m_rolloverTargets.value(rolloverInode, linkTarget);
+        }
+        if (getCopyLinkUtil().linkFile(linkTarget, m_toDirRoot + "/" + currentEntry->getPath()))
+        {
+          currentEntry->setLinkTypeLink();
+          if (linkEntry != nullptr)
+          {
+            carryBlockMap(findBlockMap(pathToLinkFile, linkEntry->getPath()), currentEntry->getPath());
+          }
+          else if (m_blockMap.isOpen())
           {
-            failedToCopy = !::getCopyLinkUtil().copyFileGenerateHash(fullPathFileToRead, fullFileNameToWrite);
-            if (!failedToCopy)
+            // A file found by the content index may have a block map in the backup that holds it.
+            QString backupDir;
+            QString targetPath;
+            if (m_contentIndex.splitPath(linkTarget, backupDir, targetPath))
             {
-              currentEntry->setHash(getCopyLinkUtil().getLastHash());
+              carryBlockMap(findBlockMap(backupDir, targetPath), currentEntry->getPath());
             }
           }
-          else if (!getCopyLinkUtil().copyFile(fullPathFileToRead, fullFileNameToWrite))
+          if (m_useContentIndex)
           {
-            failedToCopy = true;
+            // Files linked to the previous backup become canonical the first time they are seen.
+            m_contentIndex.add(currentEntry->getHash(), currentEntry->getSize(), linkTarget);
           }
+          m_progress.add(BackupProgress::FilesLinked);
+          m_progress.add(BackupProgress::BytesLinked, static_cast<qint64>(currentEntry->getSize()));
+          m_catalogWriter.append(*currentEntry);
+          INFO_MSG(QString(tr("L %1")).arg(currentEntry->getPath()), 1);
+        }
+        else if (getCopyLinkUtil().isLastLinkTooManyLinks() && fileInode(linkTarget, rolloverInode))
+        {
+          WARN_MSG(QString(tr("Maximum number of links reached for %1, copying %2")).arg(linkTarget, currentEntry->getPath()), 1);
+          rollover = true;
+        }
+        else
+        {
+          ERROR_MSG(QString(tr("EL %1")).arg(currentEntry->getPath()), 1);
+          ERROR_MSG(QString(tr("(%1)(%2)")).arg(linkTarget, m_toDirRoot), 1);
+          m_progress.add(BackupProgress::Errors);
+        }
+      }
 
-          if (failedToCopy)
-          {
-            ERROR_MSG(QString(tr("EC %1")).arg(currentEntry->getPath()), 1);
-          }
-          else
+      if (linkTarget.isEmpty() || rollover)
+      {
+        bool failedToCopy = false;
+        QString fullFileNameToWrite = m_toDirRoot + "/" + currentEntry->getPath();
+        bool needHash = (currentEntry->getHash().length() == 0);
+        const bool copiedDelta = !rollover && copyDelta(currentEntry, fullPathFileToRead, fullFileNameToWrite);
+        if (!copiedDelta && isCancelRequested())
+        {
+          delete currentEntry;
+          return;
+        }
+        if (copiedDelta)
+        {
+          // Copied from the unchanged blocks of the previous backup.
+        }
+        else if (needHash)
+        {
+          failedToCopy = !::getCopyLinkUtil().copyFileGenerateHash(fullPathFileToRead, fullFileNameToWrite);
+          if (!failedToCopy)
           {
-            INFO_MSG(QString(tr("C  %1")).arg(currentEntry->getPath()), 1);
-            currentEntry->setLinkTypeCopy();
-            m_currentEntries->addEntry(currentEntry);
-            currentEntry = nullptr;
+            currentEntry->setHash(getCopyLinkUtil().getLastHash());
+            DBFileEntries::cacheHash(fullPathFileToRead, currentEntry->getHash());
           }
         }
+        else if (!getCopyLinkUtil().copyFile(fullPathFileToRead, fullFileNameToWrite))
+        {
+          failedToCopy = true;
+        }
+
+        if (failedToCopy)
+        {
+          ERROR_MSG(QString(tr("EC %1")).arg(currentEntry->getPath()), 1);
+          m_progress.add(BackupProgress::Errors);
+        }
         else
         {
-          if (getCopyLinkUtil().linkFile(pathToLinkFile + "/" + linkEntry->getPath(), m_toDirRoot + "/" + currentEntry->getPath()))
+          m_progress.add(BackupProgress::FilesCopied);
+          INFO_MSG(QString(tr("C  %1")).arg(currentEntry->getPath()), 1);
+          // A copy is a link target for the current and later backups.
+          currentEntry->setLinkTypeCopy();
+          if (rollover)
           {
-            currentEntry->setLinkTypeLink();
-            currentEntry->setHash(linkEntry->getHash());
-            m_currentEntries->addEntry(currentEntry);
-            INFO_MSG(QString(tr("L %1")).arg(currentEntry->getPath()), 1);
-            currentEntry = nullptr;
+            getCopyLinkUtil().addLinkRollover();
+            m_rolloverTargets.insert(rolloverInode, fullFileNameToWrite);
+            if (m_useContentIndex)
+            {
+              m_contentIndex.replace(currentEntry->getHash(), currentEntry->getSize(), fullFileNameToWrite);
+            }
           }
-          else
+          else if (m_useContentIndex)
           {
-            ERROR_MSG(QString(tr("EL %1")).arg(currentEntry->getPath()), 1);
-            ERROR_MSG(QString(tr("(%1)(%2)(%3)")).arg(pathToLinkFile, linkEntry->getPath(), m_toDirRoot), 1);
+            m_contentIndex.add(currentEntry->getHash(), currentEntry->getSize(), fullFileNameToWrite);
           }
-        }
-        if (currentEntry != nullptr)
-        {
-          delete currentEntry;
-          currentEntry= nullptr;
+          m_catalogWriter.append(*currentEntry);
+          m_currentEntries->addEntry(currentEntry);
+          currentEntry = nullptr;
         }
       }
+      if (currentEntry != nullptr)
+      {
+        delete currentEntry;
+        currentEntry= nullptr;
+      }
     }
   }
-  TRACE_MSG(QString("Finished with directory %1").arg(currentFromDir.canonicalPath()), 1);
+  // A subtree with an error, or one left by a cancel, is read again by a resume, and by the next
+  // backup that uses the journal.
+  if (!isCancelRequested() && m_progress.value(BackupProgress::Errors) == errorsAtStart)
+  {
+    m_catalogWriter.directoryCompleted(relativeToPath);
+    m_dirCatalog.add(relativeToPath, record);
+  }
+  TRACE_MSG(QString("Finished with directory %1").arg(currentFromPath), 1);
+}
+
+bool LinkBackupThread::listUnchangedDir(const QString& currentFromPath, const QString& relativeDir, const DirectoryStamp& stamp, QList<ScannedEntry>& dirs, QList<ScannedEntry>& files)
+{
+  DirectoryRecord record;
+  if (m_backupSet.isStrictScan() || !m_previousDirs.find(relativeDir, record) || record.stamp != stamp || record.numSkipped != 0)
+  {
+    return false;
+  }
+  // A subdirectory without a record, or a file that was not written to the catalog, is not known.
+  const QStringList dirNames = m_previousDirs.subDirNames(relativeDir);
+  if (dirNames.count() != record.numSubDirs)
+  {
+    return false;
+  }
+  const QVector<int> fileIndexes = previousFiles(relativeDir);
+  if (fileIndexes.count() != record.numFiles)
+  {
+    return false;
+  }
+  const DBFileEntries* previousEntries = m_linkBase.newestEntries();
+  QStringList fileNames;
+  fileNames.reserve(fileIndexes.count());
+  for (const int i : fileIndexes)
+  {
+    const QString& path = previousEntries->value(i)->getPath();
+    fileNames.append(path.mid(path.lastIndexOf('/') + 1));
+  }
+  if (!m_scanner.statNames(currentFromPath, dirNames, fileNames, dirs, files))
+  {
+    return false;
+  }
+  ++m_numDirsReused;
+  TRACE_MSG(QString("Directory unchanged since the previous backup %1").arg(currentFromPath), 1);
+  return true;
+}
+
+bool LinkBackupThread::resumeFile(const DBFileEntry* entry)
+{
+  const QByteArray toPath = QFile::encodeName(m_toDirRoot + "/" + entry->getPath());
+  const DBFileEntry* resumeEntry = m_resumeEntries->findPath(entry->getPath());
+  struct stat st;
+  // A file in the chunk store is complete once its chunk list is written.
+  if (resumeEntry != nullptr && resumeEntry->getSize() == entry->getSize() && resumeEntry->getTime() == entry->getTime() &&
+      ((resumeEntry->getLinkType() == QLatin1Char('K')) ? m_chunkStore.hasList(resumeEntry->getHash(), resumeEntry->getSize()) :
+       (lstat(toPath.constData(), &st) == 0 && static_cast<quint64>(st.st_size) == entry->getSize())))
+  {
+    m_catalogWriter.append(*resumeEntry);
+    carryBlockMap(m_resumeBlocks.find(resumeEntry->getPath()), resumeEntry->getPath());
+    carryChunkMode(m_resumeModes, resumeEntry->getPath());
+    if (resumeEntry->getLinkType() == QLatin1Char('C') || resumeEntry->getLinkType() == QLatin1Char('K'))
+    {
+      m_currentEntries->addEntry(new DBFileEntry(*resumeEntry));
+      m_progress.add(BackupProgress::FilesCopied);
+    }
+    else
+    {
+      m_progress.add(BackupProgress::FilesLinked);
+      m_progress.add(BackupProgress::BytesLinked, static_cast<qint64>(entry->getSize()));
+    }
+    return true;
+  }
+  if (unlink(toPath.constData()) == 0)
+  {
+    DEBUG_MSG(QString("Removed a file left by the interrupted backup %1").arg(entry->getPath()), 2);
+  }
+  return false;
+}
+
+void LinkBackupThread::resumeCompletedDirs()
+{
+  if (m_completedDirs.isEmpty())
+  {
+    return;
+  }
+  int numResumed = 0;
+  for (int i=0; i<m_resumeEntries->count(); ++i)
+  {
+    const DBFileEntry* entry = m_resumeEntries->value(i);
+    const int lastSlash = entry->getPath().lastIndexOf('/');
+    if (lastSlash > 0 && m_completedDirs.contains(entry->getPath().left(lastSlash)))
+    {
+      m_catalogWriter.append(*entry);
+      carryBlockMap(m_resumeBlocks.find(entry->getPath()), entry->getPath());
+      carryChunkMode(m_resumeModes, entry->getPath());
+      // Copies and stored files remain link targets for the rest of this backup.
+      if (entry->getLinkType() == QLatin1Char('C') || entry->getLinkType() == QLatin1Char('K'))
+      {
+        m_currentEntries->addEntry(new DBFileEntry(*entry));
+      }
+      ++numResumed;
+    }
+  }
+  for (const QString& dir : m_completedDirs)
+  {
+    m_catalogWriter.directoryCompleted(dir);
+  }
+  INFO_MSG(QString(tr("Kept %1 entries from completed directories of the interrupted backup.")).arg(numResumed), 1);
+}
+
+QVector<int> LinkBackupThread::previousFiles(const QString& relativeDir)
+{
+  if (m_previousFilesByDir.isEmpty())
+  {
+    const DBFileEntries* previousEntries = m_linkBase.newestEntries();
+    for (int i=0; i<previousEntries->count(); ++i)
+    {
+      const QString& path = previousEntries->value(i)->getPath();
+      m_previousFilesByDir[path.left(path.lastIndexOf('/'))].append(i);
+    }
+  }
+  return m_previousFilesByDir.value(relativeDir);
+}
+
+bool LinkBackupThread::linkCleanSubtree(const QString& relativeDir)
+{
+  // The directory must be known exactly: a file that failed in the previous backup is not in its
+  // catalog, and an entry that can not be reached in the previous backup is not linked.
+  DirectoryRecord record;
+  if (!m_previousDirs.find(relativeDir, record) || record.numSkipped != 0)
+  {
+    return false;
+  }
+  const QStringList dirNames = m_previousDirs.subDirNames(relativeDir);
+  const QVector<int> fileIndexes = previousFiles(relativeDir);
+  if (dirNames.count() != record.numSubDirs || fileIndexes.count() != record.numFiles)
+  {
+    return false;
+  }
+  const DBFileEntries* previousEntries = m_linkBase.newestEntries();
+  for (const int i : fileIndexes)
+  {
+    const DBFileEntry* entry = previousEntries->value(i);
+    if (entry->getLinkType() == QLatin1Char('K') && !m_chunkStore.hasList(entry->getHash(), entry->getSize()))
+    {
+      return false;
+    }
+  }
+
+  const qint64 errorsAtStart = m_progress.value(BackupProgress::Errors);
+  int numLinked = 0;
+  for (const int i : fileIndexes)
+  {
+    if (isCancelRequested()) {
+      return true;
+    }
+    DBFileEntry entry(*previousEntries->value(i));
+    const QString& path = entry.getPath();
+    m_progress.add(BackupProgress::FilesScanned);
+    m_progress.add(BackupProgress::BytesScanned, static_cast<qint64>(entry.getSize()));
+
+    if (entry.getLinkType() == QLatin1Char('K'))
+    {
+      m_progress.add(BackupProgress::FilesLinked);
+      m_progress.add(BackupProgress::BytesLinked, static_cast<qint64>(entry.getSize()));
+      m_catalogWriter.append(entry);
+      carryChunkMode(m_previousModes, path);
+      ++numLinked;
+      continue;
+    }
+    QString linkTarget = m_previousDirRoot + "/" + path;
+    const QString toPath = m_toDirRoot + "/" + path;
+    quint64 inode = 0;
+    if (!m_rolloverTargets.isEmpty() && fileInode(linkTarget, inode))
+    {
+      linkTarget = m_rolloverTargets.value(inode, linkTarget);
+    }
+    if (getCopyLinkUtil().linkFile(linkTarget, toPath))
+    {
+      entry.setLinkTypeLink();
+      carryBlockMap(m_previousBlocks.find(path), path);
+      if (m_useContentIndex)
+      {
+        m_contentIndex.add(entry.getHash(), entry.getSize(), linkTarget);
+      }
+      m_progress.add(BackupProgress::FilesLinked);
+      m_progress.add(BackupProgress::BytesLinked, static_cast<qint64>(entry.getSize()));
+      m_catalogWriter.append(entry);
+      ++numLinked;
+    }
+    else if (getCopyLinkUtil().isLastLinkTooManyLinks() && fileInode(linkTarget, inode) && getCopyLinkUtil().copyFile(linkTarget, toPath))
+    {
+      WARN_MSG(QString(tr("Maximum number of links reached for %1, copied %2")).arg(linkTarget, path), 1);
+      entry.setLinkTypeCopy();
+      carryBlockMap(m_previousBlocks.find(path), path);
+      getCopyLinkUtil().addLinkRollover();
+      m_rolloverTargets.insert(inode, toPath);
+      if (m_useContentIndex)
+      {
+        m_contentIndex.replace(entry.getHash(), entry.getSize(), toPath);
+      }
+      m_progress.add(BackupProgress::FilesCopied);
+      m_catalogWriter.append(entry);
+      m_currentEntries->addEntry(new DBFileEntry(entry));
+    }
+    else
+    {
+      ERROR_MSG(QString(tr("EL %1")).arg(path), 1);
+      ERROR_MSG(QString(tr("(%1)(%2)")).arg(linkTarget, m_toDirRoot), 1);
+      m_progress.add(BackupProgress::Errors);
+    }
+  }
+
+  // The subdirectories are clean as well, but each is checked the same way.
+  for (const QString& name : dirNames)
+  {
+    if (isCancelRequested()) {
+      return true;
+    }
+    const QString dir = relativeDir + "/" + name;
+    bool created;
+    {
+      PerfScope scope(PerfTrace::Mkdir);
+      created = m_materializer.create(dir, true);
+    }
+    if (!created)
+    {
+      ERROR_MSG(QString("Failed to create directory %1").arg(m_toDirRoot + "/" + dir), 1);
+      m_progress.add(BackupProgress::Errors);
+    }
+    else if (!linkCleanSubtree(dir))
+    {
+      processDir(m_fromDirWithoutTopDirName + dir, m_toDirRoot + "/" + dir);
+    }
+  }
+  if (!isCancelRequested() && m_progress.value(BackupProgress::Errors) == errorsAtStart)
+  {
+    m_catalogWriter.directoryCompleted(relativeDir);
+    // The directory was not read, so its time stamps are the same as in the previous backup.
+    m_dirCatalog.add(relativeDir, record);
+  }
+  TRACE_MSG(QString("Linked %1 files in the unchanged directory %2").arg(numLinked).arg(relativeDir), 1);
+  return true;
+}
+
+bool LinkBackupThread::copyDelta(DBFileEntry* entry, const QString& fromPath, const QString& toPath)
+{
+  if (!m_blockMap.isOpen() || entry->getSize() < static_cast<quint64>(m_backupSet.getDeltaThreshold()))
+  {
+    return false;
+  }
+  BlockMapEntry blocks;
+  if (!m_blockDelta.copy(fromPath, toPath, m_previousDirRoot + "/" + entry->getPath(), m_previousBlocks.find(entry->getPath()), blocks))
+  {
+    if (!isCancelRequested())
+    {
+      WARN_MSG(QString(tr("Block delta failed for %1, copying the whole file")).arg(entry->getPath()), 1);
+    }
+    return false;
+  }
+  if (entry->getHash().length() == 0)
+  {
+    entry->setHash(m_blockDelta.getLastHash());
+    DBFileEntries::cacheHash(fromPath, entry->getHash());
+  }
+  m_blockMap.add(entry->getPath(), blocks);
+  return true;
+}
+
+void LinkBackupThread::carryBlockMap(const BlockMapEntry* blocks, const QString& path)
+{
+  if (m_blockMap.isOpen() && blocks != nullptr)
+  {
+    m_blockMap.add(path, *blocks);
+  }
+}
+
+const BlockMapEntry* LinkBackupThread::findBlockMap(const QString& backupDir, const QString& path)
+{
+  if (!m_blockMap.isOpen() || backupDir == m_toDirRoot)
+  {
+    return nullptr;
+  }
+  if (backupDir == m_previousDirRoot)
+  {
+    return m_previousBlocks.find(path);
+  }
+  BlockMap* blocks = m_olderBlocks.value(backupDir, nullptr);
+  if (blocks == nullptr)
+  {
+    // A backup without a block map is remembered as empty, so it is not read again.
+    blocks = new BlockMap();
+    blocks->read(BlockMap::blocksPath(backupDir + "/" + m_backupSet.getHashCatalogName() + ".txt"));
+    m_olderBlocks.insert(backupDir, blocks);
+  }
+  return blocks->find(path);
+}
+
+bool LinkBackupThread::storeChunks(DBFileEntry* entry, const QString& fromPath)
+{
+  if (!m_chunkStore.isOpen() || m_backupSet.getChunkThreshold() <= 0 || entry->getSize() < static_cast<quint64>(m_backupSet.getChunkThreshold()))
+  {
+    return false;
+  }
+  QString hash;
+  quint64 size = 0;
+  if (!m_chunkStore.store(fromPath, hash, size))
+  {
+    if (!isCancelRequested())
+    {
+      WARN_MSG(QString(tr("Unable to store %1 in the chunk store, copying the whole file")).arg(entry->getPath()), 1);
+    }
+    return false;
+  }
+  // The chunk list describes the bytes read, even if the file changed since it was listed.
+  entry->setHash(hash);
+  entry->setSize(size);
+  entry->setLinkTypeChunks();
+  DBFileEntries::cacheHash(fromPath, hash);
+  addChunkMode(entry->getPath(), fromPath);
+  return true;
+}
+
+bool LinkBackupThread::referenceChunks(DBFileEntry* entry, const DBFileEntry* linkEntry, const QString& fromPath)
+{
+  if (!m_chunkStore.hasList(linkEntry->getHash(), linkEntry->getSize()))
+  {
+    return false;
+  }
+  // The hash and size name the chunk list.
+  entry->setHash(linkEntry->getHash());
+  entry->setSize(linkEntry->getSize());
+  entry->setLinkTypeChunks();
+  m_progress.add(BackupProgress::FilesLinked);
+  m_progress.add(BackupProgress::BytesLinked, static_cast<qint64>(entry->getSize()));
+  m_catalogWriter.append(*entry);
+  addChunkMode(entry->getPath(), fromPath);
+  INFO_MSG(QString(tr("K %1")).arg(entry->getPath()), 1);
+  return true;
+}
+
+void LinkBackupThread::addChunkMode(const QString& path, const QString& fromPath)
+{
+  struct stat st;
+  if (m_chunkModes.isOpen() && lstat(QFile::encodeName(fromPath).constData(), &st) == 0)
+  {
+    m_chunkModes.add(path, st.st_mode);
+  }
+}
+
+void LinkBackupThread::carryChunkMode(const ChunkModes& modes, const QString& path)
+{
+  uint mode;
+  if (modes.find(path, mode))
+  {
+    m_chunkModes.add(path, mode);
+  }
+}
+
+bool LinkBackupThread::fileInode(const QString& path, quint64& inode)
+{
+  struct stat st;
+  if (lstat(QFile::encodeName(path).constData(), &st) != 0)
+  {
+    return false;
+  }
+  inode = static_cast<quint64>(st.st_ino);
+  return true;
 }
 
 bool LinkBackupThread::passes(const QFileInfo& info) const
@@ -254,6 +1098,12 @@ bool LinkBackupThread::passes(const QFileInfo& info) const
   return m_backupSet.passes(info);
 }
 
+bool LinkBackupThread::passes(const ScannedEntry& info) const
+{
+  PerfScope scope(PerfTrace::Filter);
+  return m_backupSet.passes(info);
+}
+
 QString LinkBackupThread::newestBackDirectory(const QString& parentPath)
 {
   QDir dir(parentPath);
@@ -269,12 +1119,36 @@ QString LinkBackupThread::newestBackDirectory(const QString& parentPath)
   for (int i = 0; i < list.size(); ++i) {
     QFileInfo fileInfo = list.at(i);
     if (dirNameRegExp.match(fileInfo.fileName()).hasMatch()) {
+      // An incomplete backup is missing files, so it is never used to link against.
+      if (BackupJournal::exists(fileInfo.filePath())) {
+        INFO_MSG(QString(QObject::tr("Skipping the incomplete backup in %1")).arg(fileInfo.filePath()), 1);
+        continue;
+      }
       return fileInfo.canonicalFilePath();
     }
   }
   return "";
 }
 
+QString LinkBackupThread::interruptedBackDirectory(const QString& parentPath)
+{
+  QDir dir(parentPath);
+  if (!dir.exists()) {
+    return "";
+  }
+  dir.setFilter(QDir::Dirs);
+  dir.setSorting(QDir::Name | QDir::Reversed);
+  QFileInfoList list = dir.entryInfoList();
+  QRegularExpression dirNameRegExp("^\\d{8}-\\d{6}$");
+  for (int i = 0; i < list.size(); ++i) {
+    QFileInfo fileInfo = list.at(i);
+    if (dirNameRegExp.match(fileInfo.fileName()).hasMatch()) {
+      return BackupJournal::exists(fileInfo.filePath()) ? fileInfo.canonicalFilePath() : "";
+    }
+  }
+  return "";
+}
+
 QString LinkBackupThread::findHashFileCaseInsensitive(const QString& parentPath, const QString& hashName)
 {
     QDir dir(parentPath);
@@ -285,14 +1159,23 @@ QString LinkBackupThread::findHashFileCaseInsensitive(const QString& parentPath,
     dir.setFilter(QDir::Files);
     QFileInfoList list = dir.entryInfoList();
     QRegularExpression dirNameRegExp(QString("^%1\\.txt$").arg(hashName), QRegularExpression::PatternOptions(QRegularExpression::CaseInsensitiveOption));
+    QRegularExpression partialNameRegExp(QString("^%1\\.txt\\.partial$").arg(hashName), QRegularExpression::PatternOptions(QRegularExpression::CaseInsensitiveOption));
 
+    QString partialPath;
     for (int i = 0; i < list.size(); ++i) {
       QFileInfo fileInfo = list.at(i);
       if (dirNameRegExp.match(fileInfo.fileName()).hasMatch()) {
         return fileInfo.canonicalFilePath();
       }
+      if (partialPath.isEmpty() && partialNameRegExp.match(fileInfo.fileName()).hasMatch()) {
+        partialPath = fileInfo.canonicalFilePath();
+      }
     }
-    return "";
+    // A backup that did not finish leaves the entries written up to its last checkpoint.
+    if (!partialPath.isEmpty()) {
+      WARN_MSG(QString(QObject::tr("Using the partial catalog %1 from a backup that did not finish")).arg(partialPath), 1);
+    }
+    return partialPath;
 }
 
 QString LinkBackupThread::createBackDirectory(const QString& parentPath)
@@ -310,10 +1193,13 @@ QString LinkBackupThread::createBackDirectory(const QString& parentPath)
 }
 
 int LinkBackupThread::numOldEntries() const {
-  return (m_oldEntries != nullptr) ? m_oldEntries->count() : 0;
+  const DBFileEntries* entries = m_linkBase.newestEntries();
+  return (entries != nullptr) ? entries->count() : 0;
 }
 
 void LinkBackupThread::requestCancel() {
   ::getCopyLinkUtil().setCancelRequested(true);
+  m_blockDelta.setCancelRequested(true);
+  m_chunkStore.setCancelRequested(true);
   m_cancelRequested = true;
 }
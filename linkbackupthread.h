@@ -2,7 +2,23 @@
 #define LINKBACKUPTHREAD_H
 
 #include <QThread>
+#include <QHash>
+#include <QSet>
+#include <QVector>
 #include "backupset.h"
+#include "hashcache.h"
+#include "contentindex.h"
+#include "matchplan.h"
+#include "directoryscanner.h"
+#include "backupprogress.h"
+#include "catalogwriter.h"
+#include "backupjournal.h"
+#include "linkbase.h"
+#include "changejournal.h"
+#include "directorycatalog.h"
+#include "directorymaterializer.h"
+#include "blockdelta.h"
+#include "chunkstore.h"
 
 class DBFileEntries;
 class QDir;
@@ -53,13 +69,23 @@ public:
   void setBackupSet(const BackupSet& backupSet);
 
   //**************************************************************************
-  /*! \brief Get the full path to the most recent backup directory contained in the parentPath.
+  /*! \brief Get the full path to the most recent complete backup directory contained in the parentPath.
+     *
+     *  A directory with a BackupJournal was left by a backup that did not finish, so it is skipped.
      *
      *  \param [in] parentPath is the directory containing existing backups.
      *  \return Full path to the most recent backup, or an empty string if no backup exists.
      **************************************************************************/
   static QString newestBackDirectory(const QString& parentPath);
 
+  //**************************************************************************
+  /*! \brief Get the full path to the most recent backup directory if the backup that wrote it did not finish.
+     *
+     *  \param [in] parentPath is the directory containing existing backups.
+     *  \return Full path to the most recent backup if it has a BackupJournal, or an empty string.
+     **************************************************************************/
+  static QString interruptedBackDirectory(const QString& parentPath);
+
   //**************************************************************************
   /*! \brief Get the full path to the most recent file entries object for a given hash.
      *
@@ -82,6 +108,11 @@ public:
      **************************************************************************/
   static QString createBackDirectory(const QString& parentPath);
 
+  //**************************************************************************
+  /*! \brief Progress counters for the running backup; sample them from any thread. */
+  //**************************************************************************
+  const BackupProgress& getProgress() const;
+
 protected:
   //**************************************************************************
   /*! \brief Start the thread and do the entire process. */
@@ -91,22 +122,14 @@ protected:
   //**************************************************************************
   /*! \brief Process an entire directory (as in backup this directory). Recurse as needed.
      *
-     *  The to and from directory variables are modified as the backup is performed.
+     *  The directory is read with the DirectoryScanner, so paths are built from the parent path
+     *  and each entry is stat'ed once. The directory is marked completed, and its directory record
+     *  written, only if nothing in it or below it had an error and the backup was not cancelled.
      *
-     *  \param [in, out] currentFromDir is the directory which is being backedup.
-     *  \param [in, out] currentToDir is the directory to which the backup is written.
+     *  \param [in] currentFromPath is the canonical path to the directory which is being backedup.
+     *  \param [in] currentToPath is the existing directory to which the backup is written.
      **************************************************************************/
-  virtual void processDir(QDir& currentFromDir, QDir& currentToDir);
-
-  //**************************************************************************
-  /*! \brief Set the entire set of entries for the previous backup set with this one.
-     *
-     *  This object owns the set and will delete it, so, it must be allocated using new.
-     *  Passing in a nullptr simply deletes the existing set freeing up the memory, leaving no entries.
-     *
-     *  \param Previous backup set.
-     **************************************************************************/
-  void setOldEntries(DBFileEntries* entries);
+  virtual void processDir(const QString& currentFromPath, const QString& currentToPath);
 
   //**************************************************************************
   /*! \brief Set the entire set of current entries (current backup set) with this one.
@@ -130,10 +153,128 @@ protected:
   bool passes(const QFileInfo& info) const;
 
   //**************************************************************************
-  /*! \brief Return the number of entries in the previous backup object. */
+  /*! \brief Determine if a scanned file or directory will be processed.
+     *
+     *  \param [in] info Entry read by the DirectoryScanner.
+     *  \return True if the file or directory passes the backup set filters, false otherwise.
+     **************************************************************************/
+  bool passes(const ScannedEntry& info) const;
+
+  //**************************************************************************
+  /*! \brief Return the number of entries in the newest earlier backup. */
   //**************************************************************************
   int numOldEntries() const;
 
+  //**************************************************************************
+  /*! \brief Reuse a file written by the interrupted backup that is being resumed.
+     *
+     *  The file is reused if the partial catalog has an entry for the path with the same size and
+     *  time, and the file in the backup has that size. Otherwise any file left at the path may be
+     *  incomplete, so it is removed and the file is backed up again.
+     *
+     *  \param [in] entry Entry for the file being backed up.
+     *  \return True if the file was reused and its entry written to the catalog.
+     **************************************************************************/
+  bool resumeFile(const DBFileEntry* entry);
+
+  //**************************************************************************
+  /*! \brief Write the entries from completed directories of the resumed backup to the new catalog. */
+  //**************************************************************************
+  void resumeCompletedDirs();
+
+  //**************************************************************************
+  /*! \brief Link every file below a directory that has not changed since the previous backup.
+     *
+     *  The files are taken from the previous catalog, so the source is not read. A file whose
+     *  target has the maximum number of links is copied from the previous backup.
+     *
+     *  The previous directory catalog must list the same number of files and subdirectories as
+     *  the previous catalog, and every file must be in the previous backup. A subdirectory that
+     *  does not pass is read with processDir(). As in processDir(), the directory is only marked
+     *  completed if nothing below it had an error and the backup was not cancelled.
+     *
+     *  \param [in] relativeDir Directory relative to the backup, already created.
+     *  \return True if the directory was linked; false if it must be read.
+     **************************************************************************/
+  bool linkCleanSubtree(const QString& relativeDir);
+
+  /*! \brief Indexes of the entries in the previous catalog directly in a directory. */
+  QVector<int> previousFiles(const QString& relativeDir);
+
+  //**************************************************************************
+  /*! \brief List a directory from the previous backup if it has not changed since.
+     *
+     *  The directory is unchanged if its time stamps match the previous directory catalog, nothing
+     *  in it was skipped, and the previous backup has a record for every subdirectory and a catalog
+     *  entry for every file. The names are then stat'ed without reading the directory.
+     *
+     *  \param [in] currentFromPath Full path to the source directory.
+     *  \param [in] relativeDir Directory relative to the backup.
+     *  \param [in] stamp Time stamps of the source directory read now.
+     *  \param [out] dirs Subdirectories.
+     *  \param [out] files Regular files.
+     *  \return True if the listing was reused; false if the directory must be read.
+     **************************************************************************/
+  bool listUnchangedDir(const QString& currentFromPath, const QString& relativeDir, const DirectoryStamp& stamp, QList<ScannedEntry>& dirs, QList<ScannedEntry>& files);
+
+  //**************************************************************************
+  /*! \brief Copy a large file as a block delta against its copy in the previous backup.
+     *
+     *  \param [in,out] entry File to copy; the hash is set if it is not known.
+     *  \param [in] fromPath Full path to the source file.
+     *  \param [in] toPath Full path to the new copy.
+     *  \return True if the file was copied; false if it should be copied as usual.
+     **************************************************************************/
+  bool copyDelta(DBFileEntry* entry, const QString& fromPath, const QString& toPath);
+
+  /*! \brief Write the block map of a file in an earlier backup for the same content in the new backup; nothing if blocks is null. */
+  void carryBlockMap(const BlockMapEntry* blocks, const QString& path);
+
+  //**************************************************************************
+  /*! \brief Find the block map of a file in an earlier backup.
+     *
+     *  The block map of a backup other than the previous backup is read the first time it is needed.
+     *
+     *  \param [in] backupDir Full path to the backup that holds the file.
+     *  \param [in] path Path of the file relative to the backup.
+     *  \return Block map of the file, or null if there is none.
+     **************************************************************************/
+  const BlockMapEntry* findBlockMap(const QString& backupDir, const QString& path);
+
+  //**************************************************************************
+  /*! \brief Store a large file in the chunk store instead of the new backup.
+     *
+     *  \param [in,out] entry File to store; the hash, size, and link type are set.
+     *  \param [in] fromPath Full path to the source file.
+     *  \return True if the file was stored; false if it should be copied as usual.
+     **************************************************************************/
+  bool storeChunks(DBFileEntry* entry, const QString& fromPath);
+
+  //**************************************************************************
+  /*! \brief Write a file matched to an entry in the chunk store to the catalog, sharing its chunk list.
+     *
+     *  \param [in,out] entry File matched; the hash and link type are set.
+     *  \param [in] linkEntry Entry with the link type K that matched.
+     *  \param [in] fromPath Full path to the source file, whose permissions are kept.
+     *  \return True if the chunk list exists and the entry was written.
+     **************************************************************************/
+  bool referenceChunks(DBFileEntry* entry, const DBFileEntry* linkEntry, const QString& fromPath);
+
+  /*! \brief Write the permissions of a source file stored in the chunk store. */
+  void addChunkMode(const QString& path, const QString& fromPath);
+
+  /*! \brief Write the permissions of a file in the chunk store kept by an earlier backup, if it has them. */
+  void carryChunkMode(const ChunkModes& modes, const QString& path);
+
+  //**************************************************************************
+  /*! \brief Get the inode of a file without following a symbolic link.
+     *
+     *  \param [in] path Full path to the file.
+     *  \param [out] inode Inode number of the file.
+     *  \return True if the file could be stat'ed.
+     **************************************************************************/
+  static bool fileInode(const QString& path, quint64& inode);
+
 signals:
 
 public slots:
@@ -149,14 +290,114 @@ private:
   bool m_cancelRequested;
 
   //**************************************************************************
-  /*! \brief List of entries built as files are processed. */
+  /*! \brief Files copied by this backup, the link targets for later files in the same backup. */
   //**************************************************************************
   DBFileEntries* m_currentEntries;
 
   //**************************************************************************
-  /*! \brief . List of entries from the previous backup. */
+  /*! \brief Writes every entry to the catalog as files are processed. */
+  //**************************************************************************
+  CatalogWriter m_catalogWriter;
+
+  //**************************************************************************
+  /*! \brief Marks the backup as incomplete until the catalog is renamed, and records completed directories. */
+  //**************************************************************************
+  BackupJournal m_journal;
+
+  //**************************************************************************
+  /*! \brief Entries from the partial catalog of the backup being resumed, indexed by path; null if not resuming. */
+  //**************************************************************************
+  DBFileEntries* m_resumeEntries;
+
+  //**************************************************************************
+  /*! \brief Directories, relative to the backup, completed by the backup being resumed. */
   //**************************************************************************
-  DBFileEntries* m_oldEntries;
+  QSet<QString> m_completedDirs;
+
+  //**************************************************************************
+  /*! \brief Directories changed in the source, recorded by a ChangeWatcher. */
+  //**************************************************************************
+  ChangeJournal m_changeJournal;
+
+  //**************************************************************************
+  /*! \brief Set if the change journal covers the time since the previous backup, so clean directories are linked without reading them. */
+  //**************************************************************************
+  bool m_useChangeJournal;
+
+  //**************************************************************************
+  /*! \brief Time stamps of the source directories, written next to the catalog. */
+  //**************************************************************************
+  DirectoryCatalog m_dirCatalog;
+
+  //**************************************************************************
+  /*! \brief Directory catalog of the previous backup; empty unless unchanged directories may be reused. */
+  //**************************************************************************
+  DirectoryCatalog m_previousDirs;
+
+  //**************************************************************************
+  /*! \brief Indexes of the entries in the previous catalog by directory, built the first time a directory is reused. */
+  //**************************************************************************
+  QHash<QString, QVector<int> > m_previousFilesByDir;
+
+  //**************************************************************************
+  /*! \brief Creates the directories in the new backup and remembers which exist. */
+  //**************************************************************************
+  DirectoryMaterializer m_materializer;
+
+  //**************************************************************************
+  /*! \brief Copies large changed files using the unchanged blocks of the previous backup. */
+  //**************************************************************************
+  BlockDelta m_blockDelta;
+
+  //**************************************************************************
+  /*! \brief Block digests of the large files in the new backup; open only if block deltas are used. */
+  //**************************************************************************
+  BlockMap m_blockMap;
+
+  //**************************************************************************
+  /*! \brief Block digests of the large files in the previous backup. */
+  //**************************************************************************
+  BlockMap m_previousBlocks;
+
+  //**************************************************************************
+  /*! \brief Block digests written by the interrupted backup that is being resumed. */
+  //**************************************************************************
+  BlockMap m_resumeBlocks;
+
+  //**************************************************************************
+  /*! \brief Block digests of other earlier backups by backup directory, read as files are linked to them. */
+  //**************************************************************************
+  QHash<QString, BlockMap*> m_olderBlocks;
+
+  //**************************************************************************
+  /*! \brief Chunks of the large files in every backup of the To path; open if the store is used or exists. */
+  //**************************************************************************
+  ChunkStore m_chunkStore;
+
+  //**************************************************************************
+  /*! \brief Permissions of the files in the chunk store for the new backup; open if the store is used. */
+  //**************************************************************************
+  ChunkModes m_chunkModes;
+
+  //**************************************************************************
+  /*! \brief Permissions of the files in the chunk store for the previous backup. */
+  //**************************************************************************
+  ChunkModes m_previousModes;
+
+  //**************************************************************************
+  /*! \brief Permissions written by the interrupted backup that is being resumed. */
+  //**************************************************************************
+  ChunkModes m_resumeModes;
+
+  //**************************************************************************
+  /*! \brief Number of directories listed from the previous backup. */
+  //**************************************************************************
+  qint64 m_numDirsReused;
+
+  //**************************************************************************
+  /*! \brief Entries from earlier backups, newest first. */
+  //**************************************************************************
+  LinkBase m_linkBase;
 
   //**************************************************************************
   /*! \brief Path to the new backup, this includes the time/date stamp but not the head directory name where the backup begins. */
@@ -177,12 +418,51 @@ private:
   /*! \brief Contains all backup paratmers such filters and criteria. */
   //**************************************************************************
   BackupSet m_backupSet;
+
+  //**************************************************************************
+  /*! \brief Reads the directories being backed up; the read buffer is reused for every directory. */
+  //**************************************************************************
+  DirectoryScanner m_scanner;
+
+  //**************************************************************************
+  /*! \brief Match criteria compiled into index probes when the backup starts. */
+  //**************************************************************************
+  MatchPlan m_matchPlan;
+
+  //**************************************************************************
+  /*! \brief Persistent cache of hash values by file identity; only open while a backup runs. */
+  //**************************************************************************
+  HashCache m_hashCache;
+
+  //**************************************************************************
+  /*! \brief Map content (hash and size) to a canonical file in any earlier backup. */
+  //**************************************************************************
+  ContentIndex m_contentIndex;
+
+  //**************************************************************************
+  /*! \brief True if the content index is used for this backup. */
+  //**************************************************************************
+  bool m_useContentIndex;
+
+  //**************************************************************************
+  /*! \brief Map the inode of a link target that reached the maximum number of links to the copy that replaced it in this backup. */
+  //**************************************************************************
+  QHash<quint64, QString> m_rolloverTargets;
+
+  //**************************************************************************
+  /*! \brief Counters published while the backup runs. */
+  //**************************************************************************
+  BackupProgress m_progress;
 };
 
 inline bool LinkBackupThread::isCancelRequested() const {
   return m_cancelRequested;
 }
 
+inline const BackupProgress& LinkBackupThread::getProgress() const {
+  return m_progress;
+}
+
 
 
 #endif // LINKBACKUPTHREAD_H
@@ -0,0 +1,121 @@
+#include "linkbase.h"
+#include "backupjournal.h"
+#include "dbfileentries.h"
+#include "linkbackupglobals.h"
+#include "linkbackupthread.h"
+
+#include <QDir>
+#include <QRegularExpression>
+
+LinkBase::LinkBase() : m_indexes(MatchPlan::NoIndex), m_numLoaded(0), m_fallbackHits(0)
+{
+}
+
+LinkBase::~LinkBase()
+{
+  clear();
+}
+
+void LinkBase::clear()
+{
+  for (Backup& backup : m_backups)
+  {
+    delete backup.entries;
+  }
+  m_backups.clear();
+  m_numLoaded = 0;
+  m_fallbackHits = 0;
+}
+
+int LinkBase::open(const QString& toPath, const QString& catalogName, const int depth, const MatchPlan::Indexes indexes)
+{
+  clear();
+  m_indexes = indexes;
+  const int maxBackups = (depth > 0) ? depth : DefaultDepth;
+
+  QDir dir(toPath);
+  if (!dir.exists())
+  {
+    ERROR_MSG(QString(QObject::tr("Directory %1 does not exist")).arg(toPath), 1);
+    return 0;
+  }
+  // Same names as LinkBackupThread::createBackDirectory(), which sort in chronological order.
+  dir.setFilter(QDir::Dirs | QDir::NoDotAndDotDot);
+  dir.setSorting(QDir::Name | QDir::Reversed);
+  QRegularExpression dirNameRegExp("^\\d{8}-\\d{6}$");
+  const QFileInfoList list = dir.entryInfoList();
+  for (const QFileInfo& fileInfo : list)
+  {
+    if (m_backups.count() >= maxBackups)
+    {
+      break;
+    }
+    if (!dirNameRegExp.match(fileInfo.fileName()).hasMatch() || BackupJournal::exists(fileInfo.filePath()))
+    {
+      continue;
+    }
+    Backup backup;
+    backup.path = fileInfo.canonicalFilePath();
+    backup.catalogPath = LinkBackupThread::findHashFileCaseInsensitive(backup.path, catalogName);
+    backup.entries = nullptr;
+    if (backup.catalogPath.isEmpty())
+    {
+      WARN_MSG(QString(QObject::tr("No %1 catalog in %2, it is not used to link against")).arg(catalogName, backup.path), 1);
+      continue;
+    }
+    m_backups.append(backup);
+  }
+
+  if (!m_backups.isEmpty())
+  {
+    load(0);
+  }
+  return m_backups.count();
+}
+
+void LinkBase::load(const int i)
+{
+  Backup& backup = m_backups[i];
+  backup.entries = DBFileEntries::read(backup.catalogPath, m_indexes);
+  if (backup.entries == nullptr)
+  {
+    WARN_MSG(QString(QObject::tr("Unable to read the catalog %1, it is not used to link against")).arg(backup.catalogPath), 1);
+    backup.entries = new DBFileEntries();
+    backup.entries->setIndexes(m_indexes);
+  }
+  ++m_numLoaded;
+  INFO_MSG(QString(QObject::tr("Found %1 entries in backup %2.")).arg(backup.entries->count()).arg(backup.path), 1);
+}
+
+const DBFileEntry* LinkBase::findEntry(const MatchPlan& plan, DBFileEntry* entry, const QString& matchInitialPath, QString& backupRoot)
+{
+  for (int i=0; i<m_backups.count(); ++i)
+  {
+    if (m_backups.at(i).entries == nullptr)
+    {
+      load(i);
+    }
+    const Backup& backup = m_backups.at(i);
+    const DBFileEntry* found = backup.entries->findEntry(plan, entry, matchInitialPath);
+    if (found != nullptr)
+    {
+      if (i > 0)
+      {
+        ++m_fallbackHits;
+      }
+      backupRoot = backup.path;
+      return found;
+    }
+  }
+  return nullptr;
+}
+
+QString LinkBase::newestPath() const
+{
+  return m_backups.isEmpty() ? QString() : m_backups.first().path;
+}
+
+const DBFileEntries* LinkBase::newestEntries() const
+{
+  return m_backups.isEmpty() ? nullptr : m_backups.first().entries;
+}
@@ -0,0 +1,113 @@
+#ifndef LINKBASE_H
+#define LINKBASE_H
+
+#include "matchplan.h"
+
+#include <QList>
+#include <QString>
+
+class DBFileEntries;
+class DBFileEntry;
+
+//**************************************************************************
+/*! \class LinkBase
+ *  \brief Files in earlier backups that the current backup may link against.
+ *
+ * The link base covers the newest complete backups, newest first. A backup that
+ * has no catalog for the hash method, or that did not finish, is skipped. Only the newest
+ * catalog is read when the link base is opened; an older catalog is read the first
+ * time a lookup is not found in every newer one. A lookup returns the entry from the newest
+ * backup that has a match, so a file that was missing from the newest backup, for example
+ * because it was moved away for a while, is linked rather than copied again.
+ *
+ * \author Andrew Pitonyak
+ * \copyright Andrew Pitonyak, but you may use without restriction.
+ * \date 2026
+ **************************************************************************/
+class LinkBase
+{
+public:
+  /*! \brief Number of backups searched if the backup set does not set one. */
+  static const int DefaultDepth = 3;
+
+  /*! \brief Constructor, the link base is empty. */
+  LinkBase();
+
+  /*! \brief Destructor, frees every catalog that was read. */
+  ~LinkBase();
+
+  //**************************************************************************
+  /*! \brief Find the backups in the link base and read the catalog of the newest one.
+   *
+   *  \param [in] toPath Directory containing the backups.
+   *  \param [in] catalogName Catalog name for the hash method, such as "sha1".
+   *  \param [in] depth Maximum number of backups; less than 1 uses DefaultDepth.
+   *  \param [in] indexes Indexes built for each catalog when it is read.
+   *  \return Number of backups in the link base.
+   ***************************************************************************/
+  int open(const QString& toPath, const QString& catalogName, const int depth, const MatchPlan::Indexes indexes);
+
+  /*! \brief Free every catalog and forget the backups. */
+  void clear();
+
+  //**************************************************************************
+  /*! \brief Find a file to link against, searching the newest backup first.
+   *
+   *  \param [in] plan Compiled match criteria.
+   *  \param [in] entry Entry for the file being backed up.
+   *  \param [in] matchInitialPath Path prefix of the file being backed up.
+   *  \param [out] backupRoot Set to the backup directory containing the match.
+   *  \return Matching entry, or nullptr if no backup in the link base has a match.
+   ***************************************************************************/
+  const DBFileEntry* findEntry(const MatchPlan& plan, DBFileEntry* entry, const QString& matchInitialPath, QString& backupRoot);
+
+  /*! \brief Number of backups in the link base. */
+  int count() const;
+
+  /*! \brief Number of backups whose catalog has been read. */
+  int numLoaded() const;
+
+  /*! \brief Full path to the newest backup in the link base, or an empty string. */
+  QString newestPath() const;
+
+  /*! \brief Catalog of the newest backup, or nullptr if there is none. */
+  const DBFileEntries* newestEntries() const;
+
+  /*! \brief Number of files found in a backup other than the newest. */
+  qint64 getFallbackHits() const;
+
+private:
+  /*! \brief Read the catalog for one backup; a catalog that can not be read is treated as empty. */
+  void load(const int i);
+
+  struct Backup
+  {
+    QString path;
+    QString catalogPath;
+    DBFileEntries* entries;
+  };
+
+  /*! \brief Backups newest first; entries is nullptr until the catalog is read. */
+  QList<Backup> m_backups;
+
+  MatchPlan::Indexes m_indexes;
+  int m_numLoaded;
+  qint64 m_fallbackHits;
+};
+
+inline int LinkBase::count() const
+{
+  return m_backups.count();
+}
+
+inline int LinkBase::numLoaded() const
+{
+  return m_numLoaded;
+}
+
+inline qint64 LinkBase::getFallbackHits() const
+{
+  return m_fallbackHits;
+}
+
+#endif // LINKBASE_H
@@ -2,17 +2,57 @@
 #include "linkbackupadp.h"
 #include "linkbackupglobals.h"
 #include "simpleloggeradp.h"
+#include "snapshotscrub.h"
+#include "restoreengine.h"
+#include "snapshotdiff.h"
+#include "changewatcher.h"
+#include "backupset.h"
+#include <QCommandLineParser>
+#include <QCryptographicHash>
+#include <QDir>
 #include <QFile>
 #include <QTimer>
 #include <QLoggingCategory>
+#include <QScopedPointer>
+#include <QStandardPaths>
+#include <csignal>
 #include <iostream>
 
 static CopyLinkUtil globalCopyLinkUtil;
+static PerfTrace globalPerfTrace;
 
 SimpleLoggerADP logger;
 QtEnumMapper enumMapper;
 
 void configureTheLogger();
+int runScrub(const QCommandLineParser& parser);
+int runRestore(const QCommandLineParser& parser);
+int runDiff(const QCommandLineParser& parser);
+int runHistory(const QCommandLineParser& parser);
+int runWatch(const QCommandLineParser& parser);
+
+//**************************************************************************
+/*! \brief Returns True if the arguments run without the main window, so no display is needed.
+ *
+ *  The arguments are checked before the application object exists, because a QApplication
+ *  can not be created without a display.
+ ***************************************************************************/
+static bool isCommandLineMode(int argc, char *argv[])
+{
+  static const char* options[] = {"--scrub", "--restore", "--diff", "--history", "--watch", "--help", "-h", "--version", "-v", nullptr};
+  for (int i=1; i<argc; ++i)
+  {
+    const QByteArray arg(argv[i]);
+    for (int j=0; options[j] != nullptr; ++j)
+    {
+      if (arg == options[j] || arg.startsWith(QByteArray(options[j]) + "="))
+      {
+        return true;
+      }
+    }
+  }
+  return false;
+}
 
 void messageHandler(QtMsgType type, const QMessageLogContext &context, const QString &msg)
 {
@@ -48,7 +88,7 @@ int main(int argc, char *argv[])
   // Use a 24MB buffer
   globalCopyLinkUtil.setBufferSize(1024*1024*24);
 
-  QApplication a(argc, argv);
+  QScopedPointer<QCoreApplication> a(isCommandLineMode(argc, argv) ? new QCoreApplication(argc, argv) : new QApplication(argc, argv));
   // qInstallMessageHandler(messageHandler);
 
   // Fedora disables qDebug output at the moment
@@ -71,6 +111,49 @@ int main(int argc, char *argv[])
   QCoreApplication::setApplicationName("Link Backup ADP");
   QCoreApplication::setApplicationVersion("1.0.2");
 
+  // Command line options run without the main window.
+  QCommandLineParser parser;
+  parser.setApplicationDescription("Link Backup ADP");
+  parser.addHelpOption();
+  parser.addVersionOption();
+  parser.addOption(QCommandLineOption("scrub", "Verify the files in a snapshot, or in every snapshot in a backup directory, against the catalog.", "directory"));
+  parser.addOption(QCommandLineOption("backup-set", "Backup set whose hash method names the catalog checked by --scrub, or whose source is watched by --watch.", "file"));
+  parser.addOption(QCommandLineOption("catalog", "Catalog name such as Sha1 or Sha1-Tree64M; the default is from the backup set.", "name"));
+  parser.addOption(QCommandLineOption("rate", "Maximum megabytes read per second from each device; zero for no limit.", "MB/s", "0"));
+  parser.addOption(QCommandLineOption("threads", "Number of files hashed or restored at the same time; zero for one per processor.", "count", "0"));
+  parser.addOption(QCommandLineOption("report", "JSON report of the files found by --scrub or --diff.", "file"));
+  parser.addOption(QCommandLineOption("state", "File that lets an interrupted --scrub resume; the default is in the application data directory.", "file"));
+  parser.addOption(QCommandLineOption("restore", "Restore files from the backup that contains this catalog.", "catalog"));
+  parser.addOption(QCommandLineOption("to", "Directory that receives the files restored by --restore.", "directory"));
+  parser.addOption(QCommandLineOption("path", "Path relative to the backup to restore; may be repeated. The default is everything.", "path"));
+  parser.addOption(QCommandLineOption("no-verify", "Restore without comparing each file with the catalog hash."));
+  parser.addOption(QCommandLineOption("diff", "List the files added, removed, modified and renamed since this older catalog.", "catalog"));
+  parser.addOption(QCommandLineOption("against", "Newer catalog compared by --diff.", "catalog"));
+  parser.addOption(QCommandLineOption("history", "List every snapshot that has this path, relative to the snapshot.", "path"));
+  parser.addOption(QCommandLineOption("in", "Backup directory, or one snapshot, searched by --history.", "directory"));
+  parser.addOption(QCommandLineOption("watch", "Record the directories that change in the source of --backup-set until stopped, so the next backup reads only those."));
+  parser.process(*a);
+  if (parser.isSet("watch"))
+  {
+    qRegisterMetaType<SimpleLoggerRoutingInfo::MessageCategory>( "SimpleLoggerRoutingInfo::MessageCategory" );
+    configureTheLogger();
+    return runWatch(parser);
+  }
+  if (parser.isSet("scrub") || parser.isSet("restore") || parser.isSet("diff") || parser.isSet("history"))
+  {
+    qRegisterMetaType<SimpleLoggerRoutingInfo::MessageCategory>( "SimpleLoggerRoutingInfo::MessageCategory" );
+    configureTheLogger();
+    if (parser.isSet("scrub"))
+    {
+      return runScrub(parser);
+    }
+    if (parser.isSet("restore"))
+    {
+      return runRestore(parser);
+    }
+    return parser.isSet("diff") ? runDiff(parser) : runHistory(parser);
+  }
+
   LinkBackupADP w;
   qRegisterMetaType<SimpleLoggerRoutingInfo::MessageCategory>( "SimpleLoggerRoutingInfo::MessageCategory" );
 
@@ -80,7 +163,7 @@ int main(int argc, char *argv[])
   QObject::connect(&logger, SIGNAL(formattedMessage(const QString&, SimpleLoggerRoutingInfo::MessageCategory)), &w, SLOT(formattedMessage(const QString&, SimpleLoggerRoutingInfo::MessageCategory)));
 
   w.show();
-  return a.exec();
+  return a->exec();
 }
 
 void configureTheLogger()
@@ -150,6 +233,164 @@ void configureTheLogger()
     **/
 }
 
+static SnapshotScrub* s_scrub = nullptr;
+
+static void stopScrubbing(int)
+{
+  if (s_scrub != nullptr)
+  {
+    s_scrub->requestCancel();
+  }
+}
+
+int runScrub(const QCommandLineParser& parser)
+{
+  BackupSet backupSet;
+  if (parser.isSet("backup-set") && !backupSet.readFile(parser.value("backup-set")))
+  {
+    std::cerr << qPrintable(QObject::tr("Unable to read the backup set %1").arg(parser.value("backup-set"))) << std::endl;
+    return 2;
+  }
+  const QString scrubPath = parser.value("scrub");
+  QString catalogName = parser.value("catalog");
+  if (catalogName.isEmpty())
+  {
+    catalogName = backupSet.getHashMethod().isEmpty() ? QString("Sha1") : backupSet.getHashCatalogName();
+  }
+
+  const QStringList snapshots = SnapshotScrub::findSnapshots(scrubPath, catalogName);
+  if (snapshots.isEmpty())
+  {
+    std::cerr << qPrintable(QObject::tr("No %1 snapshots found in %2").arg(catalogName, scrubPath)) << std::endl;
+    return 2;
+  }
+
+  // The state and report are kept out of the backup, named for the directory so a second run resumes the first.
+  const QString dataPath = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+  QDir().mkpath(dataPath);
+  const QByteArray pathHash = QCryptographicHash::hash(QDir(scrubPath).canonicalPath().toUtf8(), QCryptographicHash::Sha1).toHex().left(16);
+  const QString basePath = dataPath + "/Scrub-" + catalogName + "-" + QString::fromLatin1(pathHash);
+  SnapshotScrub scrub;
+  scrub.setThreadCount(parser.value("threads").toInt());
+  scrub.setBytesPerSecond(static_cast<qint64>(parser.value("rate").toDouble() * 1024.0 * 1024.0));
+  // An interrupted scrub writes its state, so the next scrub skips the files already checked.
+  s_scrub = &scrub;
+  std::signal(SIGINT, stopScrubbing);
+  std::signal(SIGTERM, stopScrubbing);
+  const bool finished = scrub.scrub(snapshots, catalogName, parser.isSet("state") ? parser.value("state") : basePath + ".state");
+  std::signal(SIGINT, SIG_DFL);
+  std::signal(SIGTERM, SIG_DFL);
+  s_scrub = nullptr;
+  const QString reportPath = parser.isSet("report") ? parser.value("report") : basePath + ".json";
+  std::cout << qPrintable(scrub.summaryText()) << std::endl;
+  if (scrub.writeReport(reportPath))
+  {
+    std::cout << qPrintable(QObject::tr("Report written to %1").arg(reportPath)) << std::endl;
+  }
+  if (!finished)
+  {
+    return 2;
+  }
+  return scrub.getProblems().isEmpty() ? 0 : 1;
+}
+
+int runRestore(const QCommandLineParser& parser)
+{
+  if (!parser.isSet("to"))
+  {
+    std::cerr << qPrintable(QObject::tr("--restore requires --to")) << std::endl;
+    return 2;
+  }
+  RestoreEngine restore;
+  restore.setThreadCount(parser.value("threads").toInt());
+  restore.setVerify(!parser.isSet("no-verify"));
+  const bool ok = restore.restore(parser.value("restore"), parser.values("path"), parser.value("to"));
+  std::cout << qPrintable(restore.summaryText()) << std::endl;
+  return ok ? 0 : 1;
+}
+
+int runDiff(const QCommandLineParser& parser)
+{
+  if (!parser.isSet("against"))
+  {
+    std::cerr << qPrintable(QObject::tr("--diff requires --against")) << std::endl;
+    return 2;
+  }
+  SnapshotDiff diff;
+  if (!diff.diff(parser.value("diff"), parser.value("against")))
+  {
+    return 2;
+  }
+  static const char* kindCodes[] = {"A", "D", "M", "R"};
+  for (const SnapshotChange& change : diff.getChanges())
+  {
+    if (change.kind == SnapshotChange::Renamed)
+    {
+      std::cout << kindCodes[change.kind] << " " << qPrintable(change.oldPath) << " -> " << qPrintable(change.path) << std::endl;
+    }
+    else
+    {
+      std::cout << kindCodes[change.kind] << " " << qPrintable(change.path) << std::endl;
+    }
+  }
+  if (parser.isSet("report"))
+  {
+    diff.writeReport(parser.value("report"));
+  }
+  std::cout << qPrintable(diff.summaryText()) << std::endl;
+  return diff.getChanges().isEmpty() ? 0 : 1;
+}
+
+int runHistory(const QCommandLineParser& parser)
+{
+  if (!parser.isSet("in"))
+  {
+    std::cerr << qPrintable(QObject::tr("--history requires --in")) << std::endl;
+    return 2;
+  }
+  const QString catalogName = parser.isSet("catalog") ? parser.value("catalog") : QString("Sha1");
+  const QStringList snapshots = SnapshotScrub::findSnapshots(parser.value("in"), catalogName);
+  const QList<FileVersion> versions = SnapshotDiff::history(snapshots, catalogName, parser.value("history"));
+  for (const FileVersion& version : versions)
+  {
+    std::cout << (version.changed ? "* " : "  ") << qPrintable(version.snapshot) << " " << qPrintable(version.entry.getTime().toString(Qt::ISODate))
+              << " " << version.entry.getSize() << " " << qPrintable(version.entry.getHash()) << std::endl;
+  }
+  std::cout << qPrintable(QObject::tr("%1 of %2 snapshots have %3").arg(versions.count()).arg(snapshots.count()).arg(parser.value("history"))) << std::endl;
+  return versions.isEmpty() ? 1 : 0;
+}
+
+static ChangeWatcher* s_watcher = nullptr;
+
+static void stopWatching(int)
+{
+  if (s_watcher != nullptr)
+  {
+    s_watcher->requestStop();
+  }
+}
+
+int runWatch(const QCommandLineParser& parser)
+{
+  BackupSet backupSet;
+  if (!parser.isSet("backup-set") || !backupSet.readFile(parser.value("backup-set")))
+  {
+    std::cerr << qPrintable(QObject::tr("--watch requires a readable --backup-set")) << std::endl;
+    return 2;
+  }
+  ChangeWatcher watcher;
+  if (!watcher.start(backupSet.getFromPath(), backupSet.getToPath()))
+  {
+    return 2;
+  }
+  s_watcher = &watcher;
+  std::signal(SIGINT, stopWatching);
+  std::signal(SIGTERM, stopWatching);
+  std::cout << qPrintable(QObject::tr("Watching %1 directories in %2").arg(watcher.numWatches()).arg(backupSet.getFromPath())) << std::endl;
+  watcher.run();
+  s_watcher = nullptr;
+  return 0;
+}
 
 //**************************************************************************
 
@@ -164,6 +405,11 @@ QtEnumMapper& getEnumMapper()
   return enumMapper;
 }
 
+PerfTrace& getPerfTrace()
+{
+  return globalPerfTrace;
+}
+
 //**************************************************************************
 //**
 //** Logging helpers.
@@ -0,0 +1,118 @@
+#include "matchplan.h"
+
+#include <QStringList>
+
+MatchPlan::MatchPlan() : m_indexes(NoIndex)
+{
+}
+
+MatchPlan::MatchPlan(const QList<CriteriaForFileMatch>& criteria) : m_indexes(NoIndex)
+{
+  compile(criteria);
+}
+
+void MatchPlan::compile(const QList<CriteriaForFileMatch>& criteria)
+{
+  m_probes.clear();
+  m_indexes = NoIndex;
+  for (const CriteriaForFileMatch& criterion : criteria)
+  {
+    Probe probe;
+    probe.fields = criterion.getFields();
+    probe.index = indexFor(probe.fields);
+    // A criterion without fields never matched anything.
+    if (probe.index == NoIndex)
+    {
+      continue;
+    }
+    // A later probe identical to an earlier one can never find anything new.
+    bool duplicate = false;
+    for (const Probe& existing : m_probes)
+    {
+      duplicate = duplicate || (existing.fields == probe.fields);
+    }
+    if (!duplicate)
+    {
+      m_probes.append(probe);
+      m_indexes |= probe.index;
+    }
+  }
+}
+
+MatchPlan::Index MatchPlan::indexFor(const CriteriaForFileMatch::CriteriaFields fields)
+{
+  // Full path is unique, so it always wins. The hash index is keyed on the hash and the size,
+  // and the hash and size always had to match when the hash was used.
+  if (fields.testFlag(CriteriaForFileMatch::FullPath))
+  {
+    return PathIndex;
+  }
+  if (fields.testFlag(CriteriaForFileMatch::Hash))
+  {
+    return HashSizeIndex;
+  }
+  const bool name = fields.testFlag(CriteriaForFileMatch::FileName);
+  const bool size = fields.testFlag(CriteriaForFileMatch::Size);
+  const bool time = fields.testFlag(CriteriaForFileMatch::Time);
+  if (name && size)
+  {
+    return NameSizeIndex;
+  }
+  if (size && time)
+  {
+    return SizeTimeIndex;
+  }
+  if (name)
+  {
+    return NameIndex;
+  }
+  if (size)
+  {
+    return SizeIndex;
+  }
+  if (time)
+  {
+    return TimeIndex;
+  }
+  return NoIndex;
+}
+
+bool MatchPlan::usesHash() const
+{
+  for (const Probe& probe : m_probes)
+  {
+    if (probe.fields.testFlag(CriteriaForFileMatch::Hash))
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+QString MatchPlan::toString() const
+{
+  static const char* indexNames[] = {"Path", "HashSize", "NameSize", "SizeTime", "Name", "Size", "Time"};
+  static const char* fieldNames[] = {"FileName", "FullPath", "Time", "Size", "Hash"};
+  QStringList probes;
+  for (const Probe& probe : m_probes)
+  {
+    QString indexName;
+    for (int i=0; i<7; ++i)
+    {
+      if (probe.index == (1 << i))
+      {
+        indexName = indexNames[i];
+      }
+    }
+    QStringList fields;
+    for (int i=0; i<5; ++i)
+    {
+      if (probe.fields.testFlag(static_cast<CriteriaForFileMatch::CriteriaField>(1 << i)))
+      {
+        fields << fieldNames[i];
+      }
+    }
+    probes << QString("%1(%2)").arg(indexName, fields.join(" "));
+  }
+  return probes.join(", ");
+}
@@ -0,0 +1,90 @@
+#ifndef MATCHPLAN_H
+#define MATCHPLAN_H
+
+#include "criteriaforfilematch.h"
+
+#include <QList>
+#include <QString>
+
+//**************************************************************************
+/*! \class MatchPlan
+ *  \brief Compiled form of a backup set's match criteria as an ordered list of index probes.
+ *
+ * Each CriteriaForFileMatch is converted once, when the backup starts, into a probe that names
+ * the most selective index able to find candidates for it, such as the full path, the hash and size,
+ * or the name and size. DBFileEntries only builds the indexes that the plan needs, and every probe
+ * is an index lookup followed by a check of the few candidates, so no criteria causes a scan of every entry.
+ *
+ * \author Andrew Pitonyak
+ * \copyright Andrew Pitonyak, but you may use without restriction.
+ * \date 2026
+ **************************************************************************/
+class MatchPlan
+{
+public:
+  /*! \brief Indexes that DBFileEntries can build, listed from most to least selective. */
+  enum Index {NoIndex=0x00, PathIndex=0x01, HashSizeIndex=0x02, NameSizeIndex=0x04, SizeTimeIndex=0x08, NameIndex=0x10, SizeIndex=0x20, TimeIndex=0x40};
+  Q_DECLARE_FLAGS(Indexes, Index)
+
+  /*! \brief One lookup: the index used to find candidates and the fields each candidate must match. */
+  struct Probe
+  {
+    Index index;
+    CriteriaForFileMatch::CriteriaFields fields;
+  };
+
+  /*! \brief Constructor, the plan has no probes so nothing matches. */
+  MatchPlan();
+
+  //**************************************************************************
+  /*! \brief Constructor that compiles the criteria.
+   *
+   *  \param [in] criteria Match criteria in the order they are tried.
+   ***************************************************************************/
+  explicit MatchPlan(const QList<CriteriaForFileMatch>& criteria);
+
+  //**************************************************************************
+  /*! \brief Compile the criteria, replacing any existing probes.
+   *
+   *  \param [in] criteria Match criteria in the order they are tried.
+   ***************************************************************************/
+  void compile(const QList<CriteriaForFileMatch>& criteria);
+
+  //**************************************************************************
+  /*! \brief Choose the index used to find candidates for a set of fields.
+   *
+   *  \param [in] fields Fields that must match.
+   *  \return Most selective index for the fields, NoIndex if no field is set.
+   ***************************************************************************/
+  static Index indexFor(const CriteriaForFileMatch::CriteriaFields fields);
+
+  /*! \brief Probes in the order they are tried. */
+  const QList<Probe>& getProbes() const;
+
+  /*! \brief Every index used by a probe. */
+  Indexes getIndexes() const;
+
+  /*! \brief Returns True if any probe matches on the hash. */
+  bool usesHash() const;
+
+  /*! \brief Human readable description of the plan, such as "HashSize(Size Hash), Path(FullPath Size)". */
+  QString toString() const;
+
+private:
+  QList<Probe> m_probes;
+  Indexes m_indexes;
+};
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(MatchPlan::Indexes)
+
+inline const QList<MatchPlan::Probe>& MatchPlan::getProbes() const
+{
+  return m_probes;
+}
+
+inline MatchPlan::Indexes MatchPlan::getIndexes() const
+{
+  return m_indexes;
+}
+
+#endif // MATCHPLAN_H
@@ -0,0 +1,350 @@
+#include "perftrace.h"
+#include "linkbackupglobals.h"
+
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutexLocker>
+#include <QStringList>
+#include <QTextStream>
+#include <QThread>
+#include <QVector>
+
+#include <chrono>
+#include <cstring>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Bound the memory used by the event trace; about 24 bytes for each event.
+static const int s_maxEventsPerThread = 4 * 1024 * 1024;
+
+// Source of the unique identifier for each PerfTrace object.
+static std::atomic<quint64> s_nextTraceId(1);
+
+//**************************************************************************
+/*! \brief Counters for one thread.
+ *
+ *  Only the owning thread writes the counters, so a relaxed load and store is enough;
+ *  the atomics only make it safe to read a summary while the backup runs.
+ ***************************************************************************/
+struct PerfTrace::ThreadData
+{
+  struct Event
+  {
+    qint64 startNs;
+    qint64 durationNs;
+    int phase;
+  };
+
+  qint64 tid;
+  QString name;
+  std::atomic<qint64> count[NumPhases];
+  std::atomic<qint64> totalNs[NumPhases];
+  std::atomic<qint64> maxNs[NumPhases];
+  std::atomic<qint64> histogram[NumPhases][NumBuckets];
+  QVector<Event> events;
+  qint64 droppedEvents;
+
+  void clear()
+  {
+    for (int phase=0; phase<NumPhases; ++phase)
+    {
+      count[phase] = 0;
+      totalNs[phase] = 0;
+      maxNs[phase] = 0;
+      for (int bucket=0; bucket<NumBuckets; ++bucket)
+      {
+        histogram[phase][bucket] = 0;
+      }
+    }
+    events.clear();
+    droppedEvents = 0;
+  }
+};
+
+//**************************************************************************
+/*! \brief Totals for one phase over every thread. */
+//**************************************************************************
+struct PhaseTotals
+{
+  qint64 count;
+  qint64 totalNs;
+  qint64 maxNs;
+  qint64 histogram[PerfTrace::NumBuckets];
+
+  /*! \brief Upper bound in microseconds of the bucket containing the requested fraction of the scopes. */
+  qint64 percentileMicros(const double fraction) const
+  {
+    const qint64 wanted = static_cast<qint64>(fraction * count);
+    qint64 seen = 0;
+    for (int bucket=0; bucket<PerfTrace::NumBuckets; ++bucket)
+    {
+      seen += histogram[bucket];
+      if (seen > wanted)
+      {
+        return static_cast<qint64>(1) << bucket;
+      }
+    }
+    return maxNs / 1000;
+  }
+};
+
+// Each thread remembers its data for the PerfTrace object that created it.
+static thread_local quint64 t_traceId = 0;
+static thread_local void* t_threadData = nullptr;
+
+PerfTrace::PerfTrace() : m_id(s_nextTraceId++), m_running(false), m_collectEvents(false), m_startNs(0)
+{
+}
+
+PerfTrace::~PerfTrace()
+{
+  qDeleteAll(m_threads);
+}
+
+void PerfTrace::start(const bool collectEvents)
+{
+  QMutexLocker locker(&m_mutex);
+  for (ThreadData* data : m_threads)
+  {
+    data->clear();
+  }
+  m_collectEvents = collectEvents;
+  m_startNs = nowNs();
+  m_running = true;
+}
+
+void PerfTrace::stop()
+{
+  m_running = false;
+}
+
+bool PerfTrace::isRunning() const
+{
+  return m_running.load(std::memory_order_relaxed);
+}
+
+qint64 PerfTrace::nowNs()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+const char* PerfTrace::phaseName(const Phase phase)
+{
+  static const char* names[] = {"Listing", "Filter", "Lookup", "Hash", "HashChunk", "Copy", "Link", "Mkdir", "CatalogWrite"};
+  return (phase >= 0 && phase < NumPhases) ? names[phase] : "Unknown";
+}
+
+PerfTrace::ThreadData* PerfTrace::threadData()
+{
+  if (t_traceId == m_id)
+  {
+    return static_cast<ThreadData*>(t_threadData);
+  }
+  ThreadData* data = new ThreadData();
+  data->clear();
+  data->tid = static_cast<qint64>(syscall(SYS_gettid));
+  QThread* thread = QThread::currentThread();
+  data->name = (thread != nullptr && !thread->objectName().isEmpty()) ? thread->objectName() : QString("Thread %1").arg(data->tid);
+  {
+    QMutexLocker locker(&m_mutex);
+    m_threads.append(data);
+  }
+  t_traceId = m_id;
+  t_threadData = data;
+  return data;
+}
+
+void PerfTrace::record(const Phase phase, const qint64 startNs, const qint64 endNs)
+{
+  if (!isRunning())
+  {
+    return;
+  }
+  ThreadData* data = threadData();
+  const qint64 durationNs = endNs - startNs;
+
+  data->count[phase].store(data->count[phase].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  data->totalNs[phase].store(data->totalNs[phase].load(std::memory_order_relaxed) + durationNs, std::memory_order_relaxed);
+  if (durationNs > data->maxNs[phase].load(std::memory_order_relaxed))
+  {
+    data->maxNs[phase].store(durationNs, std::memory_order_relaxed);
+  }
+  const quint64 micros = static_cast<quint64>(durationNs / 1000);
+  const int bucket = (micros == 0) ? 0 : qMin(NumBuckets - 1, 64 - __builtin_clzll(micros));
+  data->histogram[phase][bucket].store(data->histogram[phase][bucket].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+  if (m_collectEvents.load(std::memory_order_relaxed))
+  {
+    if (data->events.size() < s_maxEventsPerThread)
+    {
+      ThreadData::Event event;
+      event.startNs = startNs;
+      event.durationNs = durationNs;
+      event.phase = phase;
+      data->events.append(event);
+    }
+    else
+    {
+      ++data->droppedEvents;
+    }
+  }
+}
+
+QByteArray PerfTrace::summaryJson() const
+{
+  QMutexLocker locker(&m_mutex);
+  PhaseTotals totals[NumPhases];
+  memset(totals, 0, sizeof(totals));
+
+  QJsonArray threads;
+  for (const ThreadData* data : m_threads)
+  {
+    QJsonObject thread;
+    thread["tid"] = data->tid;
+    thread["name"] = data->name;
+    QJsonObject threadPhases;
+    for (int phase=0; phase<NumPhases; ++phase)
+    {
+      const qint64 count = data->count[phase].load(std::memory_order_relaxed);
+      if (count == 0)
+      {
+        continue;
+      }
+      totals[phase].count += count;
+      totals[phase].totalNs += data->totalNs[phase].load(std::memory_order_relaxed);
+      totals[phase].maxNs = qMax(totals[phase].maxNs, data->maxNs[phase].load(std::memory_order_relaxed));
+      for (int bucket=0; bucket<NumBuckets; ++bucket)
+      {
+        totals[phase].histogram[bucket] += data->histogram[phase][bucket].load(std::memory_order_relaxed);
+      }
+      QJsonObject threadPhase;
+      threadPhase["count"] = count;
+      threadPhase["totalMs"] = data->totalNs[phase].load(std::memory_order_relaxed) / 1000000.0;
+      threadPhases[phaseName(static_cast<Phase>(phase))] = threadPhase;
+    }
+    thread["phases"] = threadPhases;
+    threads.append(thread);
+  }
+
+  QJsonObject phases;
+  for (int phase=0; phase<NumPhases; ++phase)
+  {
+    const PhaseTotals& total = totals[phase];
+    if (total.count == 0)
+    {
+      continue;
+    }
+    QJsonObject summary;
+    summary["count"] = total.count;
+    summary["totalMs"] = total.totalNs / 1000000.0;
+    summary["meanUs"] = total.totalNs / 1000.0 / total.count;
+    summary["maxUs"] = total.maxNs / 1000.0;
+    summary["p50Us"] = total.percentileMicros(0.50);
+    summary["p90Us"] = total.percentileMicros(0.90);
+    summary["p99Us"] = total.percentileMicros(0.99);
+    // Trailing empty buckets are not written.
+    int lastBucket = NumBuckets - 1;
+    while (lastBucket > 0 && total.histogram[lastBucket] == 0)
+    {
+      --lastBucket;
+    }
+    QJsonArray histogram;
+    for (int bucket=0; bucket<=lastBucket; ++bucket)
+    {
+      histogram.append(total.histogram[bucket]);
+    }
+    summary["histogramLog2Us"] = histogram;
+    phases[phaseName(static_cast<Phase>(phase))] = summary;
+  }
+
+  QJsonObject root;
+  const qint64 elapsedNs = (m_startNs > 0) ? nowNs() - m_startNs : 0;
+  root["elapsedMs"] = elapsedNs / 1000000.0;
+  root["phases"] = phases;
+  root["threads"] = threads;
+  return QJsonDocument(root).toJson(QJsonDocument::Indented);
+}
+
+QString PerfTrace::summaryText() const
+{
+  QJsonObject phases = QJsonDocument::fromJson(summaryJson()).object().value("phases").toObject();
+  QStringList lines;
+  for (int phase=0; phase<NumPhases; ++phase)
+  {
+    const QString name = phaseName(static_cast<Phase>(phase));
+    if (!phases.contains(name))
+    {
+      continue;
+    }
+    QJsonObject summary = phases.value(name).toObject();
+    lines.append(QString("%1: %2 calls, %3 ms total, mean %4 us, p99 %5 us, max %6 us").arg(name).arg(summary.value("count").toVariant().toLongLong()).arg(summary.value("totalMs").toDouble(), 0, 'f', 1).arg(summary.value("meanUs").toDouble(), 0, 'f', 1).arg(summary.value("p99Us").toVariant().toLongLong()).arg(summary.value("maxUs").toDouble(), 0, 'f', 1));
+  }
+  return lines.join("\n");
+}
+
+bool PerfTrace::writeSummary(const QString& path) const
+{
+  QFile file(path);
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+  {
+    ERROR_MSG(QString(QObject::tr("Failed to open performance summary %1")).arg(path), 1);
+    return false;
+  }
+  file.write(summaryJson());
+  file.close();
+  return file.error() == QFile::NoError;
+}
+
+bool PerfTrace::writeChromeTrace(const QString& path) const
+{
+  QFile file(path);
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+  {
+    ERROR_MSG(QString(QObject::tr("Failed to open trace file %1")).arg(path), 1);
+    return false;
+  }
+
+  // Written directly rather than with QJsonDocument because a trace can hold millions of events.
+  QMutexLocker locker(&m_mutex);
+  const qint64 pid = static_cast<qint64>(getpid());
+  const qint64 startNs = m_startNs;
+  QTextStream writer(&file);
+  writer << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+  writer << QString("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%1,\"tid\":%1,\"args\":{\"name\":\"LinkBackupADP\"}}").arg(pid);
+  qint64 droppedEvents = 0;
+  for (const ThreadData* data : m_threads)
+  {
+    QString name = data->name;
+    name.replace('\\', "\\\\").replace('"', "\\\"");
+    writer << QString(",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%1,\"tid\":%2,\"args\":{\"name\":\"%3\"}}").arg(pid).arg(data->tid).arg(name);
+    for (const ThreadData::Event& event : data->events)
+    {
+      // Complete events with the times in microseconds from the start of the backup.
+      writer << ",\n{\"name\":\"" << phaseName(static_cast<Phase>(event.phase)) << "\",\"cat\":\"backup\",\"ph\":\"X\",\"pid\":" << pid << ",\"tid\":" << data->tid
+             << ",\"ts\":" << QString::number((event.startNs - startNs) / 1000.0, 'f', 3) << ",\"dur\":" << QString::number(event.durationNs / 1000.0, 'f', 3) << "}";
+    }
+    droppedEvents += data->droppedEvents;
+  }
+  writer << "\n]}\n";
+  writer.flush();
+  file.close();
+  if (droppedEvents > 0)
+  {
+    WARN_MSG(QString(QObject::tr("%1 trace events were not saved because the limit per thread was reached.")).arg(droppedEvents), 1);
+  }
+  return file.error() == QFile::NoError;
+}
+
+PerfScope::PerfScope(const PerfTrace::Phase phase) : m_phase(phase), m_startNs(getPerfTrace().isRunning() ? PerfTrace::nowNs() : 0)
+{
+}
+
+PerfScope::~PerfScope()
+{
+  if (m_startNs != 0)
+  {
+    getPerfTrace().record(m_phase, m_startNs, PerfTrace::nowNs());
+  }
+}
@@ -0,0 +1,146 @@
+#ifndef PERFTRACE_H
+#define PERFTRACE_H
+
+#include <QString>
+#include <QList>
+#include <QMutex>
+
+#include <atomic>
+
+//**************************************************************************
+/*! \class PerfTrace
+ *  \brief Per-phase timing of a backup with per-thread counters, histograms, and an optional event trace.
+ *
+ * Code is timed by placing a PerfScope on the stack. When the scope ends, the elapsed time
+ * is added to counters owned by the calling thread, so threads never contend with each other
+ * and recording is two clock reads and a few stores. Each phase keeps a count, the total and
+ * maximum time, and a histogram with power of two buckets in microseconds.
+ *
+ * When events are collected, every scope is also saved so that writeChromeTrace() can write
+ * a Chrome trace-event file that can be loaded in Perfetto or chrome://tracing.
+ *
+ * \author Andrew Pitonyak
+ * \copyright Andrew Pitonyak, but you may use without restriction.
+ * \date 2026
+ **************************************************************************/
+class PerfTrace
+{
+public:
+  /*! \brief Timed phases of a backup. */
+  enum Phase {Listing=0, Filter, Lookup, Hash, HashChunk, Copy, Link, Mkdir, CatalogWrite, NumPhases};
+
+  /*! \brief Histogram bucket i holds durations less than 2^i microseconds and at least 2^(i-1). */
+  static const int NumBuckets = 32;
+
+  /*! \brief Constructor, nothing is collected until start() is called. */
+  PerfTrace();
+
+  /*! \brief Destructor, frees the data for every thread. */
+  ~PerfTrace();
+
+  //**************************************************************************
+  /*! \brief Clear everything recorded and start timing a backup.
+   *
+   *  Call this before the threads being timed start work.
+   *  \param [in] collectEvents If True, every scope is saved for writeChromeTrace().
+   ***************************************************************************/
+  void start(const bool collectEvents);
+
+  /*! \brief Stop timing; scopes that end after this are ignored. */
+  void stop();
+
+  /*! \brief Returns True between start() and stop(). */
+  bool isRunning() const;
+
+  //**************************************************************************
+  /*! \brief Record one timed scope for the calling thread.
+   *
+   *  \param [in] phase Phase that was timed.
+   *  \param [in] startNs Value of nowNs() when the scope started.
+   *  \param [in] endNs Value of nowNs() when the scope ended.
+   ***************************************************************************/
+  void record(const Phase phase, const qint64 startNs, const qint64 endNs);
+
+  /*! \brief Monotonic clock in nanoseconds. */
+  static qint64 nowNs();
+
+  /*! \brief Name of a phase as used in the summary and the trace. */
+  static const char* phaseName(const Phase phase);
+
+  /*! \brief Per-phase summary totalled over every thread as a JSON document. */
+  QByteArray summaryJson() const;
+
+  /*! \brief Per-phase summary totalled over every thread, one line for each phase that was used. */
+  QString summaryText() const;
+
+  //**************************************************************************
+  /*! \brief Write the JSON summary to a file.
+   *
+   *  \param [in] path Full path to the file, which is replaced.
+   *  \return True if the file was written.
+   ***************************************************************************/
+  bool writeSummary(const QString& path) const;
+
+  //**************************************************************************
+  /*! \brief Write the collected events in the Chrome trace-event format.
+   *
+   *  \param [in] path Full path to the file, which is replaced.
+   *  \return True if the file was written.
+   ***************************************************************************/
+  bool writeChromeTrace(const QString& path) const;
+
+private:
+  struct ThreadData;
+
+  /*! \brief Data for the calling thread, created the first time the thread records a scope. */
+  ThreadData* threadData();
+
+  /*! \brief Disable the copy constructor, the per-thread data is owned. */
+  PerfTrace(const PerfTrace&);
+  PerfTrace& operator=(const PerfTrace&);
+
+  /*! \brief Protects m_threads; only used the first time a thread records a scope and when reporting. */
+  mutable QMutex m_mutex;
+
+  /*! \brief Data for every thread that recorded a scope. */
+  QList<ThreadData*> m_threads;
+
+  /*! \brief Distinguishes this object from any other so a thread never uses data from another object. */
+  const quint64 m_id;
+
+  std::atomic<bool> m_running;
+  std::atomic<bool> m_collectEvents;
+
+  /*! \brief nowNs() when start() was called. */
+  std::atomic<qint64> m_startNs;
+};
+
+//**************************************************************************
+/*! \class PerfScope
+ *  \brief Time the enclosing scope as one phase using the global PerfTrace.
+ *
+ * \code
+ * {
+ *   PerfScope scope(PerfTrace::Copy);
+ *   copyTheFile();
+ * }
+ * \endcode
+ **************************************************************************/
+class PerfScope
+{
+public:
+  /*! \brief Start timing the phase. */
+  explicit PerfScope(const PerfTrace::Phase phase);
+
+  /*! \brief Record the time since the constructor. */
+  ~PerfScope();
+
+private:
+  PerfScope(const PerfScope&);
+  PerfScope& operator=(const PerfScope&);
+
+  PerfTrace::Phase m_phase;
+  qint64 m_startNs;
+};
+
+#endif // PERFTRACE_H
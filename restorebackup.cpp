@@ -1,27 +1,149 @@
 #include "restorebackup.h"
+#include "dbfileentriestreemodel.h"
 
-#include <QTreeView>
-#include <QFileSystemModel>
+#include <QComboBox>
 #include <QHBoxLayout>
+#include <QHeaderView>
+#include <QLabel>
+#include <QLineEdit>
+#include <QPushButton>
+#include <QTimer>
+#include <QTreeView>
+#include <QVBoxLayout>
+
+// A search shows at most this many matches.
+static const int s_maxMatches = 1000;
+
+// While typing, the search runs once no key was pressed for this many milliseconds.
+static const int s_searchDelayMs = 300;
 
 RestoreBackup::RestoreBackup(QWidget *parent) :
-  QDialog(parent), m_BackupTreeview(nullptr)
+  QDialog(parent), m_BackupTreeview(nullptr), m_model(nullptr), m_searchText(nullptr), m_searchType(nullptr), m_nextButton(nullptr), m_searchStatus(nullptr), m_searchTimer(nullptr), m_currentMatch(-1), m_truncated(false), m_searchPending(false)
 {
   buildDialog();
 }
 
 void RestoreBackup::buildDialog()
 {
+  m_model = new DBFileEntriesTreeModel(this);
+  connect(m_model, SIGNAL(searchReady()), this, SLOT(searchReady()));
+
   m_BackupTreeview = new QTreeView();
+  m_BackupTreeview->setModel(m_model);
+  m_BackupTreeview->setSortingEnabled(true);
+  m_BackupTreeview->sortByColumn(DBFileEntriesTreeModel::Name, Qt::AscendingOrder);
+  m_BackupTreeview->header()->setSectionResizeMode(DBFileEntriesTreeModel::Name, QHeaderView::Stretch);
+  m_BackupTreeview->header()->setStretchLastSection(false);
+
+  m_searchType = new QComboBox();
+  m_searchType->addItem(tr("Name"));
+  m_searchType->addItem(tr("Hash"));
+  m_searchText = new QLineEdit();
+  m_searchText->setPlaceholderText(tr("File name such as *.odt, or the start of a hash"));
+  connect(m_searchText, SIGNAL(returnPressed()), this, SLOT(search()));
+  m_searchTimer = new QTimer(this);
+  m_searchTimer->setSingleShot(true);
+  m_searchTimer->setInterval(s_searchDelayMs);
+  connect(m_searchTimer, SIGNAL(timeout()), this, SLOT(search()));
+  connect(m_searchText, SIGNAL(textChanged(QString)), m_searchTimer, SLOT(start()));
+  connect(m_searchType, SIGNAL(currentIndexChanged(int)), m_searchTimer, SLOT(start()));
+  QPushButton* findButton = new QPushButton(tr("Find"));
+  connect(findButton, SIGNAL(clicked()), this, SLOT(search()));
+  m_nextButton = new QPushButton(tr("Next"));
+  m_nextButton->setEnabled(false);
+  connect(m_nextButton, SIGNAL(clicked()), this, SLOT(showNextMatch()));
+  m_searchStatus = new QLabel();
+
+  QHBoxLayout *searchLayout = new QHBoxLayout();
+  searchLayout->addWidget(m_searchType);
+  searchLayout->addWidget(m_searchText, 1);
+  searchLayout->addWidget(findButton);
+  searchLayout->addWidget(m_nextButton);
+
+  QVBoxLayout *vLayout = new QVBoxLayout();
+  vLayout->addLayout(searchLayout);
+  vLayout->addWidget(m_searchStatus);
+  vLayout->addWidget(m_BackupTreeview);
+  setLayout(vLayout);
+  resize(900, 600);
+}
+
+void RestoreBackup::setEntries(DBFileEntries* entries)
+{
+  m_matches.clear();
+  m_currentMatch = -1;
+  m_nextButton->setEnabled(false);
+  m_searchStatus->clear();
+  m_model->setEntries(entries);
+}
+
+void RestoreBackup::search()
+{
+  m_searchTimer->stop();
+  const QString text = m_searchText->text().trimmed();
+  m_matches.clear();
+  m_currentMatch = -1;
+  m_nextButton->setEnabled(false);
+  if (text.isEmpty())
+  {
+    m_searchStatus->clear();
+    return;
+  }
+  // The index is built on a worker thread after the catalog is set.
+  if (!m_model->isSearchReady())
+  {
+    m_searchPending = true;
+    m_searchStatus->setText(tr("Building the search index..."));
+    return;
+  }
+  m_searchPending = false;
+  m_truncated = false;
+  m_matches = (m_searchType->currentIndex() == 1) ? m_model->findHash(text, s_maxMatches, &m_truncated) : m_model->findName(text, s_maxMatches, &m_truncated);
+  if (m_matches.isEmpty())
+  {
+    m_searchStatus->setText(QString(tr("Nothing matches %1")).arg(text));
+    return;
+  }
+  m_nextButton->setEnabled(m_matches.count() > 1);
+  showMatch(0);
+}
 
-  QFileSystemModel *model = new QFileSystemModel;
-  model->setRootPath(QDir::currentPath());
-  //model->setRootPath("/andrew0/home/andy/Devsrc/Qt/");
-  m_BackupTreeview->setModel(model);
+void RestoreBackup::showNextMatch()
+{
+  if (!m_matches.isEmpty())
+  {
+    showMatch((m_currentMatch + 1) % m_matches.count());
+  }
+}
 
-  QHBoxLayout *hLayout = new QHBoxLayout();
-  //hLayout->addChildWidget(m_BackupTreeview);
-  hLayout->addWidget(m_BackupTreeview);
-  setLayout(hLayout);
+void RestoreBackup::searchReady()
+{
+  if (m_searchPending)
+  {
+    search();
+  }
 }
 
+void RestoreBackup::showMatch(const int match)
+{
+  m_currentMatch = match;
+  const QModelIndex index = m_model->indexForEntry(m_matches.at(match));
+  if (!index.isValid())
+  {
+    return;
+  }
+  for (QModelIndex parent = index.parent(); parent.isValid(); parent = parent.parent())
+  {
+    m_BackupTreeview->expand(parent);
+  }
+  m_BackupTreeview->setCurrentIndex(index);
+  m_BackupTreeview->scrollTo(index, QAbstractItemView::PositionAtCenter);
+  if (m_truncated)
+  {
+    m_searchStatus->setText(QString(tr("Match %1 of the first %2")).arg(match + 1).arg(m_matches.count()));
+  }
+  else
+  {
+    m_searchStatus->setText(QString(tr("Match %1 of %2")).arg(match + 1).arg(m_matches.count()));
+  }
+}
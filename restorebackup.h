@@ -2,23 +2,77 @@
 #define RESTOREBACKUP_H
 
 #include <QDialog>
+#include <QVector>
 
+class DBFileEntries;
+class DBFileEntriesTreeModel;
+class QComboBox;
+class QLabel;
+class QLineEdit;
+class QPushButton;
+class QTimer;
 class QTreeView;
 
+//**************************************************************************
+/*! \class RestoreBackup
+ *  \brief Browse the files in a backup catalog as a tree and search them by name or hash.
+ *
+ * A name is searched as a glob such as "*.odt", and a hash by its prefix, as the text is typed.
+ * The first match is shown with its directories expanded; Next shows the others in turn.
+ *
+ * \author Andrew Pitonyak
+ * \copyright Andrew Pitonyak, but you may use without restriction.
+ * \date 2011-2013
+ **************************************************************************/
 class RestoreBackup : public QDialog
 {
   Q_OBJECT
 public:
   explicit RestoreBackup(QWidget *parent = 0);
-  
+
+  //**************************************************************************
+  /*! \brief Show a catalog; the dialog takes ownership of the entries.
+   *
+   *  \param [in] entries Catalog to show; nullptr shows an empty tree.
+   ***************************************************************************/
+  void setEntries(DBFileEntries* entries);
+
 signals:
-  
+
 public slots:
 
+private slots:
+  /*! \brief Search for the text in the search field, waiting for the search index if needed. */
+  void search();
+
+  /*! \brief Show the next match of the last search. */
+  void showNextMatch();
+
+  /*! \brief Run a search that waited for the search index. */
+  void searchReady();
+
 private:
   void buildDialog();
 
+  /*! \brief Expand the directories above a match, then select it. */
+  void showMatch(const int match);
+
   QTreeView* m_BackupTreeview;
+  DBFileEntriesTreeModel* m_model;
+  QLineEdit* m_searchText;
+  QComboBox* m_searchType;
+  QPushButton* m_nextButton;
+  QLabel* m_searchStatus;
+  /*! \brief Searches once typing pauses. */
+  QTimer* m_searchTimer;
+
+  /*! \brief Catalog entries found by the last search. */
+  QVector<int> m_matches;
+  int m_currentMatch;
+  /*! \brief Set if the last search found more than the matches kept. */
+  bool m_truncated;
+  /*! \brief Set when a search waits for the search index. */
+  bool m_searchPending;
 };
 
 #endif // RESTOREBACKUP_H
@@ -0,0 +1,332 @@
+#include "restoreengine.h"
+#include "backupprogress.h"
+#include "chunkstore.h"
+#include "copylinkutil.h"
+#include "dbfileentries.h"
+#include "linkbackupglobals.h"
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QSet>
+#include <QThread>
+#include <QThreadPool>
+#include <QVector>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Each restore thread copies with its own buffer.
+static const qint64 s_bufferSize = 4 * 1024 * 1024;
+
+//**************************************************************************
+/*! \brief Shared state for the restore threads. */
+//**************************************************************************
+struct RestoreShared
+{
+  QString backupPath;
+  QString targetPath;
+  QString chunkStorePath;
+  /*! \brief Permissions of the files in the chunk store. */
+  const ChunkModes* chunkModes;
+  QList<const DBFileEntry*> entries;
+  std::atomic<int> next;
+  std::atomic<qint64> numRestored;
+  std::atomic<qint64> numSkipped;
+  std::atomic<qint64> bytesRestored;
+  const std::atomic<bool>* cancelRequested;
+  BackupProgress* progress;
+  bool verify;
+  QString hashMethod;
+  qint64 chunkSize;
+
+  QMutex problemMutex;
+  QList<RestoreProblem>* problems;
+
+  void addProblem(const QString& path, const QString& reason)
+  {
+    if (progress != nullptr)
+    {
+      progress->add(BackupProgress::Errors);
+    }
+    QMutexLocker locker(&problemMutex);
+    RestoreProblem problem;
+    problem.path = path;
+    problem.reason = reason;
+    problems->append(problem);
+  }
+};
+
+static qint64 modifiedMillis(const struct stat& st)
+{
+  return static_cast<qint64>(st.st_mtim.tv_sec) * 1000 + st.st_mtim.tv_nsec / 1000000;
+}
+
+//**************************************************************************
+/*! \brief Restore files until every selected entry is taken; one task per thread. */
+//**************************************************************************
+class RestoreTask : public QRunnable
+{
+public:
+  explicit RestoreTask(RestoreShared* shared) : m_shared(shared)
+  {
+    setAutoDelete(false);
+  }
+
+  void run() override
+  {
+    CopyLinkUtil util(s_bufferSize);
+    // Every directory was created before the threads started.
+    util.setCreateDirectories(false);
+    if (m_shared->verify)
+    {
+      util.setHashType(m_shared->hashMethod);
+      util.setHashChunkSize(m_shared->chunkSize);
+      // Files are already restored on several threads.
+      util.setHashThreadCount(1);
+    }
+
+    for (;;)
+    {
+      const int i = m_shared->next.fetch_add(1);
+      if (i >= m_shared->entries.count() || *m_shared->cancelRequested)
+      {
+        return;
+      }
+      restoreEntry(util, m_shared->entries.at(i));
+    }
+  }
+
+private:
+  void restoreEntry(CopyLinkUtil& util, const DBFileEntry* entry)
+  {
+    const QString fromPath = m_shared->backupPath + "/" + entry->getPath();
+    const QString toPath = m_shared->targetPath + "/" + entry->getPath();
+    const QByteArray encodedToPath = QFile::encodeName(toPath);
+    const qint64 millis = entry->getTime().toMSecsSinceEpoch();
+
+    struct stat st;
+    if (lstat(encodedToPath.constData(), &st) == 0)
+    {
+      if (S_ISREG(st.st_mode) && static_cast<quint64>(st.st_size) == entry->getSize() && modifiedMillis(st) == millis &&
+          (!m_shared->verify || (util.generateHash(toPath) && util.getLastHash() == entry->getHash())))
+      {
+        ++m_shared->numSkipped;
+        if (m_shared->progress != nullptr)
+        {
+          m_shared->progress->add(BackupProgress::FilesSkipped);
+        }
+        return;
+      }
+      if (unlink(encodedToPath.constData()) != 0)
+      {
+        m_shared->addProblem(entry->getPath(), QString(QObject::tr("Unable to replace the existing file: %1")).arg(QString::fromLocal8Bit(strerror(errno))));
+        return;
+      }
+    }
+
+    bool copied;
+    if (entry->getLinkType() == QLatin1Char('K'))
+    {
+      // A file in the chunk store is put together from its chunks.
+      copied = ChunkStore::restore(m_shared->chunkStorePath, entry->getHash(), entry->getSize(), toPath);
+      uint mode;
+      if (copied && m_shared->chunkModes->find(entry->getPath(), mode) && chmod(encodedToPath.constData(), static_cast<mode_t>(mode)) != 0)
+      {
+        m_shared->addProblem(entry->getPath(), QObject::tr("Unable to set the permissions"));
+      }
+    }
+    else
+    {
+      copied = util.copyFile(fromPath, toPath);
+    }
+    if (!copied)
+    {
+      m_shared->addProblem(entry->getPath(), QObject::tr("Copy failed"));
+      return;
+    }
+    // The restored file is hashed, not the backup, so a bad write is found too.
+    if (m_shared->verify && !util.generateHash(toPath))
+    {
+      m_shared->addProblem(entry->getPath(), QObject::tr("Unable to read the restored file"));
+    }
+    // The file is kept; the report says it does not match its catalog.
+    else if (m_shared->verify && util.getLastHash() != entry->getHash())
+    {
+      m_shared->addProblem(entry->getPath(), QString(QObject::tr("Hash %1 does not match the catalog %2")).arg(util.getLastHash(), entry->getHash()));
+    }
+
+    struct timespec times[2];
+    times[0].tv_sec = static_cast<time_t>(millis / 1000);
+    times[0].tv_nsec = static_cast<long>((millis % 1000) * 1000000);
+    times[1] = times[0];
+    if (entry->getTime().isValid() && utimensat(AT_FDCWD, encodedToPath.constData(), times, 0) != 0)
+    {
+      m_shared->addProblem(entry->getPath(), QObject::tr("Unable to set the modified time"));
+    }
+    ++m_shared->numRestored;
+    m_shared->bytesRestored += static_cast<qint64>(entry->getSize());
+    if (m_shared->progress != nullptr)
+    {
+      m_shared->progress->add(BackupProgress::FilesCopied);
+      m_shared->progress->add(BackupProgress::BytesCopied, static_cast<qint64>(entry->getSize()));
+    }
+  }
+
+  RestoreShared* m_shared;
+};
+
+RestoreEngine::RestoreEngine() : m_threadCount(0), m_verify(true), m_cancelRequested(false), m_progress(nullptr), m_numSelected(0), m_numRestored(0), m_numSkipped(0), m_bytesRestored(0), m_millis(0)
+{
+}
+
+bool RestoreEngine::restore(const QString& catalogPath, const QStringList& paths, const QString& targetPath)
+{
+  m_cancelRequested = false;
+  m_problems.clear();
+  m_numSelected = 0;
+  m_numRestored = 0;
+  m_numSkipped = 0;
+  m_bytesRestored = 0;
+  QElapsedTimer timer;
+  timer.start();
+
+  const QFileInfo catalogInfo(catalogPath);
+  RestoreShared shared;
+  shared.backupPath = catalogInfo.absolutePath();
+  shared.targetPath = QDir::cleanPath(QDir(targetPath).absolutePath());
+  // The chunk store is in the To path, next to the backup directory.
+  shared.chunkStorePath = ChunkStore::storePath(QFileInfo(shared.backupPath).absolutePath());
+  ChunkModes chunkModes;
+  chunkModes.read(ChunkModes::modesPath(catalogPath));
+  shared.chunkModes = &chunkModes;
+  shared.next = 0;
+  shared.numRestored = 0;
+  shared.numSkipped = 0;
+  shared.bytesRestored = 0;
+  shared.cancelRequested = &m_cancelRequested;
+  shared.progress = m_progress;
+  shared.verify = m_verify;
+  shared.chunkSize = 0;
+  shared.problems = &m_problems;
+
+  // The catalog name is the hash mode, such as "Sha1-Tree64M".
+  if (shared.verify && !CopyLinkUtil::parseHashModeName(catalogInfo.completeBaseName(), shared.hashMethod, shared.chunkSize))
+  {
+    WARN_MSG(QString(QObject::tr("Unknown hash method for catalog %1, files are restored without verifying them")).arg(catalogPath), 1);
+    shared.verify = false;
+  }
+
+  DBFileEntries* entries = DBFileEntries::read(catalogPath, MatchPlan::NoIndex);
+  if (entries == nullptr)
+  {
+    return false;
+  }
+
+  QStringList prefixes;
+  for (const QString& path : paths)
+  {
+    const QString prefix = QDir::cleanPath(path);
+    if (!prefix.isEmpty() && prefix != ".")
+    {
+      prefixes.append(prefix.startsWith('/') ? prefix.mid(1) : prefix);
+    }
+  }
+
+  // Select the entries and the directories that hold them.
+  QSet<QString> dirs;
+  qint64 bytesSelected = 0;
+  for (int i=0; i<entries->count(); ++i)
+  {
+    const DBFileEntry* entry = entries->value(i);
+    const QString& path = entry->getPath();
+    bool selected = prefixes.isEmpty();
+    for (int j=0; j<prefixes.count() && !selected; ++j)
+    {
+      const QString& prefix = prefixes.at(j);
+      selected = path.startsWith(prefix) && (path.length() == prefix.length() || path.at(prefix.length()) == '/');
+    }
+    if (!selected)
+    {
+      continue;
+    }
+    shared.entries.append(entry);
+    bytesSelected += static_cast<qint64>(entry->getSize());
+    for (int slash = path.lastIndexOf('/'); slash > 0; slash = path.lastIndexOf('/', slash - 1))
+    {
+      const QString dir = path.left(slash);
+      if (dirs.contains(dir))
+      {
+        break;
+      }
+      dirs.insert(dir);
+    }
+  }
+  m_numSelected = shared.entries.count();
+  if (m_progress != nullptr)
+  {
+    m_progress->start(m_numSelected, bytesSelected);
+  }
+  INFO_MSG(QString(QObject::tr("Restoring %1 files in %2 directories from %3 to %4")).arg(m_numSelected).arg(dirs.count()).arg(shared.backupPath, shared.targetPath), 1);
+
+  // Sorted, a directory is always created after its parent.
+  bool ok = QDir().mkpath(shared.targetPath);
+  QStringList sortedDirs(dirs.begin(), dirs.end());
+  dirs.clear();
+  std::sort(sortedDirs.begin(), sortedDirs.end());
+  for (const QString& dir : sortedDirs)
+  {
+    const QByteArray encodedDir = QFile::encodeName(shared.targetPath + "/" + dir);
+    if (mkdir(encodedDir.constData(), 0777) != 0 && errno != EEXIST)
+    {
+      shared.addProblem(dir, QString(QObject::tr("Unable to create the directory: %1")).arg(QString::fromLocal8Bit(strerror(errno))));
+      ok = false;
+    }
+  }
+
+  if (ok)
+  {
+    const int threadCount = (m_threadCount > 0) ? m_threadCount : QThread::idealThreadCount();
+    QVector<RestoreTask*> tasks;
+    {
+      QThreadPool pool;
+      pool.setMaxThreadCount(threadCount);
+      for (int i=0; i<threadCount && i<shared.entries.count(); ++i)
+      {
+        tasks.append(new RestoreTask(&shared));
+        pool.start(tasks.last());
+      }
+      pool.waitForDone();
+    }
+    qDeleteAll(tasks);
+  }
+  delete entries;
+
+  m_numRestored = shared.numRestored;
+  m_numSkipped = shared.numSkipped;
+  m_bytesRestored = shared.bytesRestored;
+  m_millis = timer.elapsed();
+  if (m_progress != nullptr)
+  {
+    m_progress->finish();
+  }
+  for (const RestoreProblem& problem : m_problems)
+  {
+    ERROR_MSG(QString(QObject::tr("Restore %1: %2")).arg(problem.path, problem.reason), 1);
+  }
+  INFO_MSG(summaryText(), 1);
+  return ok && !m_cancelRequested && m_problems.isEmpty();
+}
+
+QString RestoreEngine::summaryText() const
+{
+  return QString(QObject::tr("Restore: %1 files selected, %2 restored (%3 at %4), %5 already present, %6 problems")).arg(m_numSelected).arg(m_numRestored).arg(CopyLinkUtil::getBPS(m_bytesRestored, 0), CopyLinkUtil::getBPS(m_bytesRestored, m_millis)).arg(m_numSkipped).arg(m_problems.count());
+}
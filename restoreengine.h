@@ -0,0 +1,130 @@
+#ifndef RESTOREENGINE_H
+#define RESTOREENGINE_H
+
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+#include <atomic>
+
+class BackupProgress;
+
+//**************************************************************************
+/*! \brief A file that could not be restored, or that did not match its catalog. */
+//**************************************************************************
+struct RestoreProblem
+{
+  /*! \brief Path relative to the backup, as stored in the catalog. */
+  QString path;
+  /*! \brief What went wrong. */
+  QString reason;
+};
+
+//**************************************************************************
+/*! \class RestoreEngine
+ *  \brief Restore files listed in a backup catalog to a directory.
+ *
+ * The catalog, "<backup>/<hash>.txt", names the backup directory and every file in it.
+ * A subset is selected by path prefixes relative to the backup, such as "Documents/letters".
+ *
+ * Every directory needed is created first in one sorted pass. The files are then restored by a
+ * pool of threads, each with its own CopyLinkUtil. The kernel copies each file, as a reflink if
+ * the file system supports it. A file with the link type K is put back together from the chunk
+ * store in the To path, and given the permissions kept with the backup. When files are verified, the restored file is then hashed and compared
+ * with the catalog, so the check covers what was written. The modified time is set from the catalog.
+ *
+ * A file that already exists in the destination with the same size and modified time is skipped
+ * (and hashed first when verifying). Any other file in the way is replaced.
+ *
+ * \author Andrew Pitonyak
+ * \copyright Andrew Pitonyak, but you may use without restriction.
+ * \date 2026
+ **************************************************************************/
+class RestoreEngine
+{
+public:
+  /*! \brief Constructor, verifies files and uses the ideal thread count. */
+  RestoreEngine();
+
+  /*! \brief Set the number of files restored at the same time; less than 1 means use the ideal thread count. */
+  void setThreadCount(const int threadCount);
+
+  /*! \brief Set if each file is hashed and compared with the catalog while it is restored. */
+  void setVerify(const bool verify);
+
+  bool isVerify() const;
+
+  /*! \brief Set the progress counters, which are not owned; may be nullptr. */
+  void setProgress(BackupProgress* progress);
+
+  //**************************************************************************
+  /*! \brief Restore files from a backup.
+   *
+   *  \param [in] catalogPath Full path to the catalog in the backup directory.
+   *  \param [in] paths Path prefixes relative to the backup to restore; empty restores everything.
+   *  \param [in] targetPath Directory that receives the files, with the same relative paths.
+   *  \return True if every selected file was restored or skipped and matched its catalog.
+   ***************************************************************************/
+  bool restore(const QString& catalogPath, const QStringList& paths, const QString& targetPath);
+
+  /*! \brief Stop after the files being restored. */
+  void requestCancel();
+
+  bool isCancelRequested() const;
+
+  /*! \brief Problems found by the last restore. */
+  const QList<RestoreProblem>& getProblems() const;
+
+  /*! \brief Summary of the last restore for the log. */
+  QString summaryText() const;
+
+private:
+  int m_threadCount;
+  bool m_verify;
+  std::atomic<bool> m_cancelRequested;
+  BackupProgress* m_progress;
+
+  QList<RestoreProblem> m_problems;
+  qint64 m_numSelected;
+  qint64 m_numRestored;
+  qint64 m_numSkipped;
+  qint64 m_bytesRestored;
+  qint64 m_millis;
+};
+
+inline void RestoreEngine::setThreadCount(const int threadCount)
+{
+  m_threadCount = threadCount;
+}
+
+inline void RestoreEngine::setVerify(const bool verify)
+{
+  m_verify = verify;
+}
+
+inline bool RestoreEngine::isVerify() const
+{
+  return m_verify;
+}
+
+inline void RestoreEngine::setProgress(BackupProgress* progress)
+{
+  m_progress = progress;
+}
+
+inline void RestoreEngine::requestCancel()
+{
+  m_cancelRequested = true;
+}
+
+inline bool RestoreEngine::isCancelRequested() const
+{
+  return m_cancelRequested;
+}
+
+inline const QList<RestoreProblem>& RestoreEngine::getProblems() const
+{
+  return m_problems;
+}
+
+#endif // RESTOREENGINE_H
@@ -0,0 +1,24 @@
+#include "restorethread.h"
+
+#include <QStringList>
+
+RestoreThread::RestoreThread(const QString& catalogPath, const QString& targetPath, QObject *parent) : QThread(parent), m_catalogPath(catalogPath), m_targetPath(targetPath), m_restored(false)
+{
+  m_engine.setProgress(&m_progress);
+}
+
+void RestoreThread::run()
+{
+  QThread::currentThread()->setObjectName("Restore");
+  m_restored = m_engine.restore(m_catalogPath, QStringList(), m_targetPath);
+}
+
+void RestoreThread::requestCancel()
+{
+  m_engine.requestCancel();
+}
+
+QString RestoreThread::summaryText() const
+{
+  return m_engine.summaryText();
+}
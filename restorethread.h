@@ -0,0 +1,68 @@
+#ifndef RESTORETHREAD_H
+#define RESTORETHREAD_H
+
+#include <QThread>
+#include <QString>
+#include "backupprogress.h"
+#include "restoreengine.h"
+
+//**************************************************************************
+/*! \class RestoreThread
+ *  \brief Run a RestoreEngine in the background, the same way LinkBackupThread runs a backup.
+ *
+ * The window samples getProgress() on a timer, cancels with requestCancel(), and reads
+ * the result after the thread finishes.
+ *
+ * \author Andrew Pitonyak
+ * \copyright Andrew Pitonyak, but you may use without restriction.
+ * \date 2026
+ **************************************************************************/
+class RestoreThread : public QThread
+{
+  Q_OBJECT
+public:
+  //**************************************************************************
+  /*! \brief Constructor.
+   *
+   *  \param [in] catalogPath Full path to the catalog in the backup directory.
+   *  \param [in] targetPath Directory that receives the files.
+   *  \param [in] parent is this object's owner and the destructor will destroys all child objects.
+   **************************************************************************/
+  RestoreThread(const QString& catalogPath, const QString& targetPath, QObject *parent = 0);
+
+  /*! \brief Progress counters for the running restore; sample them from any thread. */
+  const BackupProgress& getProgress() const;
+
+  /*! \brief True if every file was restored and matched its catalog; valid after the thread finished. */
+  bool isRestored() const;
+
+  /*! \brief Summary of the restore; valid after the thread finished. */
+  QString summaryText() const;
+
+public slots:
+  /*! \brief Stop after the files being restored. */
+  void requestCancel();
+
+protected:
+  /*! \brief Restore every file in the catalog. */
+  virtual void run();
+
+private:
+  QString m_catalogPath;
+  QString m_targetPath;
+  RestoreEngine m_engine;
+  BackupProgress m_progress;
+  bool m_restored;
+};
+
+inline const BackupProgress& RestoreThread::getProgress() const
+{
+  return m_progress;
+}
+
+inline bool RestoreThread::isRestored() const
+{
+  return m_restored;
+}
+
+#endif // RESTORETHREAD_H
@@ -0,0 +1,543 @@
+#include "snapshotdiff.h"
+#include "catalogparser.h"
+#include "linkbackupglobals.h"
+#include "linkbackupthread.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTemporaryFile>
+#include <QVector>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+// Bytes collected before a sorted run is written.
+static const int s_runWriteBufferSize = 4 * 1024 * 1024;
+
+//**************************************************************************
+/*! \brief A catalog line and the offset of the path, which follows the fourth comma. */
+//**************************************************************************
+struct CatalogLine
+{
+  QByteArray line;
+  int pathOffset;
+};
+
+static int findPathOffset(const QByteArray& line)
+{
+  const char* begin = line.constData();
+  const char* end = begin + line.size();
+  const char* p = begin;
+  for (int i=0; i<4; ++i)
+  {
+    p = static_cast<const char*>(memchr(p, ',', static_cast<size_t>(end - p)));
+    if (p == nullptr)
+    {
+      return -1;
+    }
+    ++p;
+  }
+  return static_cast<int>(p - begin);
+}
+
+// UTF-8 byte order is code point order, so every catalog is sorted the same way.
+static int comparePaths(const CatalogLine& a, const CatalogLine& b)
+{
+  const int lengthA = a.line.size() - a.pathOffset;
+  const int lengthB = b.line.size() - b.pathOffset;
+  const int result = memcmp(a.line.constData() + a.pathOffset, b.line.constData() + b.pathOffset, static_cast<size_t>(std::min(lengthA, lengthB)));
+  return (result != 0) ? result : (lengthA - lengthB);
+}
+
+static void removeNewLine(QByteArray& line)
+{
+  while (line.endsWith('\n') || line.endsWith('\r'))
+  {
+    line.chop(1);
+  }
+}
+
+//**************************************************************************
+/*! \brief Read a catalog in path order with an external merge sort. */
+//**************************************************************************
+class SortedCatalog
+{
+public:
+  SortedCatalog(const int runSize, const QString& tempPath) : m_runSize(std::max(runSize, 1000)), m_tempPath(tempPath), m_memoryNext(0), m_count(0)
+  {
+  }
+
+  ~SortedCatalog()
+  {
+    qDeleteAll(m_runs);
+  }
+
+  //**************************************************************************
+  /*! \brief Read the catalog and write every run but the last to a temporary file.
+   *
+   *  \param [in] path Full path to the catalog.
+   *  \return True if the catalog was read and every run was written.
+   ***************************************************************************/
+  bool open(const QString& path)
+  {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+      ERROR_MSG(QString(QObject::tr("Unable to read the catalog %1")).arg(path), 1);
+      return false;
+    }
+    std::vector<CatalogLine> run;
+    run.reserve(static_cast<size_t>(std::min<qint64>(m_runSize, file.size() / 64 + 1)));
+    while (!file.atEnd())
+    {
+      CatalogLine line;
+      line.line = file.readLine();
+      removeNewLine(line.line);
+      if (line.line.isEmpty())
+      {
+        continue;
+      }
+      line.pathOffset = findPathOffset(line.line);
+      if (line.pathOffset < 0)
+      {
+        ERROR_MSG(QString(QObject::tr("Invalid line %1 in the catalog %2")).arg(QString::fromUtf8(line.line), path), 1);
+        return false;
+      }
+      run.push_back(line);
+      ++m_count;
+      if (static_cast<int>(run.size()) >= m_runSize)
+      {
+        if (!writeRun(run))
+        {
+          return false;
+        }
+        run.clear();
+      }
+    }
+
+    if (m_runs.isEmpty())
+    {
+      // The whole catalog fits in one run, so it is never written.
+      sortRun(run);
+      m_memory.swap(run);
+      return true;
+    }
+    if (!run.empty() && !writeRun(run))
+    {
+      return false;
+    }
+    m_heads.resize(m_runs.count());
+    m_headValid.resize(m_runs.count());
+    for (int i=0; i<m_runs.count(); ++i)
+    {
+      m_runs.at(i)->seek(0);
+      readHead(i);
+    }
+    return true;
+  }
+
+  //**************************************************************************
+  /*! \brief Get the next entry in path order.
+   *
+   *  \param [out] entry Next entry.
+   *  \return True if there was another entry and its line is valid.
+   ***************************************************************************/
+  bool next(DBFileEntry& entry)
+  {
+    if (m_runs.isEmpty())
+    {
+      if (m_memoryNext >= m_memory.size())
+      {
+        return false;
+      }
+      m_current = m_memory[m_memoryNext];
+      // Free each line as it is used.
+      m_memory[m_memoryNext++].line.clear();
+    }
+    else
+    {
+      // There are few runs, so a linear search for the smallest head is enough.
+      int smallest = -1;
+      for (int i=0; i<m_runs.count(); ++i)
+      {
+        if (m_headValid.at(i) && (smallest < 0 || comparePaths(m_heads.at(i), m_heads.at(smallest)) < 0))
+        {
+          smallest = i;
+        }
+      }
+      if (smallest < 0)
+      {
+        return false;
+      }
+      m_current = m_heads.at(smallest);
+      readHead(smallest);
+    }
+    if (!CatalogParser::parseLine(m_current.line.constData(), m_current.line.constData() + m_current.line.size(), entry))
+    {
+      ERROR_MSG(QString(QObject::tr("Invalid catalog line %1")).arg(QString::fromUtf8(m_current.line)), 1);
+      return false;
+    }
+    return true;
+  }
+
+  /*! \brief Line returned by the last call to next(). */
+  const CatalogLine& current() const
+  {
+    return m_current;
+  }
+
+  qint64 count() const
+  {
+    return m_count;
+  }
+
+private:
+  static void sortRun(std::vector<CatalogLine>& run)
+  {
+    std::sort(run.begin(), run.end(), [](const CatalogLine& a, const CatalogLine& b) { return comparePaths(a, b) < 0; });
+  }
+
+  bool writeRun(std::vector<CatalogLine>& run)
+  {
+    sortRun(run);
+    const QString tempPath = m_tempPath.isEmpty() ? QDir::tempPath() : m_tempPath;
+    QTemporaryFile* file = new QTemporaryFile(tempPath + "/LinkBackupDiff-XXXXXX");
+    m_runs.append(file);
+    if (!file->open())
+    {
+      ERROR_MSG(QString(QObject::tr("Unable to create a temporary file in %1")).arg(tempPath), 1);
+      return false;
+    }
+    QByteArray buffer;
+    buffer.reserve(s_runWriteBufferSize + 4096);
+    for (const CatalogLine& line : run)
+    {
+      buffer.append(line.line);
+      buffer.append('\n');
+      if (buffer.size() >= s_runWriteBufferSize)
+      {
+        if (file->write(buffer) != buffer.size())
+        {
+          ERROR_MSG(QString(QObject::tr("Unable to write the temporary file %1")).arg(file->fileName()), 1);
+          return false;
+        }
+        buffer.clear();
+      }
+    }
+    if (file->write(buffer) != buffer.size() || !file->flush())
+    {
+      ERROR_MSG(QString(QObject::tr("Unable to write the temporary file %1")).arg(file->fileName()), 1);
+      return false;
+    }
+    return true;
+  }
+
+  void readHead(const int i)
+  {
+    QTemporaryFile* file = m_runs.at(i);
+    m_headValid[i] = !file->atEnd();
+    if (m_headValid.at(i))
+    {
+      CatalogLine& head = m_heads[i];
+      head.line = file->readLine();
+      removeNewLine(head.line);
+      head.pathOffset = findPathOffset(head.line);
+      m_headValid[i] = (head.pathOffset >= 0);
+      if (!m_headValid.at(i))
+      {
+        ERROR_MSG(QString(QObject::tr("Invalid line %1 in the temporary file %2")).arg(QString::fromUtf8(head.line), file->fileName()), 1);
+      }
+    }
+  }
+
+  int m_runSize;
+  QString m_tempPath;
+
+  std::vector<CatalogLine> m_memory;
+  size_t m_memoryNext;
+
+  QList<QTemporaryFile*> m_runs;
+  std::vector<CatalogLine> m_heads;
+  std::vector<bool> m_headValid;
+
+  CatalogLine m_current;
+  qint64 m_count;
+};
+
+static QString renameKey(const QString& hash, const quint64 size)
+{
+  return hash + QLatin1Char('/') + QString::number(size);
+}
+
+//**************************************************************************
+/*! \brief Returns True if two entries for a path differ; without both hashes, the modified time stands in for the content. */
+//**************************************************************************
+static bool isModified(const DBFileEntry& oldEntry, const DBFileEntry& newEntry)
+{
+  if (oldEntry.getSize() != newEntry.getSize())
+  {
+    return true;
+  }
+  if (oldEntry.getHash().isEmpty() || newEntry.getHash().isEmpty())
+  {
+    return oldEntry.getTime() != newEntry.getTime();
+  }
+  return oldEntry.getHash() != newEntry.getHash();
+}
+
+SnapshotDiff::SnapshotDiff() : m_runSize(DefaultRunSize), m_cancelRequested(false), m_numOld(0), m_numNew(0), m_millis(0)
+{
+}
+
+bool SnapshotDiff::diff(const QString& oldCatalog, const QString& newCatalog)
+{
+  m_cancelRequested = false;
+  m_oldCatalog = oldCatalog;
+  m_newCatalog = newCatalog;
+  m_changes.clear();
+  m_numOld = 0;
+  m_numNew = 0;
+  QElapsedTimer timer;
+  timer.start();
+
+  SortedCatalog oldSorted(m_runSize, m_tempPath);
+  SortedCatalog newSorted(m_runSize, m_tempPath);
+  if (!oldSorted.open(oldCatalog) || !newSorted.open(newCatalog))
+  {
+    return false;
+  }
+  m_numOld = oldSorted.count();
+  m_numNew = newSorted.count();
+
+  // Merge join on the path.
+  DBFileEntry oldEntry;
+  DBFileEntry newEntry;
+  qint64 numOldRead = 0;
+  qint64 numNewRead = 0;
+  bool haveOld = oldSorted.next(oldEntry);
+  bool haveNew = newSorted.next(newEntry);
+  while ((haveOld || haveNew) && !m_cancelRequested)
+  {
+    const int cmp = !haveOld ? 1 : (!haveNew ? -1 : comparePaths(oldSorted.current(), newSorted.current()));
+    SnapshotChange change;
+    change.size = 0;
+    change.oldSize = 0;
+    if (cmp < 0)
+    {
+      change.kind = SnapshotChange::Removed;
+      change.path = oldEntry.getPath();
+      change.oldHash = oldEntry.getHash();
+      change.oldSize = oldEntry.getSize();
+      m_changes.append(change);
+      ++numOldRead;
+      haveOld = oldSorted.next(oldEntry);
+    }
+    else if (cmp > 0)
+    {
+      change.kind = SnapshotChange::Added;
+      change.path = newEntry.getPath();
+      change.hash = newEntry.getHash();
+      change.size = newEntry.getSize();
+      m_changes.append(change);
+      ++numNewRead;
+      haveNew = newSorted.next(newEntry);
+    }
+    else
+    {
+      if (isModified(oldEntry, newEntry))
+      {
+        change.kind = SnapshotChange::Modified;
+        change.path = newEntry.getPath();
+        change.hash = newEntry.getHash();
+        change.size = newEntry.getSize();
+        change.oldHash = oldEntry.getHash();
+        change.oldSize = oldEntry.getSize();
+        m_changes.append(change);
+      }
+      ++numOldRead;
+      ++numNewRead;
+      haveOld = oldSorted.next(oldEntry);
+      haveNew = newSorted.next(newEntry);
+    }
+  }
+  if (m_cancelRequested || numOldRead != m_numOld || numNewRead != m_numNew)
+  {
+    // Cancelled, or next() stopped early on a line it could not parse.
+    m_millis = timer.elapsed();
+    return false;
+  }
+
+  // A removed file and an added file with the same content are a rename. Empty files all
+  // share one hash, and a file without a hash has unknown content, so they are never paired.
+  QHash<QString, QList<int>> removedByKey;
+  for (int i=0; i<m_changes.count(); ++i)
+  {
+    const SnapshotChange& change = m_changes.at(i);
+    if (change.kind == SnapshotChange::Removed && change.oldSize > 0 && !change.oldHash.isEmpty())
+    {
+      removedByKey[renameKey(change.oldHash, change.oldSize)].append(i);
+    }
+  }
+  if (!removedByKey.isEmpty())
+  {
+    QVector<bool> renamedFrom(m_changes.count(), false);
+    for (int i=0; i<m_changes.count(); ++i)
+    {
+      SnapshotChange& change = m_changes[i];
+      if (change.kind != SnapshotChange::Added || change.size == 0 || change.hash.isEmpty())
+      {
+        continue;
+      }
+      auto it = removedByKey.find(renameKey(change.hash, change.size));
+      if (it != removedByKey.end() && !it.value().isEmpty())
+      {
+        const int removed = it.value().takeFirst();
+        change.kind = SnapshotChange::Renamed;
+        change.oldPath = m_changes.at(removed).path;
+        change.oldHash = m_changes.at(removed).oldHash;
+        change.oldSize = m_changes.at(removed).oldSize;
+        renamedFrom[removed] = true;
+      }
+    }
+    QList<SnapshotChange> changes;
+    changes.reserve(m_changes.count());
+    for (int i=0; i<m_changes.count(); ++i)
+    {
+      if (!renamedFrom.at(i))
+      {
+        changes.append(m_changes.at(i));
+      }
+    }
+    m_changes.swap(changes);
+  }
+
+  m_millis = timer.elapsed();
+  INFO_MSG(summaryText(), 1);
+  return true;
+}
+
+QString SnapshotDiff::summaryText() const
+{
+  int counts[4] = {0, 0, 0, 0};
+  for (const SnapshotChange& change : m_changes)
+  {
+    ++counts[change.kind];
+  }
+  return QString(QObject::tr("Diff of %1 entries in %2 and %3 entries in %4: %5 added, %6 removed, %7 modified, %8 renamed in %9 ms"))
+      .arg(m_numOld).arg(m_oldCatalog).arg(m_numNew).arg(m_newCatalog)
+      .arg(counts[SnapshotChange::Added]).arg(counts[SnapshotChange::Removed]).arg(counts[SnapshotChange::Modified]).arg(counts[SnapshotChange::Renamed])
+      .arg(m_millis);
+}
+
+bool SnapshotDiff::writeReport(const QString& path) const
+{
+  QJsonObject root;
+  root["oldCatalog"] = m_oldCatalog;
+  root["newCatalog"] = m_newCatalog;
+  root["time"] = QDateTime::currentDateTime().toString(Qt::ISODate);
+  root["millis"] = m_millis;
+  root["oldEntries"] = m_numOld;
+  root["newEntries"] = m_numNew;
+
+  static const char* kindNames[] = {"added", "removed", "modified", "renamed"};
+  QJsonArray changes;
+  for (const SnapshotChange& change : m_changes)
+  {
+    QJsonObject json;
+    json["type"] = kindNames[change.kind];
+    json["path"] = change.path;
+    if (change.kind == SnapshotChange::Renamed)
+    {
+      json["oldPath"] = change.oldPath;
+    }
+    if (change.kind != SnapshotChange::Removed)
+    {
+      json["hash"] = change.hash;
+      json["size"] = static_cast<qint64>(change.size);
+    }
+    if (change.kind == SnapshotChange::Removed || change.kind == SnapshotChange::Modified)
+    {
+      json["oldHash"] = change.oldHash;
+      json["oldSize"] = static_cast<qint64>(change.oldSize);
+    }
+    changes.append(json);
+  }
+  root["changes"] = changes;
+
+  QFile file(path);
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+  {
+    ERROR_MSG(QString(QObject::tr("Failed to write the diff report %1")).arg(path), 1);
+    return false;
+  }
+  file.write(QJsonDocument(root).toJson(QJsonDocument::Indented));
+  return true;
+}
+
+QList<FileVersion> SnapshotDiff::history(const QStringList& snapshots, const QString& catalogName, const QString& path)
+{
+  QList<FileVersion> versions;
+  QString relativePath = QDir::cleanPath(path);
+  if (relativePath.startsWith('/'))
+  {
+    relativePath = relativePath.mid(1);
+  }
+  // The path is the last field, so it follows a comma and ends the line.
+  const QByteArray needle = "," + relativePath.toUtf8();
+
+  for (const QString& snapshot : snapshots)
+  {
+    const QString catalogPath = LinkBackupThread::findHashFileCaseInsensitive(snapshot, catalogName);
+    if (catalogPath.isEmpty())
+    {
+      continue;
+    }
+    QFile file(catalogPath);
+    if (!file.open(QIODevice::ReadOnly) || file.size() == 0)
+    {
+      continue;
+    }
+    const qint64 size = file.size();
+    uchar* map = file.map(0, size);
+    if (map == nullptr)
+    {
+      WARN_MSG(QString(QObject::tr("Unable to map the catalog %1")).arg(catalogPath), 1);
+      continue;
+    }
+    const char* data = reinterpret_cast<const char*>(map);
+    const char* dataEnd = data + size;
+    for (const char* from = data; from < dataEnd; )
+    {
+      const char* found = static_cast<const char*>(memmem(from, static_cast<size_t>(dataEnd - from), needle.constData(), static_cast<size_t>(needle.size())));
+      if (found == nullptr)
+      {
+        break;
+      }
+      const char* lineEnd = found + needle.size();
+      if (lineEnd == dataEnd || *lineEnd == '\n' || *lineEnd == '\r')
+      {
+        const char* newLine = static_cast<const char*>(memrchr(data, '\n', static_cast<size_t>(found - data)));
+        const char* lineBegin = (newLine != nullptr) ? newLine + 1 : data;
+        FileVersion version;
+        // The comma may be inside another path, so the parsed path must match.
+        if (CatalogParser::parseLine(lineBegin, lineEnd, version.entry) && version.entry.getPath() == relativePath)
+        {
+          version.snapshot = snapshot;
+          version.changed = versions.isEmpty() || isModified(versions.last().entry, version.entry);
+          versions.append(version);
+          break;
+        }
+      }
+      from = found + 1;
+    }
+    file.unmap(map);
+  }
+  return versions;
+}
@@ -0,0 +1,157 @@
+#ifndef SNAPSHOTDIFF_H
+#define SNAPSHOTDIFF_H
+
+#include "dbfileentry.h"
+
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+#include <atomic>
+
+//**************************************************************************
+/*! \brief A file that differs between two catalogs. */
+//**************************************************************************
+struct SnapshotChange
+{
+  enum Kind {Added, Removed, Modified, Renamed};
+
+  Kind kind;
+  /*! \brief Path in the new catalog; the old path for a removed file. */
+  QString path;
+  /*! \brief Path in the old catalog of a renamed file. */
+  QString oldPath;
+  /*! \brief Hash in the new catalog; empty for a removed file. */
+  QString hash;
+  /*! \brief Hash in the old catalog; empty for an added file. */
+  QString oldHash;
+  quint64 size;
+  quint64 oldSize;
+};
+
+//**************************************************************************
+/*! \brief One snapshot that contains a file, as found by SnapshotDiff::history(). */
+//**************************************************************************
+struct FileVersion
+{
+  /*! \brief Full path to the snapshot. */
+  QString snapshot;
+  /*! \brief Catalog entry for the file in that snapshot. */
+  DBFileEntry entry;
+  /*! \brief True if the hash or size, or the time when there is no hash, differs from the previous snapshot that has the file. */
+  bool changed;
+};
+
+//**************************************************************************
+/*! \class SnapshotDiff
+ *  \brief Compare two backup catalogs, and find every version of one file.
+ *
+ * A catalog is written in the order the backup walked the tree, so each catalog is first sorted
+ * by path with an external merge sort: runs of lines are sorted in memory and written to
+ * temporary files, and the runs are then merged while they are read. A catalog that fits in one
+ * run is never written. The two sorted catalogs are merge-joined: a path in only the old catalog
+ * is removed, a path in only the new catalog is added, and a path in both with a different hash
+ * or size is modified; when either entry has no hash, the modified time is compared instead of the
+ * hash. Memory is bounded by the run size and the number of changes, not by the size of the catalogs.
+ *
+ * A removed and an added file with the same hash and size are reported as one rename. Files
+ * without a hash are never paired.
+ *
+ * A history query reads every catalog for a single path by searching the mapped catalog for the
+ * path at the end of a line, without parsing the other lines.
+ *
+ * \author Andrew Pitonyak
+ * \copyright Andrew Pitonyak, but you may use without restriction.
+ * \date 2026
+ **************************************************************************/
+class SnapshotDiff
+{
+public:
+  /*! \brief Number of catalog lines sorted in memory at one time. */
+  enum {DefaultRunSize = 1000000};
+
+  SnapshotDiff();
+
+  /*! \brief Set the number of catalog lines sorted in memory at one time. */
+  void setRunSize(const int runSize);
+
+  /*! \brief Set the directory for the sorted runs; empty for the system temporary directory. */
+  void setTempPath(const QString& tempPath);
+
+  //**************************************************************************
+  /*! \brief Find the files that changed between two catalogs.
+   *
+   *  \param [in] oldCatalog Full path to the older catalog.
+   *  \param [in] newCatalog Full path to the newer catalog.
+   *  \return True if both catalogs were read and compared.
+   ***************************************************************************/
+  bool diff(const QString& oldCatalog, const QString& newCatalog);
+
+  /*! \brief Changes found by the last diff, sorted by path; a rename is at its new path. */
+  const QList<SnapshotChange>& getChanges() const;
+
+  //**************************************************************************
+  /*! \brief Write the results of the last diff as JSON.
+   *
+   *  \param [in] path Full path to the report.
+   *  \return True if the report was written.
+   ***************************************************************************/
+  bool writeReport(const QString& path) const;
+
+  /*! \brief Summary of the last diff for the log. */
+  QString summaryText() const;
+
+  /*! \brief Stop the diff at the next line. */
+  void requestCancel();
+
+  bool isCancelRequested() const;
+
+  //**************************************************************************
+  /*! \brief Find a file in each snapshot.
+   *
+   *  \param [in] snapshots Full paths to the snapshots, oldest first.
+   *  \param [in] catalogName Catalog name, such as "Sha1".
+   *  \param [in] path Path of the file relative to the snapshot.
+   *  \return One version for each snapshot whose catalog has the file, in the same order.
+   ***************************************************************************/
+  static QList<FileVersion> history(const QStringList& snapshots, const QString& catalogName, const QString& path);
+
+private:
+  int m_runSize;
+  QString m_tempPath;
+  std::atomic<bool> m_cancelRequested;
+
+  QString m_oldCatalog;
+  QString m_newCatalog;
+  QList<SnapshotChange> m_changes;
+  qint64 m_numOld;
+  qint64 m_numNew;
+  qint64 m_millis;
+};
+
+inline void SnapshotDiff::setRunSize(const int runSize)
+{
+  m_runSize = runSize;
+}
+
+inline void SnapshotDiff::setTempPath(const QString& tempPath)
+{
+  m_tempPath = tempPath;
+}
+
+inline const QList<SnapshotChange>& SnapshotDiff::getChanges() const
+{
+  return m_changes;
+}
+
+inline void SnapshotDiff::requestCancel()
+{
+  m_cancelRequested = true;
+}
+
+inline bool SnapshotDiff::isCancelRequested() const
+{
+  return m_cancelRequested;
+}
+
+#endif // SNAPSHOTDIFF_H
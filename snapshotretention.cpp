@@ -0,0 +1,393 @@
+#include "snapshotretention.h"
+#include "linkbackupthread.h"
+#include "backupjournal.h"
+#include "linkbackupglobals.h"
+#include "copylinkutil.h"
+#include "chunkstore.h"
+
+#include <QDir>
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRegularExpression>
+#include <QRunnable>
+#include <QSet>
+#include <QStringList>
+#include <QThread>
+#include <QThreadPool>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//**************************************************************************
+/*! \brief State shared by the workers that delete one directory tree. */
+//**************************************************************************
+struct RemoveTreeContext
+{
+  QThreadPool pool;
+  QMutex mutex;
+  /*! \brief Every directory that was read; removed deepest first when the workers finish. */
+  QStringList directories;
+  std::atomic<qint64> numErrors;
+};
+
+//**************************************************************************
+/*! \brief Unlink the files in one directory and queue a worker for each subdirectory. */
+//**************************************************************************
+class RemoveDirectoryTask : public QRunnable
+{
+public:
+  RemoveDirectoryTask(RemoveTreeContext& context, const QByteArray& path) : m_context(context), m_path(path) {}
+
+  void run() override
+  {
+    int dirFd = open(m_path.constData(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    DIR* dir = (dirFd >= 0) ? fdopendir(dirFd) : nullptr;
+    if (dir == nullptr)
+    {
+      if (dirFd >= 0)
+      {
+        close(dirFd);
+      }
+      ++m_context.numErrors;
+      return;
+    }
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr)
+    {
+      const char* name = entry->d_name;
+      if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+      {
+        continue;
+      }
+      bool isDir = (entry->d_type == DT_DIR);
+      if (entry->d_type == DT_UNKNOWN)
+      {
+        struct stat st;
+        isDir = fstatat(dirFd, name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode);
+      }
+      if (isDir)
+      {
+        QByteArray childPath = m_path + '/' + name;
+        {
+          QMutexLocker locker(&m_context.mutex);
+          m_context.directories.append(QFile::decodeName(childPath));
+        }
+        m_context.pool.start(new RemoveDirectoryTask(m_context, childPath));
+      }
+      else if (unlinkat(dirFd, name, 0) != 0)
+      {
+        ++m_context.numErrors;
+      }
+    }
+    closedir(dir);
+  }
+
+private:
+  RemoveTreeContext& m_context;
+  QByteArray m_path;
+};
+
+SnapshotRetention::SnapshotRetention() : m_keepDaily(0), m_keepWeekly(0), m_keepMonthly(0), m_threadCount(0)
+{
+}
+
+bool SnapshotRetention::plan(const QString& toPath, const QString& topDirName, const QString& catalogName)
+{
+  m_snapshots.clear();
+  m_toPath = toPath;
+  QDir dir(toPath);
+  if (!dir.exists())
+  {
+    ERROR_MSG(QString(QObject::tr("Directory %1 does not exist")).arg(toPath), 1);
+    return false;
+  }
+  // Same names as LinkBackupThread::createBackDirectory(), which sort in chronological order.
+  dir.setFilter(QDir::Dirs | QDir::NoDotAndDotDot);
+  dir.setSorting(QDir::Name | QDir::Reversed);
+  QRegularExpression dirNameRegExp("^\\d{8}-\\d{6}$");
+  QFileInfoList list = dir.entryInfoList();
+  for (const QFileInfo& fileInfo : list)
+  {
+    if (!dirNameRegExp.match(fileInfo.fileName()).hasMatch())
+    {
+      continue;
+    }
+    // A backup that did not finish may still be resumed.
+    if (BackupJournal::exists(fileInfo.filePath()))
+    {
+      continue;
+    }
+    // Only snapshots written by this backup set.
+    if (!topDirName.isEmpty() && !QFileInfo(fileInfo.filePath() + "/" + topDirName).isDir())
+    {
+      continue;
+    }
+    SnapshotInfo snapshot;
+    snapshot.path = fileInfo.canonicalFilePath();
+    snapshot.time = QDateTime::fromString(fileInfo.fileName(), "yyyyMMdd-hhmmss");
+    snapshot.keep = false;
+    snapshot.hasCatalog = false;
+    snapshot.numFiles = 0;
+    snapshot.bytesFreed = 0;
+    if (snapshot.time.isValid())
+    {
+      m_snapshots.append(snapshot);
+    }
+  }
+  applyRules();
+  estimateBytesFreed(catalogName);
+  return true;
+}
+
+void SnapshotRetention::applyRules()
+{
+  if (!hasRules())
+  {
+    for (SnapshotInfo& snapshot : m_snapshots)
+    {
+      snapshot.keep = true;
+      snapshot.reason = "no rules";
+    }
+    return;
+  }
+
+  QSet<qint64> days;
+  QSet<qint64> weeks;
+  QSet<qint64> months;
+  for (int i=0; i<m_snapshots.count(); ++i)
+  {
+    SnapshotInfo& snapshot = m_snapshots[i];
+    QStringList reasons;
+    if (i == 0)
+    {
+      reasons << "newest";
+    }
+
+    // Snapshots are newest first, so the first snapshot seen in a period is the newest in the period.
+    const QDate date = snapshot.time.date();
+    const qint64 day = date.toJulianDay();
+    if (days.count() < m_keepDaily && !days.contains(day))
+    {
+      days.insert(day);
+      reasons << "daily";
+    }
+    int weekYear = 0;
+    const int week = date.weekNumber(&weekYear);
+    const qint64 weekKey = weekYear * 100 + week;
+    if (weeks.count() < m_keepWeekly && !weeks.contains(weekKey))
+    {
+      weeks.insert(weekKey);
+      reasons << "weekly";
+    }
+    const qint64 monthKey = date.year() * 100 + date.month();
+    if (months.count() < m_keepMonthly && !months.contains(monthKey))
+    {
+      months.insert(monthKey);
+      reasons << "monthly";
+    }
+    snapshot.keep = !reasons.isEmpty();
+    snapshot.reason = reasons.join(" ");
+  }
+}
+
+void SnapshotRetention::estimateBytesFreed(const QString& catalogName)
+{
+  // Content in a kept snapshot is never freed.
+  QSet<QByteArray> keptContent;
+
+  // For content only in pruned snapshots, the newest pruned snapshot containing it and the size.
+  QHash<QByteArray, QPair<int, qint64> > prunedContent;
+
+  // Read kept snapshots first so that pruned content can be checked as it is read.
+  QList<int> order;
+  for (int i=0; i<m_snapshots.count(); ++i)
+  {
+    if (m_snapshots[i].keep)
+    {
+      order.append(i);
+    }
+  }
+  for (int i=0; i<m_snapshots.count(); ++i)
+  {
+    if (!m_snapshots[i].keep)
+    {
+      order.append(i);
+    }
+  }
+
+  for (int i : order)
+  {
+    SnapshotInfo& snapshot = m_snapshots[i];
+    QString catalogPath = LinkBackupThread::findHashFileCaseInsensitive(snapshot.path, catalogName);
+    QFile file(catalogPath);
+    if (catalogPath.isEmpty() || !file.open(QIODevice::ReadOnly))
+    {
+      WARN_MSG(QString(QObject::tr("No %1 catalog in %2, the bytes freed can not be calculated for it")).arg(catalogName, snapshot.path), 1);
+      continue;
+    }
+    snapshot.hasCatalog = true;
+    while (!file.atEnd())
+    {
+      // linkType,time,hash,size,path; the path may contain a comma.
+      QByteArray line = file.readLine();
+      int comma1 = line.indexOf(',');
+      int comma2 = (comma1 < 0) ? -1 : line.indexOf(',', comma1 + 1);
+      int comma3 = (comma2 < 0) ? -1 : line.indexOf(',', comma2 + 1);
+      int comma4 = (comma3 < 0) ? -1 : line.indexOf(',', comma3 + 1);
+      if (comma4 < 0)
+      {
+        continue;
+      }
+      bool ok = false;
+      const qint64 size = line.mid(comma3 + 1, comma4 - comma3 - 1).toLongLong(&ok);
+      if (!ok)
+      {
+        continue;
+      }
+      ++snapshot.numFiles;
+      // Chunks may be shared by other files, so they are only counted when the store is cleaned.
+      if (line.startsWith("K,"))
+      {
+        continue;
+      }
+      QByteArray key = line.mid(comma2 + 1, comma4 - comma2 - 1).toUpper();
+      if (comma3 == comma2 + 1)
+      {
+        // No hash, so the only link is to the same file in another backup.
+        key = line.mid(comma1 + 1).trimmed();
+      }
+
+      if (snapshot.keep)
+      {
+        keptContent.insert(key);
+      }
+      else if (!keptContent.contains(key))
+      {
+        QHash<QByteArray, QPair<int, qint64> >::iterator it = prunedContent.find(key);
+        if (it == prunedContent.end())
+        {
+          prunedContent.insert(key, qMakePair(i, size));
+        }
+        else if (i < it.value().first)
+        {
+          // Index is newest first, so this snapshot is deleted later.
+          it.value().first = i;
+        }
+      }
+    }
+  }
+
+  for (QHash<QByteArray, QPair<int, qint64> >::const_iterator it = prunedContent.constBegin(); it != prunedContent.constEnd(); ++it)
+  {
+    m_snapshots[it.value().first].bytesFreed += it.value().second;
+  }
+}
+
+int SnapshotRetention::numPruned() const
+{
+  int n = 0;
+  for (const SnapshotInfo& snapshot : m_snapshots)
+  {
+    if (!snapshot.keep)
+    {
+      ++n;
+    }
+  }
+  return n;
+}
+
+qint64 SnapshotRetention::getBytesFreed() const
+{
+  qint64 bytesFreed = 0;
+  for (const SnapshotInfo& snapshot : m_snapshots)
+  {
+    bytesFreed += snapshot.bytesFreed;
+  }
+  return bytesFreed;
+}
+
+QString SnapshotRetention::report() const
+{
+  QStringList lines;
+  lines << QString(QObject::tr("Retention: keep %1 daily, %2 weekly, %3 monthly")).arg(m_keepDaily).arg(m_keepWeekly).arg(m_keepMonthly);
+  for (const SnapshotInfo& snapshot : m_snapshots)
+  {
+    if (snapshot.keep)
+    {
+      lines << QString(QObject::tr("keep   %1 (%2)")).arg(snapshot.path, snapshot.reason);
+    }
+    else if (snapshot.hasCatalog)
+    {
+      lines << QString(QObject::tr("delete %1 frees %2 (%3 files)")).arg(snapshot.path, CopyLinkUtil::getBPS(snapshot.bytesFreed, 0)).arg(snapshot.numFiles);
+    }
+    else
+    {
+      lines << QString(QObject::tr("delete %1 frees an unknown amount (no catalog)")).arg(snapshot.path);
+    }
+  }
+  lines << QString(QObject::tr("%1 of %2 backups deleted, freeing %3")).arg(numPruned()).arg(m_snapshots.count()).arg(CopyLinkUtil::getBPS(getBytesFreed(), 0));
+  return lines.join("\n");
+}
+
+int SnapshotRetention::prune()
+{
+  int numDeleted = 0;
+  if (!hasRules())
+  {
+    return numDeleted;
+  }
+  // Oldest first, so that an interrupted prune never leaves a gap in the newest backups.
+  for (int i=m_snapshots.count() - 1; i>=0; --i)
+  {
+    const SnapshotInfo& snapshot = m_snapshots.at(i);
+    if (snapshot.keep)
+    {
+      continue;
+    }
+    INFO_MSG(QString(QObject::tr("Deleting backup %1")).arg(snapshot.path), 1);
+    if (removeTree(snapshot.path, m_threadCount))
+    {
+      ++numDeleted;
+    }
+    else
+    {
+      ERROR_MSG(QString(QObject::tr("Failed to completely delete backup %1")).arg(snapshot.path), 1);
+    }
+  }
+  // The chunks used only by the deleted backups are removed from the chunk store.
+  qint64 numRemoved = 0;
+  qint64 bytesFreed = 0;
+  if (numDeleted > 0 && ChunkStore::collectGarbage(m_toPath, numRemoved, bytesFreed) && numRemoved > 0)
+  {
+    INFO_MSG(QString(QObject::tr("Removed %1 unused files from the chunk store, freeing %2")).arg(numRemoved).arg(CopyLinkUtil::getBPS(bytesFreed, 0)), 1);
+  }
+  return numDeleted;
+}
+
+bool SnapshotRetention::removeTree(const QString& path, const int threadCount)
+{
+  RemoveTreeContext context;
+  context.numErrors = 0;
+  context.pool.setMaxThreadCount(threadCount > 0 ? threadCount : QThread::idealThreadCount());
+  context.directories.append(path);
+  context.pool.start(new RemoveDirectoryTask(context, QFile::encodeName(path)));
+  context.pool.waitForDone();
+
+  // A child path is always longer than its parent, so the longest paths are removed first.
+  std::sort(context.directories.begin(), context.directories.end(), [](const QString& a, const QString& b) { return a.length() > b.length(); });
+  for (const QString& directory : context.directories)
+  {
+    if (unlinkat(AT_FDCWD, QFile::encodeName(directory).constData(), AT_REMOVEDIR) != 0)
+    {
+      ++context.numErrors;
+    }
+  }
+  return context.numErrors == 0;
+}
@@ -0,0 +1,167 @@
+#ifndef SNAPSHOTRETENTION_H
+#define SNAPSHOTRETENTION_H
+
+#include <QString>
+#include <QDateTime>
+#include <QList>
+
+//**************************************************************************
+/*! \brief One backup directory (snapshot) and the retention decision for it. */
+//**************************************************************************
+struct SnapshotInfo
+{
+  /*! \brief Full path to the snapshot directory. */
+  QString path;
+  /*! \brief Time parsed from the directory name "yyyyMMdd-hhmmss". */
+  QDateTime time;
+  /*! \brief True if a retention rule keeps the snapshot. */
+  bool keep;
+  /*! \brief Rules that keep the snapshot such as "newest daily". */
+  QString reason;
+  /*! \brief True if the catalog was found and read. */
+  bool hasCatalog;
+  /*! \brief Number of entries in the catalog. */
+  qint64 numFiles;
+  /*! \brief Bytes freed by deleting the snapshot after the older pruned snapshots were deleted. */
+  qint64 bytesFreed;
+};
+
+//**************************************************************************
+/*! \class SnapshotRetention
+ *  \brief Decide which backups to keep using daily, weekly, and monthly rules and delete the rest.
+ *
+ * Snapshots are the "yyyyMMdd-hhmmss" directories in the "to" path that contain the
+ * top directory of the backup set, so other backup sets writing to the same "to" path are
+ * not touched. The newest snapshot is always kept. Each rule keeps the newest snapshot in each of
+ * the N most recent days, weeks, or months that contain a snapshot.
+ *
+ * Most files in a snapshot are hard links, so deleting a snapshot only frees a file if no
+ * remaining snapshot links to it. This is calculated from the catalogs without walking the
+ * backup: content (hash and size) that is in a kept snapshot is never freed, and other content
+ * is freed by the newest pruned snapshot that contains it, because snapshots are deleted oldest first.
+ * A file in the chunk store is not counted; after the snapshots are deleted, the chunks that no
+ * remaining backup uses are removed by ChunkStore::collectGarbage().
+ *
+ * \author Andrew Pitonyak
+ * \copyright Andrew Pitonyak, but you may use without restriction.
+ * \date 2026
+ **************************************************************************/
+class SnapshotRetention
+{
+public:
+  /*! \brief Constructor, no rules are set so every snapshot is kept. */
+  SnapshotRetention();
+
+  /*! \brief Number of days for which the newest snapshot is kept. */
+  void setKeepDaily(const int keepDaily);
+
+  /*! \brief Number of weeks for which the newest snapshot is kept. */
+  void setKeepWeekly(const int keepWeekly);
+
+  /*! \brief Number of months for which the newest snapshot is kept. */
+  void setKeepMonthly(const int keepMonthly);
+
+  /*! \brief Maximum number of threads used to delete files; less than 1 uses QThread::idealThreadCount(). */
+  void setThreadCount(const int threadCount);
+
+  /*! \brief Returns True if any rule is set; without rules, nothing is pruned. */
+  bool hasRules() const;
+
+  //**************************************************************************
+  /*! \brief Find the snapshots, decide which to keep, and estimate the bytes freed.
+   *
+   *  Nothing is deleted, so this is the dry run.
+   *
+   *  \param [in] toPath Directory containing the backups.
+   *  \param [in] topDirName Name of the top directory that the backup set writes in each snapshot.
+   *  \param [in] catalogName Hash catalog name such as Sha1.
+   *  \return True if the snapshots could be listed.
+   ***************************************************************************/
+  bool plan(const QString& toPath, const QString& topDirName, const QString& catalogName);
+
+  /*! \brief Snapshots found by plan() sorted newest first. */
+  const QList<SnapshotInfo>& getSnapshots() const;
+
+  /*! \brief Number of snapshots that will be deleted. */
+  int numPruned() const;
+
+  /*! \brief Total bytes freed by deleting every pruned snapshot. */
+  qint64 getBytesFreed() const;
+
+  //**************************************************************************
+  /*! \brief Human readable report of the plan.
+   *
+   *  \return Multi-line report with one line for each snapshot.
+   ***************************************************************************/
+  QString report() const;
+
+  //**************************************************************************
+  /*! \brief Delete the snapshots that plan() did not keep, oldest first, then clean the chunk store.
+   *
+   *  \return Number of snapshots deleted.
+   ***************************************************************************/
+  int prune();
+
+  //**************************************************************************
+  /*! \brief Delete a directory tree using parallel workers.
+   *
+   *  Each directory is read by a worker that unlinks its files relative to the directory handle
+   *  and queues its subdirectories to other workers; directories are removed deepest first.
+   *  Symbolic links are removed, never followed.
+   *
+   *  \param [in] path Full path to the directory to delete.
+   *  \param [in] threadCount Number of threads; less than 1 uses QThread::idealThreadCount().
+   *  \return True if everything was deleted.
+   ***************************************************************************/
+  static bool removeTree(const QString& path, const int threadCount);
+
+private:
+  /*! \brief Mark the snapshots kept by each rule. */
+  void applyRules();
+
+  /*! \brief Read the catalogs and calculate the bytes freed by each pruned snapshot. */
+  void estimateBytesFreed(const QString& catalogName);
+
+  int m_keepDaily;
+  int m_keepWeekly;
+  int m_keepMonthly;
+  int m_threadCount;
+
+  /*! \brief Directory containing the backups, set by plan(). */
+  QString m_toPath;
+
+  /*! \brief Snapshots sorted newest first. */
+  QList<SnapshotInfo> m_snapshots;
+};
+
+inline void SnapshotRetention::setKeepDaily(const int keepDaily)
+{
+  m_keepDaily = keepDaily;
+}
+
+inline void SnapshotRetention::setKeepWeekly(const int keepWeekly)
+{
+  m_keepWeekly = keepWeekly;
+}
+
+inline void SnapshotRetention::setKeepMonthly(const int keepMonthly)
+{
+  m_keepMonthly = keepMonthly;
+}
+
+inline void SnapshotRetention::setThreadCount(const int threadCount)
+{
+  m_threadCount = threadCount;
+}
+
+inline bool SnapshotRetention::hasRules() const
+{
+  return m_keepDaily > 0 || m_keepWeekly > 0 || m_keepMonthly > 0;
+}
+
+inline const QList<SnapshotInfo>& SnapshotRetention::getSnapshots() const
+{
+  return m_snapshots;
+}
+
+#endif // SNAPSHOTRETENTION_H
@@ -0,0 +1,621 @@
+#include "snapshotscrub.h"
+#include "backupjournal.h"
+#include "chunkstore.h"
+#include "copylinkutil.h"
+#include "dbfileentries.h"
+#include "enhancedqcryptographichash.h"
+#include "filehash.h"
+#include "linkbackupglobals.h"
+#include "linkbackupthread.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QPair>
+#include <QRegularExpression>
+#include <QRunnable>
+#include <QSet>
+#include <QThread>
+#include <QThreadPool>
+#include <QVector>
+
+#include <algorithm>
+#include <chrono>
+#include <sys/stat.h>
+
+// Each scrub thread reads with its own buffer.
+static const qint64 s_bufferSize = 4 * 1024 * 1024;
+
+// With a rate limit, a file is read in blocks of this size, each waiting for its own time slot.
+static const qint64 s_limitedReadSize = 1024 * 1024;
+
+// A thread waiting for the rate limiter checks for a cancel this often.
+static const qint64 s_maxSleepNs = 100 * 1000 * 1000;
+
+// The state file is flushed after this many files are checked.
+static const int s_stateFlushCount = 1000;
+
+typedef QPair<quint64, quint64> InodeKey;
+
+//**************************************************************************
+/*! \brief One inode to hash, with the catalog entry that first named it. */
+//**************************************************************************
+struct ScrubItem
+{
+  enum Status {Pending, Matched, Mismatched, Unreadable};
+
+  QString path;
+  QString expected;
+  QString actual;
+  quint64 size;
+  quint64 device;
+  quint64 inode;
+  int numLinks;
+  Status status;
+  /*! \brief True for a chunk in the chunk store, which is named by its SHA-256 digest. */
+  bool chunk;
+};
+
+//**************************************************************************
+/*! \brief A later catalog entry for an inode that does not expect the same hash as the first one. */
+//**************************************************************************
+struct ScrubOtherEntry
+{
+  QString path;
+  QString expected;
+  int item;
+};
+
+//**************************************************************************
+/*! \brief Limit the bytes read per second from one device; shared by every scrub thread.
+ *
+ * Each read reserves the next free time slot on the device, so the reads are spread out
+ * evenly no matter how many threads share the device. A thread waits in short steps, so a
+ * cancel does not wait for the slot.
+ ***************************************************************************/
+class DeviceRateLimiter
+{
+public:
+  explicit DeviceRateLimiter(const qint64 bytesPerSecond) : m_bytesPerSecond(bytesPerSecond), m_nextFreeNs(0)
+  {
+  }
+
+  /*! \brief Wait for the time slot to read bytes; returns false if the scrub was cancelled. */
+  bool acquire(const qint64 bytes, const std::atomic<bool>& cancelRequested)
+  {
+    qint64 now = nowNs();
+    qint64 start;
+    {
+      QMutexLocker locker(&m_mutex);
+      start = qMax(now, m_nextFreeNs);
+      m_nextFreeNs = start + static_cast<qint64>(static_cast<double>(bytes) * 1.0e9 / static_cast<double>(m_bytesPerSecond));
+    }
+    while (start > now && !cancelRequested)
+    {
+      QThread::usleep(static_cast<unsigned long>(qMin(start - now, s_maxSleepNs) / 1000));
+      now = nowNs();
+    }
+    return !cancelRequested;
+  }
+
+private:
+  static qint64 nowNs()
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  QMutex m_mutex;
+  const qint64 m_bytesPerSecond;
+  qint64 m_nextFreeNs;
+};
+
+//**************************************************************************
+/*! \brief Shared state for the scrub threads. */
+//**************************************************************************
+struct ScrubShared
+{
+  QVector<ScrubItem>* items;
+  QHash<quint64, DeviceRateLimiter*> limiters;
+  std::atomic<int> next;
+  std::atomic<qint64> bytesHashed;
+  const std::atomic<bool>* cancelRequested;
+  QString hashMethod;
+  QCryptographicHash::Algorithm algorithm;
+  qint64 chunkSize;
+
+  QMutex stateMutex;
+  QFile* stateFile;
+  int numSinceFlush;
+};
+
+//**************************************************************************
+/*! \brief Hash inodes until every item is taken; one task per thread. */
+//**************************************************************************
+class ScrubTask : public QRunnable
+{
+public:
+  explicit ScrubTask(ScrubShared* shared) : m_shared(shared)
+  {
+    setAutoDelete(false);
+  }
+
+  void run() override
+  {
+    CopyLinkUtil util(s_bufferSize);
+    util.setHashType(m_shared->hashMethod);
+    util.setHashChunkSize(m_shared->chunkSize);
+    // The scrub already uses a thread per file.
+    util.setHashThreadCount(1);
+
+    QVector<ScrubItem>& items = *m_shared->items;
+    for (;;)
+    {
+      const int i = m_shared->next.fetch_add(1);
+      if (i >= items.count() || *m_shared->cancelRequested)
+      {
+        return;
+      }
+      ScrubItem& item = items[i];
+      DeviceRateLimiter* limiter = m_shared->limiters.value(item.device, nullptr);
+      QByteArray digest;
+      bool hashed;
+      if (limiter != nullptr)
+      {
+        hashed = limitedHash(item, limiter, digest);
+      }
+      else if (item.chunk)
+      {
+        hashed = ChunkStore::hashChunk(item.path, digest);
+      }
+      else
+      {
+        hashed = util.generateHash(item.path);
+        digest = util.getLastHash().toLatin1();
+      }
+      if (!hashed)
+      {
+        // A file not finished because of a cancel is checked by the next scrub.
+        if (*m_shared->cancelRequested)
+        {
+          return;
+        }
+        item.status = ScrubItem::Unreadable;
+        continue;
+      }
+      m_shared->bytesHashed += static_cast<qint64>(item.size);
+      item.actual = QString::fromLatin1(digest);
+      item.status = (item.actual == item.expected) ? ScrubItem::Matched : ScrubItem::Mismatched;
+      if (item.status == ScrubItem::Matched && m_shared->stateFile != nullptr)
+      {
+        QMutexLocker locker(&m_shared->stateMutex);
+        m_shared->stateFile->write(QByteArray::number(item.device) + ' ' + QByteArray::number(item.inode) + '\n');
+        if (++m_shared->numSinceFlush >= s_stateFlushCount)
+        {
+          m_shared->stateFile->flush();
+          m_shared->numSinceFlush = 0;
+        }
+      }
+    }
+  }
+
+private:
+  //**************************************************************************
+  /*! \brief Hash a file one block at a time, waiting for the rate limiter before each read.
+   *
+   *  The digest has the same form as ChunkStore::hashChunk() for a chunk, and as
+   *  CopyLinkUtil::getLastHash() for a file.
+   *
+   *  \return False if the file could not be read or the scrub was cancelled.
+   ***************************************************************************/
+  bool limitedHash(const ScrubItem& item, DeviceRateLimiter* limiter, QByteArray& digest)
+  {
+    QFile file(item.path);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+      return false;
+    }
+    FileHash hash(item.chunk ? QCryptographicHash::Sha256 : m_shared->algorithm, item.chunk ? 0 : m_shared->chunkSize);
+    QByteArray buffer(s_limitedReadSize, Qt::Uninitialized);
+    qint64 total = 0;
+    for (;;)
+    {
+      const qint64 remaining = static_cast<qint64>(item.size) - total;
+      if (!limiter->acquire(qBound(static_cast<qint64>(0), remaining, s_limitedReadSize), *m_shared->cancelRequested))
+      {
+        return false;
+      }
+      const qint64 n = file.read(buffer.data(), buffer.size());
+      if (n < 0)
+      {
+        return false;
+      }
+      if (n == 0)
+      {
+        break;
+      }
+      hash.addData(buffer.constData(), n);
+      total += n;
+    }
+    digest = hash.result(total).toHex();
+    if (!item.chunk)
+    {
+      digest = digest.toUpper();
+    }
+    return true;
+  }
+
+  ScrubShared* m_shared;
+};
+
+SnapshotScrub::SnapshotScrub() : m_threadCount(0), m_bytesPerSecond(0), m_cancelRequested(false), m_numEntries(0), m_numHashed(0), m_numShared(0), m_numResumed(0), m_bytesHashed(0), m_millis(0), m_finished(false)
+{
+}
+
+QStringList SnapshotScrub::findSnapshots(const QString& path, const QString& catalogName)
+{
+  QStringList snapshots;
+  if (!LinkBackupThread::findHashFileCaseInsensitive(path, catalogName).isEmpty())
+  {
+    snapshots.append(QDir(path).canonicalPath());
+    return snapshots;
+  }
+  QDir dir(path);
+  dir.setFilter(QDir::Dirs | QDir::NoDotAndDotDot);
+  dir.setSorting(QDir::Name);
+  QRegularExpression dirNameRegExp("^\\d{8}-\\d{6}$");
+  const QFileInfoList list = dir.entryInfoList();
+  for (const QFileInfo& fileInfo : list)
+  {
+    if (dirNameRegExp.match(fileInfo.fileName()).hasMatch() && !BackupJournal::exists(fileInfo.filePath()))
+    {
+      snapshots.append(fileInfo.canonicalFilePath());
+    }
+  }
+  return snapshots;
+}
+
+bool SnapshotScrub::scrub(const QStringList& snapshots, const QString& catalogName, const QString& statePath)
+{
+  m_cancelRequested = false;
+  m_catalogName = catalogName;
+  m_snapshots = snapshots;
+  m_problems.clear();
+  m_numEntries = 0;
+  m_numHashed = 0;
+  m_numShared = 0;
+  m_numResumed = 0;
+  m_bytesHashed = 0;
+  m_finished = false;
+  QElapsedTimer timer;
+  timer.start();
+
+  QString hashMethod;
+  qint64 chunkSize = 0;
+  if (!CopyLinkUtil::parseHashModeName(catalogName, hashMethod, chunkSize))
+  {
+    ERROR_MSG(QString(QObject::tr("Unknown hash method for catalog %1")).arg(catalogName), 1);
+    return false;
+  }
+
+  // Files checked by an interrupted scrub.
+  QSet<InodeKey> resumed;
+  if (!statePath.isEmpty())
+  {
+    QFile stateFile(statePath);
+    if (stateFile.open(QIODevice::ReadOnly))
+    {
+      while (!stateFile.atEnd())
+      {
+        const QByteArray line = stateFile.readLine();
+        const int space = line.indexOf(' ');
+        if (line.endsWith('\n') && space > 0)
+        {
+          resumed.insert(InodeKey(line.left(space).toULongLong(), line.mid(space + 1).trimmed().toULongLong()));
+        }
+      }
+      INFO_MSG(QString(QObject::tr("Resuming the scrub, %1 files were already checked")).arg(resumed.count()), 1);
+    }
+  }
+
+  // Group the catalog entries by inode so each file is read once.
+  QVector<ScrubItem> items;
+  QList<ScrubOtherEntry> otherEntries;
+  QHash<InodeKey, int> inodeToItem;
+  for (const QString& snapshot : snapshots)
+  {
+    const QString catalogPath = LinkBackupThread::findHashFileCaseInsensitive(snapshot, catalogName);
+    DBFileEntries* entries = catalogPath.isEmpty() ? nullptr : DBFileEntries::read(catalogPath, MatchPlan::NoIndex);
+    if (entries == nullptr)
+    {
+      WARN_MSG(QString(QObject::tr("No %1 catalog in %2, it is not checked")).arg(catalogName, snapshot), 1);
+      continue;
+    }
+    for (int i=0; i<entries->count() && !m_cancelRequested; ++i)
+    {
+      const DBFileEntry* entry = entries->value(i);
+      ++m_numEntries;
+      const QString path = snapshot + "/" + entry->getPath();
+      struct stat st;
+      if (entry->getLinkType() == QLatin1Char('K'))
+      {
+        // A file in the chunk store is checked chunk by chunk; a chunk shared by many files is hashed once.
+        const QString storePath = ChunkStore::storePath(QFileInfo(snapshot).absolutePath());
+        const QString listPath = ChunkStore::listPath(storePath, entry->getHash(), entry->getSize());
+        QList<ChunkStore::Chunk> chunks;
+        if (!ChunkStore::readList(storePath, entry->getHash(), entry->getSize(), chunks))
+        {
+          ScrubProblem problem;
+          problem.kind = QFileInfo::exists(listPath) ? ScrubProblem::Unreadable : ScrubProblem::Missing;
+          problem.path = listPath;
+          problem.expected = entry->getHash();
+          problem.numLinks = 1;
+          m_problems.append(problem);
+          continue;
+        }
+        for (const ChunkStore::Chunk& chunk : chunks)
+        {
+          const QString chunkPath = ChunkStore::chunkPath(storePath, chunk.first);
+          if (lstat(QFile::encodeName(chunkPath).constData(), &st) != 0)
+          {
+            ScrubProblem problem;
+            problem.kind = ScrubProblem::Missing;
+            problem.path = chunkPath;
+            problem.expected = QString::fromLatin1(chunk.first);
+            problem.numLinks = 1;
+            m_problems.append(problem);
+            continue;
+          }
+          const InodeKey key(static_cast<quint64>(st.st_dev), static_cast<quint64>(st.st_ino));
+          if (resumed.contains(key))
+          {
+            ++m_numResumed;
+            continue;
+          }
+          QHash<InodeKey, int>::const_iterator found = inodeToItem.constFind(key);
+          if (found != inodeToItem.constEnd())
+          {
+            ++items[found.value()].numLinks;
+            ++m_numShared;
+            continue;
+          }
+          ScrubItem item;
+          item.path = chunkPath;
+          item.expected = QString::fromLatin1(chunk.first);
+          item.size = static_cast<quint64>(st.st_size);
+          item.device = key.first;
+          item.inode = key.second;
+          item.numLinks = 1;
+          item.status = ScrubItem::Pending;
+          item.chunk = true;
+          inodeToItem.insert(key, items.count());
+          items.append(item);
+        }
+        continue;
+      }
+      if (lstat(QFile::encodeName(path).constData(), &st) != 0)
+      {
+        ScrubProblem problem;
+        problem.kind = ScrubProblem::Missing;
+        problem.path = path;
+        problem.expected = entry->getHash();
+        problem.numLinks = 1;
+        m_problems.append(problem);
+        continue;
+      }
+      const InodeKey key(static_cast<quint64>(st.st_dev), static_cast<quint64>(st.st_ino));
+      if (resumed.contains(key))
+      {
+        ++m_numResumed;
+        continue;
+      }
+      QHash<InodeKey, int>::const_iterator found = inodeToItem.constFind(key);
+      if (found != inodeToItem.constEnd())
+      {
+        ScrubItem& item = items[found.value()];
+        ++item.numLinks;
+        ++m_numShared;
+        if (item.expected != entry->getHash())
+        {
+          ScrubOtherEntry other;
+          other.path = path;
+          other.expected = entry->getHash();
+          other.item = found.value();
+          otherEntries.append(other);
+        }
+        continue;
+      }
+      ScrubItem item;
+      item.path = path;
+      item.expected = entry->getHash();
+      item.size = static_cast<quint64>(st.st_size);
+      item.device = key.first;
+      item.inode = key.second;
+      item.numLinks = 1;
+      item.status = ScrubItem::Pending;
+      item.chunk = false;
+      inodeToItem.insert(key, items.count());
+      items.append(item);
+    }
+    delete entries;
+  }
+  inodeToItem.clear();
+  resumed.clear();
+
+  // Inode order is close to the order on disk, which matters on a spinning disk.
+  QVector<int> order(items.count());
+  for (int i=0; i<order.count(); ++i)
+  {
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(), [&items](const int a, const int b) {
+    return items.at(a).device != items.at(b).device ? items.at(a).device < items.at(b).device : items.at(a).inode < items.at(b).inode;
+  });
+  QVector<ScrubItem> sortedItems;
+  sortedItems.reserve(items.count());
+  QVector<int> newIndex(items.count());
+  for (int i=0; i<order.count(); ++i)
+  {
+    newIndex[order.at(i)] = i;
+    sortedItems.append(items.at(order.at(i)));
+  }
+  items.swap(sortedItems);
+  sortedItems.clear();
+  for (ScrubOtherEntry& other : otherEntries)
+  {
+    other.item = newIndex.at(other.item);
+  }
+  INFO_MSG(QString(QObject::tr("Scrub: %1 entries, %2 files to hash, %3 shared by hard links, %4 missing")).arg(m_numEntries).arg(items.count()).arg(m_numShared).arg(m_problems.count()), 1);
+
+  QFile stateFile(statePath);
+  ScrubShared shared;
+  shared.items = &items;
+  shared.next = 0;
+  shared.bytesHashed = 0;
+  shared.cancelRequested = &m_cancelRequested;
+  shared.hashMethod = hashMethod;
+  bool algorithmOk;
+  shared.algorithm = EnhancedQCryptographicHash::toAlgorithm(hashMethod, &algorithmOk);
+  shared.chunkSize = chunkSize;
+  shared.stateFile = nullptr;
+  shared.numSinceFlush = 0;
+  if (!statePath.isEmpty())
+  {
+    if (stateFile.open(QIODevice::WriteOnly | QIODevice::Append))
+    {
+      shared.stateFile = &stateFile;
+    }
+    else
+    {
+      WARN_MSG(QString(QObject::tr("Unable to write the scrub state %1, the scrub can not be resumed")).arg(statePath), 1);
+    }
+  }
+  if (m_bytesPerSecond > 0 && !algorithmOk)
+  {
+    WARN_MSG(QString(QObject::tr("The read rate is not limited with the hash method %1")).arg(hashMethod), 1);
+  }
+  else if (m_bytesPerSecond > 0)
+  {
+    for (const ScrubItem& item : items)
+    {
+      if (!shared.limiters.contains(item.device))
+      {
+        shared.limiters.insert(item.device, new DeviceRateLimiter(m_bytesPerSecond));
+      }
+    }
+  }
+
+  const int threadCount = (m_threadCount > 0) ? m_threadCount : QThread::idealThreadCount();
+  QVector<ScrubTask*> tasks;
+  {
+    QThreadPool pool;
+    pool.setMaxThreadCount(threadCount);
+    for (int i=0; i<threadCount && i<items.count(); ++i)
+    {
+      tasks.append(new ScrubTask(&shared));
+      pool.start(tasks.last());
+    }
+    pool.waitForDone();
+  }
+  qDeleteAll(tasks);
+  qDeleteAll(shared.limiters);
+  if (stateFile.isOpen())
+  {
+    stateFile.close();
+  }
+  m_bytesHashed = shared.bytesHashed;
+
+  for (const ScrubItem& item : items)
+  {
+    if (item.status == ScrubItem::Pending)
+    {
+      continue;
+    }
+    ++m_numHashed;
+    if (item.status != ScrubItem::Matched)
+    {
+      ScrubProblem problem;
+      problem.kind = (item.status == ScrubItem::Mismatched) ? ScrubProblem::Mismatch : ScrubProblem::Unreadable;
+      problem.path = item.path;
+      problem.expected = item.expected;
+      problem.actual = item.actual;
+      problem.numLinks = item.numLinks;
+      m_problems.append(problem);
+    }
+  }
+  for (const ScrubOtherEntry& other : otherEntries)
+  {
+    const ScrubItem& item = items.at(other.item);
+    if (item.status == ScrubItem::Matched || item.status == ScrubItem::Mismatched)
+    {
+      ScrubProblem problem;
+      problem.kind = ScrubProblem::Mismatch;
+      problem.path = other.path;
+      problem.expected = other.expected;
+      problem.actual = item.actual;
+      problem.numLinks = item.numLinks;
+      m_problems.append(problem);
+    }
+  }
+
+  m_millis = timer.elapsed();
+  m_finished = !m_cancelRequested;
+  if (m_finished && !statePath.isEmpty())
+  {
+    QFile::remove(statePath);
+  }
+  INFO_MSG(summaryText(), 1);
+  return m_finished;
+}
+
+QString SnapshotScrub::summaryText() const
+{
+  return QString(QObject::tr("Scrub %1: %2 entries, %3 files hashed (%4 at %5), %6 shared, %7 resumed, %8 problems")).arg(m_finished ? QObject::tr("finished") : QObject::tr("stopped")).arg(m_numEntries).arg(m_numHashed).arg(CopyLinkUtil::getBPS(m_bytesHashed, 0), CopyLinkUtil::getBPS(m_bytesHashed, m_millis)).arg(m_numShared).arg(m_numResumed).arg(m_problems.count());
+}
+
+bool SnapshotScrub::writeReport(const QString& path) const
+{
+  QJsonObject root;
+  root["catalog"] = m_catalogName;
+  root["snapshots"] = QJsonArray::fromStringList(m_snapshots);
+  root["finished"] = m_finished;
+  root["time"] = QDateTime::currentDateTime().toString(Qt::ISODate);
+  root["millis"] = m_millis;
+  root["entries"] = m_numEntries;
+  root["filesHashed"] = m_numHashed;
+  root["bytesHashed"] = m_bytesHashed;
+  root["sharedEntries"] = m_numShared;
+  root["resumedEntries"] = m_numResumed;
+
+  static const char* kindNames[] = {"mismatch", "missing", "unreadable"};
+  QJsonArray problems;
+  for (const ScrubProblem& problem : m_problems)
+  {
+    QJsonObject json;
+    json["type"] = kindNames[problem.kind];
+    json["path"] = problem.path;
+    json["expected"] = problem.expected;
+    if (problem.kind == ScrubProblem::Mismatch)
+    {
+      json["actual"] = problem.actual;
+    }
+    json["links"] = problem.numLinks;
+    problems.append(json);
+  }
+  root["problems"] = problems;
+
+  QFile file(path);
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+  {
+    ERROR_MSG(QString(QObject::tr("Failed to write the scrub report %1")).arg(path), 1);
+    return false;
+  }
+  file.write(QJsonDocument(root).toJson(QJsonDocument::Indented));
+  return true;
+}
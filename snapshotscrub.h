@@ -0,0 +1,138 @@
+#ifndef SNAPSHOTSCRUB_H
+#define SNAPSHOTSCRUB_H
+
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+#include <atomic>
+
+//**************************************************************************
+/*! \brief A file whose content no longer matches its catalog, or that can not be checked. */
+//**************************************************************************
+struct ScrubProblem
+{
+  enum Kind {Mismatch, Missing, Unreadable};
+
+  Kind kind;
+  /*! \brief Full path to the file. */
+  QString path;
+  /*! \brief Hash from the catalog. */
+  QString expected;
+  /*! \brief Hash of the file as read now; empty unless kind is Mismatch. */
+  QString actual;
+  /*! \brief Number of catalog entries, in every snapshot checked, that share the file. */
+  int numLinks;
+};
+
+//**************************************************************************
+/*! \class SnapshotScrub
+ *  \brief Verify that the files in snapshots still match the hashes in their catalogs.
+ *
+ * Every entry in each snapshot catalog is stat'ed and grouped by device and inode, so a file
+ * shared by hard links in many snapshots is read and hashed once. The files are hashed by a
+ * pool of threads in inode order, each thread with its own CopyLinkUtil. Reads are limited to a
+ * number of bytes per second for each device, so a scrub can run beside other work on a slow
+ * USB disk. For a file in the chunk store, each chunk it uses is hashed once and compared with
+ * the SHA-256 digest that names it.
+ *
+ * The device and inode of every file that matched is appended to a state file. If the scrub is
+ * cancelled or stopped, the next scrub with the same state file skips those files. The state
+ * file is removed when a scrub finishes.
+ *
+ * \author Andrew Pitonyak
+ * \copyright Andrew Pitonyak, but you may use without restriction.
+ * \date 2026
+ **************************************************************************/
+class SnapshotScrub
+{
+public:
+  /*! \brief Constructor, uses the ideal thread count and no rate limit. */
+  SnapshotScrub();
+
+  /*! \brief Set the number of files hashed at the same time; less than 1 means use the ideal thread count. */
+  void setThreadCount(const int threadCount);
+
+  /*! \brief Set the maximum bytes read per second from each device; zero for no limit. */
+  void setBytesPerSecond(const qint64 bytesPerSecond);
+
+  //**************************************************************************
+  /*! \brief Check every file in the snapshots.
+   *
+   *  \param [in] snapshots Full paths to the snapshot directories.
+   *  \param [in] catalogName Catalog name, such as "sha1", which also names the hash method.
+   *  \param [in] statePath File that records checked files so an interrupted scrub can resume; empty for none.
+   *  \return True if the scrub ran to the end; problems found in files do not make it fail.
+   ***************************************************************************/
+  bool scrub(const QStringList& snapshots, const QString& catalogName, const QString& statePath);
+
+  //**************************************************************************
+  /*! \brief Write the results of the last scrub as JSON.
+   *
+   *  \param [in] path Full path to the report.
+   *  \return True if the report was written.
+   ***************************************************************************/
+  bool writeReport(const QString& path) const;
+
+  /*! \brief Summary of the last scrub for the log. */
+  QString summaryText() const;
+
+  /*! \brief Stop the scrub after the files being hashed; the state file is kept. */
+  void requestCancel();
+
+  bool isCancelRequested() const;
+
+  /*! \brief Problems found by the last scrub. */
+  const QList<ScrubProblem>& getProblems() const;
+
+  /*! \brief Get the snapshots in a path: the path if it has a catalog, otherwise the complete snapshots it contains.
+   *
+   *  \param [in] path Snapshot directory, or the "to" directory of a backup set.
+   *  \param [in] catalogName Catalog name, such as "sha1".
+   *  \return Full paths to the snapshots, oldest first.
+   */
+  static QStringList findSnapshots(const QString& path, const QString& catalogName);
+
+private:
+  int m_threadCount;
+  qint64 m_bytesPerSecond;
+  std::atomic<bool> m_cancelRequested;
+
+  QString m_catalogName;
+  QStringList m_snapshots;
+  QList<ScrubProblem> m_problems;
+  qint64 m_numEntries;
+  qint64 m_numHashed;
+  qint64 m_numShared;
+  qint64 m_numResumed;
+  qint64 m_bytesHashed;
+  qint64 m_millis;
+  bool m_finished;
+};
+
+inline void SnapshotScrub::setThreadCount(const int threadCount)
+{
+  m_threadCount = threadCount;
+}
+
+inline void SnapshotScrub::setBytesPerSecond(const qint64 bytesPerSecond)
+{
+  m_bytesPerSecond = bytesPerSecond;
+}
+
+inline void SnapshotScrub::requestCancel()
+{
+  m_cancelRequested = true;
+}
+
+inline bool SnapshotScrub::isCancelRequested() const
+{
+  return m_cancelRequested;
+}
+
+inline const QList<ScrubProblem>& SnapshotScrub::getProblems() const
+{
+  return m_problems;
+}
+
+#endif // SNAPSHOTSCRUB_H